@@ -21,8 +21,39 @@
 
 #include <pthread.h>
 #include <boilerplate/list.h>
+#include <boilerplate/atomic.h>
 
-#define HASHSLOTS  (1<<8)
+/*
+ * Hash tables start with HASHSLOTS buckets, and are resized
+ * incrementally by linear hashing: a single bucket is split in two
+ * upon insertion when the average chain length exceeds
+ * HASH_GROW_LOAD, conversely buckets are merged back two at a time
+ * upon removal when it drops below 1/HASH_GROW_LOAD, so that an
+ * empty table is back to its initial size. Buckets beyond the
+ * initial set live in segments obtained from the alloc() handler of
+ * the table operations, segment #n holding HASHSLOTS << n buckets.
+ * Tables with no alloc() handler keep a fixed size.
+ *
+ * The _lockless search variants do not take the table lock. With
+ * CONFIG_XENO_PSHARED, hash_search_lockless() is merely an alias for
+ * hash_search() though, since a process dying in a lockless read
+ * section of a shared table would block the updaters of all others:
+ * only private tables are searched locklessly.
+ * Updaters bump a sequence count around every change to the chains
+ * or to the table geometry, readers retry their lookup when it
+ * moved, falling back to a locked search if the table is too busy.
+ * Since chains are walked unlocked, memory which was reachable from
+ * the table (i.e. removed objects, their keys and unused bucket
+ * segments) is only released once all lockless readers which might
+ * still refer to it are gone: readers register with the current
+ * epoch, updaters flip the epoch then wait for the readers of the
+ * previous ones to drain, which is normally a matter of a few
+ * hundred nanoseconds, and is skipped when no reader is in flight.
+ * Updaters wait for readers after releasing the table lock.
+ */
+#define HASHSLOTS       (1<<8)
+#define HASH_MAXLEVELS  16
+#define HASH_GROW_LOAD  2
 
 struct hashobj {
 	dref_type(const void *) key;
@@ -30,6 +61,7 @@ struct hashobj {
 	char static_key[16];
 #endif
 	size_t len;
+	unsigned int hash;
 	struct holder link;
 };
 
@@ -37,8 +69,20 @@ struct hash_bucket {
 	struct listobj obj_list;
 };
 
+struct hash_sync {
+	unsigned int seq;
+	unsigned int epoch;
+	atomic_t readers[2];
+};
+
 struct hash_table {
 	struct hash_bucket table[HASHSLOTS];
+	dref_type(struct hash_bucket *) segments[HASH_MAXLEVELS];
+	unsigned int level;
+	unsigned int split;
+	unsigned int nr_objs;
+	int walkers;
+	struct hash_sync sync;
 	pthread_mutex_t lock;
 };
 
@@ -48,9 +92,9 @@ struct hash_operations {
 		       size_t len);
 #ifdef CONFIG_XENO_PSHARED
 	int (*probe)(struct hashobj *oldobj);
-	void *(*alloc)(size_t len);
-	void (*free)(void *key);
 #endif
+	void *(*alloc)(size_t len);
+	void (*free)(void *ptr);
 };
 
 typedef int (*hash_walk_op)(struct hash_table *t,
@@ -64,6 +108,7 @@ typedef int (*hash_walk_op)(struct hash_table *t,
 struct pvhashobj {
 	const void *key;
 	size_t len;
+	unsigned int hash;
 	struct pvholder link;
 };
 
@@ -73,6 +118,12 @@ struct pvhash_bucket {
 
 struct pvhash_table {
 	struct pvhash_bucket table[HASHSLOTS];
+	struct pvhash_bucket *segments[HASH_MAXLEVELS];
+	unsigned int level;
+	unsigned int split;
+	unsigned int nr_objs;
+	int walkers;
+	struct hash_sync sync;
 	pthread_mutex_t lock;
 };
 
@@ -80,6 +131,8 @@ struct pvhash_operations {
 	int (*compare)(const void *l,
 		       const void *r,
 		       size_t len);
+	void *(*alloc)(size_t len);
+	void (*free)(void *ptr);
 };
 
 typedef int (*pvhash_walk_op)(struct pvhash_table *t,
@@ -115,6 +168,11 @@ static inline void hash_init(struct hash_table *t)
 
 void hash_destroy(struct hash_table *t);
 
+static inline unsigned int hash_get_buckets(struct hash_table *t)
+{
+	return (HASHSLOTS << t->level) + t->split;
+}
+
 static inline int hash_enter(struct hash_table *t,
 			     const void *key, size_t len,
 			     struct hashobj *newobj,
@@ -138,6 +196,10 @@ struct hashobj *hash_search(struct hash_table *t,
 			    const void *key, size_t len,
 			    const struct hash_operations *hops);
 
+struct hashobj *hash_search_lockless(struct hash_table *t,
+				     const void *key, size_t len,
+				     const struct hash_operations *hops);
+
 int hash_walk(struct hash_table *t,
 	      hash_walk_op walk, void *arg);
 
@@ -179,6 +241,11 @@ struct hashobj *hash_search_probe(struct hash_table *t,
 
 void pvhash_init(struct pvhash_table *t);
 
+static inline unsigned int pvhash_get_buckets(struct pvhash_table *t)
+{
+	return (HASHSLOTS << t->level) + t->split;
+}
+
 static inline
 int pvhash_enter(struct pvhash_table *t,
 		 const void *key, size_t len,
@@ -204,15 +271,21 @@ struct pvhashobj *pvhash_search(struct pvhash_table *t,
 				const void *key, size_t len,
 				const struct pvhash_operations *hops);
 
+struct pvhashobj *pvhash_search_lockless(struct pvhash_table *t,
+					 const void *key, size_t len,
+					 const struct pvhash_operations *hops);
+
 int pvhash_walk(struct pvhash_table *t,
 		pvhash_walk_op walk, void *arg);
 
 #else /* !CONFIG_XENO_PSHARED */
 #define pvhash_init		hash_init
+#define pvhash_get_buckets	hash_get_buckets
 #define pvhash_enter		hash_enter
 #define pvhash_enter_dup	hash_enter_dup
 #define pvhash_remove		hash_remove
 #define pvhash_search		hash_search
+#define pvhash_search_lockless	hash_search_lockless
 #define pvhash_walk		hash_walk
 #define pvhash_operations	hash_operations
 #endif /* !CONFIG_XENO_PSHARED */
@@ -18,28 +18,63 @@
 #ifndef _BOILERPLATE_HEAPMEM_H
 #define _BOILERPLATE_HEAPMEM_H
 
+#include <xeno_config.h>
 #include <sys/types.h>
 #include <stdint.h>
 #include <limits.h>
+#include <boilerplate/compiler.h>
 #include <boilerplate/list.h>
 #include <boilerplate/lock.h>
 #include <boilerplate/avl.h>
 
+#ifdef CONFIG_XENO_HEAPMEM_PAGE_SHIFT
+#define HEAPMEM_PAGE_SHIFT	CONFIG_XENO_HEAPMEM_PAGE_SHIFT
+#else
 #define HEAPMEM_PAGE_SHIFT	9 /* 2^9 => 512 bytes */
+#endif
 #define HEAPMEM_PAGE_SIZE	(1UL << HEAPMEM_PAGE_SHIFT)
 #define HEAPMEM_PAGE_MASK	(~(HEAPMEM_PAGE_SIZE - 1))
 #define HEAPMEM_MIN_LOG2	4 /* 16 bytes */
 /*
  * Use bucketed memory for sizes between 2^HEAPMEM_MIN_LOG2 and
- * 2^(HEAPMEM_PAGE_SHIFT-1).
+ * 2^(HEAPMEM_PAGE_SHIFT-1). Buckets are sized by powers of two,
+ * unless CONFIG_XENO_HEAPMEM_FINE_CLASSES is set, in which case an
+ * intermediate size class sits halfway between two consecutive
+ * powers of two from 32 bytes on (16, 32, 48, 64, 96, 128...),
+ * trading a few more bucket lists for less internal
+ * fragmentation. There is no 24-byte class, so that all block sizes
+ * remain multiples of HEAPMEM_MIN_ALIGN.
  */
-#define HEAPMEM_MAX		(HEAPMEM_PAGE_SHIFT - HEAPMEM_MIN_LOG2)
+#ifdef CONFIG_XENO_HEAPMEM_FINE_CLASSES
+#define HEAPMEM_CLASSES(__log2max)	(2 * ((__log2max) - HEAPMEM_MIN_LOG2))
+#else
+#define HEAPMEM_CLASSES(__log2max)	((__log2max) - HEAPMEM_MIN_LOG2 + 1)
+#endif
+#define HEAPMEM_MAX		HEAPMEM_CLASSES(HEAPMEM_PAGE_SHIFT - 1)
 #define HEAPMEM_MIN_ALIGN	(1U << HEAPMEM_MIN_LOG2)
+/*
+ * A page of bucketed memory holds up to HEAPMEM_PAGE_SIZE /
+ * HEAPMEM_MIN_ALIGN blocks, the busy ones are tracked by a bitmap
+ * spanning HEAPMEM_MAP_WORDS 32bit words.
+ */
+#define HEAPMEM_MAP_WORDS	((HEAPMEM_PAGE_SIZE / HEAPMEM_MIN_ALIGN + 31) / 32)
 /* Max size of an extent (4Gb - HEAPMEM_PAGE_SIZE). */
 #define HEAPMEM_MAX_EXTSZ	(4294967295U - HEAPMEM_PAGE_SIZE + 1)
 /* Bits we need for encoding a page # */
 #define HEAPMEM_PGENT_BITS      (32 - HEAPMEM_PAGE_SHIFT)
 
+/*
+ * Per-thread magazines may cache blocks from 2^HEAPMEM_MIN_LOG2 to
+ * 2^HEAPMEM_MAG_MAX_LOG2 bytes in front of a heap, see
+ * heapmem_enable_magazines(). Each thread keeps up to
+ * HEAPMEM_MAG_SIZE blocks of every size, exchanging them with the
+ * heap HEAPMEM_MAG_BATCH blocks at a time.
+ */
+#define HEAPMEM_MAG_MAX_LOG2	8 /* 256 bytes */
+#define HEAPMEM_MAG_BUCKETS	HEAPMEM_CLASSES(HEAPMEM_MAG_MAX_LOG2)
+#define HEAPMEM_MAG_SIZE	8
+#define HEAPMEM_MAG_BATCH	(HEAPMEM_MAG_SIZE / 2)
+
 /* Each page is represented by a page map entry. */
 #define HEAPMEM_PGMAP_BYTES	sizeof(struct heapmem_pgentry)
 
@@ -47,16 +82,15 @@ struct heapmem_pgentry {
 	/* Linkage in bucket list. */
 	unsigned int prev : HEAPMEM_PGENT_BITS;
 	unsigned int next : HEAPMEM_PGENT_BITS;
-	/*  page_list or log2. */
+	/*  page_list or bucket size class. */
 	unsigned int type : 6;
 	/*
 	 * We hold either a spatial map of busy blocks within the page
-	 * for bucketed memory (up to 32 blocks per page), or the
-	 * overall size of the multi-page block if entry.type ==
-	 * page_list.
+	 * for bucketed memory, or the overall size of the multi-page
+	 * block if entry.type == page_list.
 	 */
 	union {
-		uint32_t map;
+		uint32_t map[HEAPMEM_MAP_WORDS];
 		uint32_t bsize;
 	};
 };
@@ -82,14 +116,110 @@ struct heapmem_extent {
 	struct heapmem_pgentry pagemap[0]; /* Start of page entries[] */
 };
 
+/*
+ * Size of the blocks from bucket @sclass, and the smallest class
+ * which may hold @size bytes, with 2^HEAPMEM_MIN_LOG2 <= @size <=
+ * 2^(HEAPMEM_PAGE_SHIFT-1).
+ */
+#ifdef CONFIG_XENO_HEAPMEM_FINE_CLASSES
+
+static inline size_t __heapmem_class_size(int sclass)
+{
+	if (sclass == 0)
+		return HEAPMEM_MIN_ALIGN;
+
+	sclass++;		/* Skip 3 * 2^(HEAPMEM_MIN_LOG2-1). */
+
+	return (size_t)(2 | (sclass & 1)) <<
+		(HEAPMEM_MIN_LOG2 - 1 + (sclass >> 1));
+}
+
+static inline int __heapmem_size_class(size_t size)
+{
+	int log2size = sizeof(size) * CHAR_BIT -
+		xenomai_count_leading_zeros(size - 1); /* 2^(log2size-1) < size */
+
+	if (log2size <= HEAPMEM_MIN_LOG2 + 1)
+		return log2size - HEAPMEM_MIN_LOG2;
+
+	if (size <= (size_t)3 << (log2size - 2))
+		return 2 * (log2size - HEAPMEM_MIN_LOG2) - 2;
+
+	return 2 * (log2size - HEAPMEM_MIN_LOG2) - 1;
+}
+
+#else  /* !CONFIG_XENO_HEAPMEM_FINE_CLASSES */
+
+static inline size_t __heapmem_class_size(int sclass)
+{
+	return (size_t)1 << (HEAPMEM_MIN_LOG2 + sclass);
+}
+
+static inline int __heapmem_size_class(size_t size)
+{
+	return sizeof(size) * CHAR_BIT -
+		xenomai_count_leading_zeros(size - 1) - HEAPMEM_MIN_LOG2;
+}
+
+#endif /* !CONFIG_XENO_HEAPMEM_FINE_CLASSES */
+
+/*
+ * The magazine depot of a heap. Magazines may not front a heap
+ * living in shared memory: blocks cached by a process exiting
+ * without running its thread finalizers would leak for good.
+ */
+struct heapmem_depot {
+	/* Non-zero if magazines are enabled. */
+	unsigned long serial;
+};
+
+/*
+ * Handlers moving blocks between the magazines and their heap,
+ * bypassing the former. get() returns the number of blocks actually
+ * obtained, put() returns -EINVAL if any block was invalid.
+ */
+struct heapmem_mag_operations {
+	int (*get)(void *heap, int sclass, void **blocks, int nr);
+	int (*put)(void *heap, void **blocks, int nr);
+	void *(*alloc)(void *heap, size_t size);
+	void (*free)(void *heap, void *block);
+};
+
 struct heap_memory {
 	pthread_mutex_t lock;
 	struct pvlistobj extents;
 	size_t arena_size;
 	size_t usable_size;
 	size_t used_size;
-	/* Heads of page lists for log2-sized blocks. */
+	/* Heads of page lists for bucketed blocks, per size class. */
 	uint32_t buckets[HEAPMEM_MAX];
+	struct heapmem_depot depot;
+	unsigned long nomem_count;
+	unsigned long badfree_count;
+};
+
+/*
+ * Free ranges of 2^n up to 2^(n+1)-1 pages are counted in
+ * free_hist[n], the last slot gathers all larger ranges.
+ */
+#define HEAPMEM_HIST_SIZE	20
+
+struct heapmem_stats {
+	size_t arena_size;
+	size_t usable_size;
+	size_t used_size;
+	/* Ranges of free pages. */
+	size_t free_size;
+	size_t largest_free;
+	unsigned int free_ranges;
+	unsigned int free_hist[HEAPMEM_HIST_SIZE];
+	/* Pages and busy blocks, per size class. */
+	unsigned int bucket_pages[HEAPMEM_MAX];
+	unsigned int bucket_blocks[HEAPMEM_MAX];
+	/* Allocation requests the heap could not satisfy. */
+	unsigned long nomem_count;
+	/* Release requests for invalid blocks. */
+	unsigned long badfree_count;
 };
 
 #define __HEAPMEM_MAP_SIZE(__nrpages)					\
@@ -127,6 +257,12 @@ void *heapmem_alloc(struct heap_memory *heap,
 int heapmem_free(struct heap_memory *heap,
 		 void *block);
 
+int heapmem_alloc_bulk(struct heap_memory *heap,
+		       size_t size, void **blocks, int nr);
+
+int heapmem_free_bulk(struct heap_memory *heap,
+		      void **blocks, int nr);
+
 static inline
 size_t heapmem_arena_size(const struct heap_memory *heap)
 {
@@ -148,6 +284,31 @@ size_t heapmem_used_size(const struct heap_memory *heap)
 ssize_t heapmem_check(struct heap_memory *heap,
 		      void *block);
 
+int heapmem_stat(struct heap_memory *heap,
+		 struct heapmem_stats *stats);
+
+void heapmem_enable_magazines(struct heap_memory *heap);
+
+void heapmem_flush_magazines(struct heap_memory *heap);
+
+void __heapmem_depot_init(struct heapmem_depot *depot);
+
+void *__heapmem_mag_alloc(struct heapmem_depot *depot, void *heap,
+			  int sclass,
+			  const struct heapmem_mag_operations *ops);
+
+int __heapmem_mag_free(struct heapmem_depot *depot, void *heap,
+		       void *block, int sclass,
+		       const struct heapmem_mag_operations *ops);
+
+void __heapmem_mag_flush(struct heapmem_depot *depot);
+
+static inline
+int heapmem_mag_enabled_p(const struct heapmem_depot *depot)
+{
+	return depot->serial != 0;
+}
+
 #ifdef __cplusplus
 }
 #endif
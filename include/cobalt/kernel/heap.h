@@ -21,6 +21,7 @@
 
 #include <linux/string.h>
 #include <linux/rbtree.h>
+#include <linux/percpu.h>
 #include <cobalt/kernel/lock.h>
 #include <cobalt/kernel/list.h>
 #include <cobalt/uapi/kernel/types.h>
@@ -47,6 +48,9 @@
 #define XNHEAP_PGENT_BITS      (32 - XNHEAP_PAGE_SHIFT)
 /* Each page is represented by a page map entry. */
 #define XNHEAP_PGMAP_BYTES	sizeof(struct xnheap_pgentry)
+/* Largest block size served from the per-CPU caches (256 bytes). */
+#define XNHEAP_CACHE_MAX_LOG2	8
+#define XNHEAP_CACHE_BUCKETS	(XNHEAP_CACHE_MAX_LOG2 - XNHEAP_MIN_LOG2 + 1)
 
 struct xnheap_pgentry {
 	/* Linkage in bucket list. */
@@ -78,6 +82,22 @@ struct xnheap_range {
 	size_t size;
 };
 
+/*
+ * Per-CPU front cache of free blocks for the smallest bucket sizes.
+ * Cached blocks are still accounted as busy by the heap, and are
+ * linked through their first word.
+ */
+struct xnheap_cache {
+	DECLARE_XNLOCK(lock);
+	struct {
+		void *head;
+		int count;
+	} buckets[XNHEAP_CACHE_BUCKETS];
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long drains;
+};
+
 struct xnheap {
 	void *membase;
 	struct rb_root addr_tree;
@@ -89,6 +109,8 @@ struct xnheap {
 	char name[XNOBJECT_NAME_LEN];
 	DECLARE_XNLOCK(lock);
 	struct list_head next;
+	struct xnheap_cache __percpu *caches;
+	int cache_depth;
 };
 
 extern struct xnheap cobalt_heap;
@@ -124,6 +146,8 @@ int xnheap_init(struct xnheap *heap,
 
 void xnheap_destroy(struct xnheap *heap);
 
+int xnheap_enable_cache(struct xnheap *heap, int depth);
+
 void *xnheap_alloc(struct xnheap *heap, size_t size);
 
 void xnheap_free(struct xnheap *heap, void *block);
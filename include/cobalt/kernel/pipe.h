@@ -23,6 +23,7 @@
 #include <linux/poll.h>
 #include <cobalt/kernel/synch.h>
 #include <cobalt/kernel/thread.h>
+#include <cobalt/kernel/timer.h>
 #include <cobalt/uapi/kernel/pipe.h>
 
 #define XNPIPE_NDEVS      CONFIG_XENO_OPT_PIPE_NRDEV
@@ -37,6 +38,8 @@
 #define XNPIPE_USER_WSYNC        0x40
 #define XNPIPE_USER_WSYNC_READY  0x80
 #define XNPIPE_USER_LCONN        0x100
+#define XNPIPE_KERN_RFLUSH       0x200
+#define XNPIPE_KERN_RDEFER       0x400
 
 #define XNPIPE_USER_ALL_WAIT \
 (XNPIPE_USER_WREAD|XNPIPE_USER_WSYNC)
@@ -80,6 +83,29 @@ struct xnpipe_state {
 	wait_queue_head_t syncq;	/* sync waiters */
 	int wcount;			/* number of waiters on this minor */
 	size_t ionrd;
+
+	/* Shared output ring (XNPIPEIOC_SETRING) */
+	struct xnpipe_ring_hdr *ring;
+	void *ringdata;
+	size_t ringsz;			/* Size of the data area */
+	size_t ringmapsz;		/* Size of the whole mapping */
+	u32 ringhead;			/* Reserved up to */
+	u32 ringpub;			/* Published up to */
+	int ringbusy;			/* Copies in flight */
+	u32 ringdrops;
+	struct list_head doneq;		/* Buffers copied to the ring */
+	int nrdoneq;
+	struct list_head dlink;		/* Link on release queue */
+
+	/* Wakeup coalescing (XNPIPEIOC_SETCOALESCE) */
+	xnticks_t cinterval;		/* Min. interval between wakeups */
+	size_t cbytes;			/* Byte watermark */
+	int cmsgs;			/* Message watermark */
+	size_t pbytes;			/* Bytes held back */
+	int pmsgs;			/* Messages held back */
+	xnticks_t lastwake;
+	struct xntimer ctimer;
+	struct xnpipe_stats stats;
 };
 
 extern struct xnpipe_state xnpipe_states[];
@@ -109,6 +135,9 @@ ssize_t xnpipe_mfixup(int minor, struct xnpipe_mh *mh, ssize_t size);
 ssize_t xnpipe_recv(int minor,
 		    struct xnpipe_mh **pmh, xnticks_t timeout);
 
+int xnpipe_recvv(int minor, struct xnpipe_mh **mhv,
+		 const size_t *maxlenv, int nr, xnticks_t timeout);
+
 int xnpipe_flush(int minor, int mode);
 
 int xnpipe_pollstate(int minor, unsigned int *mask_r);
@@ -21,6 +21,7 @@
 #define _COBALT_KERNEL_FD_H
 
 #include <linux/types.h>
+#include <linux/atomic.h>
 #include <linux/socket.h>
 #include <linux/file.h>
 #include <cobalt/kernel/tree.h>
@@ -165,6 +166,56 @@ ssize_t rtdm_recvmsg_handler(struct rtdm_fd *fd, struct user_msghdr *msg, int fl
  */
 ssize_t rtdm_sendmsg_handler(struct rtdm_fd *fd, const struct user_msghdr *msg, int flags);
 
+/**
+ * Vectored receive message handler
+ *
+ * When present, this optional handler is called by recvmmsg() instead
+ * of the per-message receive handler, for chunks of up to
+ * RTDM_MMSG_BATCH messages. The handler may wait (unless @a flags
+ * contains MSG_DONTWAIT) until the first message is available, but
+ * should only pick the following ones which are immediately
+ * available. Reception should stop after a message carrying MSG_OOB.
+ *
+ * @param[in] fd File descriptor
+ * @param[in,out] msgvec Array of message descriptors as passed by the
+ * user, automatically mirrored to safe kernel memory. The handler
+ * should update the @a msg_len field of each message received.
+ * @param[in] vlen Number of entries in @a msgvec
+ * @param[in] flags Message flags as passed by the user
+ *
+ * @return On success, the number of messages received, which may be
+ * lower than @a vlen. On failure to receive the first message, a
+ * negative error code.
+ *
+ * @see @c recvmmsg() in Linux.
+ */
+int rtdm_recvmmsg_handler(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			  unsigned int vlen, int flags);
+
+/**
+ * Vectored transmit message handler
+ *
+ * When present, this optional handler is called by sendmmsg() instead
+ * of the per-message transmit handler, for chunks of up to
+ * RTDM_MMSG_BATCH messages. Remaining messages are passed again to
+ * the handler if it processes fewer than @a vlen of them.
+ *
+ * @param[in] fd File descriptor
+ * @param[in,out] msgvec Array of message descriptors as passed by the
+ * user, automatically mirrored to safe kernel memory. The handler
+ * should update the @a msg_len field of each message transmitted.
+ * @param[in] vlen Number of entries in @a msgvec
+ * @param[in] flags Message flags as passed by the user
+ *
+ * @return On success, the number of messages transmitted, which may
+ * be lower than @a vlen. On failure to transmit the first message, a
+ * negative error code.
+ *
+ * @see @c sendmmsg() in Linux.
+ */
+int rtdm_sendmmsg_handler(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			  unsigned int vlen, int flags);
+
 /**
  * Select handler
  *
@@ -280,6 +331,14 @@ struct rtdm_fd_ops {
 	/** See rtdm_sendmsg_handler(). */
 	ssize_t (*sendmsg_nrt)(struct rtdm_fd *fd,
 			       const struct user_msghdr *msg, int flags);
+	/** See rtdm_recvmmsg_handler(). */
+	int (*recvmmsg_rt)(struct rtdm_fd *fd,
+			   struct mmsghdr *msgvec, unsigned int vlen,
+			   int flags);
+	/** See rtdm_sendmmsg_handler(). */
+	int (*sendmmsg_rt)(struct rtdm_fd *fd,
+			   struct mmsghdr *msgvec, unsigned int vlen,
+			   int flags);
 	/** See rtdm_select_handler(). */
 	int (*select)(struct rtdm_fd *fd,
 		      struct xnselector *selector,
@@ -300,7 +359,7 @@ struct rtdm_fd {
 	unsigned int magic;
 	struct rtdm_fd_ops *ops;
 	struct cobalt_ppd *owner;
-	unsigned int refs;
+	atomic_t refs;
 	int ufd;
 	int minor;
 	int oflags;
@@ -380,13 +439,13 @@ ssize_t rtdm_fd_recvmsg(int ufd, struct user_msghdr *msg, int flags);
 
 int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags, void __user *u_timeout,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg),
 		       int (*get_timespec)(struct timespec64 *ts, const void __user *u_ts));
 
 int __rtdm_fd_recvmmsg64(int ufd, void __user *u_msgvec, unsigned int vlen,
 			 unsigned int flags, void __user *u_timeout,
-			 int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+			 int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 			 int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg));
 
 ssize_t rtdm_fd_sendmsg(int ufd, const struct user_msghdr *msg,
@@ -394,9 +453,12 @@ ssize_t rtdm_fd_sendmsg(int ufd, const struct user_msghdr *msg,
 
 int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg));
 
+/* Chunk size of message vectors passed to vectored handlers. */
+#define RTDM_MMSG_BATCH  16
+
 int rtdm_fd_mmap(int ufd, struct _rtdm_mmap_request *rma,
 		 void **u_addrp);
 
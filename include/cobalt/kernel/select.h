@@ -32,6 +32,9 @@
 #define XNSELECT_EXCEPT    2
 #define XNSELECT_MAX_TYPES 3
 
+/* Selector flags. */
+#define XNSELECT_EDGE      0x1	/* Queue bindings turning ready. */
+
 struct xnselector {
 	struct xnsynch synchbase;
 	struct fds {
@@ -40,6 +43,8 @@ struct xnselector {
 	} fds [XNSELECT_MAX_TYPES];
 	struct list_head destroy_link;
 	struct list_head bindings; /* only used by xnselector_destroy */
+	struct list_head ready;	   /* only used with XNSELECT_EDGE */
+	int flags;
 };
 
 #define __NFDBITS__	(8 * sizeof(unsigned long))
@@ -94,6 +99,12 @@ struct xnselect_binding {
 	unsigned int bit_index;
 	struct list_head link;  /* link in selected fds list. */
 	struct list_head slink; /* link in selector list */
+	struct list_head rlink; /* link in selector ready list */
+};
+
+struct xnselect_event {
+	unsigned int type;
+	unsigned int index;
 };
 
 void xnselect_init(struct xnselect *select_block);
@@ -130,6 +141,15 @@ void xnselect_destroy(struct xnselect *select_block);
 
 int xnselector_init(struct xnselector *selector);
 
+int xnselector_init_edge(struct xnselector *selector);
+
+int xnselector_unbind(struct xnselector *selector,
+		      unsigned int type, unsigned int index);
+
+int xnselect_collect(struct xnselector *selector,
+		     struct xnselect_event *events, int maxevents,
+		     xnticks_t timeout, xntmode_t timeout_mode);
+
 int xnselect(struct xnselector *selector,
 	     fd_set *out_fds[XNSELECT_MAX_TYPES],
 	     fd_set *in_fds[XNSELECT_MAX_TYPES],
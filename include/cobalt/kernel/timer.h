@@ -25,6 +25,7 @@
 #include <cobalt/kernel/list.h>
 #include <cobalt/kernel/assert.h>
 #include <cobalt/kernel/ancillaries.h>
+#include <linux/rbtree.h>
 #include <asm/xenomai/wrappers.h>
 
 /**
@@ -133,60 +134,174 @@ static inline void xntlist_insert(struct list_head *q, struct xntlholder *holder
 		list_del(&(h)->link);		\
 	} while (0)
 
-#if defined(CONFIG_XENO_OPT_TIMER_RBTREE)
-
-#include <linux/rbtree.h>
-
-typedef struct {
+struct xntrbholder {
 	unsigned long long date;
 	unsigned prio;
 	struct rb_node link;
-} xntimerh_t;
-
-#define xntimerh_date(h) ((h)->date)
-#define xntimerh_prio(h) ((h)->prio)
-#define xntimerh_init(h) do { } while (0)
+};
 
-typedef struct {
+struct xntrbtree {
 	struct rb_root root;
-	xntimerh_t *head;
-} xntimerq_t;
-
-#define xntimerq_init(q)			\
-	({					\
-		xntimerq_t *_q = (q);		\
-		_q->root = RB_ROOT;		\
-		_q->head = NULL;		\
-	})
+	struct xntrbholder *head;
+};
 
-#define xntimerq_destroy(q) do { } while (0)
-#define xntimerq_empty(q) ((q)->head == NULL)
+#define xntrbholder_date(h)	((h)->date)
+#define xntrbholder_prio(h)	((h)->prio)
+#define xntrbtree_empty(q)	((q)->head == NULL)
+#define xntrbtree_head(q)	((q)->head)
 
-#define xntimerq_head(q) ((q)->head)
+static inline void xntrbtree_init(struct xntrbtree *q)
+{
+	q->root = RB_ROOT;
+	q->head = NULL;
+}
 
-#define xntimerq_next(q, h)						\
-	({								\
-		struct rb_node *_node = rb_next(&(h)->link);		\
-		_node ? (container_of(_node, xntimerh_t, link)) : NULL; \
-	})
+static inline struct xntrbholder *xntrbtree_next(struct xntrbtree *q,
+						 struct xntrbholder *h)
+{
+	struct rb_node *node = rb_next(&h->link);
 
-#define xntimerq_second(q, h) xntimerq_next(q, h)
+	return node ? container_of(node, struct xntrbholder, link) : NULL;
+}
 
-void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder);
+void xntrbtree_insert(struct xntrbtree *q, struct xntrbholder *holder);
 
-static inline void xntimerq_remove(xntimerq_t *q, xntimerh_t *holder)
+static inline void xntrbtree_remove(struct xntrbtree *q,
+				    struct xntrbholder *holder)
 {
 	if (holder == q->head)
-		q->head = xntimerq_second(q, holder);
+		q->head = xntrbtree_next(q, holder);
 
 	rb_erase(&holder->link, &q->root);
 }
 
+/*
+ * Hierarchical timer wheel. Timers due before @near_end are kept in
+ * exact order in the near list, which always provides the queue
+ * head. Later timers are hashed into one of XNTWHEEL_LEVELS wheels of
+ * XNTWHEEL_SLOTS unordered slots, each level covering a span
+ * XNTWHEEL_SLOTS times larger than the previous one, starting with
+ * 2^XNTWHEEL_SHIFT ticks per slot. Timers beyond the top level wait
+ * in the far list. Once the near list runs empty, the earliest
+ * occupied slot is cascaded down, until the timers of the next
+ * level-0 slot are sorted into the near list.
+ */
+#define XNTWHEEL_SHIFT		16
+#define XNTWHEEL_BITS		6
+#define XNTWHEEL_SLOTS		(1 << XNTWHEEL_BITS)
+#define XNTWHEEL_LEVELS		5
+#define XNTWHEEL_NEAR		0xff
+#define XNTWHEEL_FAR		0xfe
+
+struct xntwholder {
+	unsigned long long date;
+	int prio;
+	struct list_head link;
+	unsigned char level;
+	unsigned char slot;
+};
+
+struct xntwheel {
+	struct list_head near;
+	unsigned long long near_end;
+	int nr_wheel;		/* Timers outside of the near list */
+	u64 pending[XNTWHEEL_LEVELS];
+	struct list_head slots[XNTWHEEL_LEVELS][XNTWHEEL_SLOTS];
+	struct list_head far;
+	unsigned long long far_min;
+};
+
+struct xntwheel_it {
+	int pos;
+};
+
+#define xntwholder_date(h)	((h)->date)
+#define xntwholder_prio(h)	((h)->prio)
+#define xntwheel_empty(q)	(list_empty(&(q)->near) && (q)->nr_wheel == 0)
+
+void xntwheel_init(struct xntwheel *q);
+
+void xntwheel_insert(struct xntwheel *q, struct xntwholder *holder);
+
+void xntwheel_remove(struct xntwheel *q, struct xntwholder *holder);
+
+struct xntwholder *xntwheel_cascade(struct xntwheel *q);
+
+struct xntwholder *xntwheel_it_begin(struct xntwheel *q,
+				     struct xntwheel_it *it);
+
+struct xntwholder *xntwheel_it_next(struct xntwheel *q,
+				    struct xntwheel_it *it,
+				    struct xntwholder *h);
+
+static inline struct xntwholder *xntwheel_head(struct xntwheel *q)
+{
+	if (!list_empty(&q->near))
+		return list_first_entry(&q->near, struct xntwholder, link);
+
+	return q->nr_wheel ? xntwheel_cascade(q) : NULL;
+}
+
+static inline struct xntwholder *xntwheel_second(struct xntwheel *q,
+						 struct xntwholder *h)
+{
+	if (list_is_last(&h->link, &q->near)) {
+		if (q->nr_wheel == 0)
+			return NULL;
+		/* Pull the next timers behind @h. */
+		xntwheel_cascade(q);
+	}
+
+	return list_next_entry(h, link);
+}
+
+#if defined(CONFIG_XENO_OPT_TIMER_RBTREE)
+
+typedef struct xntrbholder xntimerh_t;
+
+#define xntimerh_date(h) xntrbholder_date(h)
+#define xntimerh_prio(h) xntrbholder_prio(h)
+#define xntimerh_init(h) do { } while (0)
+
+typedef struct xntrbtree xntimerq_t;
+
+#define xntimerq_init(q)	xntrbtree_init(q)
+#define xntimerq_destroy(q)	do { } while (0)
+#define xntimerq_empty(q)	xntrbtree_empty(q)
+#define xntimerq_head(q)	xntrbtree_head(q)
+#define xntimerq_next(q, h)	xntrbtree_next((q),(h))
+#define xntimerq_second(q, h)	xntrbtree_next((q),(h))
+#define xntimerq_insert(q, h)	xntrbtree_insert((q),(h))
+#define xntimerq_remove(q, h)	xntrbtree_remove((q),(h))
+
 typedef struct { } xntimerq_it_t;
 
 #define xntimerq_it_begin(q,i)	((void) (i), xntimerq_head(q))
 #define xntimerq_it_next(q,i,h) ((void) (i), xntimerq_next((q),(h)))
 
+#elif defined(CONFIG_XENO_OPT_TIMER_WHEEL)
+
+typedef struct xntwholder xntimerh_t;
+
+#define xntimerh_date(h)	xntwholder_date(h)
+#define xntimerh_prio(h)	xntwholder_prio(h)
+#define xntimerh_init(h)	do { } while (0)
+
+typedef struct xntwheel xntimerq_t;
+
+#define xntimerq_init(q)	xntwheel_init(q)
+#define xntimerq_destroy(q)	do { } while (0)
+#define xntimerq_empty(q)	xntwheel_empty(q)
+#define xntimerq_head(q)	xntwheel_head(q)
+#define xntimerq_second(q, h)	xntwheel_second((q),(h))
+#define xntimerq_insert(q, h)	xntwheel_insert((q),(h))
+#define xntimerq_remove(q, h)	xntwheel_remove((q),(h))
+
+typedef struct xntwheel_it xntimerq_it_t;
+
+#define xntimerq_it_begin(q,i)	xntwheel_it_begin((q),(i))
+#define xntimerq_it_next(q,i,h) xntwheel_it_next((q),(i),(h))
+
 #else /* CONFIG_XENO_OPT_TIMER_LIST */
 
 typedef struct xntlholder xntimerh_t;
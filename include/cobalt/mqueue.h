@@ -22,6 +22,7 @@
 #define _COBALT_MQUEUE_H
 
 #include <cobalt/wrappers.h>
+#include <cobalt/uapi/mqueue.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,6 +27,17 @@
 #include <xeno_config.h>
 #include <cobalt/wrappers.h>
 
+struct rt_print_stats {
+	/* Records queued for output. */
+	unsigned long records;
+	/* Records lost for lack of room in the relay buffer. */
+	unsigned long dropped;
+	/* Records cut short for lack of room in the relay buffer. */
+	unsigned long truncated;
+	/* Early printer wakeups caused by the fill watermark. */
+	unsigned long wakeups;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -122,6 +133,14 @@ const char *rt_print_buffer_name(void);
 
 void rt_print_flush_buffers(void);
 
+int rt_vfprintf_bin(FILE *stream, const char *format, va_list args);
+
+int rt_fprintf_bin(FILE *stream, const char *format, ...);
+
+int rt_printf_bin(const char *format, ...);
+
+void rt_print_get_stats(struct rt_print_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -33,6 +33,10 @@ extern int __cobalt_print_bufcount;
 
 extern int __cobalt_print_syncdelay;
 
+extern int __cobalt_print_ringsz;
+
+extern int __cobalt_print_watermark;
+
 static inline define_config_tunable(main_prio, int, prio)
 {
 	__cobalt_main_prio = prio;
@@ -73,6 +77,26 @@ static inline read_config_tunable(print_sync_delay, int)
 	return __cobalt_print_syncdelay;
 }
 
+static inline define_config_tunable(print_shared_ring, int, size)
+{
+	__cobalt_print_ringsz = size;
+}
+
+static inline read_config_tunable(print_shared_ring, int)
+{
+	return __cobalt_print_ringsz;
+}
+
+static inline define_config_tunable(print_flush_watermark, int, percent)
+{
+	__cobalt_print_watermark = percent;
+}
+
+static inline read_config_tunable(print_flush_watermark, int)
+{
+	return __cobalt_print_watermark;
+}
+
 #ifdef __cplusplus
 }
 #endif
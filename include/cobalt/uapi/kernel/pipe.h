@@ -18,6 +18,8 @@
 #ifndef _COBALT_UAPI_KERNEL_PIPE_H
 #define _COBALT_UAPI_KERNEL_PIPE_H
 
+#include <linux/types.h>
+
 #define	XNPIPE_IOCTL_BASE	'p'
 
 #define XNPIPEIOC_GET_NRDEV	_IOW(XNPIPE_IOCTL_BASE, 0, int)
@@ -25,6 +27,9 @@
 #define XNPIPEIOC_OFLUSH	_IO(XNPIPE_IOCTL_BASE, 2)
 #define XNPIPEIOC_FLUSH		XNPIPEIOC_OFLUSH
 #define XNPIPEIOC_SETSIG	_IO(XNPIPE_IOCTL_BASE, 3)
+#define XNPIPEIOC_SETRING	_IO(XNPIPE_IOCTL_BASE, 4)
+#define XNPIPEIOC_SETCOALESCE	_IOW(XNPIPE_IOCTL_BASE, 5, struct xnpipe_coalesce)
+#define XNPIPEIOC_GETSTATS	_IOR(XNPIPE_IOCTL_BASE, 6, struct xnpipe_stats)
 
 #define XNPIPE_NORMAL	0x0
 #define XNPIPE_URGENT	0x1
@@ -34,4 +39,58 @@
 
 #define XNPIPE_MINOR_AUTO  (-1)
 
+/*
+ * Wakeup coalescing settings of a message pipe. Once enabled by a
+ * non-zero @interval, the Linux reader is woken up at most once per
+ * @interval nanoseconds, unless @bytes or @msgs of output are
+ * pending earlier (zero disables either watermark). Urgent messages
+ * are never held back. @interval may not exceed
+ * XNPIPE_COALESCE_MAXINT, @msgs may not exceed INT_MAX.
+ */
+#define XNPIPE_COALESCE_MAXINT	1000000000ULL	/* 1s */
+
+struct xnpipe_coalesce {
+	__u64 interval;
+	__u32 bytes;
+	__u32 msgs;
+};
+
+struct xnpipe_stats {
+	__u64 sends;		/* Messages sent to the reader */
+	__u64 wakeups;		/* Reader wakeups scheduled */
+	__u64 coalesced;	/* Notifications folded into a wakeup */
+};
+
+/*
+ * Layout of the shared output ring which a Linux reader may map from
+ * a message pipe after setting it up with XNPIPEIOC_SETRING. The
+ * header page comes first, followed by the data area at @dataoff.
+ * Records are laid out back to back in the data area, each starting
+ * with a struct xnpipe_ring_rec and aligned on XNPIPE_RING_ALIGN. A
+ * record which would straddle the end of the data area is preceded
+ * by a padding record up to the end of it.
+ *
+ * @head and @tail are free running byte offsets: the kernel advances
+ * @head after storing a record, the reader advances @tail after
+ * consuming it.
+ */
+struct xnpipe_ring_hdr {
+	/* Written by the kernel. */
+	__u32 head;
+	__u32 size;	/* Size of the data area (power of 2) */
+	__u32 dataoff;	/* Offset of the data area in the mapping */
+	__u32 drops;	/* Messages dropped on ring overflow */
+	__u32 __pad[12];
+	/* Written by the reader. */
+	__u32 tail;
+};
+
+struct xnpipe_ring_rec {
+	__u32 len;	/* Payload length, or XNPIPE_RING_PAD */
+	__u32 __reserved;
+};
+
+#define XNPIPE_RING_PAD		0xffffffffU
+#define XNPIPE_RING_ALIGN	8
+
 #endif /* !_COBALT_UAPI_KERNEL_PIPE_H */
@@ -0,0 +1,26 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_MQUEUE_H
+#define _COBALT_UAPI_MQUEUE_H
+
+/*
+ * Creation flag passed in mq_attr.mq_flags: the queue is shared by a
+ * single sender and a single receiver, and messages are conveyed
+ * through a lockless FIFO ring, regardless of their priority.
+ */
+#define MQ_SPSC		0x40000000
+
+#endif /* !_COBALT_UAPI_MQUEUE_H */
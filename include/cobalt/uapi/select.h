@@ -0,0 +1,38 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_SELECT_H
+#define _COBALT_UAPI_SELECT_H
+
+#include <cobalt/uapi/kernel/types.h>
+
+/* Event bits, one per xnselect type. */
+#define COBALT_SELECT_READ	0x1
+#define COBALT_SELECT_WRITE	0x2
+#define COBALT_SELECT_EXCEPT	0x4
+
+/* Interest set operations. */
+#define COBALT_SELECT_ADD	1
+#define COBALT_SELECT_DEL	2
+
+/* Creation flags. */
+#define COBALT_SELECT_CLOEXEC	0x1
+
+struct cobalt_select_event {
+	__u32 fd;
+	__u32 events;
+};
+
+#endif /* !_COBALT_UAPI_SELECT_H */
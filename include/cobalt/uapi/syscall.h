@@ -141,6 +141,9 @@
 #define sc_cobalt_timerfd_settime64		118
 #define sc_cobalt_timerfd_gettime64		119
 #define sc_cobalt_pselect64			120
+#define sc_cobalt_selector_create		121
+#define sc_cobalt_selector_ctl			122
+#define sc_cobalt_selector_wait			123
 
 #define __NR_COBALT_SYSCALLS			128 /* Power of 2 */
 
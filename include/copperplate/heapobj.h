@@ -52,6 +52,39 @@ struct sysgroup {
 	pthread_mutex_t lock;
 };
 
+/*
+ * Free ranges of 2^(n + HEAPOBJ_HIST_MIN_LOG2) bytes up to twice
+ * that size are counted in free_hist[n], the last slot gathers all
+ * larger ranges.
+ */
+#define HEAPOBJ_HIST_MIN_LOG2	4
+#define HEAPOBJ_HIST_SIZE	24
+#define HEAPOBJ_MAX_BUCKETS	16
+
+struct heapobj_bucket_stats {
+	size_t bsize;
+	unsigned int pages;
+	unsigned int busy;
+};
+
+struct heapobj_stats {
+	size_t usable_size;
+	size_t used_size;
+	size_t free_size;
+	size_t largest_free;
+	unsigned int free_ranges;
+	unsigned int free_hist[HEAPOBJ_HIST_SIZE];
+	/*
+	 * Only heapmem and the shared heap carve small blocks out of
+	 * pages dedicated to their size class, nr_buckets is zero
+	 * for other allocators.
+	 */
+	int nr_buckets;
+	struct heapobj_bucket_stats buckets[HEAPOBJ_MAX_BUCKETS];
+	unsigned long nomem_count;
+	unsigned long badfree_count;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -74,10 +107,14 @@ void destroy_memory_pool(void *pool);
 size_t add_new_area(void *pool, size_t size, void *mem);
 void *malloc_ex(size_t size, void *pool);
 void free_ex(void *pool, void *ptr);
+int malloc_bulk_ex(size_t size, void **blocks, int nr, void *pool);
+void free_bulk_ex(void **blocks, int nr, void *pool);
 void *tlsf_malloc(size_t size);
 void tlsf_free(void *ptr);
 size_t malloc_usable_size_ex(void *ptr, void *pool);
 
+int pvheapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats);
+
 static inline
 void pvheapobj_destroy(struct heapobj *hobj)
 {
@@ -106,6 +143,19 @@ void pvheapobj_free(struct heapobj *hobj, void *ptr)
 	free_ex(ptr, hobj->pool);
 }
 
+static inline
+int pvheapobj_alloc_bulk(struct heapobj *hobj, size_t size,
+			 void **blocks, int nr)
+{
+	return malloc_bulk_ex(size, blocks, nr, hobj->pool);
+}
+
+static inline
+void pvheapobj_free_bulk(struct heapobj *hobj, void **blocks, int nr)
+{
+	free_bulk_ex(blocks, nr, hobj->pool);
+}
+
 static inline
 size_t pvheapobj_validate(struct heapobj *hobj, void *ptr)
 {
@@ -146,6 +196,8 @@ static inline char *pvstrdup(const char *ptr)
 
 extern struct heap_memory heapmem_main;
 
+int pvheapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats);
+
 static inline
 void pvheapobj_destroy(struct heapobj *hobj)
 {
@@ -173,6 +225,20 @@ void pvheapobj_free(struct heapobj *hobj, void *ptr)
 	heapmem_free((struct heap_memory *)hobj->pool, ptr);
 }
 
+static inline
+int pvheapobj_alloc_bulk(struct heapobj *hobj, size_t size,
+			 void **blocks, int nr)
+{
+	return heapmem_alloc_bulk((struct heap_memory *)hobj->pool,
+				  size, blocks, nr);
+}
+
+static inline
+void pvheapobj_free_bulk(struct heapobj *hobj, void **blocks, int nr)
+{
+	heapmem_free_bulk((struct heap_memory *)hobj->pool, blocks, nr);
+}
+
 static inline
 size_t pvheapobj_validate(struct heapobj *hobj, void *ptr)
 {
@@ -240,10 +306,17 @@ void *pvheapobj_alloc(struct heapobj *hobj, size_t size);
 
 void pvheapobj_free(struct heapobj *hobj, void *ptr);
 
+int pvheapobj_alloc_bulk(struct heapobj *hobj, size_t size,
+			 void **blocks, int nr);
+
+void pvheapobj_free_bulk(struct heapobj *hobj, void **blocks, int nr);
+
 size_t pvheapobj_inquire(struct heapobj *hobj);
 
 size_t pvheapobj_validate(struct heapobj *hobj, void *ptr);
 
+int pvheapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats);
+
 #endif /* !CONFIG_XENO_HEAPMEM */
 
 #ifdef CONFIG_XENO_PSHARED
@@ -367,6 +440,12 @@ void *heapobj_alloc(struct heapobj *hobj,
 void heapobj_free(struct heapobj *hobj,
 		  void *ptr);
 
+int heapobj_alloc_bulk(struct heapobj *hobj, size_t size,
+		       void **blocks, int nr);
+
+void heapobj_free_bulk(struct heapobj *hobj,
+		       void **blocks, int nr);
+
 size_t heapobj_validate(struct heapobj *hobj,
 			void *ptr);
 
@@ -374,6 +453,8 @@ size_t heapobj_inquire(struct heapobj *hobj);
 
 size_t heapobj_get_size(struct heapobj *hobj);
 
+int heapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats);
+
 int heapobj_bind_session(const char *session);
 
 void heapobj_unbind_session(void);
@@ -476,6 +557,18 @@ static inline void heapobj_free(struct heapobj *hobj,
 	pvheapobj_free(hobj, ptr);
 }
 
+static inline int heapobj_alloc_bulk(struct heapobj *hobj, size_t size,
+				     void **blocks, int nr)
+{
+	return pvheapobj_alloc_bulk(hobj, size, blocks, nr);
+}
+
+static inline void heapobj_free_bulk(struct heapobj *hobj,
+				     void **blocks, int nr)
+{
+	pvheapobj_free_bulk(hobj, blocks, nr);
+}
+
 static inline size_t heapobj_validate(struct heapobj *hobj,
 				      void *ptr)
 {
@@ -487,6 +580,12 @@ static inline size_t heapobj_inquire(struct heapobj *hobj)
 	return pvheapobj_inquire(hobj);
 }
 
+static inline int heapobj_stat(struct heapobj *hobj,
+			       struct heapobj_stats *stats)
+{
+	return pvheapobj_stat(hobj, stats);
+}
+
 static inline int heapobj_bind_session(const char *session)
 {
 	return -ENOSYS;
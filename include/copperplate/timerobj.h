@@ -23,6 +23,22 @@
 #include <time.h>
 #include <boilerplate/list.h>
 #include <boilerplate/lock.h>
+#include <boilerplate/time.h>
+
+struct timer_server;
+
+struct timerobj_stats {
+	/* CPU the server is pinned to, -1 if none. */
+	int cpu;
+	/* Number of handler calls. */
+	unsigned long long dispatches;
+	/* Delay from expiry date to handler call (ns). */
+	ticks_t latency_sum;
+	ticks_t latency_max;
+	/* Handler run time (ns). */
+	ticks_t runtime_sum;
+	ticks_t runtime_max;
+};
 
 struct timerobj {
 	struct itimerspec itspec;
@@ -30,7 +46,12 @@ struct timerobj {
 	timer_t timer;
 	pthread_mutex_t lock;
 	int cancel_state;
+	struct timer_server *server;
+#ifdef CONFIG_XENO_TIMER_HEAP
+	int hpos;
+#else
 	struct pvholder next;
+#endif
 };
 
 static inline int timerobj_lock(struct timerobj *tmobj)
@@ -62,6 +83,8 @@ int timerobj_start(struct timerobj *tmobj,
 
 int timerobj_stop(struct timerobj *tmobj);
 
+int timerobj_get_stats(int server, struct timerobj_stats *stats);
+
 int timerobj_pkg_init(void);
 
 #ifdef __cplusplus
@@ -26,6 +26,7 @@ struct copperplate_setup_data {
 	const char *registry_root;
 	int no_registry;
 	int shared_registry;
+	int per_cpu_timers;
 	size_t mem_pool;
 	gid_t session_gid;
 };
@@ -73,6 +74,16 @@ static inline read_config_tunable(shared_registry, int)
 	return __copperplate_setup_data.shared_registry;
 }
 
+static inline define_config_tunable(per_cpu_timers, int, percpu)
+{
+	__copperplate_setup_data.per_cpu_timers = percpu;
+}
+
+static inline read_config_tunable(per_cpu_timers, int)
+{
+	return __copperplate_setup_data.per_cpu_timers;
+}
+
 static inline define_config_tunable(mem_pool_size, size_t, size)
 {
 	__copperplate_setup_data.mem_pool = size;
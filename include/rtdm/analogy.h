@@ -230,6 +230,18 @@ int a4l_ftoraw(a4l_chinfo_t *chan,
 int a4l_dtoraw(a4l_chinfo_t *chan,
 	       a4l_rnginfo_t *rng, void *dst, double *src, int cnt);
 
+int a4l_rawtof_inplace(a4l_chinfo_t *chan,
+		       a4l_rnginfo_t *rng, void *buf, int cnt);
+
+int a4l_rawtod_inplace(a4l_chinfo_t *chan,
+		       a4l_rnginfo_t *rng, void *buf, int cnt);
+
+int a4l_ftoraw_inplace(a4l_chinfo_t *chan,
+		       a4l_rnginfo_t *rng, void *buf, int cnt);
+
+int a4l_dtoraw_inplace(a4l_chinfo_t *chan,
+		       a4l_rnginfo_t *rng, void *buf, int cnt);
+
 int a4l_read_calibration_file(char *name, struct a4l_calibration_data *data);
 
 int a4l_get_softcal_converter(struct a4l_polynomial *converter,
@@ -238,6 +250,8 @@ int a4l_get_softcal_converter(struct a4l_polynomial *converter,
 
 int a4l_rawtodcal(a4l_chinfo_t *chan, double *dst, void *src,
 		  int cnt, struct a4l_polynomial *converter);
+int a4l_rawtodcal_inplace(a4l_chinfo_t *chan, void *buf, int cnt,
+			  struct a4l_polynomial *converter);
 int a4l_dcaltoraw(a4l_chinfo_t * chan, void *dst, double *src, int cnt,
 		  struct a4l_polynomial *converter);
 
@@ -463,8 +463,89 @@ struct can_ifreq {
  */
 #define CAN_RAW_RECV_OWN_MSGS   0x4
 
+/**
+ * CAN receive ring
+ *
+ * Switches the socket to ring mode: accepted frames are stored into a
+ * ring shared with the application instead of the socket buffer, so
+ * that they can be consumed without any system call. The ring is
+ * mapped by calling @c mmap(2) on the socket, with a length of
+ * @c getpagesize() + nr_frames * sizeof(struct can_ring_frame), the
+ * ring header coming first, followed by the frames at the data
+ * offset it gives. Each frame carries its reception timestamp.
+ *
+ * The kernel stores frame number @a head & (nr_frames - 1) then
+ * increments @a head, the application consumes frames up to @a head
+ * and advances @a tail accordingly, issuing a full memory barrier
+ * before reading @a head again. Frames are dropped and counted in @a
+ * drops while the ring is full.
+ *
+ * Once the ring is found empty, the application should wait by
+ * calling select(2) or poll(2) for input, or by calling one of the
+ * @ref Recv "receive functions" which do not copy any frame in ring
+ * mode, but wait for the ring to have contents and return the number
+ * of frames available. A call to a receive function is also needed
+ * to rearm select/poll after the socket was reported readable.
+ *
+ * The ring can only be set up once per socket.
+ *
+ * @n
+ * @param [in] level @b SOL_CAN_RAW
+ *
+ * @param [in] optname @b CAN_RAW_RX_RING
+ *
+ * @param [in] optval Pointer to an unsigned integer value giving the
+ *                    number of frames, which must be a power of two.
+ *
+ * @param [in] optlen Size of unsigned int: sizeof(unsigned int).
+ *
+ * @coretags{secondary-only}
+ * @n
+ * Specific return values:
+ * - -EFAULT (It was not possible to access user space memory area at the
+ *            specified address.)
+ * - -EINVAL (Invalid length "optlen" or invalid number of frames)
+ * - -EBUSY (A ring was already set up for the socket)
+ * - -ENOMEM (Not enough memory for the ring)
+ */
+#define CAN_RAW_RX_RING		0x5
+
 /** @} */
 
+/** Largest number of frames in a @ref CAN_RAW_RX_RING "receive ring" */
+#define CAN_RING_MAX_FRAMES	65536
+
+/**
+ * Header of a mapped @ref CAN_RAW_RX_RING "receive ring"
+ */
+struct can_ring_header {
+	/** Free running index of the next frame stored by the kernel */
+	uint32_t head;
+	/** Number of frames dropped while the ring was full */
+	uint32_t drops;
+	/** Number of frames in the ring */
+	uint32_t nr_frames;
+	/** Offset of the first frame from the start of the mapping */
+	uint32_t data_offset;
+	uint32_t __reserved[12];
+	/** Free running index of the next frame to be consumed, written
+	 *  by the application */
+	uint32_t tail;
+};
+
+/**
+ * Frame stored in a @ref CAN_RAW_RX_RING "receive ring"
+ */
+struct can_ring_frame {
+	/** Reception timestamp */
+	nanosecs_abs_t timestamp;
+	/** Index of the interface the frame was received from */
+	int ifindex;
+	uint32_t __reserved;
+	/** Received frame */
+	can_frame_t frame;
+};
+
 /*!
  * @anchor CANIOCTLs @name IOCTLs
  * CAN device IOCTLs
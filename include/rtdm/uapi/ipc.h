@@ -765,6 +765,128 @@ struct sockaddr_ipc {
  * RT/non-RT
  */
 #define IDDP_POOLSZ		2
+/**
+ * IDDP receive ring configuration
+ *
+ * Switches the socket to ring mode: instead of conveying each
+ * datagram through a buffer pulled from a pool, a ring of
+ * fixed-size slots is allocated at binding time for receiving
+ * data. This ring can be mapped to the address space of the
+ * receiver via @c mmap(2) on the socket, so that datagrams can be
+ * read in place.
+ *
+ * Senders connected to a port in ring mode may map the same ring by
+ * calling @c mmap(2) on their own socket, then write datagrams in
+ * place into slots obtained with @ref IDDP_RTIOC_RESERVE, before
+ * handing them over to the receiver with @ref IDDP_RTIOC_COMMIT. The
+ * regular send and receive calls remain available on both sides,
+ * moving data to or from the ring with a single copy.
+ *
+ * The payload size of each slot is rounded up to a multiple of the
+ * cache line size. The mapping starts with a @ref iddp_ring_header
+ * "ring header", slots follow at the data offset it gives. Upon
+ * return from @c getsockopt(), the @a map_size field gives the size
+ * of the memory area to pass to @c mmap(2). When called for a socket
+ * which is not itself in ring mode but is connected to a ring mode
+ * port, @c getsockopt() reports the configuration of the ring of
+ * the peer port.
+ *
+ * It is not allowed to configure a ring after the socket was
+ * bound. However, multiple configuration calls are allowed prior to
+ * the binding; the last value set will be used. A local pool size
+ * set via @ref IDDP_POOLSZ is ignored in ring mode.
+ *
+ * @param [in] level @ref sockopts_iddp "SOL_IDDP"
+ * @param [in] optname @b IDDP_RING
+ * @param [in] optval Pointer to struct iddp_ring_config
+ * @param [in] optlen sizeof(struct iddp_ring_config)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EALREADY (socket already bound)
+ * - -EINVAL (@a optlen is invalid, the slot count is not a power of
+ *   two, or the slot size is zero)
+ * - -ENXIO (getsockopt() only, no ring is available for the socket)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define IDDP_RING		3
+/** @} */
+
+/**
+ * IDDP receive ring configuration.
+ */
+struct iddp_ring_config {
+	/** Number of slots, must be a power of two. */
+	unsigned int nr_slots;
+	/** Maximum payload size of a slot, in bytes. */
+	unsigned int slot_size;
+	/** Size of the ring mapping (output only). */
+	unsigned int map_size;
+};
+
+/**
+ * @anchor iddp_ring_header
+ * Header of a mapped IDDP ring. The slot number N starts at offset
+ * @a data_offset + N * @a slot_size from the beginning of the
+ * mapping.
+ */
+struct iddp_ring_header {
+	/** Number of slots. */
+	unsigned int nr_slots;
+	/** Slot size, in bytes. */
+	unsigned int slot_size;
+	/** Offset of the first slot. */
+	unsigned int data_offset;
+};
+
+/**
+ * IDDP ring slot descriptor.
+ */
+struct iddp_ring_desc {
+	/** Slot number. */
+	unsigned int slot;
+	/** Offset of the pending data within the slot. */
+	unsigned int offset;
+	/** Length of the datagram. */
+	unsigned int len;
+	/** Port number of the sender (receive side only). */
+	int from;
+	/** Any of MSG_DONTWAIT, MSG_OOB. */
+	int flags;
+};
+
+#define RTIOC_TYPE_IPC		RTDM_CLASS_RTIPC
+
+/**
+ * @anchor iddp_ring_ioctls @name IDDP ring requests
+ * Sending and receiving datagrams in place through an IDDP ring.
+ * @{ */
+/**
+ * Reserve a free slot in the ring of the peer port, waiting for one
+ * to be released if none is available, unless MSG_DONTWAIT is
+ * set. The socket must be connected to a port in ring mode, and must
+ * have mapped its ring. On success, the @a slot field is updated.
+ */
+#define IDDP_RTIOC_RESERVE	_IOWR(RTIOC_TYPE_IPC, 0x00, struct iddp_ring_desc)
+/**
+ * Hand a reserved slot filled with @a len bytes over to the peer
+ * port. MSG_OOB queues the datagram ahead of all others.
+ */
+#define IDDP_RTIOC_COMMIT	_IOW(RTIOC_TYPE_IPC, 0x01, struct iddp_ring_desc)
+/**
+ * Wait for the next datagram received in ring mode, unless
+ * MSG_DONTWAIT is set. On success, the slot remains busy until
+ * released by @ref IDDP_RTIOC_RELEASE.
+ */
+#define IDDP_RTIOC_RECEIVE	_IOWR(RTIOC_TYPE_IPC, 0x02, struct iddp_ring_desc)
+/**
+ * Release a slot obtained from @ref IDDP_RTIOC_RECEIVE.
+ */
+#define IDDP_RTIOC_RELEASE	_IOW(RTIOC_TYPE_IPC, 0x03, struct iddp_ring_desc)
 /** @} */
 
 #define SOL_BUFP		313
@@ -834,6 +956,70 @@ struct sockaddr_ipc {
  * RT/non-RT
  */
 #define BUFP_BUFSZ		2
+/**
+ * BUFP broadcast mode
+ *
+ * Switches the buffer of the socket to broadcast mode: the data
+ * written to the bound port is shared by every socket connected to
+ * it, each of them reading through its own cursor into the single
+ * buffer. A reader only receives the data written after it got
+ * connected. The bound socket itself reads through a cursor of its
+ * own as well.
+ *
+ * Writers never wait for readers in broadcast mode: once the buffer
+ * is full, the oldest data is overwritten. A reader which fell
+ * behind by more than the buffer size receives -EPIPE from its next
+ * read, at which point its cursor is moved to the most recent write
+ * position. The count of such overruns can be retrieved via @ref
+ * BUFP_OVERRUNS.
+ *
+ * The readers should be left unbound, since a bound socket only
+ * reads from its own buffer.
+ *
+ * It is not allowed to switch the broadcast mode after the socket
+ * was bound. However, multiple configuration calls are allowed prior
+ * to the binding; the last value set will be used.
+ *
+ * @param [in] level @ref sockopts_bufp "SOL_BUFP"
+ * @param [in] optname @b BUFP_BROADCAST
+ * @param [in] optval Pointer to a variable of type int, non-zero
+ * enables the broadcast mode
+ * @param [in] optlen sizeof(int)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EALREADY (socket already bound)
+ * - -EINVAL (@a optlen is invalid)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_BROADCAST		3
+/**
+ * BUFP broadcast overrun count
+ *
+ * Returns the number of times the socket lost data as a reader of a
+ * buffer in @ref BUFP_BROADCAST "broadcast mode", because writers
+ * overwrote it before it could be read. This option is read-only.
+ *
+ * @param [in] level @ref sockopts_bufp "SOL_BUFP"
+ * @param [in] optname @b BUFP_OVERRUNS
+ * @param [out] optval Pointer to a variable of type unsigned int,
+ * receiving the overrun count
+ * @param [in] optlen sizeof(unsigned int)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EINVAL (@a optlen is invalid, or setsockopt() was called)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_OVERRUNS		4
 /** @} */
 
 /**
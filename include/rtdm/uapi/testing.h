@@ -61,6 +61,33 @@ typedef struct rttst_tmbench_config {
 	int freeze_max;
 } rttst_tmbench_config_t;
 
+#define RTTST_TMQUEUE_LIST		0
+#define RTTST_TMQUEUE_RBTREE		1
+#define RTTST_TMQUEUE_WHEEL		2
+#define RTTST_TMQUEUE_NR		3
+
+struct rttst_tmqueue_stats {
+	__s64 insert_avg_ns;
+	__s64 insert_max_ns;
+	__s64 remove_avg_ns;
+	__s64 remove_max_ns;
+	__s64 expire_avg_ns;
+	__s64 expire_max_ns;
+};
+
+struct rttst_tmqueue_bench {
+	/* Outstanding timers, up to 65536. */
+	__u32 nrtimers;
+	/* Expire or cancel operations to run on the loaded queue. */
+	__u32 nrops;
+	/* Timers are armed to [now, now + span) ns. */
+	__u64 span;
+	/* Percentage of cancellations among operations. */
+	int cancel_ratio;
+	/* Results, indexed by RTTST_TMQUEUE_*. */
+	struct rttst_tmqueue_stats stats[RTTST_TMQUEUE_NR];
+};
+
 struct rttst_swtest_task {
 	unsigned int index;
 	unsigned int flags;
@@ -161,6 +188,9 @@ struct rttst_heap_stathdr {
 #define RTTST_RTIOC_TMBENCH_STOP \
 	_IOWR(RTIOC_TYPE_TESTING, 0x11, struct rttst_overall_bench_res)
 
+#define RTTST_RTIOC_TMBENCH_QUEUES \
+	_IOWR(RTIOC_TYPE_TESTING, 0x12, struct rttst_tmqueue_bench)
+
 #define RTTST_RTIOC_SWTEST_SET_TASKS_COUNT \
 	_IOW(RTIOC_TYPE_TESTING, 0x30, __u32)
 
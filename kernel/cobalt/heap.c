@@ -131,13 +131,45 @@ static struct xnvfile_snapshot_ops vfile_ops = {
 	.show = vfile_show,
 };
 
+static int cache_vfile_show(struct xnvfile_regular_iterator *it, void *data)
+{
+	struct xnheap_cache *c;
+	int cpu, n, cached;
+
+	if (cobalt_heap.caches == NULL)
+		return 0;
+
+	xnvfile_printf(it, "%3s %12s %12s %8s %8s\n",
+		       "CPU", "HITS", "MISSES", "DRAINS", "CACHED");
+
+	for_each_online_cpu(cpu) {
+		c = per_cpu_ptr(cobalt_heap.caches, cpu);
+		for (n = 0, cached = 0; n < XNHEAP_CACHE_BUCKETS; n++)
+			cached += c->buckets[n].count;
+		xnvfile_printf(it, "%3d %12lu %12lu %8lu %8d\n",
+			       cpu, c->hits, c->misses, c->drains, cached);
+	}
+
+	return 0;
+}
+
+static struct xnvfile_regular_ops cache_vfile_ops = {
+	.show = cache_vfile_show,
+};
+
+static struct xnvfile_regular cache_vfile = {
+	.ops = &cache_vfile_ops,
+};
+
 void xnheap_init_proc(void)
 {
 	xnvfile_init_snapshot("heap", &vfile, &cobalt_vfroot);
+	xnvfile_init_regular("heapcache", &cache_vfile, &cobalt_vfroot);
 }
 
 void xnheap_cleanup_proc(void)
 {
+	xnvfile_destroy_regular(&cache_vfile);
 	xnvfile_destroy_snapshot(&vfile);
 }
 
@@ -513,23 +545,7 @@ static void *add_free_range(struct xnheap *heap,
 	return pagenr_to_addr(heap, pg);
 }
 
-/**
- * @fn void *xnheap_alloc(struct xnheap *heap, size_t size)
- * @brief Allocate a memory block from a memory heap.
- *
- * Allocates a contiguous region of memory from an active memory heap.
- * Such allocation is guaranteed to be time-bounded.
- *
- * @param heap The descriptor address of the heap to get memory from.
- *
- * @param size The size in bytes of the requested block.
- *
- * @return The address of the allocated region upon success, or NULL
- * if no memory is available from the specified heap.
- *
- * @coretags{unrestricted}
- */
-void *xnheap_alloc(struct xnheap *heap, size_t size)
+static void *alloc_block(struct xnheap *heap, size_t size)
 {
 	int log2size, ilog, pg, b = -1;
 	size_t bsize;
@@ -601,21 +617,8 @@ void *xnheap_alloc(struct xnheap *heap, size_t size)
 
 	return block;
 }
-EXPORT_SYMBOL_GPL(xnheap_alloc);
 
-/**
- * @fn void xnheap_free(struct xnheap *heap, void *block)
- * @brief Release a block to a memory heap.
- *
- * Releases a memory block to a heap.
- *
- * @param heap The heap descriptor.
- *
- * @param block The block to be returned to the heap.
- *
- * @coretags{unrestricted}
- */
-void xnheap_free(struct xnheap *heap, void *block)
+static void free_block(struct xnheap *heap, void *block)
 {
 	unsigned long pgoff, boff;
 	int log2size, pg, n;
@@ -677,6 +680,214 @@ bad:
 	XENO_WARN(MEMORY, 1, "invalid block %p in heap %s",
 		  block, heap->name);
 }
+
+static void *cache_get(struct xnheap *heap, int log2size)
+{
+	int ilog = log2size - XNHEAP_MIN_LOG2;
+	struct xnheap_cache *c;
+	void *block;
+	spl_t s;
+
+	/*
+	 * We might migrate before grabbing the lock, in which case we
+	 * would merely pull from a remote cache, which is still safe.
+	 */
+	c = raw_cpu_ptr(heap->caches);
+	xnlock_get_irqsave(&c->lock, s);
+
+	block = c->buckets[ilog].head;
+	if (block) {
+		c->buckets[ilog].head = *(void **)block;
+		c->buckets[ilog].count--;
+		c->hits++;
+	} else
+		c->misses++;
+
+	xnlock_put_irqrestore(&c->lock, s);
+
+	return block;
+}
+
+/*
+ * Check a block released to a per-CPU cache the way free_block()
+ * would, since the cached path does not go through it. Returns the
+ * log2 size of the block if it may be cached, zero otherwise, in
+ * which case the caller should hand it over to free_block() for
+ * reporting. The type and busy bit of a page cannot change while a
+ * valid block from it is allocated, so we may peek at them
+ * locklessly; anything else will be caught by free_block().
+ */
+static int check_cached_block(struct xnheap *heap, void *block)
+{
+	unsigned long pgoff, boff;
+	int pg, log2size;
+
+	if (block < heap->membase)
+		return 0;
+
+	pgoff = block - heap->membase;
+	if (pgoff >= heap->usable_size)
+		return 0;
+
+	pg = pgoff >> XNHEAP_PAGE_SHIFT;
+	if (!page_is_valid(heap, pg))
+		return 0;
+
+	log2size = heap->pagemap[pg].type;
+	if (log2size < XNHEAP_MIN_LOG2 || log2size > XNHEAP_CACHE_MAX_LOG2)
+		return 0;
+
+	boff = pgoff & ~XNHEAP_PAGE_MASK;
+	if ((boff & ((1UL << log2size) - 1)) != 0) /* Not at block start? */
+		return 0;
+
+	/* A block already returned to its page is not busy anymore. */
+	if (!(READ_ONCE(heap->pagemap[pg].map) & (1U << (boff >> log2size))))
+		return 0;
+
+	return log2size;
+}
+
+static bool cache_put(struct xnheap *heap, void *block, int log2size)
+{
+	int ilog = log2size - XNHEAP_MIN_LOG2;
+	struct xnheap_cache *c;
+	bool cached = false;
+	spl_t s;
+
+	c = raw_cpu_ptr(heap->caches);
+	xnlock_get_irqsave(&c->lock, s);
+
+	/*
+	 * A cached block still looks busy to check_cached_block(),
+	 * so catch the common case of a block released twice in a
+	 * row by comparing it to the last one cached. Going through
+	 * the whole bucket would touch up to cache_depth cold
+	 * blocks.
+	 */
+	if (unlikely(c->buckets[ilog].head == block)) {
+		xnlock_put_irqrestore(&c->lock, s);
+		XENO_WARN(MEMORY, 1, "block %p freed twice in heap %s",
+			  block, heap->name);
+		return true;	/* Drop the duplicate. */
+	}
+
+	if (c->buckets[ilog].count < heap->cache_depth) {
+		*(void **)block = c->buckets[ilog].head;
+		c->buckets[ilog].head = block;
+		c->buckets[ilog].count++;
+		cached = true;
+	}
+
+	xnlock_put_irqrestore(&c->lock, s);
+
+	return cached;
+}
+
+/*
+ * Give all cached blocks back to the heap, so that they may be
+ * coalesced into larger ranges. Called when the heap runs out of
+ * memory.
+ */
+static bool drain_caches(struct xnheap *heap)
+{
+	struct xnheap_cache *c;
+	bool drained = false;
+	void *block, *next;
+	int cpu, n;
+	spl_t s;
+
+	for_each_possible_cpu(cpu) {
+		c = per_cpu_ptr(heap->caches, cpu);
+		for (n = 0; n < XNHEAP_CACHE_BUCKETS; n++) {
+			xnlock_get_irqsave(&c->lock, s);
+			block = c->buckets[n].head;
+			c->buckets[n].head = NULL;
+			c->buckets[n].count = 0;
+			if (block)
+				c->drains++;
+			xnlock_put_irqrestore(&c->lock, s);
+			while (block) {
+				next = *(void **)block;
+				free_block(heap, block);
+				block = next;
+				drained = true;
+			}
+		}
+	}
+
+	return drained;
+}
+
+/**
+ * @fn void *xnheap_alloc(struct xnheap *heap, size_t size)
+ * @brief Allocate a memory block from a memory heap.
+ *
+ * Allocates a contiguous region of memory from an active memory heap.
+ * Such allocation is guaranteed to be time-bounded.
+ *
+ * @param heap The descriptor address of the heap to get memory from.
+ *
+ * @param size The size in bytes of the requested block.
+ *
+ * @return The address of the allocated region upon success, or NULL
+ * if no memory is available from the specified heap.
+ *
+ * @coretags{unrestricted}
+ */
+void *xnheap_alloc(struct xnheap *heap, size_t size)
+{
+	int log2size;
+	void *block;
+
+	if (heap->caches == NULL)
+		return alloc_block(heap, size);
+
+	/*
+	 * Serve small blocks from the per-CPU cache first, so that
+	 * common allocations do not bounce the heap lock between
+	 * CPUs.
+	 */
+	if (size > 0 && size <= (1U << XNHEAP_CACHE_MAX_LOG2)) {
+		log2size = size <= XNHEAP_MIN_ALIGN ?
+			XNHEAP_MIN_LOG2 : order_base_2(size);
+		block = cache_get(heap, log2size);
+		if (block)
+			return block;
+	}
+
+	block = alloc_block(heap, size);
+	if (block == NULL && drain_caches(heap))
+		block = alloc_block(heap, size);
+
+	return block;
+}
+EXPORT_SYMBOL_GPL(xnheap_alloc);
+
+/**
+ * @fn void xnheap_free(struct xnheap *heap, void *block)
+ * @brief Release a block to a memory heap.
+ *
+ * Releases a memory block to a heap.
+ *
+ * @param heap The heap descriptor.
+ *
+ * @param block The block to be returned to the heap.
+ *
+ * @coretags{unrestricted}
+ */
+void xnheap_free(struct xnheap *heap, void *block)
+{
+	int log2size;
+
+	if (heap->caches) {
+		log2size = check_cached_block(heap, block);
+		if (log2size && cache_put(heap, block, log2size))
+			return;
+	}
+
+	free_block(heap, block);
+}
 EXPORT_SYMBOL_GPL(xnheap_free);
 
 ssize_t xnheap_check_block(struct xnheap *heap, void *block)
@@ -758,6 +969,8 @@ int xnheap_init(struct xnheap *heap, void *membase, size_t size)
 	heap->membase = membase;
 	heap->usable_size = size;
 	heap->used_size = 0;
+	heap->caches = NULL;
+	heap->cache_depth = 0;
 		      
 	/*
 	 * The free page pool is maintained as a set of ranges of
@@ -805,10 +1018,61 @@ void xnheap_destroy(struct xnheap *heap)
 	nrheaps--;
 	xnvfile_touch_tag(&vfile_tag);
 	xnlock_put_irqrestore(&nklock, s);
+	if (heap->caches)
+		free_percpu(heap->caches);
 	vfree(heap->pagemap);
 }
 EXPORT_SYMBOL_GPL(xnheap_destroy);
 
+/**
+ * @fn int xnheap_enable_cache(struct xnheap *heap, int depth)
+ * @brief Enable per-CPU front caches on a memory heap.
+ *
+ * Free blocks up to 2^XNHEAP_CACHE_MAX_LOG2 bytes are kept in a
+ * per-CPU cache, from which subsequent allocations of the same size
+ * class are served without grabbing the heap lock. Each cache holds
+ * at most @a depth blocks per size class; all caches are drained back
+ * to the heap whenever an allocation would fail otherwise.
+ *
+ * Caching is not enabled with CONFIG_XENO_OPT_DEBUG_MEMORY, so that
+ * invalid releases are still detected immediately.
+ *
+ * @param heap The heap descriptor, which must have been initialized
+ * by xnheap_init() and not have served any request yet.
+ *
+ * @param depth The maximum number of blocks cached per CPU and size
+ * class. Zero leaves caching disabled.
+ *
+ * @return 0 is returned upon success, or -ENOMEM if the per-CPU
+ * memory cannot be obtained.
+ *
+ * @coretags{secondary-only}
+ */
+int xnheap_enable_cache(struct xnheap *heap, int depth)
+{
+	struct xnheap_cache *c;
+	int cpu;
+
+	secondary_mode_only();
+
+	if (depth <= 0 || IS_ENABLED(CONFIG_XENO_OPT_DEBUG_MEMORY))
+		return 0;
+
+	heap->caches = alloc_percpu(struct xnheap_cache);
+	if (heap->caches == NULL)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		c = per_cpu_ptr(heap->caches, cpu);
+		xnlock_init(&c->lock);
+	}
+
+	heap->cache_depth = depth;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnheap_enable_cache);
+
 /**
  * @fn xnheap_set_name(struct xnheap *heap,const char *name,...)
  * @brief Set the heap's name string.
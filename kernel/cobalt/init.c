@@ -160,6 +160,13 @@ static __init int sys_init(void)
 	}
 	xnheap_set_name(&cobalt_heap, "system heap");
 
+	ret = xnheap_enable_cache(&cobalt_heap, CONFIG_XENO_OPT_SYS_HEAP_CACHE);
+	if (ret) {
+		xnheap_destroy(&cobalt_heap);
+		xnheap_vfree(heapaddr);
+		return ret;
+	}
+
 	xnsched_init_all();
 
 	xnregistry_init();
@@ -26,6 +26,9 @@
 #include <linux/termios.h>
 #include <linux/spinlock.h>
 #include <linux/device.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
 #include <linux/uaccess.h>
 #include <linux/compat.h>
 #include <asm/io.h>
@@ -48,6 +51,10 @@ static LIST_HEAD(xnpipe_sleepq);
 
 static LIST_HEAD(xnpipe_asyncq);
 
+static LIST_HEAD(xnpipe_doneq);
+
+#define XNPIPE_RING_MAXSZ	(16 << 20)
+
 static int xnpipe_wakeup_virq;
 
 static struct class *xnpipe_class;
@@ -87,8 +94,11 @@ static inline void xnpipe_minor_free(int minor)
 
 static inline void xnpipe_enqueue_wait(struct xnpipe_state *state, int mask)
 {
-	if (state->wcount != 0x7fffffff && state->wcount++ == 0)
+	if (state->wcount != 0x7fffffff && state->wcount++ == 0) {
 		list_add_tail(&state->slink, &xnpipe_sleepq);
+		/* Nobody waited, drop stale wakeup requests. */
+		state->status &= ~XNPIPE_USER_ALL_READY;
+	}
 
 	state->status |= mask;
 }
@@ -147,6 +157,72 @@ static inline void xnpipe_dequeue_all(struct xnpipe_state *state, int mask)
 	__sigpending;							\
 })
 
+static inline ssize_t xnpipe_flush_bufq(void (*fn)(void *buf, void *xstate),
+					struct list_head *q,
+					void *xstate)
+{
+	struct xnpipe_mh *mh, *tmp;
+	ssize_t n = 0;
+
+	if (list_empty(q))
+		return 0;
+
+	/* Queue is private, no locking is required. */
+	list_for_each_entry_safe(mh, tmp, q, link) {
+		list_del(&mh->link);
+		n += xnpipe_m_size(mh);
+		fn(mh, xstate);
+	}
+
+	/* Return the overall count of bytes flushed. */
+	return n;
+}
+
+/*
+ * Move the specified queue contents to a private queue, then call the
+ * flush handler to purge it. The latter runs without locking.
+ * Returns the number of bytes flushed. Must be entered with nklock
+ * held, interrupts off.
+ */
+#define xnpipe_flushq(__state, __q, __f, __s)				\
+({									\
+	LIST_HEAD(__privq);						\
+	ssize_t __n;							\
+									\
+	list_splice_init(&(state)->__q, &__privq);			\
+	(__state)->nr ## __q = 0;					\
+	xnlock_put_irqrestore(&nklock, (__s));				\
+	__n = xnpipe_flush_bufq((__state)->ops.__f, &__privq, (__state)->xstate);	\
+	xnlock_get_irqsave(&nklock, (__s));				\
+									\
+	__n;								\
+})
+
+/*
+ * Release the extra state and the minor, unless xnpipe_wakeup_proc()
+ * is busy releasing ring buffers, in which case the latter completes
+ * the job when done. Must be entered with nklock held, interrupts
+ * off.
+ */
+#define xnpipe_release_xstate(__state, __s)				\
+	do {								\
+		if ((__state)->status & XNPIPE_KERN_RFLUSH) {		\
+			(__state)->status |= XNPIPE_KERN_RDEFER;	\
+			break;						\
+		}							\
+		xnlock_put_irqrestore(&nklock, (__s));			\
+		(__state)->ops.release((__state)->xstate);		\
+		xnlock_get_irqsave(&nklock, (__s));			\
+		xnpipe_minor_free(xnminor_from_state(__state));		\
+	} while (0)
+
+/* Must be entered with nklock held, interrupts off. */
+#define xnpipe_flush_doneq(__state, __s)				\
+	do {								\
+		list_del_init(&(__state)->dlink);			\
+		xnpipe_flushq((__state), doneq, free_obuf, (__s));	\
+	} while (0)
+
 static irqreturn_t xnpipe_wakeup_proc(int sirq, void *dev_id)
 {
 	struct xnpipe_state *state;
@@ -155,6 +231,23 @@ static irqreturn_t xnpipe_wakeup_proc(int sirq, void *dev_id)
 
 	xnlock_get_irqsave(&nklock, s);
 
+	/*
+	 * Release the buffers the Xenomai side copied to the shared
+	 * rings. Should the extra state be released meanwhile, this
+	 * is postponed until we are done with them.
+	 */
+	while (!list_empty(&xnpipe_doneq)) {
+		state = list_first_entry(&xnpipe_doneq, struct xnpipe_state, dlink);
+		list_del_init(&state->dlink);
+		state->status |= XNPIPE_KERN_RFLUSH;
+		xnpipe_flushq(state, doneq, free_obuf, s);
+		state->status &= ~XNPIPE_KERN_RFLUSH;
+		if (state->status & XNPIPE_KERN_RDEFER) {
+			state->status &= ~XNPIPE_KERN_RDEFER;
+			xnpipe_release_xstate(state, s);
+		}
+	}
+
 	/*
 	 * NOTE: sleepers might enter/leave the queue while we don't
 	 * hold the nklock in these wakeup loops. So we iterate over
@@ -230,46 +323,211 @@ static inline void xnpipe_schedule_request(void) /* hw IRQs off */
 	pipeline_post_sirq(xnpipe_wakeup_virq);
 }
 
-static inline ssize_t xnpipe_flush_bufq(void (*fn)(void *buf, void *xstate),
-					struct list_head *q,
-					void *xstate)
+/*
+ * Reserve room for a @len byte message in the shared ring of @state,
+ * returning the record to fill in. Must be entered with nklock held,
+ * interrupts off.
+ */
+static struct xnpipe_ring_rec *
+xnpipe_ring_reserve(struct xnpipe_state *state, size_t len)
 {
-	struct xnpipe_mh *mh, *tmp;
-	ssize_t n = 0;
+	size_t recsz, off, pad = 0, size = state->ringsz;
+	struct xnpipe_ring_rec *rec;
+	u32 head = state->ringhead, used;
 
-	if (list_empty(q))
-		return 0;
+	recsz = ALIGN(sizeof(*rec) + len, XNPIPE_RING_ALIGN);
+	if (recsz > size)
+		return ERR_PTR(-EMSGSIZE);
 
-	/* Queue is private, no locking is required. */
-	list_for_each_entry_safe(mh, tmp, q, link) {
-		list_del(&mh->link);
-		n += xnpipe_m_size(mh);
-		fn(mh, xstate);
+	off = head & (size - 1);
+	if (off + recsz > size)
+		pad = size - off;
+
+	/*
+	 * The tail index belongs to the reader, don't trust it
+	 * beyond what the ring may hold.
+	 */
+	used = head - READ_ONCE(state->ring->tail);
+	if (used > size || used + pad + recsz > size) {
+		state->ring->drops = ++state->ringdrops;
+		return ERR_PTR(-ENOBUFS);
 	}
 
-	/* Return the overall count of bytes flushed. */
-	return n;
+	/* Fetch the tail before overwriting the space it released. */
+	smp_mb();
+
+	if (pad) {
+		rec = state->ringdata + off;
+		rec->len = XNPIPE_RING_PAD;
+		off = 0;
+	}
+
+	rec = state->ringdata + off;
+	rec->len = len;
+	state->ringhead = head + pad + recsz;
+	state->ringbusy++;
+
+	return rec;
 }
 
 /*
- * Move the specified queue contents to a private queue, then call the
- * flush handler to purge it. The latter runs without locking.
- * Returns the number of bytes flushed. Must be entered with nklock
+ * Publish the records reserved in @ring so far, unless some copy is
+ * still in flight, since the reader consumes them in order: the last
+ * copier to finish publishes for all. Must be entered with nklock
  * held, interrupts off.
  */
-#define xnpipe_flushq(__state, __q, __f, __s)				\
-({									\
-	LIST_HEAD(__privq);						\
-	ssize_t __n;							\
-									\
-	list_splice_init(&(state)->__q, &__privq);			\
-	(__state)->nr ## __q = 0;					\
-	xnlock_put_irqrestore(&nklock, (__s));				\
-	__n = xnpipe_flush_bufq((__state)->ops.__f, &__privq, (__state)->xstate);	\
-	xnlock_get_irqsave(&nklock, (__s));				\
-									\
-	__n;								\
-})
+static void xnpipe_ring_commit(struct xnpipe_state *state,
+			       struct xnpipe_ring_hdr *ring)
+{
+	if (--state->ringbusy > 0 || state->ring != ring)
+		return;
+
+	/* Publish the records before the head index. */
+	smp_wmb();
+	state->ringpub = state->ringhead;
+	WRITE_ONCE(ring->head, state->ringhead);
+}
+
+/*
+ * Copy a message to the shared ring of @state. A ring may be as
+ * large as XNPIPE_RING_MAXSZ, so the nklock is released while
+ * copying, the reserved record being published afterwards. Must be
+ * entered with nklock held, interrupts off.
+ */
+#define xnpipe_ring_put(__state, __data, __len, __s)			\
+	({								\
+		struct xnpipe_ring_hdr *__ring = (__state)->ring;	\
+		struct xnpipe_ring_rec *__rec;				\
+		int __ret = 0;						\
+		__rec = xnpipe_ring_reserve(__state, __len);		\
+		if (IS_ERR(__rec))					\
+			__ret = PTR_ERR(__rec);				\
+		else {							\
+			xnlock_put_irqrestore(&nklock, (__s));		\
+			memcpy(__rec + 1, (__data), (__len));		\
+			xnlock_get_irqsave(&nklock, (__s));		\
+			xnpipe_ring_commit(__state, __ring);		\
+		}							\
+		__ret;							\
+	})
+
+/*
+ * Queue a message copied to the shared ring for release by
+ * xnpipe_wakeup_proc(), since the free_obuf handler may not run from
+ * the sender context. Returns non-zero if the wakeup virq should be
+ * scheduled. Must be entered with nklock held, interrupts off.
+ */
+static inline int xnpipe_ring_retire(struct xnpipe_state *state,
+				     struct xnpipe_mh *mh)
+{
+	list_add_tail(&mh->link, &state->doneq);
+	state->nrdoneq++;
+
+	if (!list_empty(&state->dlink))
+		return 0;
+
+	list_add_tail(&state->dlink, &xnpipe_doneq);
+
+	return 1;
+}
+
+/*
+ * Wake up the Linux reader about new output. A reader which has a
+ * wakeup pending already will pick the new data along with it.
+ * Returns non-zero if the wakeup virq should be scheduled. Must be
+ * entered with nklock held, interrupts off.
+ */
+static int xnpipe_kick_reader(struct xnpipe_state *state)
+{
+	int need_sched = 0, waiting = 0;
+
+	state->pbytes = 0;
+	state->pmsgs = 0;
+	if (xntimer_running_p(&state->ctimer))
+		xntimer_stop(&state->ctimer);
+
+	if (state->status & XNPIPE_USER_WREAD) {
+		/*
+		 * Wake up the regular Linux task waiting for input
+		 * from the Xenomai side.
+		 */
+		waiting = 1;
+		if ((state->status & XNPIPE_USER_WREAD_READY) == 0) {
+			state->status |= XNPIPE_USER_WREAD_READY;
+			need_sched = 1;
+		}
+	}
+
+	if (state->asyncq) {	/* Schedule asynch sig. */
+		waiting = 1;
+		if ((state->status & XNPIPE_USER_SIGIO) == 0) {
+			state->status |= XNPIPE_USER_SIGIO;
+			need_sched = 1;
+		}
+	}
+
+	if (need_sched) {
+		state->lastwake = xnclock_read_monotonic(&nkclock);
+		state->stats.wakeups++;
+	} else if (waiting)
+		state->stats.coalesced++;
+
+	return need_sched;
+}
+
+/*
+ * Notify the Linux reader about @bytes of new output. With wakeup
+ * coalescing enabled, the wakeup is postponed until either watermark
+ * is reached or the minimum interval since the previous wakeup has
+ * elapsed, whichever comes first. Returns non-zero if the wakeup
+ * virq should be scheduled. Must be entered with nklock held,
+ * interrupts off.
+ */
+static int xnpipe_notify_reader(struct xnpipe_state *state,
+				size_t bytes, int flags)
+{
+	xnticks_t now;
+
+	if (state->cinterval == 0 || (flags & XNPIPE_URGENT))
+		return xnpipe_kick_reader(state);
+
+	state->pbytes += bytes;
+	state->pmsgs++;
+
+	if ((state->cbytes && state->pbytes >= state->cbytes) ||
+	    (state->cmsgs && state->pmsgs >= state->cmsgs))
+		return xnpipe_kick_reader(state);
+
+	now = xnclock_read_monotonic(&nkclock);
+	if (now - state->lastwake >= state->cinterval)
+		return xnpipe_kick_reader(state);
+
+	if (!xntimer_running_p(&state->ctimer))
+		xntimer_start(&state->ctimer,
+			      state->lastwake + state->cinterval,
+			      XN_INFINITE, XN_ABSOLUTE);
+
+	state->stats.coalesced++;
+
+	return 0;
+}
+
+static void xnpipe_coalesce_handler(struct xntimer *timer) /* nklock held */
+{
+	struct xnpipe_state *state;
+
+	state = container_of(timer, struct xnpipe_state, ctimer);
+	if (xnpipe_kick_reader(state))
+		xnpipe_schedule_request();
+}
+
+static inline bool xnpipe_output_pending(struct xnpipe_state *state)
+{
+	if (state->ring && state->ringpub != READ_ONCE(state->ring->tail))
+		return true;
+
+	return !list_empty(&state->outq);
+}
 
 static void *xnpipe_default_alloc_ibuf(size_t size, void *xstate)
 {
@@ -389,6 +647,7 @@ int xnpipe_disconnect(int minor)
 	state->status &= ~XNPIPE_KERN_CONN;
 
 	state->ionrd -= xnpipe_flushq(state, outq, free_obuf, s);
+	xnpipe_flush_doneq(state, s);
 
 	if ((state->status & XNPIPE_USER_CONN) == 0)
 		goto cleanup;
@@ -421,12 +680,8 @@ cleanup:
 	 */
 	if (state->status & XNPIPE_USER_CONN)
 		state->status |= XNPIPE_KERN_LCLOSE;
-	else {
-		xnlock_put_irqrestore(&nklock, s);
-		state->ops.release(state->xstate);
-		xnlock_get_irqsave(&nklock, s);
-		xnpipe_minor_free(minor);
-	}
+	else
+		xnpipe_release_xstate(state, s);
 
 	if (need_sched)
 		xnpipe_schedule_request();
@@ -440,7 +695,7 @@ EXPORT_SYMBOL_GPL(xnpipe_disconnect);
 ssize_t xnpipe_send(int minor, struct xnpipe_mh *mh, size_t size, int flags)
 {
 	struct xnpipe_state *state;
-	int need_sched = 0;
+	int need_sched = 0, ret;
 	spl_t s;
 
 	if (minor < 0 || minor >= XNPIPE_NDEVS)
@@ -459,6 +714,37 @@ ssize_t xnpipe_send(int minor, struct xnpipe_mh *mh, size_t size, int flags)
 	}
 
 	xnpipe_m_size(mh) = size - sizeof(*mh);
+
+	if (state->ring) {
+		/*
+		 * The reader consumes the shared ring in place, so the
+		 * message is done with once copied there. Urgent
+		 * messages cannot jump the queue in this mode.
+		 */
+		ret = xnpipe_ring_put(state, xnpipe_m_data(mh),
+				      xnpipe_m_size(mh), s);
+		/* We may have raced with xnpipe_disconnect(). */
+		if (ret == 0 && (state->status & XNPIPE_KERN_CONN) == 0)
+			ret = -EBADF;
+		if (ret) {
+			xnlock_put_irqrestore(&nklock, s);
+			return ret;
+		}
+		xnpipe_m_rdoff(mh) = xnpipe_m_size(mh);
+		if (state->ops.output)
+			state->ops.output(mh, state->xstate);
+		state->stats.sends++;
+		/*
+		 * Release the buffer regardless of wakeup coalescing,
+		 * which only holds back the reader: the sender may be
+		 * short of buffers before the next wakeup is due.
+		 */
+		need_sched = xnpipe_ring_retire(state, mh);
+		need_sched |= xnpipe_notify_reader(state,
+						   xnpipe_m_size(mh), flags);
+		goto out;
+	}
+
 	xnpipe_m_rdoff(mh) = 0;
 	state->ionrd += xnpipe_m_size(mh);
 
@@ -474,20 +760,9 @@ ssize_t xnpipe_send(int minor, struct xnpipe_mh *mh, size_t size, int flags)
 		return (ssize_t) size;
 	}
 
-	if (state->status & XNPIPE_USER_WREAD) {
-		/*
-		 * Wake up the regular Linux task waiting for input
-		 * from the Xenomai side.
-		 */
-		state->status |= XNPIPE_USER_WREAD_READY;
-		need_sched = 1;
-	}
-
-	if (state->asyncq) {	/* Schedule asynch sig. */
-		state->status |= XNPIPE_USER_SIGIO;
-		need_sched = 1;
-	}
-
+	state->stats.sends++;
+	need_sched = xnpipe_notify_reader(state, xnpipe_m_size(mh), flags);
+out:
 	if (need_sched)
 		xnpipe_schedule_request();
 
@@ -500,6 +775,7 @@ EXPORT_SYMBOL_GPL(xnpipe_send);
 ssize_t xnpipe_mfixup(int minor, struct xnpipe_mh *mh, ssize_t size)
 {
 	struct xnpipe_state *state;
+	int ret;
 	spl_t s;
 
 	if (minor < 0 || minor >= XNPIPE_NDEVS)
@@ -517,8 +793,29 @@ ssize_t xnpipe_mfixup(int minor, struct xnpipe_mh *mh, ssize_t size)
 		return -EBADF;
 	}
 
-	xnpipe_m_size(mh) += size;
-	state->ionrd += size;
+	/*
+	 * A message which was copied to the shared ring is the only
+	 * one with its read offset at the end of the data. Send the
+	 * extra bytes as a record of their own in that case.
+	 */
+	if (xnpipe_m_rdoff(mh) == xnpipe_m_size(mh)) {
+		ret = state->ring == NULL ? -EPIPE :
+			xnpipe_ring_put(state, xnpipe_m_data(mh) +
+					xnpipe_m_size(mh), size, s);
+		if (ret == 0 && (state->status & XNPIPE_KERN_CONN) == 0)
+			ret = -EBADF;
+		if (ret) {
+			xnlock_put_irqrestore(&nklock, s);
+			return ret;
+		}
+		xnpipe_m_size(mh) += size;
+		xnpipe_m_rdoff(mh) += size;
+		if (xnpipe_notify_reader(state, size, 0))
+			xnpipe_schedule_request();
+	} else {
+		xnpipe_m_size(mh) += size;
+		state->ionrd += size;
+	}
 
 	xnlock_put_irqrestore(&nklock, s);
 
@@ -526,13 +823,19 @@ ssize_t xnpipe_mfixup(int minor, struct xnpipe_mh *mh, ssize_t size)
 }
 EXPORT_SYMBOL_GPL(xnpipe_mfixup);
 
-ssize_t xnpipe_recv(int minor, struct xnpipe_mh **pmh, xnticks_t timeout)
+/*
+ * Pull up to @nr messages from the input queue, waiting for the first
+ * one. The following messages are only pulled if immediately
+ * available and no larger than @maxlenv[n] (or unconditionally if
+ * @maxlenv is NULL). Return the count of messages pulled.
+ */
+int xnpipe_recvv(int minor, struct xnpipe_mh **mhv,
+		 const size_t *maxlenv, int nr, xnticks_t timeout)
 {
 	struct xnpipe_state *state;
 	struct xnpipe_mh *mh;
 	xntmode_t mode;
-	ssize_t ret;
-	int info;
+	int info, ret;
 	spl_t s;
 
 	if (minor < 0 || minor >= XNPIPE_NDEVS)
@@ -584,10 +887,14 @@ ssize_t xnpipe_recv(int minor, struct xnpipe_mh **pmh, xnticks_t timeout)
 		}
 	}
 
-	mh = list_get_entry(&state->inq, struct xnpipe_mh, link);
-	*pmh = mh;
-	state->nrinq--;
-	ret = (ssize_t)xnpipe_m_size(mh);
+	for (ret = 0; ret < nr && !list_empty(&state->inq); ret++) {
+		mh = list_first_entry(&state->inq, struct xnpipe_mh, link);
+		if (ret > 0 && maxlenv && xnpipe_m_size(mh) > maxlenv[ret])
+			break;
+		list_del(&mh->link);
+		mhv[ret] = mh;
+		state->nrinq--;
+	}
 
 	if (state->status & XNPIPE_USER_WSYNC) {
 		state->status |= XNPIPE_USER_WSYNC_READY;
@@ -600,6 +907,18 @@ unlock_and_exit:
 
 	return ret;
 }
+EXPORT_SYMBOL_GPL(xnpipe_recvv);
+
+ssize_t xnpipe_recv(int minor, struct xnpipe_mh **pmh, xnticks_t timeout)
+{
+	int ret;
+
+	ret = xnpipe_recvv(minor, pmh, NULL, 1, timeout);
+	if (ret < 0)
+		return ret;
+
+	return (ssize_t)xnpipe_m_size(*pmh);
+}
 EXPORT_SYMBOL_GPL(xnpipe_recv);
 
 int xnpipe_flush(int minor, int mode)
@@ -666,18 +985,40 @@ int xnpipe_pollstate(int minor, unsigned int *mask_r)
 }
 EXPORT_SYMBOL_GPL(xnpipe_pollstate);
 
+/*
+ * Detach the shared ring from the pipe, the mapping is gone by the
+ * time the file is released. Must be entered with nklock held,
+ * interrupts off.
+ */
+#define xnpipe_drop_ring(__state, __s)					\
+	do {								\
+		void *__ring = (__state)->ring;				\
+		if (__ring) {						\
+			(__state)->ring = NULL;				\
+			while ((__state)->ringbusy > 0) {		\
+				xnlock_put_irqrestore(&nklock, (__s));	\
+				cpu_relax();				\
+				xnlock_get_irqsave(&nklock, (__s));	\
+			}						\
+			xnlock_put_irqrestore(&nklock, (__s));		\
+			vfree(__ring);					\
+			xnlock_get_irqsave(&nklock, (__s));		\
+		}							\
+	} while (0)
+
 /* Must be entered with nklock held, interrupts off. */
 #define xnpipe_cleanup_user_conn(__state, __s)				\
 	do {								\
 		xnpipe_flushq((__state), outq, free_obuf, (__s));	\
 		xnpipe_flushq((__state), inq, free_ibuf, (__s));	\
+		xnpipe_drop_ring(__state, __s);				\
+		(__state)->cinterval = 0;				\
+		xntimer_stop(&(__state)->ctimer);			\
 		(__state)->status &= ~XNPIPE_USER_CONN;			\
 		if ((__state)->status & XNPIPE_KERN_LCLOSE) {		\
 			(__state)->status &= ~XNPIPE_KERN_LCLOSE;	\
-			xnlock_put_irqrestore(&nklock, (__s));		\
-			(__state)->ops.release((__state)->xstate);	\
-			xnlock_get_irqsave(&nklock, (__s));		\
-			xnpipe_minor_free(xnminor_from_state(__state));	\
+			xnpipe_flush_doneq(__state, __s);		\
+			xnpipe_release_xstate(__state, __s);		\
 		}							\
 	} while(0)
 
@@ -719,6 +1060,11 @@ static int xnpipe_open(struct inode *inode, struct file *file)
 	state->status |= XNPIPE_USER_CONN;
 	state->status &= ~XNPIPE_USER_LCONN;
 	state->wcount = 0;
+	state->cinterval = 0;
+	state->pbytes = 0;
+	state->pmsgs = 0;
+	state->lastwake = 0;
+	memset(&state->stats, 0, sizeof(state->stats));
 
 	state->status &=
 		~(XNPIPE_USER_ALL_WAIT | XNPIPE_USER_ALL_READY |
@@ -808,6 +1154,13 @@ static ssize_t xnpipe_read(struct file *file,
 		xnlock_put_irqrestore(&nklock, s);
 		return -EPIPE;
 	}
+
+	/* Output goes to the shared ring only once set up. */
+	if (state->ring) {
+		xnlock_put_irqrestore(&nklock, s);
+		return -EINVAL;
+	}
+
 	/*
 	 * Queue probe and proc enqueuing must be seen atomically,
 	 * including from the Xenomai side.
@@ -974,6 +1327,83 @@ retry:
 	return (ssize_t)count;
 }
 
+static int xnpipe_set_ring(struct xnpipe_state *state, unsigned long size)
+{
+	struct xnpipe_ring_hdr *ring;
+	size_t mapsz;
+	int ret = 0;
+	spl_t s;
+
+	if (size < PAGE_SIZE || size > XNPIPE_RING_MAXSZ ||
+	    !is_power_of_2(size))
+		return -EINVAL;
+
+	mapsz = PAGE_SIZE + size;
+	ring = vmalloc_user(mapsz);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	ring->size = size;
+	ring->dataoff = PAGE_SIZE;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	/*
+	 * Pending messages would be stranded in the output queue,
+	 * so switching to the ring is only allowed while it is
+	 * empty, once.
+	 */
+	if (state->ring || state->ringbusy || !list_empty(&state->outq))
+		ret = -EBUSY;
+	else {
+		state->ringdata = (void *)ring + PAGE_SIZE;
+		state->ringsz = size;
+		state->ringmapsz = mapsz;
+		state->ringhead = 0;
+		state->ringpub = 0;
+		state->ringdrops = 0;
+		state->ring = ring;
+	}
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (ret)
+		vfree(ring);
+
+	return ret;
+}
+
+static int xnpipe_set_coalesce(struct xnpipe_state *state,
+			       const struct xnpipe_coalesce __user *u_cf)
+{
+	struct xnpipe_coalesce cf;
+	spl_t s;
+
+	if (copy_from_user(&cf, u_cf, sizeof(cf)))
+		return -EFAULT;
+
+	/* Keep lastwake + cinterval from overflowing. */
+	if (cf.interval > XNPIPE_COALESCE_MAXINT || cf.msgs > INT_MAX)
+		return -EINVAL;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	state->cinterval = cf.interval;
+	state->cbytes = cf.bytes;
+	state->cmsgs = cf.msgs;
+
+	/*
+	 * Deliver what was held back so far, the new settings apply
+	 * from the next send on.
+	 */
+	if (xntimer_running_p(&state->ctimer) && xnpipe_kick_reader(state))
+		xnpipe_schedule_request();
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+
 static long xnpipe_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct xnpipe_state *state = file->private_data;
@@ -1032,9 +1462,40 @@ static long xnpipe_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		xnpipe_asyncsig = arg;
 		break;
 
+	case XNPIPEIOC_SETRING:
+
+		return xnpipe_set_ring(state, arg);
+
+	case XNPIPEIOC_SETCOALESCE:
+
+		return xnpipe_set_coalesce(state, (void __user *)arg);
+
+	case XNPIPEIOC_GETSTATS: {
+		struct xnpipe_stats stats;
+
+		xnlock_get_irqsave(&nklock, s);
+		stats = state->stats;
+		xnlock_put_irqrestore(&nklock, s);
+
+		if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+			return -EFAULT;
+
+		break;
+	}
+
 	case FIONREAD:
 
-		n = (state->status & XNPIPE_KERN_CONN) ? state->ionrd : 0;
+		xnlock_get_irqsave(&nklock, s);
+
+		n = 0;
+		if (state->status & XNPIPE_KERN_CONN) {
+			n = state->ionrd;
+			if (state->ring)
+				n += (u32)(state->ringpub -
+					   READ_ONCE(state->ring->tail));
+		}
+
+		xnlock_put_irqrestore(&nklock, s);
 
 		if (put_user(n, (int *)arg))
 			return -EFAULT;
@@ -1106,7 +1567,7 @@ static unsigned xnpipe_poll(struct file *file, poll_table *pt)
 	else
 		r_mask |= POLLHUP;
 
-	if (!list_empty(&state->outq))
+	if (xnpipe_output_pending(state))
 		r_mask |= (POLLIN | POLLRDNORM);
 	else
 		/*
@@ -1122,10 +1583,26 @@ static unsigned xnpipe_poll(struct file *file, poll_table *pt)
 	return r_mask | w_mask;
 }
 
+static int xnpipe_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct xnpipe_state *state = file->private_data;
+	size_t len = vma->vm_end - vma->vm_start;
+
+	/* The ring may only go away when the file is released. */
+	if (state->ring == NULL)
+		return -ENXIO;
+
+	if (vma->vm_pgoff != 0 || len > state->ringmapsz)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, state->ring, 0);
+}
+
 static struct file_operations xnpipe_fops = {
 	.read = xnpipe_read,
 	.write = xnpipe_write,
 	.poll = xnpipe_poll,
+	.mmap = xnpipe_mmap,
 	.unlocked_ioctl = xnpipe_ioctl,
 	.compat_ioctl = xnpipe_compat_ioctl,
 	.open = xnpipe_open,
@@ -1147,6 +1624,14 @@ int xnpipe_mount(void)
 		state->nrinq = 0;
 		INIT_LIST_HEAD(&state->outq);
 		state->nroutq = 0;
+		INIT_LIST_HEAD(&state->doneq);
+		state->nrdoneq = 0;
+		INIT_LIST_HEAD(&state->dlink);
+		state->ring = NULL;
+		state->ringbusy = 0;
+		state->cinterval = 0;
+		xntimer_init(&state->ctimer, &nkclock,
+			     xnpipe_coalesce_handler, NULL, XNTIMER_IGRAVITY);
 	}
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6,4,0)
@@ -1194,6 +1679,9 @@ void xnpipe_umount(void)
 {
 	int i;
 
+	for (i = 0; i < XNPIPE_NDEVS; i++)
+		xntimer_destroy(&xnpipe_states[i].ctimer);
+
 	pipeline_delete_inband_sirq(xnpipe_wakeup_virq);
 
 	unregister_chrdev(XNPIPE_DEV_MAJOR, "rtpipe");
@@ -41,6 +41,7 @@
 #define COBALT_EVENT_MAGIC	COBALT_MAGIC(0F)
 #define COBALT_MONITOR_MAGIC	COBALT_MAGIC(10)
 #define COBALT_TIMERFD_MAGIC	COBALT_MAGIC(11)
+#define COBALT_SELECTOR_MAGIC	COBALT_MAGIC(12)
 
 #define cobalt_obj_active(h,m,t)	\
 	((h) && ((t *)(h))->magic == (m))
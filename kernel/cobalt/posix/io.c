@@ -101,9 +101,12 @@ static int get_timespec(struct timespec64 *ts,
 	return cobalt_get_u_timespec(ts, u_ts);
 }
 
-static int get_mmsg(struct mmsghdr *mmsg, void __user *u_mmsg)
+static int get_mmsg(struct mmsghdr *mmsg, void __user **u_mmsg_p)
 {
-	return cobalt_copy_from_user(mmsg, u_mmsg, sizeof(*mmsg));
+	struct mmsghdr __user **p = (struct mmsghdr **)u_mmsg_p,
+		*q __user = (*p)++;
+
+	return cobalt_copy_from_user(mmsg, q, sizeof(*mmsg));
 }
 
 static int put_mmsg(void __user **u_mmsg_p, const struct mmsghdr *mmsg)
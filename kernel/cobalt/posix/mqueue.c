@@ -43,10 +43,25 @@ struct cobalt_mq {
 	struct xnsynch receivers;
 	struct xnsynch senders;
 	size_t memsize;
+	size_t msgsize;
 	char *mem;
+	/*
+	 * Guards the message lists and the waiter counts, so that
+	 * senders and receivers only need nklock for waiting for,
+	 * or waking up each other. nklock nests outside of it.
+	 */
+	DECLARE_XNLOCK(lock);
 	struct list_head queued;
 	struct list_head avail;
 	int nrqueued;
+	int nrsendwait;
+	int nrrcvwait;
+	int nrsenders;
+	int nrreceivers;
+
+	/* MQ_SPSC ring, slot indexes are free-running. */
+	unsigned long spsc_head ____cacheline_aligned_in_smp;
+	unsigned long spsc_tail ____cacheline_aligned_in_smp;
 
 	/* mq_notify */
 	struct siginfo si;
@@ -133,6 +148,58 @@ static inline void mq_msg_free(struct cobalt_mq *mq, struct cobalt_msg * msg)
 	list_add(&msg->link, &mq->avail); /* For earliest re-use of the block. */
 }
 
+static inline bool mq_spsc_p(struct cobalt_mq *mq)
+{
+	return !!(mq->attr.mq_flags & MQ_SPSC);
+}
+
+static inline struct cobalt_msg *
+mq_spsc_slot(struct cobalt_mq *mq, unsigned long index)
+{
+	return (struct cobalt_msg *)
+		(mq->mem + (index % mq->attr.mq_maxmsg) * mq->msgsize);
+}
+
+/*
+ * Whether senders and receivers may skip nklock, i.e. nobody waits
+ * for select() events or for a mq_notify() signal. Changing this
+ * requires holding both nklock and mq->lock.
+ */
+static inline bool mq_unwatched_p(struct cobalt_mq *mq)
+{
+	return list_empty(&mq->read_select.bindings) &&
+		list_empty(&mq->write_select.bindings) &&
+		mq->target == NULL;
+}
+
+static inline bool mq_readable_p(struct cobalt_mq *mq)
+{
+	if (mq_spsc_p(mq))
+		return smp_load_acquire(&mq->spsc_tail) !=
+			READ_ONCE(mq->spsc_head);
+
+	return !list_empty(&mq->queued);
+}
+
+static inline bool mq_writable_p(struct cobalt_mq *mq)
+{
+	if (mq_spsc_p(mq))
+		return READ_ONCE(mq->spsc_tail) -
+			smp_load_acquire(&mq->spsc_head) < mq->attr.mq_maxmsg;
+
+	return !list_empty(&mq->avail);
+}
+
+static int mq_spsc_signal(struct cobalt_mq *mq) /* nklock held */
+{
+	int resched;
+
+	resched = xnselect_signal(&mq->read_select, mq_readable_p(mq));
+	resched |= xnselect_signal(&mq->write_select, mq_writable_p(mq));
+
+	return resched;
+}
+
 static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 {
 	unsigned i, msgsize, memsize;
@@ -166,8 +233,16 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 		return -ENOSPC;
 
 	mq->memsize = memsize;
+	mq->msgsize = msgsize;
+	xnlock_init(&mq->lock);
 	INIT_LIST_HEAD(&mq->queued);
 	mq->nrqueued = 0;
+	mq->nrsendwait = 0;
+	mq->nrrcvwait = 0;
+	mq->nrsenders = 0;
+	mq->nrreceivers = 0;
+	mq->spsc_head = 0;
+	mq->spsc_tail = 0;
 	xnsynch_init(&mq->receivers, XNSYNCH_PRIO, NULL);
 	xnsynch_init(&mq->senders, XNSYNCH_PRIO, NULL);
 	mq->mem = mem;
@@ -180,6 +255,7 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 	}
 
 	mq->attr = *attr;
+	mq->attr.mq_flags &= MQ_SPSC;
 	mq->target = NULL;
 	xnselect_init(&mq->read_select);
 	xnselect_init(&mq->write_select);
@@ -228,11 +304,41 @@ static int mq_unref(struct cobalt_mq *mq)
 	return mq_unref_inner(mq, s);
 }
 
+static int mq_attach(struct cobalt_mq *mq, unsigned int perms)
+{
+	int sender = perms != O_RDONLY, receiver = perms != O_WRONLY;
+	int ret = 0;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	if (mq_spsc_p(mq) && ((sender && mq->nrsenders > 0) ||
+			      (receiver && mq->nrreceivers > 0)))
+		ret = -EBUSY;
+	else {
+		mq->nrsenders += sender;
+		mq->nrreceivers += receiver;
+	}
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ret;
+}
+
+static void mq_detach(struct cobalt_mq *mq, unsigned int perms)
+{
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	mq->nrsenders -= perms != O_RDONLY;
+	mq->nrreceivers -= perms != O_WRONLY;
+	xnlock_put_irqrestore(&nklock, s);
+}
+
 static void mqd_close(struct rtdm_fd *fd)
 {
 	struct cobalt_mqd *mqd = container_of(fd, struct cobalt_mqd, fd);
 	struct cobalt_mq *mq = mqd->mq;
 
+	mq_detach(mq, rtdm_fd_flags(fd) & COBALT_PERMS_MASK);
 	kfree(mqd);
 	mq_unref(mq);
 }
@@ -243,7 +349,9 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 {
 	struct cobalt_mqd *mqd = container_of(fd, struct cobalt_mqd, fd);
 	struct xnselect_binding *binding;
+	struct xnselect *select_block;
 	struct cobalt_mq *mq;
+	unsigned int state;
 	int err;
 	spl_t s;
 
@@ -262,26 +370,34 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 		err = -EBADF;
 		if ((rtdm_fd_flags(fd) & COBALT_PERMS_MASK) == O_WRONLY)
 			goto unlock_and_error;
-
-		err = xnselect_bind(&mq->read_select, binding,
-				selector, type, index,
-				!list_empty(&mq->queued));
-		if (err)
-			goto unlock_and_error;
+		select_block = &mq->read_select;
 		break;
 
-	case XNSELECT_WRITE:
+	default: /* XNSELECT_WRITE */
 		err = -EBADF;
 		if ((rtdm_fd_flags(fd) & COBALT_PERMS_MASK) == O_RDONLY)
 			goto unlock_and_error;
-
-		err = xnselect_bind(&mq->write_select, binding,
-				selector, type, index,
-				!list_empty(&mq->avail));
-		if (err)
-			goto unlock_and_error;
+		select_block = &mq->write_select;
 		break;
 	}
+
+	/*
+	 * Once bound, senders and receivers leave their fast path
+	 * and serialize on nklock, so we may evaluate the queue
+	 * state without mq->lock afterwards. For SPSC rings, the
+	 * barrier pairs with mq_spsc_finish_send/rcv().
+	 */
+	xnlock_get(&mq->lock);
+	err = xnselect_bind(select_block, binding,
+			    selector, type, index, 0);
+	xnlock_put(&mq->lock);
+	if (err)
+		goto unlock_and_error;
+
+	smp_mb();
+	state = type == XNSELECT_READ ? mq_readable_p(mq) : mq_writable_p(mq);
+	if (xnselect_signal(select_block, state))
+		xnsched_run();
 	xnlock_put_irqrestore(&nklock, s);
 	return 0;
 
@@ -311,11 +427,25 @@ static inline int mqd_create(struct cobalt_mq *mq, unsigned long flags, int ufd)
 	mqd->fd.oflags = flags;
 	mqd->mq = mq;
 
+	ret = mq_attach(mq, flags & COBALT_PERMS_MASK);
+	if (ret) {
+		kfree(mqd);
+		return ret;
+	}
+
 	ret = rtdm_fd_enter(&mqd->fd, ufd, COBALT_MQD_MAGIC, &mqd_ops);
 	if (ret < 0)
-		return ret;
+		goto fail;
+
+	ret = rtdm_fd_register(&mqd->fd, ufd);
+	if (ret < 0)
+		goto fail;
+
+	return 0;
+fail:
+	mq_detach(mq, flags & COBALT_PERMS_MASK);
 
-	return rtdm_fd_register(&mqd->fd, ufd);
+	return ret;
 }
 
 static int mq_open(int uqd, const char *name, int oflags,
@@ -449,6 +579,10 @@ static inline int mq_unlink(const char *name)
 	return 0;
 }
 
+/*
+ * Grab a free message slot, with mq->lock held for regular queues.
+ * The sender owns the tail of a SPSC ring, so it needs no lock.
+ */
 static inline struct cobalt_msg *
 mq_trysend(struct cobalt_mqd *mqd, size_t len)
 {
@@ -465,6 +599,14 @@ mq_trysend(struct cobalt_mqd *mqd, size_t len)
 	if (len > mq->attr.mq_msgsize)
 		return ERR_PTR(-EMSGSIZE);
 
+	if (mq_spsc_p(mq)) {
+		/* Pairs with smp_store_release() in mq_spsc_finish_rcv(). */
+		if (mq->spsc_tail - smp_load_acquire(&mq->spsc_head) >=
+		    mq->attr.mq_maxmsg)
+			return ERR_PTR(-EAGAIN);
+		return mq_spsc_slot(mq, mq->spsc_tail);
+	}
+
 	msg = mq_msg_alloc(mq);
 	if (msg == NULL)
 		return ERR_PTR(-EAGAIN);
@@ -475,6 +617,10 @@ mq_trysend(struct cobalt_mqd *mqd, size_t len)
 	return msg;
 }
 
+/*
+ * Pick the next message, with mq->lock held for regular queues. The
+ * receiver owns the head of a SPSC ring, so it needs no lock.
+ */
 static inline struct cobalt_msg *
 mq_tryrcv(struct cobalt_mqd *mqd, size_t len)
 {
@@ -491,6 +637,13 @@ mq_tryrcv(struct cobalt_mqd *mqd, size_t len)
 	if (len < mq->attr.mq_msgsize)
 		return ERR_PTR(-EMSGSIZE);
 
+	if (mq_spsc_p(mq)) {
+		/* Pairs with smp_store_release() in mq_spsc_finish_send(). */
+		if (smp_load_acquire(&mq->spsc_tail) == mq->spsc_head)
+			return ERR_PTR(-EAGAIN);
+		return mq_spsc_slot(mq, mq->spsc_head);
+	}
+
 	if (list_empty(&mq->queued))
 		return ERR_PTR(-EAGAIN);
 
@@ -503,6 +656,49 @@ mq_tryrcv(struct cobalt_mqd *mqd, size_t len)
 	return msg;
 }
 
+/*
+ * Fast path of the send and receive calls: nklock is not needed
+ * unless a select() binding or a notification request has to be
+ * updated.
+ */
+static struct cobalt_msg *
+mq_tryio_fast(struct cobalt_mqd *mqd, size_t len,
+	      struct cobalt_msg *(*tryio)(struct cobalt_mqd *mqd, size_t len))
+{
+	struct cobalt_mq *mq = mqd->mq;
+	struct cobalt_msg *msg;
+	spl_t s;
+
+	if (mq_spsc_p(mq))
+		return tryio(mqd, len);
+
+	xnlock_get_irqsave(&mq->lock, s);
+	if (mq_unwatched_p(mq))
+		msg = tryio(mqd, len);
+	else
+		msg = ERR_PTR(-EAGAIN);
+	xnlock_put_irqrestore(&mq->lock, s);
+
+	return msg;
+}
+
+static void mq_notify_target(struct cobalt_mq *mq) /* nklock held */
+{
+	struct cobalt_sigpending *sigp;
+
+	sigp = cobalt_signal_alloc();
+	if (sigp) {
+		cobalt_copy_siginfo(SI_MESGQ, &sigp->si, &mq->si);
+		if (cobalt_signal_send(mq->target, sigp, 0) <= 0)
+			cobalt_signal_free(sigp);
+	}
+
+	/* The lockless paths check mq_unwatched_p() under mq->lock. */
+	xnlock_get(&mq->lock);
+	mq->target = NULL;
+	xnlock_put(&mq->lock);
+}
+
 static struct cobalt_msg *
 mq_timedsend_inner(struct cobalt_mqd *mqd,
 		   size_t len, const void __user *u_ts,
@@ -510,8 +706,8 @@ mq_timedsend_inner(struct cobalt_mqd *mqd,
 					const void __user *u_ts))
 {
 	struct cobalt_mqwait_context mwc;
+	struct cobalt_mq *mq = mqd->mq;
 	struct cobalt_msg *msg;
-	struct cobalt_mq *mq;
 	struct timespec64 ts;
 	xntmode_t tmode;
 	xnticks_t to;
@@ -521,7 +717,20 @@ mq_timedsend_inner(struct cobalt_mqd *mqd,
 	to = XN_INFINITE;
 	tmode = XN_RELATIVE;
 redo:
+	msg = mq_tryio_fast(mqd, len, mq_trysend);
+	if (msg != ERR_PTR(-EAGAIN))
+		return msg;
+
 	xnlock_get_irqsave(&nklock, s);
+	xnlock_get(&mq->lock);
+	/*
+	 * Count ourselves as a waiter before checking for room
+	 * again, so that receivers releasing a slot from their fast
+	 * path switch to the slow one. For SPSC rings, this barrier
+	 * pairs with the one in mq_spsc_finish_rcv().
+	 */
+	mq->nrsendwait++;
+	smp_mb();
 	msg = mq_trysend(mqd, len);
 	if (msg != ERR_PTR(-EAGAIN))
 		goto out;
@@ -530,6 +739,8 @@ redo:
 		goto out;
 
 	if (fetch_timeout) {
+		mq->nrsendwait--;
+		xnlock_put(&mq->lock);
 		xnlock_put_irqrestore(&nklock, s);
 		ret = fetch_timeout(&ts, u_ts);
 		if (ret)
@@ -542,9 +753,11 @@ redo:
 		goto redo;
 	}
 
-	mq = mqd->mq;
+	xnlock_put(&mq->lock);
 	xnthread_prepare_wait(&mwc.wc);
+	mwc.msg = NULL;
 	ret = xnsynch_sleep_on(&mq->senders, to, tmode);
+	xnlock_get(&mq->lock);
 	if (ret) {
 		if (ret & XNBREAK)
 			msg = ERR_PTR(-EINTR);
@@ -552,9 +765,17 @@ redo:
 			msg = ERR_PTR(-ETIMEDOUT);
 		else if (ret & XNRMID)
 			msg = ERR_PTR(-EBADF);
+	} else if (mwc.msg == NULL) {
+		/* Woken up by a SPSC receiver, try again. */
+		mq->nrsendwait--;
+		xnlock_put(&mq->lock);
+		xnlock_put_irqrestore(&nklock, s);
+		goto redo;
 	} else
 		msg = mwc.msg;
 out:
+	mq->nrsendwait--;
+	xnlock_put(&mq->lock);
 	xnlock_put_irqrestore(&nklock, s);
 
 	return msg;
@@ -583,19 +804,69 @@ static void mq_release_msg(struct cobalt_mq *mq, struct cobalt_msg *msg)
 	}
 }
 
+/* Kick a waiter of a SPSC ring, which retries on its own. */
+static void mq_spsc_wakeup(struct xnsynch *synch) /* nklock held */
+{
+	struct xnthread *thread;
+
+	if (xnsynch_pended_p(synch)) {
+		thread = xnsynch_wakeup_one_sleeper(synch);
+		xnthread_complete_wait(xnthread_get_wait_context(thread));
+	}
+}
+
+static int mq_spsc_finish_send(struct cobalt_mq *mq, struct cobalt_msg *msg)
+{
+	unsigned long tail = mq->spsc_tail;
+	bool was_empty;
+	spl_t s;
+
+	was_empty = READ_ONCE(mq->spsc_head) == tail;
+	/* Publish the message, pairs with mq_tryrcv(). */
+	smp_store_release(&mq->spsc_tail, tail + 1);
+	/* Pairs with mq_timedrcv_inner() and mqd_select(). */
+	smp_mb();
+	if (READ_ONCE(mq->nrrcvwait) == 0 && mq_unwatched_p(mq))
+		return 0;
+
+	xnlock_get_irqsave(&nklock, s);
+	mq_spsc_wakeup(&mq->receivers);
+	mq_spsc_signal(mq);
+	if (was_empty && mq->target)
+		mq_notify_target(mq);
+	xnsched_run();
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+
 static int
 mq_finish_send(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
 {
 	struct cobalt_mqwait_context *mwc;
 	struct xnthread_wait_context *wc;
-	struct cobalt_sigpending *sigp;
 	struct xnthread *thread;
 	struct cobalt_mq *mq;
+	bool first = false;
 	spl_t s;
 
 	mq = mqd->mq;
 
+	if (mq_spsc_p(mq))
+		return mq_spsc_finish_send(mq, msg);
+
+	/* Queue the message without nklock if nobody is to be told. */
+	xnlock_get_irqsave(&mq->lock, s);
+	if (mq->nrrcvwait == 0 && mq_unwatched_p(mq)) {
+		list_add_priff(msg, &mq->queued, prio, link);
+		mq->nrqueued++;
+		xnlock_put_irqrestore(&mq->lock, s);
+		return 0;
+	}
+	xnlock_put_irqrestore(&mq->lock, s);
+
 	xnlock_get_irqsave(&nklock, s);
+	xnlock_get(&mq->lock);
 	/* Can we do pipelined sending? */
 	if (xnsynch_pended_p(&mq->receivers)) {
 		thread = xnsynch_wakeup_one_sleeper(&mq->receivers);
@@ -607,23 +878,18 @@ mq_finish_send(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
 		/* Nope, have to go through the queue. */
 		list_add_priff(msg, &mq->queued, prio, link);
 		mq->nrqueued++;
+		first = list_is_singular(&mq->queued);
+	}
+	xnlock_put(&mq->lock);
 
-		/*
-		 * If first message and no pending reader, send a
-		 * signal if notification was enabled via mq_notify().
-		 */
-		if (list_is_singular(&mq->queued)) {
-			xnselect_signal(&mq->read_select, 1);
-			if (mq->target) {
-				sigp = cobalt_signal_alloc();
-				if (sigp) {
-					cobalt_copy_siginfo(SI_MESGQ, &sigp->si, &mq->si);
-					if (cobalt_signal_send(mq->target, sigp, 0) <= 0)
-						cobalt_signal_free(sigp);
-				}
-				mq->target = NULL;
-			}
-		}
+	/*
+	 * If first message and no pending reader, send a signal if
+	 * notification was enabled via mq_notify().
+	 */
+	if (first) {
+		xnselect_signal(&mq->read_select, 1);
+		if (mq->target)
+			mq_notify_target(mq);
 	}
 	xnsched_run();
 	xnlock_put_irqrestore(&nklock, s);
@@ -639,8 +905,8 @@ mq_timedrcv_inner(struct cobalt_mqd *mqd,
 				       const void __user *u_ts))
 {
 	struct cobalt_mqwait_context mwc;
+	struct cobalt_mq *mq = mqd->mq;
 	struct cobalt_msg *msg;
-	struct cobalt_mq *mq;
 	struct timespec64 ts;
 	xntmode_t tmode;
 	xnticks_t to;
@@ -650,7 +916,15 @@ mq_timedrcv_inner(struct cobalt_mqd *mqd,
 	to = XN_INFINITE;
 	tmode = XN_RELATIVE;
 redo:
+	msg = mq_tryio_fast(mqd, len, mq_tryrcv);
+	if (msg != ERR_PTR(-EAGAIN))
+		return msg;
+
 	xnlock_get_irqsave(&nklock, s);
+	xnlock_get(&mq->lock);
+	/* Pairs with the barrier in mq_spsc_finish_send(). */
+	mq->nrrcvwait++;
+	smp_mb();
 	msg = mq_tryrcv(mqd, len);
 	if (msg != ERR_PTR(-EAGAIN))
 		goto out;
@@ -659,6 +933,8 @@ redo:
 		goto out;
 
 	if (fetch_timeout) {
+		mq->nrrcvwait--;
+		xnlock_put(&mq->lock);
 		xnlock_put_irqrestore(&nklock, s);
 		ret = fetch_timeout(&ts, u_ts);
 		if (ret)
@@ -671,36 +947,89 @@ redo:
 		goto redo;
 	}
 
-	mq = mqd->mq;
+	xnlock_put(&mq->lock);
 	xnthread_prepare_wait(&mwc.wc);
+	mwc.msg = NULL;
 	ret = xnsynch_sleep_on(&mq->receivers, to, tmode);
-	if (ret == 0)
+	xnlock_get(&mq->lock);
+	if (ret == 0) {
 		msg = mwc.msg;
-	else if (ret & XNRMID)
+		if (msg == NULL) {
+			/* Woken up by a SPSC sender, try again. */
+			mq->nrrcvwait--;
+			xnlock_put(&mq->lock);
+			xnlock_put_irqrestore(&nklock, s);
+			goto redo;
+		}
+	} else if (ret & XNRMID)
 		msg = ERR_PTR(-EBADF);
 	else if (ret & XNTIMEO)
 		msg = ERR_PTR(-ETIMEDOUT);
 	else
 		msg = ERR_PTR(-EINTR);
 out:
+	mq->nrrcvwait--;
+	xnlock_put(&mq->lock);
 	xnlock_put_irqrestore(&nklock, s);
 
 	return msg;
 }
 
+static int mq_spsc_finish_rcv(struct cobalt_mq *mq)
+{
+	spl_t s;
+
+	/* Release the slot once we are done reading it. */
+	smp_store_release(&mq->spsc_head, mq->spsc_head + 1);
+	/* Pairs with mq_timedsend_inner() and mqd_select(). */
+	smp_mb();
+	if (READ_ONCE(mq->nrsendwait) == 0 && mq_unwatched_p(mq))
+		return 0;
+
+	xnlock_get_irqsave(&nklock, s);
+	mq_spsc_wakeup(&mq->senders);
+	mq_spsc_signal(mq);
+	xnsched_run();
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+
 static int
 mq_finish_rcv(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
 {
+	struct cobalt_mq *mq = mqd->mq;
 	spl_t s;
 
+	if (mq_spsc_p(mq))
+		return mq_spsc_finish_rcv(mq);
+
+	/* Recycle the message without nklock if nobody is to be told. */
+	xnlock_get_irqsave(&mq->lock, s);
+	if (mq->nrsendwait == 0 && mq_unwatched_p(mq)) {
+		mq_msg_free(mq, msg);
+		xnlock_put_irqrestore(&mq->lock, s);
+		return 0;
+	}
+	xnlock_put_irqrestore(&mq->lock, s);
+
 	xnlock_get_irqsave(&nklock, s);
-	mq_release_msg(mqd->mq, msg);
+	xnlock_get(&mq->lock);
+	mq_release_msg(mq, msg);
+	xnlock_put(&mq->lock);
 	xnsched_run();
 	xnlock_put_irqrestore(&nklock, s);
 
 	return 0;
 }
 
+/* A SPSC slot is only published by mq_finish_send(). */
+static void mq_abort_send(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
+{
+	if (!mq_spsc_p(mqd->mq))
+		mq_finish_rcv(mqd, msg);
+}
+
 static inline int mq_getattr(struct cobalt_mqd *mqd, struct mq_attr *attr)
 {
 	struct cobalt_mq *mq;
@@ -708,10 +1037,15 @@ static inline int mq_getattr(struct cobalt_mqd *mqd, struct mq_attr *attr)
 
 	mq = mqd->mq;
 	*attr = mq->attr;
-	xnlock_get_irqsave(&nklock, s);
-	attr->mq_flags = rtdm_fd_flags(&mqd->fd);
+	attr->mq_flags |= rtdm_fd_flags(&mqd->fd);
+	if (mq_spsc_p(mq)) {
+		attr->mq_curmsgs = READ_ONCE(mq->spsc_tail) -
+			READ_ONCE(mq->spsc_head);
+		return 0;
+	}
+	xnlock_get_irqsave(&mq->lock, s);
 	attr->mq_curmsgs = mq->nrqueued;
-	xnlock_put_irqrestore(&nklock, s);
+	xnlock_put_irqrestore(&mq->lock, s);
 
 	return 0;
 }
@@ -734,6 +1068,7 @@ mq_notify(struct cobalt_mqd *mqd, unsigned index, const struct sigevent *evp)
 
 	xnlock_get_irqsave(&nklock, s);
 	mq = mqd->mq;
+	xnlock_get(&mq->lock);
 	if (mq->target && mq->target != thread) {
 		err = -EBUSY;
 		goto unlock_and_error;
@@ -759,10 +1094,12 @@ mq_notify(struct cobalt_mqd *mqd, unsigned index, const struct sigevent *evp)
 		mq->si.si_uid = get_current_uuid();
 	}
 
+	xnlock_put(&mq->lock);
 	xnlock_put_irqrestore(&nklock, s);
 	return 0;
 
       unlock_and_error:
+	xnlock_put(&mq->lock);
 	xnlock_put_irqrestore(&nklock, s);
 	return err;
 }
@@ -962,7 +1299,7 @@ int __cobalt_mq_timedsend(mqd_t uqd, const void __user *u_buf, size_t len,
 
 	ret = cobalt_copy_from_user(msg->data, u_buf, len);
 	if (ret) {
-		mq_finish_rcv(mqd, msg);
+		mq_abort_send(mqd, msg);
 		goto out;
 	}
 	msg->len = len;
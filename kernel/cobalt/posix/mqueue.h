@@ -22,6 +22,7 @@
 #include <linux/types.h>
 #include <linux/fcntl.h>
 #include <xenomai/posix/syscall.h>
+#include <cobalt/uapi/mqueue.h>
 
 struct mq_attr {
 	long mq_flags;
@@ -0,0 +1,263 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Selector descriptors: a persistent interest set of file
+ * descriptors attached to an edge-triggered xnselector, so that
+ * waiting for events does not require binding, then scanning all
+ * watched descriptors again on each call like select() does.
+ */
+#include <linux/err.h>
+#include <cobalt/kernel/select.h>
+#include <rtdm/fd.h>
+#include "internal.h"
+#include "clock.h"
+#include "selector.h"
+
+#define COBALT_SELECT_EVENTS	\
+	(COBALT_SELECT_READ | COBALT_SELECT_WRITE | COBALT_SELECT_EXCEPT)
+
+/* Number of events collected at once under nklock. */
+#define COBALT_SELECT_BATCH	32
+
+struct cobalt_selector {
+	struct rtdm_fd fd;
+	struct xnselector *selector;
+};
+
+static void selector_close(struct rtdm_fd *fd)
+{
+	struct cobalt_selector *sel;
+
+	sel = container_of(fd, struct cobalt_selector, fd);
+	/* Releases the selector memory asynchronously. */
+	xnselector_destroy(sel->selector);
+	xnfree(sel);
+}
+
+static struct rtdm_fd_ops selector_ops = {
+	.close = selector_close,
+};
+
+COBALT_SYSCALL(selector_create, lostage, (int flags))
+{
+	struct cobalt_selector *sel;
+	int ret, ufd;
+
+	if (flags & ~COBALT_SELECT_CLOEXEC)
+		return -EINVAL;
+
+	sel = xnmalloc(sizeof(*sel));
+	if (sel == NULL)
+		return -ENOMEM;
+
+	sel->selector = xnmalloc(sizeof(*sel->selector));
+	if (sel->selector == NULL) {
+		ret = -ENOMEM;
+		goto fail_selector;
+	}
+
+	ufd = __rtdm_anon_getfd("[cobalt-selector]", O_RDWR |
+				((flags & COBALT_SELECT_CLOEXEC) ? O_CLOEXEC : 0));
+	if (ufd < 0) {
+		ret = ufd;
+		goto fail_getfd;
+	}
+
+	xnselector_init_edge(sel->selector);
+	sel->fd.oflags = 0;
+
+	ret = rtdm_fd_enter(&sel->fd, ufd, COBALT_SELECTOR_MAGIC, &selector_ops);
+	if (ret < 0)
+		goto fail;
+
+	ret = rtdm_fd_register(&sel->fd, ufd);
+	if (ret < 0)
+		goto fail;
+
+	return ufd;
+fail:
+	__rtdm_anon_putfd(ufd);
+fail_getfd:
+	xnfree(sel->selector);
+fail_selector:
+	xnfree(sel);
+
+	return ret;
+}
+
+static inline struct cobalt_selector *selector_get(int ufd)
+{
+	struct rtdm_fd *fd;
+
+	fd = rtdm_fd_get(ufd, COBALT_SELECTOR_MAGIC);
+	if (IS_ERR(fd)) {
+		int err = PTR_ERR(fd);
+		if (err == -EBADF && cobalt_current_process() == NULL)
+			err = -EPERM;
+		return ERR_PTR(err);
+	}
+
+	return container_of(fd, struct cobalt_selector, fd);
+}
+
+static inline void selector_put(struct cobalt_selector *sel)
+{
+	rtdm_fd_put(&sel->fd);
+}
+
+/*
+ * xnselect_bind() refuses to bind a descriptor twice for the same
+ * event type under nklock, so that concurrent additions cannot both
+ * succeed. On error, we only drop the bindings this call
+ * established.
+ */
+static int selector_add(struct xnselector *selector,
+			int ufd, unsigned int events)
+{
+	unsigned int type;
+	int ret = 0;
+
+	for (type = 0; type < XNSELECT_MAX_TYPES; type++) {
+		if ((events & (1 << type)) == 0)
+			continue;
+		ret = rtdm_fd_select(ufd, selector, type);
+		if (ret) {
+			/* Plain Linux descriptors cannot be watched. */
+			if (ret == -EADV)
+				ret = -EPERM;
+			while (type-- > 0)
+				if (events & (1 << type))
+					xnselector_unbind(selector, type, ufd);
+			break;
+		}
+	}
+
+	return ret;
+}
+
+static int selector_del(struct xnselector *selector,
+			int ufd, unsigned int events)
+{
+	unsigned int type;
+	int ret = -ENOENT;
+
+	if (events == 0)
+		events = COBALT_SELECT_EVENTS;
+
+	for (type = 0; type < XNSELECT_MAX_TYPES; type++) {
+		if ((events & (1 << type)) &&
+		    xnselector_unbind(selector, type, ufd) == 0)
+			ret = 0;
+	}
+
+	return ret;
+}
+
+COBALT_SYSCALL(selector_ctl, primary,
+	       (int fd, int op, int ufd, unsigned int events))
+{
+	struct cobalt_selector *sel;
+	int ret;
+
+	if (events & ~COBALT_SELECT_EVENTS)
+		return -EINVAL;
+
+	if (ufd < 0 || ufd >= __FD_SETSIZE || ufd == fd)
+		return -EINVAL;
+
+	sel = selector_get(fd);
+	if (IS_ERR(sel))
+		return PTR_ERR(sel);
+
+	switch (op) {
+	case COBALT_SELECT_ADD:
+		ret = events ? selector_add(sel->selector, ufd, events) : -EINVAL;
+		break;
+	case COBALT_SELECT_DEL:
+		ret = selector_del(sel->selector, ufd, events);
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+	selector_put(sel);
+
+	return ret;
+}
+
+COBALT_SYSCALL(selector_wait, primary,
+	       (int fd, struct cobalt_select_event __user *u_events,
+		int maxevents, const __s64 __user *u_timeout))
+{
+	struct xnselect_event events[COBALT_SELECT_BATCH];
+	xnticks_t timeout = XN_INFINITE;
+	struct cobalt_select_event ev;
+	xntmode_t mode = XN_RELATIVE;
+	struct cobalt_selector *sel;
+	int ret, n, i, count = 0;
+	__s64 ns;
+
+	if (maxevents <= 0 ||
+	    maxevents > INT_MAX / sizeof(struct cobalt_select_event))
+		return -EINVAL;
+
+	if (!access_ok(u_events, maxevents * sizeof(*u_events)))
+		return -EFAULT;
+
+	if (u_timeout) {
+		if (cobalt_copy_from_user(&ns, u_timeout, sizeof(ns)))
+			return -EFAULT;
+		if (ns < 0)
+			return -EINVAL;
+		if (ns == 0)
+			timeout = XN_NONBLOCK;
+		else {
+			timeout = clock_get_ticks(CLOCK_MONOTONIC) + ns;
+			mode = XN_ABSOLUTE;
+		}
+	}
+
+	sel = selector_get(fd);
+	if (IS_ERR(sel))
+		return PTR_ERR(sel);
+
+	do {
+		n = min_t(int, maxevents - count, COBALT_SELECT_BATCH);
+		ret = xnselect_collect(sel->selector, events, n,
+				       timeout, mode);
+		if (ret <= 0)
+			break;
+
+		for (i = 0; i < ret; i++, count++) {
+			ev.fd = events[i].index;
+			ev.events = 1 << events[i].type;
+			if (cobalt_copy_to_user(u_events + count,
+						&ev, sizeof(ev))) {
+				/* Report what we could copy, if anything. */
+				ret = -EFAULT;
+				goto out;
+			}
+		}
+		/* Only drain what is already queued from now on. */
+		timeout = XN_NONBLOCK;
+		mode = XN_RELATIVE;
+	} while (ret == n && count < maxevents);
+out:
+	selector_put(sel);
+
+	return count ?: ret;
+}
@@ -0,0 +1,31 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _COBALT_POSIX_SELECTOR_H
+#define _COBALT_POSIX_SELECTOR_H
+
+#include <cobalt/uapi/select.h>
+#include <xenomai/posix/syscall.h>
+
+COBALT_SYSCALL_DECL(selector_create, (int flags));
+
+COBALT_SYSCALL_DECL(selector_ctl,
+		    (int fd, int op, int ufd, unsigned int events));
+
+COBALT_SYSCALL_DECL(selector_wait,
+		    (int fd, struct cobalt_select_event __user *u_events,
+		     int maxevents, const __s64 __user *u_timeout));
+
+#endif /* !_COBALT_POSIX_SELECTOR_H */
@@ -797,9 +797,12 @@ static int get_timespec32(struct timespec64 *ts,
 	return sys32_get_timespec(ts, u_ts);
 }
 
-static int get_mmsg32(struct mmsghdr *mmsg, void __user *u_mmsg)
+static int get_mmsg32(struct mmsghdr *mmsg, void __user **u_mmsg_p)
 {
-	return sys32_get_mmsghdr(mmsg, u_mmsg);
+	struct compat_mmsghdr __user **p = (struct compat_mmsghdr **)u_mmsg_p,
+		*q __user = (*p)++;
+
+	return sys32_get_mmsghdr(mmsg, q);
 }
 
 static int put_mmsg32(void __user **u_mmsg_p, const struct mmsghdr *mmsg)
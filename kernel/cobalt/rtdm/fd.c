@@ -25,6 +25,9 @@
 #include <linux/poll.h>
 #include <linux/kthread.h>
 #include <linux/fdtable.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <cobalt/kernel/registry.h>
 #include <cobalt/kernel/lock.h>
 #include <cobalt/kernel/ppd.h>
@@ -40,15 +43,29 @@
 
 #define RTDM_SETFL_MASK (O_NONBLOCK)
 
-DEFINE_PRIVATE_XNLOCK(fdtree_lock);
+DEFINE_PRIVATE_XNLOCK(fdlist_lock);
 static LIST_HEAD(rtdm_fd_cleanup_queue);
 static struct semaphore rtdm_fd_cleanup_sem;
 
-struct rtdm_fd_index {
-	struct xnid id;
-	struct rtdm_fd *fd;
+/*
+ * Every process indexes its RTDM file descriptors in an array,
+ * which is searched without locking. Lookups run with hard irqs
+ * off, bumping a per-CPU sequence count on entry and exit. Before
+ * an updater drops an array or an entry it removed from it, it
+ * waits for any lookup which might still refer to them to finish
+ * (see synchronize_fd_lookups()). Updaters serialize on
+ * fdtab_mutex, and all run in secondary mode.
+ */
+struct rtdm_fd_table {
+	unsigned int size;
+	struct rtdm_fd *fds[];
 };
 
+#define RTDM_FDTAB_MIN_SIZE	64
+
+static DEFINE_MUTEX(fdtab_mutex);
+static DEFINE_PER_CPU(unsigned long, fd_lookup_seq);
+
 static int enosys(void)
 {
 	return -ENOSYS;
@@ -69,23 +86,84 @@ static int enodev(void)
 	return -ENODEV;
 }
 
-static inline struct rtdm_fd_index *
-fetch_fd_index(struct cobalt_ppd *p, int ufd)
+/* Grab a reference on the descriptor indexed by @ufd, if any. */
+static struct rtdm_fd *fetch_fd(struct cobalt_ppd *p, int ufd)
 {
-	struct xnid *id = xnid_fetch(&p->fds, ufd);
-	if (id == NULL)
-		return NULL;
+	struct rtdm_fd_table *tab;
+	struct rtdm_fd *fd = NULL;
+	unsigned long *seq;
+	spl_t s;
+
+	splhigh(s);
 
-	return container_of(id, struct rtdm_fd_index, id);
+	seq = raw_cpu_ptr(&fd_lookup_seq);
+	WRITE_ONCE(*seq, *seq + 1);
+	smp_mb();
+
+	tab = READ_ONCE(p->fdtab);
+	if (tab && ufd >= 0 && ufd < tab->size) {
+		fd = READ_ONCE(tab->fds[ufd]);
+		if (fd && !atomic_inc_not_zero(&fd->refs))
+			fd = NULL;
+	}
+
+	smp_mb();
+	WRITE_ONCE(*seq, *seq + 1);
+
+	splexit(s);
+
+	return fd;
 }
 
-static struct rtdm_fd *fetch_fd(struct cobalt_ppd *p, int ufd)
+/*
+ * Wait for all lookups in progress to finish, so that none of them
+ * may still be using a table or a descriptor which was unpublished
+ * before this call.
+ */
+static void synchronize_fd_lookups(void)
+{
+	unsigned long seq;
+	int cpu;
+
+	smp_mb();
+
+	for_each_online_cpu(cpu) {
+		seq = READ_ONCE(per_cpu(fd_lookup_seq, cpu));
+		if (seq & 1) {
+			while (READ_ONCE(per_cpu(fd_lookup_seq, cpu)) == seq)
+				cpu_relax();
+		}
+	}
+
+	smp_mb();
+}
+
+static int grow_fd_table(struct cobalt_ppd *p, int ufd)
 {
-	struct rtdm_fd_index *idx = fetch_fd_index(p, ufd);
-	if (idx == NULL)
-		return NULL;
+	struct rtdm_fd_table *tab, *old = p->fdtab;
+	unsigned int size;
+
+	if (old && ufd < old->size)
+		return 0;
+
+	size = max_t(unsigned int, roundup_pow_of_two(ufd + 1),
+		     RTDM_FDTAB_MIN_SIZE);
+	tab = kvzalloc(sizeof(*tab) + size * sizeof(tab->fds[0]), GFP_KERNEL);
+	if (tab == NULL)
+		return -ENOMEM;
+
+	tab->size = size;
+	if (old)
+		memcpy(tab->fds, old->fds, old->size * sizeof(old->fds[0]));
+
+	smp_store_release(&p->fdtab, tab);
+
+	if (old) {
+		synchronize_fd_lookups();
+		kvfree(old);
+	}
 
-	return idx->fd;
+	return 0;
 }
 
 #define assign_invalid_handler(__handler, __invalid)			\
@@ -173,7 +251,7 @@ int rtdm_fd_enter(struct rtdm_fd *fd, int ufd, unsigned int magic,
 	fd->ops = ops;
 	fd->owner = ppd;
 	fd->ufd = ufd;
-	fd->refs = 1;
+	atomic_set(&fd->refs, 1);
 	fd->stale = false;
 	set_compat_bit(fd);
 	INIT_LIST_HEAD(&fd->next);
@@ -183,26 +261,30 @@ int rtdm_fd_enter(struct rtdm_fd *fd, int ufd, unsigned int magic,
 
 int rtdm_fd_register(struct rtdm_fd *fd, int ufd)
 {
-	struct rtdm_fd_index *idx;
 	struct cobalt_ppd *ppd;
-	spl_t s;
-	int ret = 0;
+	int ret;
+
+	if (ufd < 0)
+		return -EBADF;
 
 	ppd = cobalt_ppd_get(0);
-	idx = kmalloc(sizeof(*idx), GFP_KERNEL);
-	if (idx == NULL)
-		return -ENOMEM;
 
-	idx->fd = fd;
+	mutex_lock(&fdtab_mutex);
+
+	ret = grow_fd_table(ppd, ufd);
+	if (ret)
+		goto out;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
-	ret = xnid_enter(&ppd->fds, &idx->id, ufd);
-	xnlock_put_irqrestore(&fdtree_lock, s);
-	if (ret < 0) {
-		kfree(idx);
+	if (ppd->fdtab->fds[ufd]) {
 		ret = -EBUSY;
+		goto out;
 	}
 
+	/* Publish the descriptor once fully built. */
+	smp_store_release(&ppd->fdtab->fds[ufd], fd);
+out:
+	mutex_unlock(&fdtab_mutex);
+
 	return ret;
 }
 
@@ -217,9 +299,9 @@ int rtdm_device_new_fd(struct rtdm_fd *fd, int ufd,
 		return ret;
 
 	trace_cobalt_fd_created(fd, ufd);
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdlist_lock, s);
 	list_add(&fd->next, &device->openfd_list);
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdlist_lock, s);
 
 	return 0;
 }
@@ -248,25 +330,27 @@ struct rtdm_fd *rtdm_fd_get(int ufd, unsigned int magic)
 {
 	struct cobalt_ppd *p = cobalt_ppd_get(0);
 	struct rtdm_fd *fd;
-	spl_t s;
+	int ret;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
 	fd = fetch_fd(p, ufd);
-	if (fd == NULL || (magic != 0 && fd->magic != magic)) {
-		fd = ERR_PTR(-EADV);
-		goto out;
+	if (fd == NULL)
+		return ERR_PTR(-EADV);
+
+	if (magic != 0 && fd->magic != magic) {
+		ret = -EADV;
+		goto fail;
 	}
 
 	if (fd->stale) {
-		fd = ERR_PTR(-EBADF);
-		goto out;
+		ret = -EBADF;
+		goto fail;
 	}
 
-	++fd->refs;
-out:
-	xnlock_put_irqrestore(&fdtree_lock, s);
-
 	return fd;
+fail:
+	rtdm_fd_put(fd);
+
+	return ERR_PTR(ret);
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_get);
 
@@ -285,11 +369,11 @@ static int fd_cleanup_thread(void *data)
 				return 0;
 		} while (err);
 
-		xnlock_get_irqsave(&fdtree_lock, s);
+		xnlock_get_irqsave(&fdlist_lock, s);
 		fd = list_first_entry(&rtdm_fd_cleanup_queue,
 				struct rtdm_fd, cleanup);
 		list_del(&fd->cleanup);
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdlist_lock, s);
 
 		fd->ops->close(fd);
 	}
@@ -308,27 +392,27 @@ static struct lostage_trigger_close {
 	.inband_work = PIPELINE_INBAND_WORK_INITIALIZER(lostage_trigger_close),
 };
 
-static void __put_fd(struct rtdm_fd *fd, spl_t s)
+static void put_fd(struct rtdm_fd *fd)
 {
-	bool destroy, trigger;
+	bool trigger;
+	spl_t s;
 
-	XENO_WARN_ON(COBALT, fd->refs <= 0);
-	destroy = --fd->refs == 0;
-	if (destroy && !list_empty(&fd->next))
-		list_del_init(&fd->next);
+	XENO_WARN_ON(COBALT, atomic_read(&fd->refs) <= 0);
+	if (!atomic_dec_and_test(&fd->refs))
+		return;
 
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdlist_lock, s);
 
-	if (!destroy)
-		return;
+	if (!list_empty(&fd->next))
+		list_del_init(&fd->next);
 
-	if (is_secondary_domain())
+	if (is_secondary_domain()) {
+		xnlock_put_irqrestore(&fdlist_lock, s);
 		fd->ops->close(fd);
-	else {
-		xnlock_get_irqsave(&fdtree_lock, s);
+	} else {
 		trigger = list_empty(&rtdm_fd_cleanup_queue);
 		list_add_tail(&fd->cleanup, &rtdm_fd_cleanup_queue);
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdlist_lock, s);
 
 		if (trigger)
 			pipeline_post_inband_work(&fd_closework);
@@ -341,21 +425,21 @@ void rtdm_device_flush_fds(struct rtdm_device *dev)
 	struct rtdm_fd *fd;
 	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdlist_lock, s);
 
 	while (!list_empty(&dev->openfd_list)) {
 		fd = list_get_entry_init(&dev->openfd_list, struct rtdm_fd, next);
 		fd->stale = true;
-		if (drv->ops.close) {
-			rtdm_fd_get_light(fd);
-			xnlock_put_irqrestore(&fdtree_lock, s);
+		/* Leave descriptors being released to their closer. */
+		if (drv->ops.close && rtdm_fd_get_light(fd)) {
+			xnlock_put_irqrestore(&fdlist_lock, s);
 			drv->ops.close(fd);
 			rtdm_fd_put(fd);
-			xnlock_get_irqsave(&fdtree_lock, s);
+			xnlock_get_irqsave(&fdlist_lock, s);
 		}
 	}
 
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdlist_lock, s);
 }
 
 /**
@@ -370,10 +454,7 @@ void rtdm_device_flush_fds(struct rtdm_device *dev)
  */
 void rtdm_fd_put(struct rtdm_fd *fd)
 {
-	spl_t s;
-
-	xnlock_get_irqsave(&fdtree_lock, s);
-	__put_fd(fd, s);
+	put_fd(fd);
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_put);
 
@@ -393,15 +474,8 @@ EXPORT_SYMBOL_GPL(rtdm_fd_put);
  */
 int rtdm_fd_lock(struct rtdm_fd *fd)
 {
-	spl_t s;
-
-	xnlock_get_irqsave(&fdtree_lock, s);
-	if (fd->refs == 0) {
-		xnlock_put_irqrestore(&fdtree_lock, s);
+	if (!atomic_inc_not_zero(&fd->refs))
 		return -EIDRM;
-	}
-	++fd->refs;
-	xnlock_put_irqrestore(&fdtree_lock, s);
 
 	return 0;
 }
@@ -419,10 +493,7 @@ EXPORT_SYMBOL_GPL(rtdm_fd_lock);
  */
 void rtdm_fd_unlock(struct rtdm_fd *fd)
 {
-	spl_t s;
-
-	xnlock_get_irqsave(&fdtree_lock, s);
-	__put_fd(fd, s);
+	put_fd(fd);
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_unlock);
 
@@ -658,21 +729,44 @@ static void recvmmsg_timeout_handler(struct xntimer *timer)
 	xnthread_resume(rq->waiter, XNDELAY);
 }
 
+/*
+ * Process a chunk of messages, using the vectored handler if the
+ * driver has one, or the per-message handler for the first entry
+ * otherwise. Return the number of messages processed.
+ */
+static int do_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgv,
+		       unsigned int nr, int flags)
+{
+	ssize_t len;
+
+	if (fd->ops->recvmmsg_rt)
+		return fd->ops->recvmmsg_rt(fd, mmsgv, nr, flags);
+
+	len = fd->ops->recvmsg_rt(fd, &mmsgv->msg_hdr, flags);
+	if (len < 0)
+		return len;
+
+	mmsgv->msg_len = (unsigned int)len;
+
+	return 1;
+}
+
 int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags, void __user *u_timeout,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg),
 		       int (*get_timespec)(struct timespec64 *ts, const void __user *u_ts))
 {
+	struct mmsghdr mmsgv[RTDM_MMSG_BATCH];
+	unsigned int batch, nr;
+	int i, n = 0;
 	struct cobalt_recvmmsg_timer rq;
 	xntmode_t tmode = XN_RELATIVE;
 	struct timespec64 ts = { 0 };
 	int ret = 0, datagrams = 0;
+	void __user *u_rp, *u_wp;
 	xnticks_t timeout = 0;
-	struct mmsghdr mmsg;
 	struct rtdm_fd *fd;
-	void __user *u_p;
-	ssize_t len;
 	spl_t s;
 
 	fd = rtdm_fd_get(ufd, 0);
@@ -715,26 +809,36 @@ int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 	if (fd->oflags & O_NONBLOCK)
 		flags |= MSG_DONTWAIT;
 
-	for (u_p = u_msgvec; vlen > 0; vlen--) {
-		ret = get_mmsg(&mmsg, u_p);
-		if (ret)
+	batch = fd->ops->recvmmsg_rt ? RTDM_MMSG_BATCH : 1;
+
+	for (u_rp = u_wp = u_msgvec; vlen > 0; vlen -= n, u_rp = u_wp) {
+		for (nr = 0; nr < min(vlen, batch); nr++) {
+			ret = get_mmsg(&mmsgv[nr], &u_rp);
+			if (ret)
+				break;
+		}
+		if (nr == 0)
 			break;
-		len = fd->ops->recvmsg_rt(fd, &mmsg.msg_hdr, flags);
-		if (len < 0) {
-			ret = len;
+		n = do_recvmmsg(fd, mmsgv, nr, flags & ~MSG_WAITFORONE);
+		if (n < 0) {
+			ret = n;
 			break;
 		}
-		mmsg.msg_len = (unsigned int)len;
-		ret = put_mmsg(&u_p, &mmsg);
-		if (ret)
-			break;
-		datagrams++;
-		/* OOB data requires immediate handling. */
-		if (mmsg.msg_hdr.msg_flags & MSG_OOB)
+		if (n == 0)	/* No progress, don't spin. */
 			break;
+		for (i = 0; i < n; i++) {
+			ret = put_mmsg(&u_wp, &mmsgv[i]);
+			if (ret)
+				goto done;
+			datagrams++;
+			/* OOB data requires immediate handling. */
+			if (mmsgv[i].msg_hdr.msg_flags & MSG_OOB)
+				goto done;
+		}
 		if (flags & MSG_WAITFORONE)
 			flags |= MSG_DONTWAIT;
 	}
+done:
 
 	if (timeout) {
 		xnlock_get_irqsave(&nklock, s);
@@ -763,7 +867,7 @@ static inline int __rtdm_fetch_timeout64(struct timespec64 *ts,
 int __rtdm_fd_recvmmsg64(int ufd, void __user *u_msgvec, unsigned int vlen,
 			 unsigned int flags, void __user *u_timeout,
 			 int (*get_mmsg)(struct mmsghdr *mmsg,
-					 void __user *u_mmsg),
+					 void __user **u_mmsg_p),
 			 int (*put_mmsg)(void __user **u_mmsg_p,
 					 const struct mmsghdr *mmsg))
 {
@@ -807,16 +911,34 @@ out:
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_sendmsg);
 
+static int do_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgv,
+		       unsigned int nr, int flags)
+{
+	ssize_t len;
+
+	if (fd->ops->sendmmsg_rt)
+		return fd->ops->sendmmsg_rt(fd, mmsgv, nr, flags);
+
+	len = fd->ops->sendmsg_rt(fd, &mmsgv->msg_hdr, flags);
+	if (len < 0)
+		return len;
+
+	mmsgv->msg_len = (unsigned int)len;
+
+	return 1;
+}
+
 int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg))
 {
+	struct mmsghdr mmsgv[RTDM_MMSG_BATCH];
+	unsigned int batch, nr;
+	int i, n = 0;
 	int ret = 0, datagrams = 0;
-	struct mmsghdr mmsg;
+	void __user *u_rp, *u_wp;
 	struct rtdm_fd *fd;
-	void __user *u_p;
-	ssize_t len;
 
 	fd = rtdm_fd_get(ufd, 0);
 	if (IS_ERR(fd)) {
@@ -831,21 +953,31 @@ int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 	if (fd->oflags & O_NONBLOCK)
 		flags |= MSG_DONTWAIT;
 
-	for (u_p = u_msgvec; vlen > 0; vlen--) {
-		ret = get_mmsg(&mmsg, u_p);
-		if (ret)
+	batch = fd->ops->sendmmsg_rt ? RTDM_MMSG_BATCH : 1;
+
+	for (u_rp = u_wp = u_msgvec; vlen > 0; vlen -= n, u_rp = u_wp) {
+		for (nr = 0; nr < min(vlen, batch); nr++) {
+			ret = get_mmsg(&mmsgv[nr], &u_rp);
+			if (ret)
+				break;
+		}
+		if (nr == 0)
 			break;
-		len = fd->ops->sendmsg_rt(fd, &mmsg.msg_hdr, flags);
-		if (len < 0) {
-			ret = len;
+		n = do_sendmmsg(fd, mmsgv, nr, flags);
+		if (n < 0) {
+			ret = n;
 			break;
 		}
-		mmsg.msg_len = (unsigned int)len;
-		ret = put_mmsg(&u_p, &mmsg);
-		if (ret)
+		if (n == 0)	/* No progress, don't spin. */
 			break;
-		datagrams++;
+		for (i = 0; i < n; i++) {
+			ret = put_mmsg(&u_wp, &mmsgv[i]);
+			if (ret)
+				goto done;
+			datagrams++;
+		}
 	}
+done:
 
 	rtdm_fd_put(fd);
 
@@ -858,41 +990,39 @@ out:
 	return ret;
 }
 
-static void
-__fd_close(struct cobalt_ppd *p, struct rtdm_fd_index *idx, spl_t s)
-{
-	xnid_remove(&p->fds, &idx->id);
-	__put_fd(idx->fd, s);
-
-	kfree(idx);
-}
-
 int rtdm_fd_close(int ufd, unsigned int magic)
 {
-	struct rtdm_fd_index *idx;
+	struct rtdm_fd_table *tab;
 	struct cobalt_ppd *ppd;
 	struct rtdm_fd *fd;
-	spl_t s;
 
 	secondary_mode_only();
 
 	ppd = cobalt_ppd_get(0);
 
-	xnlock_get_irqsave(&fdtree_lock, s);
-	idx = fetch_fd_index(ppd, ufd);
-	if (idx == NULL)
+	mutex_lock(&fdtab_mutex);
+
+	tab = ppd->fdtab;
+	if (tab == NULL || ufd < 0 || ufd >= tab->size)
 		goto eadv;
 
-	fd = idx->fd;
-	if (magic != 0 && fd->magic != magic) {
+	fd = tab->fds[ufd];
+	if (fd == NULL || (magic != 0 && fd->magic != magic)) {
 eadv:
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		mutex_unlock(&fdtab_mutex);
 		return -EADV;
 	}
 
 	set_compat_bit(fd);
 
-	trace_cobalt_fd_close(current, fd, ufd, fd->refs);
+	trace_cobalt_fd_close(current, fd, ufd, atomic_read(&fd->refs));
+
+	WRITE_ONCE(tab->fds[ufd], NULL);
+
+	mutex_unlock(&fdtab_mutex);
+
+	/* No lookup may grab a new reference past this point. */
+	synchronize_fd_lookups();
 
 	/*
 	 * In dual kernel mode, the linux-side fdtable and the RTDM
@@ -901,7 +1031,7 @@ eadv:
 	 * descriptor was removed from the fdtable if some refs on
 	 * rtdm_fd are still pending.
 	 */
-	__fd_close(ppd, idx, s);
+	put_fd(fd);
 	close_fd(ufd);
 
 	return 0;
@@ -945,13 +1075,14 @@ out:
 int rtdm_fd_valid_p(int ufd)
 {
 	struct rtdm_fd *fd;
-	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
 	fd = fetch_fd(cobalt_ppd_get(0), ufd);
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	if (fd == NULL)
+		return 0;
+
+	put_fd(fd);
 
-	return fd != NULL;
+	return 1;
 }
 
 /**
@@ -1120,25 +1251,32 @@ int rtdm_fd_put_iovec(struct rtdm_fd *fd, const struct iovec *iov,
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_put_iovec);
 
-static void destroy_fd(void *cookie, struct xnid *id)
-{
-	struct cobalt_ppd *p = cookie;
-	struct rtdm_fd_index *idx;
-	spl_t s;
-
-	idx = container_of(id, struct rtdm_fd_index, id);
-	xnlock_get_irqsave(&fdtree_lock, s);
-	__fd_close(p, idx, 0);
-}
-
 void rtdm_fd_cleanup(struct cobalt_ppd *p)
 {
+	struct rtdm_fd_table *tab;
+	unsigned int n;
+
 	/*
 	 * This is called on behalf of a (userland) task exit handler,
 	 * so we don't have to deal with the regular file descriptors,
 	 * we only have to empty our own index.
 	 */
-	xntree_cleanup(&p->fds, p, destroy_fd);
+	mutex_lock(&fdtab_mutex);
+	tab = p->fdtab;
+	WRITE_ONCE(p->fdtab, NULL);
+	mutex_unlock(&fdtab_mutex);
+
+	if (tab == NULL)
+		return;
+
+	synchronize_fd_lookups();
+
+	for (n = 0; n < tab->size; n++) {
+		if (tab->fds[n])
+			put_fd(tab->fds[n]);
+	}
+
+	kvfree(tab);
 }
 
 void rtdm_fd_init(void)
@@ -49,10 +49,10 @@ int __rtdm_dev_ioctl_core(struct rtdm_fd *fd,
 int __rtdm_mmap_from_fdop(struct rtdm_fd *fd, size_t len, off_t offset,
 			  int prot, int flags, void **pptr);
 
-/* nklock held, irqs off. */
-static inline void rtdm_fd_get_light(struct rtdm_fd *fd)
+/* Fails if the descriptor is being released. */
+static inline bool rtdm_fd_get_light(struct rtdm_fd *fd)
 {
-	++fd->refs;
+	return atomic_inc_not_zero(&fd->refs);
 }
 
 int rtdm_init(void);
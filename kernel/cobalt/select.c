@@ -45,6 +45,16 @@
  * - a @a struct @a xnselector structure, the selection structure,  passed by
  * the thread calling the xnselect service, where this service does all its
  * housekeeping.
+ *
+ * A selector initialized with xnselector_init_edge() keeps its
+ * bindings across calls, and queues each binding on a ready list
+ * when the state of the bound file descriptor turns from not ready
+ * to ready. xnselect_collect() then dequeues the ready bindings
+ * without scanning the whole interest set, so that the cost of a
+ * wake-up does not depend on the number of file descriptors
+ * watched. Readiness is edge-triggered: a collected binding is not
+ * reported again until its file descriptor goes through a not ready
+ * state first.
  * @{
  */
 
@@ -72,6 +82,13 @@ static inline int xnselect_wakeup(struct xnselector *selector)
 	return xnsynch_flush(&selector->synchbase, 0) == XNSYNCH_RESCHED;
 }
 
+static inline void xnselect_enqueue(struct xnselector *selector,
+				    struct xnselect_binding *binding)
+{
+	if ((selector->flags & XNSELECT_EDGE) && list_empty(&binding->rlink))
+		list_add_tail(&binding->rlink, &selector->ready);
+}
+
 /**
  * Bind a file descriptor (represented by its @a xnselect structure) to a
  * selector block.
@@ -100,6 +117,8 @@ static inline int xnselect_wakeup(struct xnselector *selector)
  * locking section.
  *
  * @retval -EINVAL if @a type or @a index is invalid;
+ * @retval -EEXIST if @a selector already watches the file descriptor
+ * at @a index for events of @a type;
  * @retval 0 otherwise.
  *
  * @coretags{task-unrestricted, might-switch, atomic-entry}
@@ -116,16 +135,21 @@ int xnselect_bind(struct xnselect *select_block,
 	if (type >= XNSELECT_MAX_TYPES || index > __FD_SETSIZE)
 		return -EINVAL;
 
+	if (__FD_ISSET__(index, &selector->fds[type].expected))
+		return -EEXIST;
+
 	binding->selector = selector;
 	binding->fd = select_block;
 	binding->type = type;
 	binding->bit_index = index;
 
+	INIT_LIST_HEAD(&binding->rlink);
 	list_add_tail(&binding->slink, &selector->bindings);
 	list_add_tail(&binding->link, &select_block->bindings);
 	__FD_SET__(index, &selector->fds[type].expected);
 	if (state) {
 		__FD_SET__(index, &selector->fds[type].pending);
+		xnselect_enqueue(selector, binding);
 		if (xnselect_wakeup(selector))
 			xnsched_run();
 	} else
@@ -149,12 +173,15 @@ int __xnselect_signal(struct xnselect *select_block, unsigned state)
 					&selector->fds[binding->type].pending)) {
 				__FD_SET__(binding->bit_index,
 					 &selector->fds[binding->type].pending);
+				xnselect_enqueue(selector, binding);
 				if (xnselect_wakeup(selector))
 					resched = 1;
 			}
-		} else
+		} else {
 			__FD_CLR__(binding->bit_index,
 				 &selector->fds[binding->type].pending);
+			list_del_init(&binding->rlink);
+		}
 	}
 
 	return resched;
@@ -164,7 +191,11 @@ EXPORT_SYMBOL_GPL(__xnselect_signal);
 /**
  * Destroy the @a xnselect structure associated with a file descriptor.
  *
- * Any binding with a @a xnselector block is destroyed.
+ * Any binding with a @a xnselector block is destroyed. Plain
+ * selectors are woken up, so that select() reports the file
+ * descriptor, then fails on it. Edge-triggered selectors silently
+ * forget about the file descriptor instead, no event is queued for
+ * it.
  *
  * @param select_block pointer to the @a xnselect structure associated
  * with a file descriptor
@@ -188,7 +219,10 @@ void xnselect_destroy(struct xnselect *select_block)
 		selector = binding->selector;
 		__FD_CLR__(binding->bit_index,
 			 &selector->fds[binding->type].expected);
-		if (!__FD_ISSET__(binding->bit_index,
+		if (selector->flags & XNSELECT_EDGE)
+			__FD_CLR__(binding->bit_index,
+				 &selector->fds[binding->type].pending);
+		else if (!__FD_ISSET__(binding->bit_index,
 				&selector->fds[binding->type].pending)) {
 			__FD_SET__(binding->bit_index,
 				 &selector->fds[binding->type].pending);
@@ -196,6 +230,7 @@ void xnselect_destroy(struct xnselect *select_block)
 				resched = 1;
 		}
 		list_del(&binding->slink);
+		list_del(&binding->rlink);
 		xnlock_put_irqrestore(&nklock, s);
 		xnfree(binding);
 		xnlock_get_irqsave(&nklock, s);
@@ -289,11 +324,152 @@ int xnselector_init(struct xnselector *selector)
 		__FD_ZERO__(&selector->fds[i].pending);
 	}
 	INIT_LIST_HEAD(&selector->bindings);
+	INIT_LIST_HEAD(&selector->ready);
+	selector->flags = 0;
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(xnselector_init);
 
+/**
+ * Initialize an edge-triggered selector structure.
+ *
+ * Same as xnselector_init(), except that bindings turning ready are
+ * queued to the selector, for retrieval by xnselect_collect().
+ *
+ * @param selector The selector structure to be initialized.
+ *
+ * @retval 0
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnselector_init_edge(struct xnselector *selector)
+{
+	xnselector_init(selector);
+	selector->flags = XNSELECT_EDGE;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnselector_init_edge);
+
+/**
+ * Remove a file descriptor from a selector.
+ *
+ * The binding established by xnselect_bind() between @a selector and
+ * the file descriptor at @a index for events of the given @a type is
+ * dropped.
+ *
+ * @param selector the selector structure;
+ *
+ * @param type type of events (@a XNSELECT_READ, @a XNSELECT_WRITE, or @a
+ * XNSELECT_EXCEPT);
+ *
+ * @param index index of the file descriptor in the bit fields used by
+ * the @a selector structure.
+ *
+ * @retval -ENOENT if no such binding exists;
+ * @retval 0 otherwise.
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnselector_unbind(struct xnselector *selector,
+		      unsigned int type, unsigned int index)
+{
+	struct xnselect_binding *binding;
+	spl_t s;
+
+	if (type >= XNSELECT_MAX_TYPES || index >= __FD_SETSIZE)
+		return -ENOENT;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (!__FD_ISSET__(index, &selector->fds[type].expected))
+		goto fail;
+
+	list_for_each_entry(binding, &selector->bindings, slink) {
+		if (binding->type == type && binding->bit_index == index)
+			goto found;
+	}
+fail:
+	xnlock_put_irqrestore(&nklock, s);
+
+	return -ENOENT;
+found:
+	list_del(&binding->slink);
+	list_del(&binding->link);
+	list_del(&binding->rlink);
+	__FD_CLR__(index, &selector->fds[type].expected);
+	__FD_CLR__(index, &selector->fds[type].pending);
+	xnlock_put_irqrestore(&nklock, s);
+
+	xnfree(binding);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnselector_unbind);
+
+/**
+ * Collect the file descriptors which turned ready, wait for one if
+ * there is none.
+ *
+ * Bindings are dequeued from the ready list of an edge-triggered
+ * selector in the order they turned ready, the cost of the operation
+ * is proportional to the number of events returned, not to the number
+ * of file descriptors bound to the selector.
+ *
+ * @param selector the selector structure, which must have been
+ * initialized with xnselector_init_edge();
+ * @param events the array receiving the events collected;
+ * @param maxevents the number of entries available in @a events;
+ * @param timeout the timeout, whose meaning depends on @a timeout_mode,
+ * XN_NONBLOCK in XN_RELATIVE mode prevents waiting;
+ * @param timeout_mode the mode of @a timeout.
+ *
+ * @retval -EINTR if xnselect_collect() was interrupted while waiting;
+ * @retval 0 in case of timeout;
+ * @retval the number of events collected.
+ *
+ * @coretags{primary-only, might-switch}
+ */
+int xnselect_collect(struct xnselector *selector,
+		     struct xnselect_event *events, int maxevents,
+		     xnticks_t timeout, xntmode_t timeout_mode)
+{
+	struct xnselect_binding *binding;
+	int info = 0, n = 0;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	while (list_empty(&selector->ready)) {
+		if (timeout == XN_NONBLOCK && timeout_mode == XN_RELATIVE) {
+			info = XNTIMEO;
+			break;
+		}
+		info = xnsynch_sleep_on(&selector->synchbase,
+					timeout, timeout_mode);
+		if (info & (XNBREAK | XNTIMEO))
+			break;
+	}
+
+	while (n < maxevents && !list_empty(&selector->ready)) {
+		binding = list_first_entry(&selector->ready,
+					   struct xnselect_binding, rlink);
+		list_del_init(&binding->rlink);
+		events[n].type = binding->type;
+		events[n].index = binding->bit_index;
+		n++;
+	}
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (n == 0 && (info & XNBREAK))
+		return -EINTR;
+
+	return n;
+}
+EXPORT_SYMBOL_GPL(xnselect_collect);
+
 /**
  * Check the state of a number of file descriptors, wait for a state change if
  * no descriptor is ready.
@@ -684,28 +684,28 @@ char *xntimer_format_time(xnticks_t ns, char *buf, size_t bufsz)
 }
 EXPORT_SYMBOL_GPL(xntimer_format_time);
 
-#if defined(CONFIG_XENO_OPT_TIMER_RBTREE)
-static inline bool xntimerh_is_lt(xntimerh_t *left, xntimerh_t *right)
+static inline bool xntrbholder_is_lt(struct xntrbholder *left,
+				     struct xntrbholder *right)
 {
 	return left->date < right->date
 		|| (left->date == right->date && left->prio > right->prio);
 }
 
-void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder)
+void xntrbtree_insert(struct xntrbtree *q, struct xntrbholder *holder)
 {
 	struct rb_node **new = &q->root.rb_node, *parent = NULL;
 
 	if (!q->head)
 		q->head = holder;
-	else if (xntimerh_is_lt(holder, q->head)) {
+	else if (xntrbholder_is_lt(holder, q->head)) {
 		parent = &q->head->link;
 		new = &parent->rb_left;
 		q->head = holder;
 	} else while (*new) {
-		xntimerh_t *i = container_of(*new, xntimerh_t, link);
+		struct xntrbholder *i = container_of(*new, struct xntrbholder, link);
 
 		parent = *new;
-		if (xntimerh_is_lt(holder, i))
+		if (xntrbholder_is_lt(holder, i))
 			new = &((*new)->rb_left);
 		else
 			new = &((*new)->rb_right);
@@ -714,6 +714,276 @@ void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder)
 	rb_link_node(&holder->link, parent, new);
 	rb_insert_color(&holder->link, &q->root);
 }
-#endif
+EXPORT_SYMBOL_GPL(xntrbtree_insert);
+
+#define XNTWHEEL_NR_LISTS	(XNTWHEEL_LEVELS * XNTWHEEL_SLOTS + 2)
+
+static inline int xntwheel_shift(int level)
+{
+	return XNTWHEEL_SHIFT + level * XNTWHEEL_BITS;
+}
+
+void xntwheel_init(struct xntwheel *q)
+{
+	int level, slot;
+
+	INIT_LIST_HEAD(&q->near);
+	INIT_LIST_HEAD(&q->far);
+	q->near_end = 0;
+	q->nr_wheel = 0;
+	q->far_min = 0;
+
+	for (level = 0; level < XNTWHEEL_LEVELS; level++) {
+		q->pending[level] = 0;
+		for (slot = 0; slot < XNTWHEEL_SLOTS; slot++)
+			INIT_LIST_HEAD(&q->slots[level][slot]);
+	}
+}
+EXPORT_SYMBOL_GPL(xntwheel_init);
+
+static void xntwheel_insert_near(struct xntwheel *q,
+				 struct xntwholder *holder)
+{
+	struct xntwholder *p;
+
+	holder->level = XNTWHEEL_NEAR;
+
+	/*
+	 * Same ordering as the linear queue: by date, then by
+	 * decreasing priority, FIFO among equals. Scan backwards,
+	 * since cascaded timers are the latest ones.
+	 */
+	list_for_each_entry_reverse(p, &q->near, link) {
+		if (holder->date > p->date ||
+		    (holder->date == p->date && holder->prio <= p->prio))
+			break;
+	}
+
+	list_add(&holder->link, &p->link);
+}
+
+static void xntwheel_hash(struct xntwheel *q, struct xntwholder *holder)
+{
+	unsigned long long date = holder->date;
+	int level, shift, slot;
+
+	for (level = 0; level < XNTWHEEL_LEVELS; level++) {
+		shift = xntwheel_shift(level);
+		if ((date >> shift) - (q->near_end >> shift) < XNTWHEEL_SLOTS) {
+			slot = (date >> shift) & (XNTWHEEL_SLOTS - 1);
+			list_add_tail(&holder->link, &q->slots[level][slot]);
+			q->pending[level] |= 1ULL << slot;
+			holder->level = level;
+			holder->slot = slot;
+			return;
+		}
+	}
+
+	if (list_empty(&q->far) || date < q->far_min)
+		q->far_min = date;
+
+	list_add_tail(&holder->link, &q->far);
+	holder->level = XNTWHEEL_FAR;
+}
+
+void xntwheel_insert(struct xntwheel *q, struct xntwholder *holder)
+{
+	struct xntwholder *h, *tmp;
+	unsigned long long end;
+
+	if (holder->date >= q->near_end) {
+		xntwheel_hash(q, holder);
+		q->nr_wheel++;
+		return;
+	}
+
+	/*
+	 * The near window may have moved far ahead while cascading
+	 * from a sparse queue. Pull it back to the period of the new
+	 * timer, so that the near list never grows beyond a period
+	 * worth of timers. The wheel slots may then start earlier than
+	 * they appear to, which xntwheel_cascade() copes with.
+	 */
+	end = ((holder->date >> XNTWHEEL_SHIFT) + 1) << XNTWHEEL_SHIFT;
+	if (end < q->near_end) {
+		q->near_end = end;
+		list_for_each_entry_safe_reverse(h, tmp, &q->near, link) {
+			if (h->date < end)
+				break;
+			list_del(&h->link);
+			xntwheel_hash(q, h);
+			q->nr_wheel++;
+		}
+	}
+
+	xntwheel_insert_near(q, holder);
+}
+EXPORT_SYMBOL_GPL(xntwheel_insert);
+
+void xntwheel_remove(struct xntwheel *q, struct xntwholder *holder)
+{
+	struct xntwholder *h;
+
+	list_del(&holder->link);
+
+	switch (holder->level) {
+	case XNTWHEEL_NEAR:
+		return;
+	case XNTWHEEL_FAR:
+		if (holder->date == q->far_min) {
+			q->far_min = ULLONG_MAX;
+			list_for_each_entry(h, &q->far, link)
+				if (h->date < q->far_min)
+					q->far_min = h->date;
+		}
+		break;
+	default:
+		if (list_empty(&q->slots[holder->level][holder->slot]))
+			q->pending[holder->level] &= ~(1ULL << holder->slot);
+	}
+
+	q->nr_wheel--;
+}
+EXPORT_SYMBOL_GPL(xntwheel_remove);
+
+/*
+ * Advance the near window until some timers enter the near list,
+ * then return the queue head. Each round looks for the occupied slot
+ * starting the earliest, with ties resolved in favour of the highest
+ * level: a level-0 slot is sorted into the near list, any other slot
+ * (or the far list) is rehashed over the lower levels.
+ *
+ * Once the near window was pulled back by xntwheel_insert(), a slot
+ * may hold timers from a later turn of its wheel, so its start date
+ * is only a lower bound. This is fine for picking the window, but
+ * the timers of a level-0 slot still have to be checked against it.
+ */
+struct xntwholder *xntwheel_cascade(struct xntwheel *q)
+{
+	unsigned long long ne, cur, lb, best_lb = 0;
+	int level, shift, slot, best;
+	struct xntwholder *h, *tmp;
+	u64 pending;
+	bool moved;
+	LIST_HEAD(privq);
+
+	while (q->nr_wheel > 0) {
+		ne = q->near_end;
+		best = -1;
+
+		if (!list_empty(&q->far)) {
+			lb = (q->far_min >> XNTWHEEL_SHIFT) << XNTWHEEL_SHIFT;
+			best_lb = max(lb, ne);
+			best = XNTWHEEL_LEVELS;
+		}
+
+		for (level = XNTWHEEL_LEVELS - 1; level >= 0; level--) {
+			pending = q->pending[level];
+			if (pending == 0)
+				continue;
+			shift = xntwheel_shift(level);
+			cur = ne >> shift;
+			slot = cur & (XNTWHEEL_SLOTS - 1);
+			pending = slot ? ror64(pending, slot) : pending;
+			lb = (cur + __ffs64(pending)) << shift;
+			lb = max(lb, ne);
+			if (best < 0 || lb < best_lb) {
+				best = level;
+				best_lb = lb;
+			}
+		}
+
+		if (best == XNTWHEEL_LEVELS)
+			list_splice_init(&q->far, &privq);
+		else {
+			shift = xntwheel_shift(best);
+			slot = (best_lb >> shift) & (XNTWHEEL_SLOTS - 1);
+			list_splice_init(&q->slots[best][slot], &privq);
+			q->pending[best] &= ~(1ULL << slot);
+		}
+
+		if (best == 0) {
+			q->near_end = ((best_lb >> XNTWHEEL_SHIFT) + 1)
+				<< XNTWHEEL_SHIFT;
+			moved = false;
+			list_for_each_entry_safe(h, tmp, &privq, link) {
+				list_del(&h->link);
+				if (h->date >= q->near_end)
+					xntwheel_hash(q, h);
+				else {
+					xntwheel_insert_near(q, h);
+					q->nr_wheel--;
+					moved = true;
+				}
+			}
+			if (moved)
+				break;
+			continue;
+		}
+
+		/* Nothing may be due before best_lb. */
+		q->near_end = best_lb;
+		list_for_each_entry_safe(h, tmp, &privq, link) {
+			list_del(&h->link);
+			xntwheel_hash(q, h);
+		}
+	}
+
+	if (list_empty(&q->near))
+		return NULL;
+
+	return list_first_entry(&q->near, struct xntwholder, link);
+}
+EXPORT_SYMBOL_GPL(xntwheel_cascade);
+
+static struct list_head *xntwheel_list(struct xntwheel *q, int pos)
+{
+	if (pos == 0)
+		return &q->near;
+
+	if (pos == XNTWHEEL_NR_LISTS - 1)
+		return &q->far;
+
+	pos--;
+
+	return &q->slots[pos / XNTWHEEL_SLOTS][pos % XNTWHEEL_SLOTS];
+}
+
+static struct xntwholder *xntwheel_it_first(struct xntwheel *q,
+					    struct xntwheel_it *it)
+{
+	struct list_head *l;
+
+	for (; it->pos < XNTWHEEL_NR_LISTS; it->pos++) {
+		l = xntwheel_list(q, it->pos);
+		if (!list_empty(l))
+			return list_first_entry(l, struct xntwholder, link);
+	}
+
+	return NULL;
+}
+
+/* Iterate over all outstanding timers, in no particular order. */
+struct xntwholder *xntwheel_it_begin(struct xntwheel *q,
+				     struct xntwheel_it *it)
+{
+	it->pos = 0;
+
+	return xntwheel_it_first(q, it);
+}
+EXPORT_SYMBOL_GPL(xntwheel_it_begin);
+
+struct xntwholder *xntwheel_it_next(struct xntwheel *q,
+				    struct xntwheel_it *it,
+				    struct xntwholder *h)
+{
+	if (!list_is_last(&h->link, xntwheel_list(q, it->pos)))
+		return list_next_entry(h, link);
+
+	it->pos++;
+
+	return xntwheel_it_first(q, it);
+}
+EXPORT_SYMBOL_GPL(xntwheel_it_next);
 
 /** @} */
@@ -30,6 +30,7 @@
 #ifdef __KERNEL__
 
 #include <asm/atomic.h>
+#include <linux/hash.h>
 #include <linux/mutex.h>
 #include <linux/netdevice.h>
 
@@ -43,6 +44,11 @@
  * for reception at the same time using Bind */
 #define RTCAN_MAX_RECEIVERS  CONFIG_XENO_DRIVERS_CAN_MAX_RECEIVERS
 
+/* Number of hash buckets indexing the exact-match filters of a
+ * controller by CAN ID */
+#define RTCAN_RECV_HASH_BITS 6
+#define RTCAN_RECV_HASH_SIZE (1 << RTCAN_RECV_HASH_BITS)
+
 /* Suppress handling of refcount if module support is not enabled
  * or modules cannot be unloaded */
 
@@ -151,6 +157,15 @@ struct rtcan_device {
      * locality all list elements are kept in this array. */
     struct rtcan_recv               receivers[RTCAN_MAX_RECEIVERS];
 
+    /* Index over the reception list. Filters comparing all 29 resp.
+     * all 11 identifier bits are hashed by identifier, any other
+     * (masked or inverted) filter is kept on the residual list. The
+     * chains are linked via index_next and protected by
+     * rtcan_recv_list_lock like the reception list. */
+    struct rtcan_recv               *recv_eff_hash[RTCAN_RECV_HASH_SIZE];
+    struct rtcan_recv               *recv_sff_hash[RTCAN_RECV_HASH_SIZE];
+    struct rtcan_recv               *recv_residual;
+
     /* Indicates the length of the empty list */
     int                             free_entries;
 
@@ -183,6 +198,11 @@ void rtcan_dev_alloc_name (struct rtcan_device *dev, const char *name_mask);
 struct rtcan_device *rtcan_dev_get_by_name(const char *if_name);
 struct rtcan_device *rtcan_dev_get_by_index(int ifindex);
 
+static inline unsigned int rtcan_recv_hash(uint32_t can_id)
+{
+    return hash_32(can_id, RTCAN_RECV_HASH_BITS);
+}
+
 #ifdef RTCAN_USE_REFCOUNT
 #define rtcan_dev_reference(dev)      atomic_inc(&(dev)->refcount)
 #define rtcan_dev_dereference(dev)    atomic_dec(&(dev)->refcount)
@@ -43,6 +43,10 @@ struct rtcan_recv {
 					     */
     struct rtcan_recv       *next;          /* pointer to next list element
 					     */
+    struct rtcan_recv       *index_next;    /* pointer to next element in
+					     *   the same index chain */
+    struct rtcan_recv       **index_head;   /* head of the index chain this
+					     *   element is linked to */
 };
 
 
@@ -37,6 +37,8 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/stringify.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 
 #include <rtdm/driver.h>
 
@@ -76,6 +78,44 @@ static inline int rtcan_accept_msg(uint32_t can_id, can_filter_t *filter)
 }
 
 
+static void rtcan_rcv_deliver_ring(struct rtcan_socket *sock,
+				   struct rtcan_rx_ring *ring,
+				   struct rtcan_skb *skb)
+{
+    struct rtcan_rb_frame *frame = &skb->rb_frame;
+    struct can_ring_header *hdr = ring->hdr;
+    struct can_ring_frame *slot;
+    uint32_t head = ring->head;
+
+    /* The tail index is user-controlled, so it only tells whether
+     * there is room left. */
+    if (head - READ_ONCE(hdr->tail) >= ring->nr_frames) {
+	hdr->drops++;
+	sock->rx_buf_full++;
+	return;
+    }
+
+    slot = &ring->frames[head & (ring->nr_frames - 1)];
+    memcpy(&slot->timestamp, (void *)frame + skb->rb_frame_size,
+	   RTCAN_TIMESTAMP_SIZE);
+    slot->ifindex = frame->can_ifindex;
+    slot->frame.can_id = frame->can_id;
+    slot->frame.can_dlc = frame->can_dlc & RTCAN_HAS_NO_TIMESTAMP;
+    memcpy(slot->frame.data, frame->data,
+	   skb->rb_frame_size - EMPTY_RB_FRAME_SIZE);
+
+    /* Publish the frame, then wake up the reader if it had consumed
+     * everything before, pairing with the barrier it issues between
+     * updating the tail index and reading the head index again. */
+    ring->head = ++head;
+    smp_wmb();
+    WRITE_ONCE(hdr->head, head);
+    smp_mb();
+    if (READ_ONCE(hdr->tail) == head - 1)
+	rtdm_sem_up(&sock->recv_sem);
+}
+
+
 static void rtcan_rcv_deliver(struct rtcan_recv *recv_listener,
 			      struct rtcan_skb *skb)
 {
@@ -90,6 +130,12 @@ static void rtcan_rcv_deliver(struct rtcan_recv *recv_listener,
 
     sock = recv_listener->sock;
 
+    if (sock->rx_ring) {
+	rtcan_rcv_deliver_ring(sock, sock->rx_ring, skb);
+	rtdm_fd_unlock(fd);
+	return;
+    }
+
     cpy_size = skb->rb_frame_size;
     /* Check if socket wants to receive a timestamp */
     if (test_bit(RTCAN_GET_TIMESTAMP, &sock->flags)) {
@@ -136,6 +182,42 @@ static void rtcan_rcv_deliver(struct rtcan_recv *recv_listener,
 }
 
 
+static inline void rtcan_rcv_chain(struct rtcan_recv *recv_listener,
+				   struct rtcan_skb *skb,
+				   struct rtcan_socket *tx_socket)
+{
+    uint32_t can_id = skb->rb_frame.can_id;
+
+    while (recv_listener != NULL) {
+	if ((recv_listener->sock != tx_socket) &&
+	    rtcan_accept_msg(can_id, &recv_listener->can_filter)) {
+	    recv_listener->match_count++;
+	    rtcan_rcv_deliver(recv_listener, skb);
+	}
+	recv_listener = recv_listener->index_next;
+    }
+}
+
+
+/* Deliver a frame to all listeners whose filter accepts it except
+ * tx_socket. Only the buckets a matching exact filter may be hashed
+ * to are searched, followed by the residual list. */
+static void rtcan_rcv_filtered(struct rtcan_device *dev,
+			       struct rtcan_skb *skb,
+			       struct rtcan_socket *tx_socket)
+{
+    uint32_t can_id = skb->rb_frame.can_id;
+
+    rtcan_rcv_chain(dev->recv_sff_hash[rtcan_recv_hash(can_id &
+						       CAN_SFF_MASK)],
+		    skb, tx_socket);
+    rtcan_rcv_chain(dev->recv_eff_hash[rtcan_recv_hash(can_id &
+						       CAN_EFF_MASK)],
+		    skb, tx_socket);
+    rtcan_rcv_chain(dev->recv_residual, skb, tx_socket);
+}
+
+
 void rtcan_rcv(struct rtcan_device *dev, struct rtcan_skb *skb)
 {
     nanosecs_abs_t timestamp = rtdm_clock_read();
@@ -158,13 +240,7 @@ void rtcan_rcv(struct rtcan_device *dev, struct rtcan_skb *skb)
 	}
     } else {
 	dev->rx_count++;
-	while (recv_listener != NULL) {
-	    if (rtcan_accept_msg(frame->can_id, &recv_listener->can_filter)) {
-		recv_listener->match_count++;
-		rtcan_rcv_deliver(recv_listener, skb);
-	    }
-	    recv_listener = recv_listener->next;
-	}
+	rtcan_rcv_filtered(dev, skb, NULL);
     }
 }
 
@@ -192,22 +268,12 @@ void rtcan_tx_push(struct rtcan_device *dev, struct rtcan_socket *sock,
 void rtcan_loopback(struct rtcan_device *dev)
 {
     nanosecs_abs_t timestamp = rtdm_clock_read();
-    /* Entry in reception list, begin with head */
-    struct rtcan_recv *recv_listener = dev->recv_list;
-    struct rtcan_rb_frame *frame = &dev->tx_skb.rb_frame;
 
     memcpy((void *)&dev->tx_skb.rb_frame + dev->tx_skb.rb_frame_size,
 	   &timestamp, RTCAN_TIMESTAMP_SIZE);
 
-    while (recv_listener != NULL) {
-	dev->rx_count++;
-	if ((dev->tx_socket != recv_listener->sock) &&
-	    rtcan_accept_msg(frame->can_id, &recv_listener->can_filter)) {
-	    recv_listener->match_count++;
-	    rtcan_rcv_deliver(recv_listener, &dev->tx_skb);
-	}
-	recv_listener = recv_listener->next;
-    }
+    dev->rx_count++;
+    rtcan_rcv_filtered(dev, &dev->tx_skb, dev->tx_socket);
     dev->tx_socket = NULL;
 }
 
@@ -398,6 +464,47 @@ static int rtcan_raw_setsockopt(struct rtdm_fd *fd,
 #endif
 	break;
 
+    case CAN_RAW_RX_RING: {
+	struct rtcan_rx_ring *ring;
+	unsigned int nr_frames;
+
+	if (so->optlen != sizeof(unsigned int))
+	    return -EINVAL;
+
+	if (rtdm_fd_is_user(fd)) {
+	    if (!rtdm_read_user_ok(fd, so->optval, so->optlen) ||
+		rtdm_copy_from_user(fd, &nr_frames, so->optval, so->optlen))
+		return -EFAULT;
+	} else
+	    memcpy(&nr_frames, so->optval, so->optlen);
+
+	if (nr_frames == 0 || nr_frames > CAN_RING_MAX_FRAMES ||
+	    !is_power_of_2(nr_frames))
+	    return -EINVAL;
+
+	if (sock->rx_ring)
+	    return -EBUSY;
+
+	ring = rtcan_rx_ring_alloc(nr_frames);
+	if (ring == NULL)
+	    return -ENOMEM;
+
+	/* Frames still pending in the socket buffer are dropped, the
+	 * receive semaphore only counts wakeups from now on. */
+	rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+	if (sock->rx_ring == NULL) {
+	    sock->recv_head = sock->recv_tail;
+	    sock->rx_ring = ring;
+	    ring = NULL;
+	} else
+	    ret = -EBUSY;
+	rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+
+	if (ring)
+	    rtcan_rx_ring_put(ring);
+	break;
+    }
+
     default:
 	ret = -ENOPROTOOPT;
     }
@@ -523,6 +630,47 @@ do {									\
 	recv_buf_index = (recv_buf_index + len) & (RTCAN_RXBUF_SIZE - 1); \
 } while (0)
 
+/*
+ * Receiving in ring mode: wait for the ring to have contents, without
+ * copying anything. Wakeups posted so far are consumed first, so that
+ * select/poll only reports the socket readable again after the
+ * reader found the ring empty.
+ */
+static ssize_t rtcan_raw_recv_ring(struct rtcan_socket *sock,
+				   struct rtcan_rx_ring *ring, int flags)
+{
+    struct can_ring_header *hdr = ring->hdr;
+    nanosecs_rel_t timeout;
+    uint32_t avail;
+    int ret;
+
+    if (flags & ~MSG_DONTWAIT)
+	return -EINVAL;
+
+    rtcan_raw_enable_bus_err(sock);
+
+    timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sock->rx_timeout;
+
+    for (;;) {
+	while (rtdm_sem_timeddown(&sock->recv_sem,
+				  RTDM_TIMEOUT_NONE, NULL) == 0)
+	    ;
+
+	smp_mb();
+	avail = READ_ONCE(ring->head) - READ_ONCE(hdr->tail);
+	if (avail)
+	    return min(avail, ring->nr_frames);
+
+	ret = rtdm_sem_timeddown(&sock->recv_sem, timeout, NULL);
+	if (ret == -EIDRM)
+	    return -EBADF;
+	if (ret == -EWOULDBLOCK)
+	    return -EAGAIN;
+	if (ret)
+	    return ret;
+    }
+}
+
 ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd,
 			  struct user_msghdr *msg, int flags)
 {
@@ -545,6 +693,9 @@ ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd,
     /* Clear frame memory location */
     memset(&frame, 0, sizeof(can_frame_t));
 
+    if (sock->rx_ring)
+	return rtcan_raw_recv_ring(sock, sock->rx_ring, flags);
+
     /* Check flags */
     if (flags & ~(MSG_DONTWAIT | MSG_PEEK))
 	return -EINVAL;
@@ -973,6 +1124,61 @@ finally:
     return ret;
 }
 
+static int rtcan_raw_select(struct rtdm_fd *fd, struct xnselector *selector,
+			    unsigned int type, unsigned int fd_index)
+{
+    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
+
+    switch (type) {
+    case XNSELECT_READ:
+	return rtdm_sem_select(&sock->recv_sem, selector,
+			       XNSELECT_READ, fd_index);
+    default:
+	return -EBADF;
+    }
+}
+
+
+static void rtcan_rx_ring_vmopen(struct vm_area_struct *vma)
+{
+    rtcan_rx_ring_get(vma->vm_private_data);
+}
+
+static void rtcan_rx_ring_vmclose(struct vm_area_struct *vma)
+{
+    rtcan_rx_ring_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct rtcan_rx_ring_vmops = {
+    .open = rtcan_rx_ring_vmopen,
+    .close = rtcan_rx_ring_vmclose,
+};
+
+static int rtcan_raw_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
+    struct rtcan_rx_ring *ring = sock->rx_ring;
+    int ret;
+
+    if (ring == NULL)
+	return -ENXIO;
+
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > ring->memsz)
+	return -EINVAL;
+
+    ret = rtdm_mmap_vmem(vma, ring->hdr);
+    if (ret)
+	return ret;
+
+    /* The mapping holds a reference on the ring. */
+    rtcan_rx_ring_get(ring);
+    vma->vm_ops = &rtcan_rx_ring_vmops;
+    vma->vm_private_data = ring;
+
+    return 0;
+}
+
+
 static struct rtdm_driver rtcan_driver = {
 	.profile_info		= RTDM_PROFILE_INFO(rtcan,
 						    RTDM_CLASS_CAN,
@@ -989,6 +1195,8 @@ static struct rtdm_driver rtcan_driver = {
 		.ioctl_nrt	= rtcan_raw_ioctl,
 		.recvmsg_rt	= rtcan_raw_recvmsg,
 		.sendmsg_rt	= rtcan_raw_sendmsg,
+		.select		= rtcan_raw_select,
+		.mmap		= rtcan_raw_mmap,
 	},
 };
 
@@ -42,8 +42,8 @@ void rtcan_raw_print_filter(struct rtcan_device *dev)
     rtdm_printk("%s: recv_list=%p empty_list=%p free_entries=%d\n",
 		dev->name, dev->recv_list, dev->empty_list, dev->free_entries);
     for (i = 0; i < RTCAN_MAX_RECEIVERS; i++, r++) {
-	rtdm_printk("%2d %p sock=%p next=%p id=%x mask=%x\n",
-		    i, r, r->sock, r->next,
+	rtdm_printk("%2d %p sock=%p next=%p index_next=%p id=%x mask=%x\n",
+		    i, r, r->sock, r->next, r->index_next,
 		    r->can_filter.can_id, r->can_filter.can_mask);
     }
 }
@@ -68,6 +68,50 @@ static inline void rtcan_raw_mount_filter(can_filter_t *recv_filter,
 }
 
 
+/* Returns the index chain a mounted filter belongs to. A filter can
+ * only match frames whose identifier bits it compares, so an exact
+ * filter is only looked up in the bucket hashed from these bits. */
+static struct rtcan_recv **rtcan_raw_index_head(struct rtcan_device *dev,
+						 can_filter_t *filter)
+{
+    uint32_t mask = filter->can_mask;
+
+    if ((mask & CAN_INV_FILTER))
+	return &dev->recv_residual;
+
+    if ((mask & CAN_EFF_MASK) == CAN_EFF_MASK)
+	return &dev->recv_eff_hash[rtcan_recv_hash(filter->can_id &
+						   CAN_EFF_MASK)];
+
+    if ((mask & CAN_SFF_MASK) == CAN_SFF_MASK)
+	return &dev->recv_sff_hash[rtcan_recv_hash(filter->can_id &
+						   CAN_SFF_MASK)];
+
+    return &dev->recv_residual;
+}
+
+
+static inline void rtcan_raw_index_filter(struct rtcan_device *dev,
+					  struct rtcan_recv *recv)
+{
+    struct rtcan_recv **head = rtcan_raw_index_head(dev, &recv->can_filter);
+
+    recv->index_head = head;
+    recv->index_next = *head;
+    *head = recv;
+}
+
+
+static inline void rtcan_raw_unindex_filter(struct rtcan_recv *recv)
+{
+    struct rtcan_recv **pos = recv->index_head;
+
+    while (*pos != recv)
+	pos = &(*pos)->index_next;
+    *pos = recv->index_next;
+}
+
+
 int rtcan_raw_check_filter(struct rtcan_socket *sock, int ifindex,
 			   struct rtcan_filter_list *flist)
 {
@@ -162,6 +206,7 @@ int rtcan_raw_add_filter(struct rtcan_socket *sock, int ifindex)
 				   &sock->flist->flist[0]);
 	    last->match_count = 0;
 	    last->sock = sock;
+	    rtcan_raw_index_filter(dev, last);
 	    for (j = 1; j < flistlen; j++) {
 		/* Register remaining filters */
 		last = last->next;
@@ -169,6 +214,7 @@ int rtcan_raw_add_filter(struct rtcan_socket *sock, int ifindex)
 				       &sock->flist->flist[j]);
 		last->sock = sock;
 		last->match_count = 0;
+		rtcan_raw_index_filter(dev, last);
 	    }
 	    /* Decrease free entries counter by length of filter list */
 	    dev->free_entries -= flistlen;
@@ -179,6 +225,7 @@ int rtcan_raw_add_filter(struct rtcan_socket *sock, int ifindex)
 	    last->can_filter.can_id = last->can_filter.can_mask = 0;
 	    last->sock = sock;
 	    last->match_count = 0;
+	    rtcan_raw_index_filter(dev, last);
 	    /* Decrease free entries counter by 1
 	     * (one filter for all CAN frames) */
 	    dev->free_entries--;
@@ -232,10 +279,14 @@ void rtcan_raw_remove_filter(struct rtcan_socket *sock)
 	    next = first->next;
 	}
 
-	/* Now go to the end of the old filter list */
+	/* Now go to the end of the old filter list, dropping each
+	 * entry from the index */
 	last = next;
-	for (j = 1; j < sock->flistlen; j++)
+	rtcan_raw_unindex_filter(last);
+	for (j = 1; j < sock->flistlen; j++) {
 	    last = last->next;
+	    rtcan_raw_unindex_filter(last);
+	}
 
 	/* Detach found first list entry from reception list */
 	if (first)
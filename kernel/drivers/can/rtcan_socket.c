@@ -28,6 +28,10 @@
  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
 #include "rtcan_socket.h"
 #include "rtcan_list.h"
 
@@ -49,6 +53,7 @@ void rtcan_socket_init(struct rtdm_fd *fd)
     sock->flist = NULL;
     sock->err_mask = 0;
     sock->rx_buf_full = 0;
+    sock->rx_ring = NULL;
     sock->flags = 0;
 #ifdef CONFIG_XENO_DRIVERS_CAN_LOOPBACK
     sock->loopback = 1;
@@ -102,4 +107,46 @@ void rtcan_socket_cleanup(struct rtdm_fd *fd)
 	sock->socket_list.next = NULL;
     }
     rtdm_lock_put_irqrestore(&rtcan_recv_list_lock, lock_ctx);
+
+    /* The socket is unbound, no more frames can be stored. */
+    if (sock->rx_ring) {
+	rtcan_rx_ring_put(sock->rx_ring);
+	sock->rx_ring = NULL;
+    }
+}
+
+
+struct rtcan_rx_ring *rtcan_rx_ring_alloc(unsigned int nr_frames)
+{
+    struct rtcan_rx_ring *ring;
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (ring == NULL)
+	return NULL;
+
+    ring->memsz = PAGE_SIZE +
+	PAGE_ALIGN(nr_frames * sizeof(struct can_ring_frame));
+    ring->hdr = vmalloc(ring->memsz);
+    if (ring->hdr == NULL) {
+	kfree(ring);
+	return NULL;
+    }
+
+    memset(ring->hdr, 0, ring->memsz);
+    ring->hdr->nr_frames = nr_frames;
+    ring->hdr->data_offset = PAGE_SIZE;
+    ring->frames = (void *)ring->hdr + PAGE_SIZE;
+    ring->nr_frames = nr_frames;
+    atomic_set(&ring->refs, 1);
+
+    return ring;
+}
+
+
+void rtcan_rx_ring_put(struct rtcan_rx_ring *ring)
+{
+    if (atomic_dec_and_test(&ring->refs)) {
+	vfree(ring->hdr);
+	kfree(ring);
+    }
 }
@@ -117,6 +117,21 @@ struct rtcan_filter_list {
     struct can_filter flist[1];
 };
 
+/*
+ * Receive ring of a socket in ring mode (CAN_RAW_RX_RING). The memory
+ * starting at hdr is shared with user space, so only the tail index is
+ * taken from there, and checked against the kernel copy of the head
+ * index. The ring is refcounted by the socket and each mapping of it.
+ */
+struct rtcan_rx_ring {
+    struct can_ring_header *hdr;
+    struct can_ring_frame  *frames;
+    unsigned int        nr_frames;
+    uint32_t            head;
+    size_t              memsz;
+    atomic_t            refs;
+};
+
 /*
  * Internal CAN socket structure.
  *
@@ -177,6 +192,10 @@ struct rtcan_socket {
 
     struct rtcan_filter_list *flist;
 
+    /* Receive ring replacing recv_buf in ring mode, never changes once
+     * set. Protected by rtcan_socket_lock in all socket structures. */
+    struct rtcan_rx_ring *rx_ring;
+
 #ifdef CONFIG_XENO_DRIVERS_CAN_LOOPBACK
     int loopback;
 #endif
@@ -206,5 +225,13 @@ extern struct list_head rtcan_socket_list;
 extern void rtcan_socket_init(struct rtdm_fd *fd);
 extern void rtcan_socket_cleanup(struct rtdm_fd *fd);
 
+extern struct rtcan_rx_ring *rtcan_rx_ring_alloc(unsigned int nr_frames);
+extern void rtcan_rx_ring_put(struct rtcan_rx_ring *ring);
+
+static inline void rtcan_rx_ring_get(struct rtcan_rx_ring *ring)
+{
+    atomic_inc(&ring->refs);
+}
+
 
 #endif  /* __RTCAN_SOCKET_H_ */
@@ -49,6 +49,23 @@ struct bufp_socket {
 	off_t wrrsvd;
 	int wrsem;
 	size_t fillsz;
+	/*
+	 * Broadcast mode: total count of bytes reserved and committed
+	 * by writers since binding, offset matching the latter.
+	 */
+	u64 wrhead;
+	u64 wrseq;
+	off_t wrcmoff;
+	/* Readers sharing our buffer in broadcast mode. */
+	struct list_head readers;
+	/*
+	 * Reader side: the broadcast buffer we are attached to, our
+	 * cursor into it and the count of overruns we suffered.
+	 */
+	struct bufp_socket *bcast;
+	struct list_head rdlink;
+	u64 rdseq;
+	unsigned int overruns;
 	rtdm_event_t i_event;
 	rtdm_event_t o_event;
 
@@ -71,9 +88,17 @@ static struct sockaddr_ipc nullsa = {
 
 static struct xnmap *portmap;
 
+/*
+ * Internal flag deferring the wakeup of the threads waiting on the
+ * other end of the buffer, so that a batch of messages triggers a
+ * single notification.
+ */
+#define BUFP_DEFER_WAKEUP  MSG_MORE
+
 #define _BUFP_BINDING   0
 #define _BUFP_BOUND     1
 #define _BUFP_CONNECTED 2
+#define _BUFP_BROADCAST 3
 
 #ifdef CONFIG_XENO_OPT_VFILE
 
@@ -122,6 +147,13 @@ static int bufp_socket(struct rtdm_fd *fd)
 	sk->wrrsvd = 0;
 	sk->rdsem = 0;
 	sk->wrsem = 0;
+	sk->wrhead = 0;
+	sk->wrseq = 0;
+	sk->wrcmoff = 0;
+	INIT_LIST_HEAD(&sk->readers);
+	sk->bcast = NULL;
+	sk->rdseq = 0;
+	sk->overruns = 0;
 	sk->status = 0;
 	sk->handle = 0;
 	sk->rx_timeout = RTDM_TIMEOUT_INFINITE;
@@ -134,19 +166,49 @@ static int bufp_socket(struct rtdm_fd *fd)
 	return 0;
 }
 
+static void __bufp_detach_reader(struct bufp_socket *sk) /* nklock held */
+{
+	if (sk->bcast) {
+		list_del(&sk->rdlink);
+		sk->bcast = NULL;
+	}
+}
+
+/*
+ * Attach a reader to a broadcast buffer. The reader only gets the
+ * data written from now on.
+ */
+static void __bufp_attach_reader(struct bufp_socket *sk,
+				 struct bufp_socket *rsk) /* nklock held */
+{
+	__bufp_detach_reader(sk);
+	list_add_tail(&sk->rdlink, &rsk->readers);
+	sk->bcast = rsk;
+	sk->rdseq = rsk->wrseq;
+	sk->rdoff = rsk->wrcmoff;
+}
+
 static void bufp_close(struct rtdm_fd *fd)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct bufp_socket *sk = priv->state;
+	struct bufp_socket *sk = priv->state, *reader, *tmp;
 	rtdm_lockctx_t s;
 
 	rtdm_event_destroy(&sk->i_event);
 	rtdm_event_destroy(&sk->o_event);
 
+	cobalt_atomic_enter(s);
+	__bufp_detach_reader(sk);
+	cobalt_atomic_leave(s);
+
 	if (test_bit(_BUFP_BOUND, &sk->status)) {
 		if (sk->name.sipc_port > -1) {
 			cobalt_atomic_enter(s);
 			xnmap_remove(portmap, sk->name.sipc_port);
+			/* Readers find out on their next read. */
+			list_for_each_entry_safe(reader, tmp,
+						 &sk->readers, rdlink)
+				__bufp_detach_reader(reader);
 			cobalt_atomic_leave(s);
 		}
 
@@ -160,13 +222,66 @@ static void bufp_close(struct rtdm_fd *fd)
 	kfree(sk);
 }
 
+/*
+ * Wake up all threads pending on the output wait queue, if there is
+ * enough room for the leading one to post its message.
+ */
+static int __bufp_notify_output(struct bufp_socket *sk) /* nklock held */
+{
+	struct bufp_wait_context *bufwc;
+	struct rtipc_wait_context *wc;
+	struct xnthread *waiter;
+
+	waiter = rtipc_peek_wait_head(&sk->o_event);
+	if (waiter == NULL)
+		return 0;
+
+	wc = rtipc_get_wait_context(waiter);
+	XENO_BUG_ON(COBALT, wc == NULL);
+	bufwc = container_of(wc, struct bufp_wait_context, wc);
+	if (bufwc->len + sk->fillsz > sk->bufsz)
+		return 0;
+
+	/* This call rescheds internally. */
+	rtdm_event_pulse(&sk->o_event);
+
+	return 1;
+}
+
+/*
+ * Wake up all threads pending on the input wait queue, if we
+ * accumulated enough data to feed the leading one.
+ */
+static int __bufp_notify_input(struct bufp_socket *sk) /* nklock held */
+{
+	struct bufp_wait_context *bufwc;
+	struct rtipc_wait_context *wc;
+	struct xnthread *waiter;
+
+	waiter = rtipc_peek_wait_head(&sk->i_event);
+	if (waiter == NULL)
+		return 0;
+
+	/* Broadcast readers all wait on distinct cursors. */
+	if (test_bit(_BUFP_BROADCAST, &sk->status))
+		goto pulse;
+
+	wc = rtipc_get_wait_context(waiter);
+	XENO_BUG_ON(COBALT, wc == NULL);
+	bufwc = container_of(wc, struct bufp_wait_context, wc);
+	if (bufwc->len > sk->fillsz)
+		return 0;
+pulse:
+	rtdm_event_pulse(&sk->i_event);
+
+	return 1;
+}
+
 static ssize_t __bufp_readbuf(struct bufp_socket *sk,
 			      struct xnbufd *bufd,
 			      int flags)
 {
-	struct bufp_wait_context wait, *bufwc;
-	struct rtipc_wait_context *wc;
-	struct xnthread *waiter;
+	struct bufp_wait_context wait;
 	size_t rbytes, n, avail;
 	ssize_t len, ret, xret;
 	rtdm_toseq_t toseq;
@@ -232,22 +347,8 @@ redo:
 		if (sk->fillsz == 0) /* -> becomes non-readable */
 			resched |= xnselect_signal(&sk->priv->recv_block, 0);
 
-		/*
-		 * Wake up all threads pending on the output wait
-		 * queue, if we freed enough room for the leading one
-		 * to post its message.
-		 */
-		waiter = rtipc_peek_wait_head(&sk->o_event);
-		if (waiter == NULL)
-			goto out;
-
-		wc = rtipc_get_wait_context(waiter);
-		XENO_BUG_ON(COBALT, wc == NULL);
-		bufwc = container_of(wc, struct bufp_wait_context, wc);
-		if (bufwc->len + sk->fillsz <= sk->bufsz)
-			/* This call rescheds internally. */
-			rtdm_event_pulse(&sk->o_event);
-		else if (resched)
+		if (!(flags & BUFP_DEFER_WAKEUP) &&
+		    !__bufp_notify_output(sk) && resched)
 			xnsched_run();
 		/*
 		 * We cannot fail anymore once some data has been
@@ -274,6 +375,10 @@ redo:
 			goto redo;
 		}
 
+		/* Don't let writers wait for the room we freed. */
+		if (flags & BUFP_DEFER_WAKEUP)
+			__bufp_notify_output(sk);
+
 		wait.len = len;
 		wait.sk = sk;
 		rtipc_prepare_wait(&wait.wc);
@@ -292,29 +397,179 @@ out:
 	return ret;
 }
 
+static struct bufp_socket *__bufp_lock_dest(int port,
+					    struct rtdm_fd **rfdp)
+{
+	struct bufp_socket *rsk;
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+
+	cobalt_atomic_enter(s);
+	rfd = xnmap_fetch_nocheck(portmap, port);
+	if (rfd && rtdm_fd_lock(rfd) < 0)
+		rfd = NULL;
+	cobalt_atomic_leave(s);
+	if (rfd == NULL)
+		return ERR_PTR(-ECONNRESET);
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_BUFP_BOUND, &rsk->status)) {
+		rtdm_fd_unlock(rfd);
+		return ERR_PTR(-ECONNREFUSED);
+	}
+
+	*rfdp = rfd;
+
+	return rsk;
+}
+
+static ssize_t __bufp_readbcast(struct bufp_socket *sk,
+				struct bufp_socket *rsk,
+				struct xnbufd *bufd,
+				int flags)
+{
+	struct bufp_wait_context wait;
+	ssize_t len, ret, xret;
+	rtdm_toseq_t toseq;
+	rtdm_lockctx_t s;
+	size_t rbytes, n;
+	off_t rdoff;
+	u64 rdseq;
+
+	len = bufd->b_len;
+
+	rtdm_toseq_init(&toseq, sk->rx_timeout);
+
+	cobalt_atomic_enter(s);
+
+	if (sk->bcast != rsk)
+		__bufp_attach_reader(sk, rsk);
+
+	for (;;) {
+		/*
+		 * Writers never wait for readers, so the data at our
+		 * cursor may have been overwritten already.
+		 */
+		if (rsk->wrhead - sk->rdseq > rsk->bufsz)
+			goto overrun;
+
+		if (rsk->wrseq - sk->rdseq >= len)
+			break;
+
+		if (flags & MSG_DONTWAIT) {
+			ret = -EWOULDBLOCK;
+			goto out;
+		}
+
+		wait.len = len;
+		wait.sk = rsk;
+		rtipc_prepare_wait(&wait.wc);
+		ret = rtdm_event_timedwait(&rsk->i_event,
+					   sk->rx_timeout, &toseq);
+		if (unlikely(ret))
+			goto out;
+
+		if (sk->bcast != rsk) {
+			ret = -ECONNRESET;
+			goto out;
+		}
+	}
+
+	/* Move our cursor past the message. */
+	rdseq = sk->rdseq;
+	rdoff = sk->rdoff;
+	sk->rdseq += len;
+	sk->rdoff = (rdoff + len) % rsk->bufsz;
+	rbytes = ret = len;
+
+	do {
+		if (rdoff + rbytes > rsk->bufsz)
+			n = rsk->bufsz - rdoff;
+		else
+			n = rbytes;
+		cobalt_atomic_leave(s);
+		xret = xnbufd_copy_from_kmem(bufd, rsk->bufmem + rdoff, n);
+		cobalt_atomic_enter(s);
+		if (xret < 0) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		rbytes -= n;
+		rdoff = (rdoff + n) % rsk->bufsz;
+	} while (rbytes > 0);
+
+	/*
+	 * We copied the data without holding the lock: make sure no
+	 * writer overwrote it in the meantime.
+	 */
+	if (rsk->wrhead - rdseq > rsk->bufsz)
+		goto overrun;
+
+	if (sk->rdseq == rsk->wrseq) /* -> becomes non-readable */
+		xnselect_signal(&sk->priv->recv_block, 0);
+
+	goto out;
+
+overrun:
+	/* Resync to the most recent write position. */
+	sk->overruns++;
+	sk->rdseq = rsk->wrseq;
+	sk->rdoff = rsk->wrcmoff;
+	xnselect_signal(&sk->priv->recv_block, 0);
+	ret = -EPIPE;
+out:
+	cobalt_atomic_leave(s);
+
+	return ret;
+}
+
 static ssize_t __bufp_recvmsg(struct rtdm_fd *fd,
 			      struct iovec *iov, int iovlen, int flags,
 			      struct sockaddr_ipc *saddr)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct bufp_socket *sk = priv->state;
+	struct bufp_socket *sk = priv->state, *rsk = NULL;
 	ssize_t len, wrlen, vlen, ret;
+	struct rtdm_fd *rfd = NULL;
 	struct xnbufd bufd;
+	size_t bufsz;
 	int nvec;
 
-	if (!test_bit(_BUFP_BOUND, &sk->status))
-		return -EAGAIN;
-
 	len = rtdm_get_iov_flatlen(iov, iovlen);
 	if (len == 0)
 		return 0;
+
+	/*
+	 * A bound socket reads from its own buffer, a connected one
+	 * may read from the buffer of its peer in broadcast mode.
+	 */
+	if (test_bit(_BUFP_BOUND, &sk->status)) {
+		if (test_bit(_BUFP_BROADCAST, &sk->status))
+			rsk = sk;
+		bufsz = sk->bufsz;
+	} else {
+		if (!test_bit(_BUFP_CONNECTED, &sk->status))
+			return -EAGAIN;
+		rsk = __bufp_lock_dest(sk->peer.sipc_port, &rfd);
+		if (IS_ERR(rsk))
+			return PTR_ERR(rsk);
+		if (!test_bit(_BUFP_BROADCAST, &rsk->status)) {
+			rtdm_fd_unlock(rfd);
+			return -EAGAIN;
+		}
+		bufsz = rsk->bufsz;
+	}
+
 	/*
 	 * We may only return complete messages to readers, so there
 	 * is no point in waiting for messages which are larger than
 	 * what the buffer can hold.
 	 */
-	if (len > sk->bufsz)
-		return -EINVAL;
+	if (len > bufsz) {
+		ret = -EINVAL;
+		goto out;
+	}
 
 	/*
 	 * Write "len" bytes from the buffer to the vector cells. Each
@@ -326,15 +581,17 @@ static ssize_t __bufp_recvmsg(struct rtdm_fd *fd,
 		vlen = wrlen >= iov[nvec].iov_len ? iov[nvec].iov_len : wrlen;
 		if (rtdm_fd_is_user(fd)) {
 			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
-			ret = __bufp_readbuf(sk, &bufd, flags);
+			ret = rsk ? __bufp_readbcast(sk, rsk, &bufd, flags) :
+				__bufp_readbuf(sk, &bufd, flags);
 			xnbufd_unmap_uread(&bufd);
 		} else {
 			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
-			ret = __bufp_readbuf(sk, &bufd, flags);
+			ret = rsk ? __bufp_readbcast(sk, rsk, &bufd, flags) :
+				__bufp_readbuf(sk, &bufd, flags);
 			xnbufd_unmap_kread(&bufd);
 		}
 		if (ret < 0)
-			return ret;
+			goto out;
 		iov[nvec].iov_base += vlen;
 		iov[nvec].iov_len -= vlen;
 		wrlen -= vlen;
@@ -345,25 +602,27 @@ static ssize_t __bufp_recvmsg(struct rtdm_fd *fd,
 
 	/*
 	 * There is no way to determine who the sender was since we
-	 * process data in byte-oriented mode, so we just copy our own
-	 * sockaddr to send back a valid address.
+	 * process data in byte-oriented mode, so we just copy the
+	 * sockaddr of the buffer owner to send back a valid address.
 	 */
 	if (saddr)
-		*saddr = sk->name;
+		*saddr = rsk ? rsk->name : sk->name;
+
+	ret = len - wrlen;
+out:
+	if (rfd)
+		rtdm_fd_unlock(rfd);
 
-	return len - wrlen;
+	return ret;
 }
 
-static ssize_t bufp_recvmsg(struct rtdm_fd *fd,
-			    struct user_msghdr *msg, int flags)
+static ssize_t __bufp_recvmsg_hdr(struct rtdm_fd *fd,
+				  struct user_msghdr *msg, int flags)
 {
 	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
 	struct sockaddr_ipc saddr;
 	ssize_t ret;
 
-	if (flags & ~MSG_DONTWAIT)
-		return -EINVAL;
-
 	if (msg->msg_name) {
 		if (msg->msg_namelen < sizeof(struct sockaddr_ipc))
 			return -EINVAL;
@@ -399,6 +658,47 @@ static ssize_t bufp_recvmsg(struct rtdm_fd *fd,
 	return ret;
 }
 
+static ssize_t bufp_recvmsg(struct rtdm_fd *fd,
+			    struct user_msghdr *msg, int flags)
+{
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	return __bufp_recvmsg_hdr(fd, msg, flags);
+}
+
+static int bufp_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct bufp_socket *sk = priv->state;
+	rtdm_lockctx_t s;
+	ssize_t ret = 0;
+	int n;
+
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	/*
+	 * Only the first message may wait for input. Writers are
+	 * notified once about the room freed by the whole batch.
+	 */
+	for (n = 0; n < vlen; n++) {
+		ret = __bufp_recvmsg_hdr(fd, &msgvec[n].msg_hdr,
+					 flags | BUFP_DEFER_WAKEUP);
+		if (ret < 0)
+			break;
+		msgvec[n].msg_len = ret;
+		flags |= MSG_DONTWAIT;
+	}
+
+	cobalt_atomic_enter(s);
+	__bufp_notify_output(sk);
+	cobalt_atomic_leave(s);
+
+	return n ?: ret;
+}
+
 static ssize_t bufp_read(struct rtdm_fd *fd, void *buf, size_t len)
 {
 	struct iovec iov = { .iov_base = buf, .iov_len = len };
@@ -406,14 +706,74 @@ static ssize_t bufp_read(struct rtdm_fd *fd, void *buf, size_t len)
 	return __bufp_recvmsg(fd, &iov, 1, 0, NULL);
 }
 
+static ssize_t __bufp_writebcast(struct bufp_socket *rsk,
+				 struct xnbufd *bufd,
+				 int flags)
+{
+	struct bufp_socket *reader;
+	ssize_t len, ret, xret;
+	size_t wbytes, n;
+	rtdm_lockctx_t s;
+	int resched = 0;
+	off_t wroff;
+
+	len = bufd->b_len;
+
+	cobalt_atomic_enter(s);
+
+	/*
+	 * Writers never wait for room in broadcast mode, the oldest
+	 * data is overwritten instead. Lagging readers detect this
+	 * from the distance between their cursor and the write head.
+	 */
+	wroff = rsk->wroff;
+	rsk->wroff = (wroff + len) % rsk->bufsz;
+	rsk->wrhead += len;
+	rsk->wrsem++;
+	wbytes = ret = len;
+
+	do {
+		if (wroff + wbytes > rsk->bufsz)
+			n = rsk->bufsz - wroff;
+		else
+			n = wbytes;
+		cobalt_atomic_leave(s);
+		xret = xnbufd_copy_to_kmem(rsk->bufmem + wroff, bufd, n);
+		cobalt_atomic_enter(s);
+		if (xret < 0) {
+			memset(rsk->bufmem + wroff, 0, n);
+			ret = -EFAULT;
+			break;
+		}
+
+		wbytes -= n;
+		wroff = (wroff + n) % rsk->bufsz;
+	} while (wbytes > 0);
+
+	if (--rsk->wrsem > 0)
+		goto out;
+
+	rsk->wrseq = rsk->wrhead;
+	rsk->wrcmoff = rsk->wroff;
+
+	list_for_each_entry(reader, &rsk->readers, rdlink)
+		resched |= xnselect_signal(&reader->priv->recv_block, POLLIN);
+
+	if (!(flags & BUFP_DEFER_WAKEUP) &&
+	    !__bufp_notify_input(rsk) && resched)
+		xnsched_run();
+out:
+	cobalt_atomic_leave(s);
+
+	return ret;
+}
+
 static ssize_t __bufp_writebuf(struct bufp_socket *rsk,
 			       struct bufp_socket *sk,
 			       struct xnbufd *bufd,
 			       int flags)
 {
-	struct bufp_wait_context wait, *bufwc;
-	struct rtipc_wait_context *wc;
-	struct xnthread *waiter;
+	struct bufp_wait_context wait;
 	size_t wbytes, n, avail;
 	ssize_t len, ret, xret;
 	rtdm_toseq_t toseq;
@@ -421,6 +781,9 @@ static ssize_t __bufp_writebuf(struct bufp_socket *rsk,
 	off_t wroff;
 	int resched;
 
+	if (test_bit(_BUFP_BROADCAST, &rsk->status))
+		return __bufp_writebcast(rsk, bufd, flags);
+
 	len = bufd->b_len;
 
 	rtdm_toseq_init(&toseq, sk->tx_timeout);
@@ -481,21 +844,9 @@ static ssize_t __bufp_writebuf(struct bufp_socket *rsk,
 
 		if (rsk->fillsz == rsk->bufsz) /* becomes non-writable */
 			resched |= xnselect_signal(&rsk->priv->send_block, 0);
-		/*
-		 * Wake up all threads pending on the input wait
-		 * queue, if we accumulated enough data to feed the
-		 * leading one.
-		 */
-		waiter = rtipc_peek_wait_head(&rsk->i_event);
-		if (waiter == NULL)
-			goto out;
 
-		wc = rtipc_get_wait_context(waiter);
-		XENO_BUG_ON(COBALT, wc == NULL);
-		bufwc = container_of(wc, struct bufp_wait_context, wc);
-		if (bufwc->len <= rsk->fillsz)
-			rtdm_event_pulse(&rsk->i_event);
-		else if (resched)
+		if (!(flags & BUFP_DEFER_WAKEUP) &&
+		    !__bufp_notify_input(rsk) && resched)
 			xnsched_run();
 		/*
 		 * We cannot fail anymore once some data has been
@@ -509,6 +860,10 @@ static ssize_t __bufp_writebuf(struct bufp_socket *rsk,
 			break;
 		}
 
+		/* Don't let readers wait for the data we sent. */
+		if (flags & BUFP_DEFER_WAKEUP)
+			__bufp_notify_input(rsk);
+
 		wait.len = len;
 		wait.sk = rsk;
 		rtipc_prepare_wait(&wait.wc);
@@ -527,45 +882,22 @@ out:
 	return ret;
 }
 
-static ssize_t __bufp_sendmsg(struct rtdm_fd *fd,
-			      struct iovec *iov, int iovlen, int flags,
-			      const struct sockaddr_ipc *daddr)
+static ssize_t __bufp_sendiov(struct rtdm_fd *fd,
+			      struct bufp_socket *sk, struct bufp_socket *rsk,
+			      struct iovec *iov, int iovlen, ssize_t len,
+			      int flags)
 {
-	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct bufp_socket *sk = priv->state, *rsk;
-	ssize_t len, rdlen, vlen, ret = 0;
-	struct rtdm_fd *rfd;
+	ssize_t rdlen, vlen, ret;
 	struct xnbufd bufd;
-	rtdm_lockctx_t s;
 	int nvec;
 
-	len = rtdm_get_iov_flatlen(iov, iovlen);
-	if (len == 0)
-		return 0;
-
-	cobalt_atomic_enter(s);
-	rfd = xnmap_fetch_nocheck(portmap, daddr->sipc_port);
-	if (rfd && rtdm_fd_lock(rfd) < 0)
-		rfd = NULL;
-	cobalt_atomic_leave(s);
-	if (rfd == NULL)
-		return -ECONNRESET;
-
-	rsk = rtipc_fd_to_state(rfd);
-	if (!test_bit(_BUFP_BOUND, &rsk->status)) {
-		rtdm_fd_unlock(rfd);
-		return -ECONNREFUSED;
-	}
-
 	/*
 	 * We may only send complete messages, so there is no point in
 	 * accepting messages which are larger than what the buffer
 	 * can hold.
 	 */
-	if (len > rsk->bufsz) {
-		ret = -EINVAL;
-		goto fail;
-	}
+	if (len > rsk->bufsz)
+		return -EINVAL;
 
 	/*
 	 * Read "len" bytes to the buffer from the vector cells. Each
@@ -585,55 +917,84 @@ static ssize_t __bufp_sendmsg(struct rtdm_fd *fd,
 			xnbufd_unmap_kread(&bufd);
 		}
 		if (ret < 0)
-			goto fail;
+			return ret;
 		iov[nvec].iov_base += vlen;
 		iov[nvec].iov_len -= vlen;
 		rdlen -= vlen;
 	}
 
-	rtdm_fd_unlock(rfd);
-
 	return len - rdlen;
-fail:
-	rtdm_fd_unlock(rfd);
-
-	return ret;
 }
 
-static ssize_t bufp_sendmsg(struct rtdm_fd *fd,
-			    const struct user_msghdr *msg, int flags)
+static ssize_t __bufp_sendmsg(struct rtdm_fd *fd,
+			      struct iovec *iov, int iovlen, int flags,
+			      const struct sockaddr_ipc *daddr)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
-	struct bufp_socket *sk = priv->state;
-	struct sockaddr_ipc daddr;
-	ssize_t ret;
+	struct bufp_socket *sk = priv->state, *rsk;
+	struct rtdm_fd *rfd;
+	ssize_t len, ret;
 
-	if (flags & ~MSG_DONTWAIT)
-		return -EINVAL;
+	len = rtdm_get_iov_flatlen(iov, iovlen);
+	if (len == 0)
+		return 0;
+
+	rsk = __bufp_lock_dest(daddr->sipc_port, &rfd);
+	if (IS_ERR(rsk))
+		return PTR_ERR(rsk);
+
+	ret = __bufp_sendiov(fd, sk, rsk, iov, iovlen, len, flags);
+
+	rtdm_fd_unlock(rfd);
 
+	return ret;
+}
+
+static int __bufp_get_daddr(struct rtdm_fd *fd, struct bufp_socket *sk,
+			    const struct user_msghdr *msg,
+			    struct sockaddr_ipc *daddr)
+{
 	if (msg->msg_name) {
 		if (msg->msg_namelen != sizeof(struct sockaddr_ipc))
 			return -EINVAL;
 
 		/* Fetch the destination address to send to. */
-		if (rtipc_get_arg(fd, &daddr, msg->msg_name, sizeof(daddr)))
+		if (rtipc_get_arg(fd, daddr, msg->msg_name, sizeof(*daddr)))
 			return -EFAULT;
 
-		if (daddr.sipc_port < 0 ||
-		    daddr.sipc_port >= CONFIG_XENO_OPT_BUFP_NRPORT)
+		if (daddr->sipc_port < 0 ||
+		    daddr->sipc_port >= CONFIG_XENO_OPT_BUFP_NRPORT)
 			return -EINVAL;
 	} else {
 		if (msg->msg_namelen != 0)
 			return -EINVAL;
-		daddr = sk->peer;
-		if (daddr.sipc_port < 0)
+		*daddr = sk->peer;
+		if (daddr->sipc_port < 0)
 			return -EDESTADDRREQ;
 	}
 
 	if (msg->msg_iovlen >= UIO_MAXIOV)
 		return -EINVAL;
 
+	return 0;
+}
+
+static ssize_t bufp_sendmsg(struct rtdm_fd *fd,
+			    const struct user_msghdr *msg, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct bufp_socket *sk = priv->state;
+	struct sockaddr_ipc daddr;
+	ssize_t ret;
+
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	ret = __bufp_get_daddr(fd, sk, msg, &daddr);
+	if (ret)
+		return ret;
+
 	/* Copy I/O vector in */
 	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
 	if (ret)
@@ -649,6 +1010,66 @@ static ssize_t bufp_sendmsg(struct rtdm_fd *fd,
 	return rtdm_put_iovec(fd, iov, msg, iov_fast) ?: ret;
 }
 
+static int bufp_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct bufp_socket *sk = priv->state, *rsk = NULL;
+	struct sockaddr_ipc daddr;
+	struct rtdm_fd *rfd = NULL;
+	struct user_msghdr *msg;
+	int n, port = -1;
+	ssize_t len, ret = 0;
+	rtdm_lockctx_t s;
+
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	/*
+	 * Write a series of messages heading to the same port,
+	 * notifying the reader once for the whole batch.
+	 */
+	for (n = 0; n < vlen; n++) {
+		msg = &msgvec[n].msg_hdr;
+		ret = __bufp_get_daddr(fd, sk, msg, &daddr);
+		if (ret)
+			break;
+		if (rfd == NULL) {
+			rsk = __bufp_lock_dest(daddr.sipc_port, &rfd);
+			if (IS_ERR(rsk))
+				return PTR_ERR(rsk);
+			port = daddr.sipc_port;
+		} else if (daddr.sipc_port != port)
+			break;
+		ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+		if (ret)
+			break;
+		len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+		if (len > 0)
+			len = __bufp_sendiov(fd, sk, rsk, iov, msg->msg_iovlen,
+					     len, flags | BUFP_DEFER_WAKEUP);
+		if (len < 0) {
+			rtdm_drop_iovec(iov, iov_fast);
+			ret = len;
+			break;
+		}
+		ret = rtdm_put_iovec(fd, iov, msg, iov_fast);
+		if (ret)
+			break;
+		msgvec[n].msg_len = len;
+	}
+
+	if (rfd) {
+		cobalt_atomic_enter(s);
+		__bufp_notify_input(rsk);
+		cobalt_atomic_leave(s);
+		rtdm_fd_unlock(rfd);
+	}
+
+	return n ?: ret;
+}
+
 static ssize_t bufp_write(struct rtdm_fd *fd,
 			  const void *buf, size_t len)
 {
@@ -729,6 +1150,14 @@ static int __bufp_bind_socket(struct rtipc_private *priv,
 	}
 
 	cobalt_atomic_enter(s);
+	/*
+	 * A bound socket only reads from its own buffer, through a
+	 * cursor of its own in broadcast mode.
+	 */
+	if (test_bit(_BUFP_BROADCAST, &sk->status))
+		__bufp_attach_reader(sk, sk);
+	else
+		__bufp_detach_reader(sk);
 	__clear_bit(_BUFP_BINDING, &sk->status);
 	__set_bit(_BUFP_BOUND, &sk->status);
 	if (xnselect_signal(&priv->send_block, POLLOUT))
@@ -748,6 +1177,7 @@ static int __bufp_connect_socket(struct bufp_socket *sk,
 {
 	struct sockaddr_ipc _sa;
 	struct bufp_socket *rsk;
+	struct rtdm_fd *rfd;
 	int ret, resched = 0;
 	rtdm_lockctx_t s;
 	xnhandle_t h;
@@ -812,6 +1242,22 @@ set_assoc:
 		__clear_bit(_BUFP_CONNECTED, &sk->status);
 	else
 		__set_bit(_BUFP_CONNECTED, &sk->status);
+	/*
+	 * An unbound socket connected to a buffer in broadcast mode
+	 * becomes one of its readers. If the peer is not bound yet,
+	 * this happens upon the first read.
+	 */
+	if (!test_bit(_BUFP_BOUND, &sk->status)) {
+		__bufp_detach_reader(sk);
+		rfd = sa->sipc_port < 0 ? NULL :
+			xnmap_fetch_nocheck(portmap, sa->sipc_port);
+		if (rfd) {
+			rsk = rtipc_fd_to_state(rfd);
+			if (test_bit(_BUFP_BOUND, &rsk->status) &&
+			    test_bit(_BUFP_BROADCAST, &rsk->status))
+				__bufp_attach_reader(sk, rsk);
+		}
+	}
 	if (resched)
 		xnsched_run();
 	cobalt_atomic_leave(s);
@@ -828,7 +1274,7 @@ static int __bufp_setsockopt(struct bufp_socket *sk,
 	struct __kernel_old_timeval tv;
 	rtdm_lockctx_t s;
 	size_t len;
-	int ret;
+	int ret, val;
 
 	ret = rtipc_get_sockoptin(fd, &sopt, arg);
 	if (ret)
@@ -901,6 +1347,22 @@ static int __bufp_setsockopt(struct bufp_socket *sk,
 		cobalt_atomic_leave(s);
 		break;
 
+	case BUFP_BROADCAST:
+		if (sopt.optlen != sizeof(val))
+			return -EINVAL;
+		if (rtipc_get_arg(fd, &val, sopt.optval, sizeof(val)))
+			return -EFAULT;
+		cobalt_atomic_enter(s);
+		if (test_bit(_BUFP_BOUND, &sk->status) ||
+		    test_bit(_BUFP_BINDING, &sk->status))
+			ret = -EALREADY;
+		else if (val)
+			__set_bit(_BUFP_BROADCAST, &sk->status);
+		else
+			__clear_bit(_BUFP_BROADCAST, &sk->status);
+		cobalt_atomic_leave(s);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -915,9 +1377,10 @@ static int __bufp_getsockopt(struct bufp_socket *sk,
 	struct _rtdm_getsockopt_args sopt;
 	struct rtipc_port_label plabel;
 	struct __kernel_old_timeval tv;
+	unsigned int overruns;
 	rtdm_lockctx_t s;
 	socklen_t len;
-	int ret;
+	int ret, val;
 
 	ret = rtipc_get_sockoptout(fd, &sopt, arg);
 	if (ret)
@@ -965,6 +1428,22 @@ static int __bufp_getsockopt(struct bufp_socket *sk,
 			return -EFAULT;
 		break;
 
+	case BUFP_BROADCAST:
+		if (len < sizeof(val))
+			return -EINVAL;
+		val = test_bit(_BUFP_BROADCAST, &sk->status);
+		if (rtipc_put_arg(fd, sopt.optval, &val, sizeof(val)))
+			return -EFAULT;
+		break;
+
+	case BUFP_OVERRUNS:
+		if (len < sizeof(overruns))
+			return -EINVAL;
+		overruns = sk->overruns;
+		if (rtipc_put_arg(fd, sopt.optval, &overruns, sizeof(overruns)))
+			return -EFAULT;
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -1054,7 +1533,10 @@ static unsigned int bufp_pollstate(struct rtdm_fd *fd) /* atomic */
 	unsigned int mask = 0;
 	struct rtdm_fd *rfd;
 
-	if (test_bit(_BUFP_BOUND, &sk->status) && sk->fillsz > 0)
+	if (sk->bcast) {
+		if (sk->bcast->wrseq != sk->rdseq)
+			mask |= POLLIN;
+	} else if (test_bit(_BUFP_BOUND, &sk->status) && sk->fillsz > 0)
 		mask |= POLLIN;
 
 	/*
@@ -1067,7 +1549,8 @@ static unsigned int bufp_pollstate(struct rtdm_fd *fd) /* atomic */
 		rfd = xnmap_fetch_nocheck(portmap, sk->peer.sipc_port);
 		if (rfd) {
 			rsk = rtipc_fd_to_state(rfd);
-			if (rsk->fillsz < rsk->bufsz)
+			if (test_bit(_BUFP_BROADCAST, &rsk->status) ||
+			    rsk->fillsz < rsk->bufsz)
 				mask |= POLLOUT;
 		}
 	} else
@@ -1100,6 +1583,8 @@ struct rtipc_protocol bufp_proto_driver = {
 		.close = bufp_close,
 		.recvmsg = bufp_recvmsg,
 		.sendmsg = bufp_sendmsg,
+		.recvmmsg = bufp_recvmmsg,
+		.sendmmsg = bufp_sendmmsg,
 		.read = bufp_read,
 		.write = bufp_write,
 		.ioctl = bufp_ioctl,
@@ -23,6 +23,8 @@
 #include <linux/slab.h>
 #include <linux/poll.h>
 #include <linux/time.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/bufd.h>
 #include <cobalt/kernel/map.h>
@@ -39,6 +41,54 @@ struct iddp_message {
 	char data[];
 };
 
+#define IDDP_SLOT_FREE		0
+#define IDDP_SLOT_RESERVED	1	/* Being filled by a sender. */
+#define IDDP_SLOT_QUEUED	2	/* Waiting for the receiver. */
+#define IDDP_SLOT_READING	3	/* Being copied out by recvmsg. */
+#define IDDP_SLOT_HELD		4	/* Handed over to the receiver. */
+
+struct iddp_slot {
+	int state;
+	int from;
+	size_t rdoff;
+	size_t len;
+	struct iddp_socket *owner;
+};
+
+/*
+ * Receive ring of a socket in ring mode. The slot memory is shared
+ * with userland, all indexes are kept in kernel space. The ring may
+ * outlive the receiving socket until the last mapping is gone.
+ */
+struct iddp_ring {
+	atomic_t refs;
+	struct iddp_ring_header *hdr;
+	size_t memsz;
+	unsigned int nr_slots;
+	size_t slot_size;
+	struct iddp_slot *slots;
+	unsigned int *freelist;
+	unsigned int nr_free;
+	unsigned int *fifo;
+	unsigned int fifo_head;
+	unsigned int fifo_count;
+};
+
+/*
+ * A message moving between a buffer and the I/O vector of a sender
+ * or receiver. The buffer is either an mbuf from the pool or a ring
+ * slot.
+ */
+struct iddp_xfer {
+	struct iddp_message *mbuf;
+	unsigned int slot;
+	void *data;
+	size_t rdoff;
+	size_t len;
+	int from;
+	bool done;
+};
+
 struct iddp_socket {
 	int magic;
 	struct sockaddr_ipc name;
@@ -56,6 +106,10 @@ struct iddp_socket {
 	nanosecs_rel_t rx_timeout;
 	nanosecs_rel_t tx_timeout;
 	unsigned long stalls;	/* Buffer stall counter. */
+	unsigned int ring_slots;
+	size_t ring_slotsz;
+	struct iddp_ring *ring;	  /* Receive ring (ring mode). */
+	struct iddp_ring *txring; /* Peer ring mapped for sending. */
 	struct rtipc_private *priv;
 };
 
@@ -159,6 +213,275 @@ static void __iddp_free_mbuf(struct iddp_socket *sk,
 	rtdm_waitqueue_broadcast(sk->poolwaitq);
 }
 
+static inline size_t __iddp_ring_memsz(unsigned int nr_slots,
+				       size_t slot_size)
+{
+	/* The header page comes first, slots follow. */
+	return PAGE_ALIGN(PAGE_SIZE + (size_t)nr_slots * slot_size);
+}
+
+static inline void *__iddp_slot_data(struct iddp_ring *ring,
+				     unsigned int slot)
+{
+	return (void *)ring->hdr + PAGE_SIZE + slot * ring->slot_size;
+}
+
+static void iddp_free_ring(struct iddp_ring *ring)
+{
+	if (ring->hdr)
+		xnheap_vfree(ring->hdr);
+	kvfree(ring->fifo);
+	kvfree(ring->freelist);
+	kvfree(ring->slots);
+	kfree(ring);
+}
+
+static struct iddp_ring *iddp_alloc_ring(unsigned int nr_slots,
+					 size_t slot_size)
+{
+	struct iddp_ring *ring;
+	unsigned int n;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (ring == NULL)
+		return NULL;
+
+	ring->slots = kvcalloc(nr_slots, sizeof(*ring->slots), GFP_KERNEL);
+	ring->freelist = kvcalloc(nr_slots, sizeof(unsigned int), GFP_KERNEL);
+	ring->fifo = kvcalloc(nr_slots, sizeof(unsigned int), GFP_KERNEL);
+	ring->memsz = __iddp_ring_memsz(nr_slots, slot_size);
+	ring->hdr = xnheap_vmalloc(ring->memsz);
+	if (ring->slots == NULL || ring->freelist == NULL ||
+	    ring->fifo == NULL || ring->hdr == NULL) {
+		iddp_free_ring(ring);
+		return NULL;
+	}
+
+	/* This memory is going to be mapped to userland. */
+	memset(ring->hdr, 0, ring->memsz);
+	ring->hdr->nr_slots = nr_slots;
+	ring->hdr->slot_size = slot_size;
+	ring->hdr->data_offset = PAGE_SIZE;
+	ring->nr_slots = nr_slots;
+	ring->slot_size = slot_size;
+
+	/* Hand out low slot numbers first. */
+	for (n = 0; n < nr_slots; n++)
+		ring->freelist[n] = nr_slots - n - 1;
+	ring->nr_free = nr_slots;
+	atomic_set(&ring->refs, 1);
+
+	return ring;
+}
+
+static inline void iddp_get_ring(struct iddp_ring *ring)
+{
+	atomic_inc(&ring->refs);
+}
+
+static void iddp_put_ring(struct iddp_ring *ring) /* in-band */
+{
+	if (atomic_dec_and_test(&ring->refs))
+		iddp_free_ring(ring);
+}
+
+static inline bool __iddp_readable(struct iddp_socket *sk) /* nklock held */
+{
+	if (sk->ring)
+		return sk->ring->fifo_count > 0;
+
+	return !list_empty(&sk->inq);
+}
+
+static int __iddp_ring_reserve(struct iddp_socket *sk,
+			       struct iddp_socket *rsk,
+			       int flags, unsigned int *pslot)
+{
+	struct iddp_ring *ring = rsk->ring;
+	rtdm_toseq_t timeout_seq;
+	struct iddp_slot *sl;
+	rtdm_lockctx_t s;
+	int ret = 0;
+
+	rtdm_toseq_init(&timeout_seq, sk->tx_timeout);
+
+	rtdm_waitqueue_lock(rsk->poolwaitq, s);
+
+	for (;;) {
+		if (ring->nr_free > 0) {
+			*pslot = ring->freelist[--ring->nr_free];
+			sl = ring->slots + *pslot;
+			sl->state = IDDP_SLOT_RESERVED;
+			sl->owner = sk;
+			break;
+		}
+		if (flags & MSG_DONTWAIT) {
+			ret = -EAGAIN;
+			break;
+		}
+		/* Wait for the receiver to release a slot. */
+		++rsk->stalls;
+		ret = rtdm_timedwait_locked(rsk->poolwaitq,
+					    sk->tx_timeout, &timeout_seq);
+		if (unlikely(ret == -EIDRM))
+			ret = -ECONNRESET;
+		if (ret)
+			break;
+	}
+
+	rtdm_waitqueue_unlock(rsk->poolwaitq, s);
+
+	return ret;
+}
+
+static void __iddp_ring_commit(struct iddp_socket *rsk, unsigned int slot,
+			       size_t len, int from, int flags) /* nklock held */
+{
+	struct iddp_ring *ring = rsk->ring;
+	struct iddp_slot *sl = ring->slots + slot;
+	unsigned int mask = ring->nr_slots - 1, pos;
+
+	sl->state = IDDP_SLOT_QUEUED;
+	sl->owner = NULL;
+	sl->from = from;
+	sl->rdoff = 0;
+	sl->len = len;
+
+	/*
+	 * CAUTION: we must remain atomic from the moment we signal
+	 * POLLIN, until sem_up has happened.
+	 */
+	if (ring->fifo_count == 0) /* -> readable */
+		xnselect_signal(&rsk->priv->recv_block, POLLIN);
+
+	/* The FIFO can't overflow, there are no more slots than cells. */
+	if (flags & MSG_OOB) {
+		ring->fifo_head = (ring->fifo_head - 1) & mask;
+		pos = ring->fifo_head;
+	} else
+		pos = (ring->fifo_head + ring->fifo_count) & mask;
+
+	ring->fifo[pos] = slot;
+	ring->fifo_count++;
+
+	rtdm_sem_up(&rsk->insem); /* Will resched. */
+}
+
+static unsigned int __iddp_ring_dequeue(struct iddp_ring *ring,
+					int state) /* nklock held */
+{
+	unsigned int slot;
+
+	slot = ring->fifo[ring->fifo_head];
+	ring->fifo_head = (ring->fifo_head + 1) & (ring->nr_slots - 1);
+	ring->fifo_count--;
+	ring->slots[slot].state = state;
+
+	return slot;
+}
+
+static void __iddp_ring_release(struct iddp_ring *ring,
+				unsigned int slot) /* nklock held */
+{
+	struct iddp_slot *sl = ring->slots + slot;
+
+	sl->state = IDDP_SLOT_FREE;
+	sl->owner = NULL;
+	ring->freelist[ring->nr_free++] = slot;
+}
+
+static void __iddp_release_slot(struct iddp_socket *rsk, unsigned int slot)
+{
+	rtdm_lockctx_t s;
+
+	cobalt_atomic_enter(s);
+	__iddp_ring_release(rsk->ring, slot);
+	cobalt_atomic_leave(s);
+
+	rtdm_waitqueue_broadcast(rsk->poolwaitq);
+}
+
+static struct rtdm_fd *__iddp_lock_port(int port)
+{
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+
+	cobalt_atomic_enter(s);
+	rfd = xnmap_fetch_nocheck(portmap, port);
+	if (rfd && rtdm_fd_lock(rfd) < 0)
+		rfd = NULL;
+	cobalt_atomic_leave(s);
+
+	return rfd;
+}
+
+/*
+ * Lock the peer port a sender has mapped the ring of, making sure
+ * the same ring is still attached to it.
+ */
+static int __iddp_lock_ring_peer(struct iddp_socket *sk,
+				 struct rtdm_fd **rfdp)
+{
+	struct iddp_socket *rsk;
+	struct rtdm_fd *rfd;
+
+	if (!test_bit(_IDDP_CONNECTED, &sk->status))
+		return -EDESTADDRREQ;
+
+	if (sk->txring == NULL)
+		return -ENXIO;
+
+	rfd = __iddp_lock_port(sk->peer.sipc_port);
+	if (rfd == NULL)
+		return -ECONNRESET;
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_IDDP_BOUND, &rsk->status) || rsk->ring != sk->txring) {
+		rtdm_fd_unlock(rfd);
+		return -ECONNRESET;
+	}
+
+	*rfdp = rfd;
+
+	return 0;
+}
+
+/*
+ * Give back the slots a sender reserved from a peer ring, but did
+ * not commit.
+ */
+static void iddp_cancel_reservations(struct iddp_socket *sk,
+				     struct iddp_ring *ring)
+{
+	struct iddp_socket *rsk;
+	int n, count = 0;
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+
+	cobalt_atomic_enter(s);
+
+	for (n = 0; n < ring->nr_slots; n++) {
+		if (ring->slots[n].state == IDDP_SLOT_RESERVED &&
+		    ring->slots[n].owner == sk) {
+			__iddp_ring_release(ring, n);
+			count++;
+		}
+	}
+
+	cobalt_atomic_leave(s);
+
+	if (count == 0)
+		return;
+
+	rfd = __iddp_lock_port(sk->peer.sipc_port);
+	if (rfd) {
+		rsk = rtipc_fd_to_state(rfd);
+		if (rsk->ring == ring)
+			rtdm_waitqueue_broadcast(rsk->poolwaitq);
+		rtdm_fd_unlock(rfd);
+	}
+}
+
 static int iddp_socket(struct rtdm_fd *fd)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
@@ -175,6 +498,10 @@ static int iddp_socket(struct rtdm_fd *fd)
 	sk->rx_timeout = RTDM_TIMEOUT_INFINITE;
 	sk->tx_timeout = RTDM_TIMEOUT_INFINITE;
 	sk->stalls = 0;
+	sk->ring_slots = 0;
+	sk->ring_slotsz = 0;
+	sk->ring = NULL;
+	sk->txring = NULL;
 	*sk->label = 0;
 	INIT_LIST_HEAD(&sk->inq);
 	rtdm_sem_init(&sk->insem, 0);
@@ -196,6 +523,11 @@ static void iddp_close(struct rtdm_fd *fd)
 	rtdm_sem_destroy(&sk->insem);
 	rtdm_waitqueue_destroy(&sk->privwaitq);
 
+	if (sk->txring) {
+		iddp_cancel_reservations(sk, sk->txring);
+		iddp_put_ring(sk->txring);
+	}
+
 	if (test_bit(_IDDP_BOUND, &sk->status)) {
 		if (sk->handle)
 			xnregistry_remove(sk->handle);
@@ -213,6 +545,10 @@ static void iddp_close(struct rtdm_fd *fd)
 		}
 	}
 
+	/* Unread datagrams in ring mode go away with the ring. */
+	if (sk->ring)
+		iddp_put_ring(sk->ring);
+
 	/* Send unread datagrams back to the system heap. */
 	while (!list_empty(&sk->inq)) {
 		mbuf = list_entry(sk->inq.next, struct iddp_message, next);
@@ -225,26 +561,15 @@ static void iddp_close(struct rtdm_fd *fd)
 	return;
 }
 
-static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
-			      struct iovec *iov, int iovlen, int flags,
-			      struct sockaddr_ipc *saddr)
+/*
+ * Wait for input, returning with nklock held if some is available.
+ */
+static int __iddp_wait_input(struct iddp_socket *sk, int flags,
+			     rtdm_lockctx_t *ps)
 {
-	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iddp_socket *sk = priv->state;
-	ssize_t maxlen, len, wrlen, vlen;
 	rtdm_toseq_t timeout_seq, *toseq;
-	int nvec, rdoff, ret, dofree;
-	struct iddp_message *mbuf;
 	nanosecs_rel_t timeout;
-	struct xnbufd bufd;
-	rtdm_lockctx_t s;
-
-	if (!test_bit(_IDDP_BOUND, &sk->status))
-		return -EAGAIN;
-
-	maxlen = rtdm_get_iov_flatlen(iov, iovlen);
-	if (maxlen == 0)
-		return 0;
+	int ret;
 
 	if (flags & MSG_DONTWAIT) {
 		timeout = RTDM_TIMEOUT_NONE;
@@ -252,10 +577,9 @@ static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
 	} else {
 		timeout = sk->rx_timeout;
 		toseq = &timeout_seq;
+		rtdm_toseq_init(toseq, timeout);
 	}
 
-	/* We want to pick one buffer from the queue. */
-
 	for (;;) {
 		ret = rtdm_sem_timeddown(&sk->insem, timeout, toseq);
 		if (unlikely(ret)) {
@@ -264,76 +588,235 @@ static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
 			return ret;
 		}
 		/* We may have spurious wakeups. */
-		cobalt_atomic_enter(s);
-		if (!list_empty(&sk->inq))
-			break;
-		cobalt_atomic_leave(s);
+		cobalt_atomic_enter(*ps);
+		if (__iddp_readable(sk))
+			return 0;
+		cobalt_atomic_leave(*ps);
 	}
+}
 
-	/* Pull heading message from input queue. */
-	mbuf = list_entry(sk->inq.next, struct iddp_message, next);
-	rdoff = mbuf->rdoff;
-	len = mbuf->len - rdoff;
-	if (saddr) {
-		saddr->sipc_family = AF_RTIPC;
-		saddr->sipc_port = mbuf->from;
+/*
+ * Pull the heading message from the input queue into @x, at most
+ * @maxlen bytes of it. A partially read message is reposted.
+ */
+static void __iddp_pull(struct iddp_socket *sk, size_t maxlen,
+			struct iddp_xfer *x) /* nklock held */
+{
+	struct iddp_message *mbuf;
+	struct iddp_slot *sl;
+
+	if (sk->ring) {
+		x->mbuf = NULL;
+		x->slot = sk->ring->fifo[sk->ring->fifo_head];
+		sl = sk->ring->slots + x->slot;
+		x->data = __iddp_slot_data(sk->ring, x->slot);
+		x->rdoff = sl->rdoff;
+		x->len = sl->len - x->rdoff;
+		x->from = sl->from;
+		x->done = maxlen >= x->len;
+		if (!x->done)
+			sl->rdoff += maxlen;
+		else
+			__iddp_ring_dequeue(sk->ring, IDDP_SLOT_READING);
+	} else {
+		mbuf = list_entry(sk->inq.next, struct iddp_message, next);
+		x->mbuf = mbuf;
+		x->data = mbuf->data;
+		x->rdoff = mbuf->rdoff;
+		x->len = mbuf->len - x->rdoff;
+		x->from = mbuf->from;
+		x->done = maxlen >= x->len;
+		if (!x->done)
+			mbuf->rdoff += maxlen;
+		else
+			list_del(&mbuf->next);
 	}
-	if (maxlen >= len) {
-		list_del(&mbuf->next);
-		dofree = 1;
-		if (list_empty(&sk->inq)) /* -> non-readable */
-			xnselect_signal(&priv->recv_block, 0);
 
+	if (x->done) {
+		if (!__iddp_readable(sk)) /* -> non-readable */
+			xnselect_signal(&sk->priv->recv_block, 0);
 	} else {
 		/* Buffer is only partially read: repost. */
-		mbuf->rdoff += maxlen;
-		len = maxlen;
-		dofree = 0;
+		x->len = maxlen;
+		rtdm_sem_up(&sk->insem);
 	}
+}
 
-	if (!dofree)
-		rtdm_sem_up(&sk->insem);
+static size_t __iddp_head_len(struct iddp_socket *sk) /* nklock held */
+{
+	struct iddp_message *mbuf;
+	struct iddp_slot *sl;
 
-	cobalt_atomic_leave(s);
+	if (sk->ring) {
+		sl = sk->ring->slots + sk->ring->fifo[sk->ring->fifo_head];
+		return sl->len - sl->rdoff;
+	}
 
-	/* Now, write "len" bytes from mbuf->data to the vector cells */
-	for (nvec = 0, wrlen = len; nvec < iovlen && wrlen > 0; nvec++) {
+	mbuf = list_entry(sk->inq.next, struct iddp_message, next);
+
+	return mbuf->len - mbuf->rdoff;
+}
+
+/* Write the pulled data to the vector cells. */
+static int __iddp_copy_out(struct rtdm_fd *fd, struct iovec *iov,
+			   int iovlen, struct iddp_xfer *x)
+{
+	size_t rdoff = x->rdoff;
+	ssize_t wrlen, vlen, ret;
+	struct xnbufd bufd;
+	int nvec;
+
+	for (nvec = 0, wrlen = x->len; nvec < iovlen && wrlen > 0; nvec++) {
 		if (iov[nvec].iov_len == 0)
 			continue;
 		vlen = wrlen >= iov[nvec].iov_len ? iov[nvec].iov_len : wrlen;
 		if (rtdm_fd_is_user(fd)) {
 			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
+			ret = xnbufd_copy_from_kmem(&bufd, x->data + rdoff, vlen);
 			xnbufd_unmap_uread(&bufd);
 		} else {
 			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
+			ret = xnbufd_copy_from_kmem(&bufd, x->data + rdoff, vlen);
 			xnbufd_unmap_kread(&bufd);
 		}
 		if (ret < 0)
-			break;
+			return ret;
 		iov[nvec].iov_base += vlen;
 		iov[nvec].iov_len -= vlen;
 		wrlen -= vlen;
 		rdoff += vlen;
 	}
 
-	if (dofree)
-		__iddp_free_mbuf(sk, mbuf);
+	return 0;
+}
 
-	return ret ?: len;
+/*
+ * Give back the buffers of all fully read messages, waking up the
+ * senders once.
+ */
+static void __iddp_release_input(struct iddp_socket *sk,
+				 struct iddp_xfer *xv, int nr)
+{
+	int n, count = 0;
+	rtdm_lockctx_t s;
+
+	if (sk->ring) {
+		cobalt_atomic_enter(s);
+		for (n = 0; n < nr; n++) {
+			if (xv[n].done) {
+				__iddp_ring_release(sk->ring, xv[n].slot);
+				count++;
+			}
+		}
+		cobalt_atomic_leave(s);
+	} else {
+		for (n = 0; n < nr; n++) {
+			if (xv[n].done) {
+				xnheap_free(sk->bufpool, xv[n].mbuf);
+				count++;
+			}
+		}
+	}
+
+	if (count > 0)
+		rtdm_waitqueue_broadcast(sk->poolwaitq);
 }
 
-static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
-			    struct user_msghdr *msg, int flags)
+/*
+ * Put pulled messages we could not deliver back at the head of the
+ * input queue, in their original order. A partially read message
+ * was left queued, so only its read offset is restored, unless some
+ * other reader went on reading it meanwhile.
+ */
+static void __iddp_requeue_input(struct iddp_socket *sk,
+				 struct iddp_xfer *xv, int nr)
 {
-	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
-	struct sockaddr_ipc saddr;
-	ssize_t ret;
+	struct iddp_ring *ring = sk->ring;
+	struct iddp_message *mbuf;
+	struct iddp_xfer *x;
+	struct iddp_slot *sl;
+	rtdm_lockctx_t s;
+	int n;
 
-	if (flags & ~MSG_DONTWAIT)
-		return -EINVAL;
+	cobalt_atomic_enter(s);
 
+	for (n = nr - 1; n >= 0; n--) {
+		x = xv + n;
+		if (!x->done) {
+			if (!__iddp_readable(sk))
+				continue;
+			if (ring) {
+				sl = ring->slots + x->slot;
+				if (ring->fifo[ring->fifo_head] == x->slot &&
+				    sl->rdoff == x->rdoff + x->len)
+					sl->rdoff = x->rdoff;
+			} else {
+				mbuf = list_entry(sk->inq.next,
+						  struct iddp_message, next);
+				if (mbuf == x->mbuf &&
+				    mbuf->rdoff == x->rdoff + x->len)
+					mbuf->rdoff = x->rdoff;
+			}
+			continue;
+		}
+		if (!__iddp_readable(sk)) /* -> readable */
+			xnselect_signal(&sk->priv->recv_block, POLLIN);
+		if (ring) {
+			ring->fifo_head = (ring->fifo_head - 1) &
+				(ring->nr_slots - 1);
+			ring->fifo[ring->fifo_head] = x->slot;
+			ring->fifo_count++;
+			ring->slots[x->slot].state = IDDP_SLOT_QUEUED;
+		} else
+			list_add(&x->mbuf->next, &sk->inq);
+		rtdm_sem_up(&sk->insem);
+	}
+
+	cobalt_atomic_leave(s);
+}
+
+static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
+			      struct iovec *iov, int iovlen, int flags,
+			      struct sockaddr_ipc *saddr)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_socket *sk = priv->state;
+	struct iddp_xfer x;
+	rtdm_lockctx_t s;
+	ssize_t maxlen;
+	int ret;
+
+	if (!test_bit(_IDDP_BOUND, &sk->status))
+		return -EAGAIN;
+
+	maxlen = rtdm_get_iov_flatlen(iov, iovlen);
+	if (maxlen == 0)
+		return 0;
+
+	/* We want to pick one buffer from the queue. */
+	ret = __iddp_wait_input(sk, flags, &s);
+	if (ret)
+		return ret;
+
+	__iddp_pull(sk, maxlen, &x);
+
+	cobalt_atomic_leave(s);
+
+	if (saddr) {
+		saddr->sipc_family = AF_RTIPC;
+		saddr->sipc_port = x.from;
+	}
+
+	ret = __iddp_copy_out(fd, iov, iovlen, &x);
+
+	if (x.done)
+		__iddp_release_input(sk, &x, 1);
+
+	return ret ?: x.len;
+}
+
+static int __iddp_check_recvmsg(const struct user_msghdr *msg)
+{
 	if (msg->msg_name) {
 		if (msg->msg_namelen < sizeof(struct sockaddr_ipc))
 			return -EINVAL;
@@ -343,6 +826,23 @@ static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
 	if (msg->msg_iovlen >= UIO_MAXIOV)
 		return -EINVAL;
 
+	return 0;
+}
+
+static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
+			    struct user_msghdr *msg, int flags)
+{
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct sockaddr_ipc saddr;
+	ssize_t ret;
+
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	ret = __iddp_check_recvmsg(msg);
+	if (ret)
+		return ret;
+
 	/* Copy I/O vector in */
 	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
 	if (ret)
@@ -368,6 +868,117 @@ static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
 	return ret;
 }
 
+static int iddp_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct iddp_xfer xv[RTDM_MMSG_BATCH];
+	ssize_t maxlen[RTDM_MMSG_BATCH];
+	struct iddp_socket *sk = priv->state;
+	struct sockaddr_ipc saddr;
+	struct user_msghdr *msg;
+	int n, nr, ret = 0;
+	rtdm_lockctx_t s;
+
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	if (!test_bit(_IDDP_BOUND, &sk->status))
+		return -EAGAIN;
+
+	vlen = min_t(unsigned int, vlen, RTDM_MMSG_BATCH);
+
+	/*
+	 * Figure out the room available from each message first, so
+	 * that we may pull all the input we can accept at once.
+	 */
+	for (nr = 0; nr < vlen; nr++) {
+		msg = &msgvec[nr].msg_hdr;
+		ret = __iddp_check_recvmsg(msg);
+		if (ret)
+			break;
+		ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+		if (ret)
+			break;
+		maxlen[nr] = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+		rtdm_drop_iovec(iov, iov_fast);
+		if (maxlen[nr] < 0) {
+			ret = maxlen[nr];
+			break;
+		}
+		if (maxlen[nr] == 0 && nr > 0)
+			break;
+	}
+
+	if (nr == 0)
+		return ret;
+
+	if (maxlen[0] == 0) {
+		msgvec[0].msg_len = 0;
+		return 1;
+	}
+
+	ret = __iddp_wait_input(sk, flags, &s);
+	if (ret)
+		return ret;
+
+	__iddp_pull(sk, maxlen[0], &xv[0]);
+
+	/*
+	 * Then pick the following messages which are immediately
+	 * available, as long as they fit in full.
+	 */
+	for (n = 1; n < nr && xv[n - 1].done; n++) {
+		if (!__iddp_readable(sk) || __iddp_head_len(sk) > maxlen[n])
+			break;
+		if (rtdm_sem_timeddown(&sk->insem, RTDM_TIMEOUT_NONE, NULL))
+			break;
+		__iddp_pull(sk, maxlen[n], &xv[n]);
+	}
+
+	cobalt_atomic_leave(s);
+
+	/*
+	 * Like recvmsg(), we drop the input we failed to copy out.
+	 * The messages pulled after it go back to the input queue.
+	 */
+	for (nr = 0; nr < n; nr++) {
+		msg = &msgvec[nr].msg_hdr;
+		ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+		if (ret)
+			break;
+		ret = __iddp_copy_out(fd, iov, msg->msg_iovlen, &xv[nr]);
+		if (ret) {
+			rtdm_drop_iovec(iov, iov_fast);
+			break;
+		}
+		ret = rtdm_put_iovec(fd, iov, msg, iov_fast);
+		if (ret)
+			break;
+		if (msg->msg_name) {
+			saddr.sipc_family = AF_RTIPC;
+			saddr.sipc_port = xv[nr].from;
+			if (rtipc_put_arg(fd, msg->msg_name,
+					  &saddr, sizeof(saddr))) {
+				ret = -EFAULT;
+				break;
+			}
+			msg->msg_namelen = sizeof(struct sockaddr_ipc);
+		}
+		msgvec[nr].msg_len = xv[nr].len;
+	}
+
+	if (nr < n) {
+		__iddp_requeue_input(sk, xv + nr + 1, n - nr - 1);
+		n = nr + 1;
+	}
+
+	__iddp_release_input(sk, xv, n);
+
+	return nr ?: ret;
+}
+
 static ssize_t iddp_read(struct rtdm_fd *fd, void *buf, size_t len)
 {
 	struct iovec iov = { .iov_base = buf, .iov_len = len };
@@ -375,44 +986,47 @@ static ssize_t iddp_read(struct rtdm_fd *fd, void *buf, size_t len)
 	return __iddp_recvmsg(fd, &iov, 1, 0, NULL);
 }
 
-static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
-			      struct iovec *iov, int iovlen, int flags,
-			      const struct sockaddr_ipc *daddr)
+static void __iddp_discard(struct iddp_socket *rsk, struct iddp_xfer *x)
+{
+	if (x->mbuf)
+		__iddp_free_mbuf(rsk, x->mbuf);
+	else
+		__iddp_release_slot(rsk, x->slot);
+}
+
+/*
+ * Get a buffer from the receiver for @len bytes, and move them from
+ * the vector cells.
+ */
+static int __iddp_fill(struct rtdm_fd *fd,
+		       struct iddp_socket *sk, struct iddp_socket *rsk,
+		       struct iovec *iov, int iovlen, size_t len, int flags,
+		       struct iddp_xfer *x)
 {
-	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iddp_socket *sk = priv->state, *rsk;
-	struct iddp_message *mbuf;
-	ssize_t len, rdlen, vlen;
 	int nvec, wroff, ret;
-	struct rtdm_fd *rfd;
+	ssize_t rdlen, vlen;
 	struct xnbufd bufd;
-	rtdm_lockctx_t s;
-
-	len = rtdm_get_iov_flatlen(iov, iovlen);
-	if (len == 0)
-		return 0;
 
-	cobalt_atomic_enter(s);
-	rfd = xnmap_fetch_nocheck(portmap, daddr->sipc_port);
-	if (rfd && rtdm_fd_lock(rfd) < 0)
-		rfd = NULL;
-	cobalt_atomic_leave(s);
-	if (rfd == NULL)
-		return -ECONNRESET;
-
-	rsk = rtipc_fd_to_state(rfd);
-	if (!test_bit(_IDDP_BOUND, &rsk->status)) {
-		rtdm_fd_unlock(rfd);
-		return -ECONNREFUSED;
+	if (rsk->ring) {
+		/* Ring mode: copy straight to a slot of the receiver. */
+		if (len > rsk->ring->slot_size)
+			return -EMSGSIZE;
+		ret = __iddp_ring_reserve(sk, rsk, flags, &x->slot);
+		if (unlikely(ret))
+			return ret;
+		x->mbuf = NULL;
+		x->data = __iddp_slot_data(rsk->ring, x->slot);
+	} else {
+		x->mbuf = __iddp_alloc_mbuf(rsk, len, sk->tx_timeout,
+					    flags, &ret);
+		if (unlikely(ret))
+			return ret;
+		x->data = x->mbuf->data;
 	}
 
-	mbuf = __iddp_alloc_mbuf(rsk, len, sk->tx_timeout, flags, &ret);
-	if (unlikely(ret)) {
-		rtdm_fd_unlock(rfd);
-		return ret;
-	}
+	x->len = len;
 
-	/* Now, move "len" bytes to mbuf->data from the vector cells */
+	/* Now, move "len" bytes to the buffer data from the vector cells */
 	for (nvec = 0, rdlen = len, wroff = 0;
 	     nvec < iovlen && rdlen > 0; nvec++) {
 		if (iov[nvec].iov_len == 0)
@@ -420,22 +1034,34 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 		vlen = rdlen >= iov[nvec].iov_len ? iov[nvec].iov_len : rdlen;
 		if (rtdm_fd_is_user(fd)) {
 			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_to_kmem(mbuf->data + wroff, &bufd, vlen);
+			ret = xnbufd_copy_to_kmem(x->data + wroff, &bufd, vlen);
 			xnbufd_unmap_uread(&bufd);
 		} else {
 			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_to_kmem(mbuf->data + wroff, &bufd, vlen);
+			ret = xnbufd_copy_to_kmem(x->data + wroff, &bufd, vlen);
 			xnbufd_unmap_kread(&bufd);
 		}
-		if (ret < 0)
-			goto fail;
+		if (ret < 0) {
+			__iddp_discard(rsk, x);
+			return ret;
+		}
 		iov[nvec].iov_base += vlen;
 		iov[nvec].iov_len -= vlen;
 		rdlen -= vlen;
 		wroff += vlen;
 	}
 
-	cobalt_atomic_enter(s);
+	return 0;
+}
+
+static void __iddp_post(struct iddp_socket *sk, struct iddp_socket *rsk,
+			struct iddp_xfer *x, int flags) /* nklock held */
+{
+	if (x->mbuf == NULL) {
+		__iddp_ring_commit(rsk, x->slot, x->len,
+				   sk->name.sipc_port, flags);
+		return;
+	}
 
 	/*
 	 * CAUTION: we must remain atomic from the moment we signal
@@ -444,63 +1070,114 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 	if (list_empty(&rsk->inq)) /* -> readable */
 		xnselect_signal(&rsk->priv->recv_block, POLLIN);
 
-	mbuf->from = sk->name.sipc_port;
+	x->mbuf->from = sk->name.sipc_port;
 
 	if (flags & MSG_OOB)
-		list_add(&mbuf->next, &rsk->inq);
+		list_add(&x->mbuf->next, &rsk->inq);
 	else
-		list_add_tail(&mbuf->next, &rsk->inq);
+		list_add_tail(&x->mbuf->next, &rsk->inq);
 
 	rtdm_sem_up(&rsk->insem); /* Will resched. */
+}
 
-	cobalt_atomic_leave(s);
+static struct iddp_socket *__iddp_lock_dest(int port,
+					    struct rtdm_fd **rfdp)
+{
+	struct iddp_socket *rsk;
+	struct rtdm_fd *rfd;
+
+	rfd = __iddp_lock_port(port);
+	if (rfd == NULL)
+		return ERR_PTR(-ECONNRESET);
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_IDDP_BOUND, &rsk->status)) {
+		rtdm_fd_unlock(rfd);
+		return ERR_PTR(-ECONNREFUSED);
+	}
+
+	*rfdp = rfd;
+
+	return rsk;
+}
+
+static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
+			      struct iovec *iov, int iovlen, int flags,
+			      const struct sockaddr_ipc *daddr)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_socket *sk = priv->state, *rsk;
+	struct rtdm_fd *rfd;
+	struct iddp_xfer x;
+	rtdm_lockctx_t s;
+	ssize_t len;
+	int ret;
 
-	rtdm_fd_unlock(rfd);
+	len = rtdm_get_iov_flatlen(iov, iovlen);
+	if (len == 0)
+		return 0;
 
-	return len;
+	rsk = __iddp_lock_dest(daddr->sipc_port, &rfd);
+	if (IS_ERR(rsk))
+		return PTR_ERR(rsk);
 
-fail:
-	__iddp_free_mbuf(rsk, mbuf);
+	ret = __iddp_fill(fd, sk, rsk, iov, iovlen, len, flags, &x);
+	if (ret == 0) {
+		cobalt_atomic_enter(s);
+		__iddp_post(sk, rsk, &x, flags);
+		cobalt_atomic_leave(s);
+	}
 
 	rtdm_fd_unlock(rfd);
 
-	return ret;
+	return ret ?: len;
 }
 
-static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
-			    const struct user_msghdr *msg, int flags)
+static int __iddp_get_daddr(struct rtdm_fd *fd, struct iddp_socket *sk,
+			    const struct user_msghdr *msg,
+			    struct sockaddr_ipc *daddr)
 {
-	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
-	struct iddp_socket *sk = priv->state;
-	struct sockaddr_ipc daddr;
-	ssize_t ret;
-
-	if (flags & ~(MSG_OOB | MSG_DONTWAIT))
-		return -EINVAL;
-
 	if (msg->msg_name) {
 		if (msg->msg_namelen != sizeof(struct sockaddr_ipc))
 			return -EINVAL;
 
 		/* Fetch the destination address to send to. */
-		if (rtipc_get_arg(fd, &daddr, msg->msg_name, sizeof(daddr)))
+		if (rtipc_get_arg(fd, daddr, msg->msg_name, sizeof(*daddr)))
 			return -EFAULT;
 
-		if (daddr.sipc_port < 0 ||
-		    daddr.sipc_port >= CONFIG_XENO_OPT_IDDP_NRPORT)
+		if (daddr->sipc_port < 0 ||
+		    daddr->sipc_port >= CONFIG_XENO_OPT_IDDP_NRPORT)
 			return -EINVAL;
 	} else {
 		if (msg->msg_namelen != 0)
 			return -EINVAL;
-		daddr = sk->peer;
-		if (daddr.sipc_port < 0)
+		*daddr = sk->peer;
+		if (daddr->sipc_port < 0)
 			return -EDESTADDRREQ;
 	}
 
 	if (msg->msg_iovlen >= UIO_MAXIOV)
 		return -EINVAL;
 
+	return 0;
+}
+
+static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
+			    const struct user_msghdr *msg, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct iddp_socket *sk = priv->state;
+	struct sockaddr_ipc daddr;
+	ssize_t ret;
+
+	if (flags & ~(MSG_OOB | MSG_DONTWAIT))
+		return -EINVAL;
+
+	ret = __iddp_get_daddr(fd, sk, msg, &daddr);
+	if (ret)
+		return ret;
+
 	/* Copy I/O vector in */
 	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
 	if (ret)
@@ -516,6 +1193,86 @@ static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
 	return rtdm_put_iovec(fd, iov, msg, iov_fast) ?: ret;
 }
 
+static int iddp_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct iddp_socket *sk = priv->state, *rsk = NULL;
+	struct iddp_xfer xv[RTDM_MMSG_BATCH];
+	int n, i, port = -1, ret = 0;
+	struct sockaddr_ipc daddr;
+	struct rtdm_fd *rfd = NULL;
+	struct user_msghdr *msg;
+	rtdm_lockctx_t s;
+	ssize_t len;
+
+	if (flags & ~(MSG_OOB | MSG_DONTWAIT))
+		return -EINVAL;
+
+	vlen = min_t(unsigned int, vlen, RTDM_MMSG_BATCH);
+
+	/*
+	 * Fill buffers for a series of messages heading to the same
+	 * port, then post them all at once. Once the first buffer is
+	 * filled, we must not wait for more room, since the receiver
+	 * could not consume the messages we hold back.
+	 */
+	for (n = 0; n < vlen; n++) {
+		msg = &msgvec[n].msg_hdr;
+		ret = __iddp_get_daddr(fd, sk, msg, &daddr);
+		if (ret)
+			break;
+		if (rfd == NULL) {
+			rsk = __iddp_lock_dest(daddr.sipc_port, &rfd);
+			if (IS_ERR(rsk))
+				return PTR_ERR(rsk);
+			port = daddr.sipc_port;
+		} else if (daddr.sipc_port != port)
+			break;
+		ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+		if (ret)
+			break;
+		len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+		if (len < 0) {
+			rtdm_drop_iovec(iov, iov_fast);
+			ret = len;
+			break;
+		}
+		xv[n].data = NULL;
+		if (len > 0) {
+			ret = __iddp_fill(fd, sk, rsk, iov, msg->msg_iovlen,
+					  len, n > 0 ? flags | MSG_DONTWAIT : flags,
+					  &xv[n]);
+			if (ret) {
+				rtdm_drop_iovec(iov, iov_fast);
+				break;
+			}
+		}
+		ret = rtdm_put_iovec(fd, iov, msg, iov_fast);
+		if (ret) {
+			if (xv[n].data)
+				__iddp_discard(rsk, &xv[n]);
+			break;
+		}
+		msgvec[n].msg_len = len;
+	}
+
+	if (n > 0) {
+		cobalt_atomic_enter(s);
+		for (i = 0; i < n; i++) {
+			if (xv[i].data)
+				__iddp_post(sk, rsk, &xv[i], flags);
+		}
+		cobalt_atomic_leave(s);
+	}
+
+	if (rfd)
+		rtdm_fd_unlock(rfd);
+
+	return n ?: ret;
+}
+
 static ssize_t iddp_write(struct rtdm_fd *fd,
 			  const void *buf, size_t len)
 {
@@ -538,6 +1295,7 @@ static int __iddp_bind_socket(struct rtdm_fd *fd,
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
 	struct iddp_socket *sk = priv->state;
+	struct iddp_ring *ring = NULL;
 	int ret = 0, port;
 	rtdm_lockctx_t s;
 	void *poolmem;
@@ -569,11 +1327,20 @@ static int __iddp_bind_socket(struct rtdm_fd *fd,
 	sa->sipc_port = port;
 
 	/*
-	 * Allocate a local buffer pool if we were told to do so via
-	 * setsockopt() before we got there.
+	 * Allocate a receive ring or a local buffer pool if we were
+	 * told to do so via setsockopt() before we got there. The ring
+	 * supersedes the pool.
 	 */
 	poolsz = sk->poolsz;
-	if (poolsz > 0) {
+	if (sk->ring_slots > 0) {
+		poolsz = 0;
+		ring = iddp_alloc_ring(sk->ring_slots, sk->ring_slotsz);
+		if (ring == NULL) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+		sk->poolwaitq = &sk->privwaitq;
+	} else if (poolsz > 0) {
 		poolsz = PAGE_ALIGN(poolsz);
 		poolmem = xnheap_vmalloc(poolsz);
 		if (poolmem == NULL) {
@@ -604,11 +1371,14 @@ static int __iddp_bind_socket(struct rtdm_fd *fd,
 				xnheap_destroy(&sk->privpool);
 				xnheap_vfree(poolmem);
 			}
+			if (ring)
+				iddp_free_ring(ring);
 			goto fail;
 		}
 	}
 
 	cobalt_atomic_enter(s);
+	sk->ring = ring;
 	__clear_bit(_IDDP_BINDING, &sk->status);
 	__set_bit(_IDDP_BOUND, &sk->status);
 	if (xnselect_signal(&priv->send_block, POLLOUT))
@@ -705,6 +1475,7 @@ static int __iddp_setsockopt(struct iddp_socket *sk,
 {
 	struct _rtdm_setsockopt_args sopt;
 	struct rtipc_port_label plabel;
+	struct iddp_ring_config rcfg;
 	struct __kernel_old_timeval tv;
 	rtdm_lockctx_t s;
 	size_t len;
@@ -781,6 +1552,29 @@ static int __iddp_setsockopt(struct iddp_socket *sk,
 		cobalt_atomic_leave(s);
 		break;
 
+	case IDDP_RING:
+		if (sopt.optlen != sizeof(rcfg))
+			return -EINVAL;
+		if (rtipc_get_arg(fd, &rcfg, sopt.optval, sizeof(rcfg)))
+			return -EFAULT;
+		if (!is_power_of_2(rcfg.nr_slots))
+			return -EINVAL;
+		len = ALIGN((size_t)rcfg.slot_size, SMP_CACHE_BYTES);
+		/* The mapping size must be representable. */
+		if (len == 0 ||
+		    (u64)len * rcfg.nr_slots > UINT_MAX - 2 * PAGE_SIZE)
+			return -EINVAL;
+		cobalt_atomic_enter(s);
+		if (test_bit(_IDDP_BOUND, &sk->status) ||
+		    test_bit(_IDDP_BINDING, &sk->status))
+			ret = -EALREADY;
+		else {
+			sk->ring_slots = rcfg.nr_slots;
+			sk->ring_slotsz = len;
+		}
+		cobalt_atomic_leave(s);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -788,12 +1582,53 @@ static int __iddp_setsockopt(struct iddp_socket *sk,
 	return ret;
 }
 
+/*
+ * The ring of a socket is its own receive ring if configured,
+ * otherwise the ring of the port it is connected to, if any.
+ */
+static int __iddp_get_ring_config(struct iddp_socket *sk,
+				  struct iddp_ring_config *rcfg)
+{
+	struct iddp_socket *rsk;
+	struct rtdm_fd *rfd;
+	int ret = 0;
+
+	if (sk->ring_slots > 0) {
+		rcfg->nr_slots = sk->ring_slots;
+		rcfg->slot_size = sk->ring_slotsz;
+		goto done;
+	}
+
+	if (!test_bit(_IDDP_CONNECTED, &sk->status))
+		return -ENXIO;
+
+	rfd = __iddp_lock_port(sk->peer.sipc_port);
+	if (rfd == NULL)
+		return -ENXIO;
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (test_bit(_IDDP_BOUND, &rsk->status) && rsk->ring) {
+		rcfg->nr_slots = rsk->ring->nr_slots;
+		rcfg->slot_size = rsk->ring->slot_size;
+	} else
+		ret = -ENXIO;
+
+	rtdm_fd_unlock(rfd);
+	if (ret)
+		return ret;
+done:
+	rcfg->map_size = __iddp_ring_memsz(rcfg->nr_slots, rcfg->slot_size);
+
+	return 0;
+}
+
 static int __iddp_getsockopt(struct iddp_socket *sk,
 			     struct rtdm_fd *fd,
 			     void *arg)
 {
 	struct _rtdm_getsockopt_args sopt;
 	struct rtipc_port_label plabel;
+	struct iddp_ring_config rcfg;
 	struct __kernel_old_timeval tv;
 	rtdm_lockctx_t s;
 	socklen_t len;
@@ -846,6 +1681,16 @@ static int __iddp_getsockopt(struct iddp_socket *sk,
 			return -EFAULT;
 		break;
 
+	case IDDP_RING:
+		if (len < sizeof(rcfg))
+			return -EINVAL;
+		ret = __iddp_get_ring_config(sk, &rcfg);
+		if (ret)
+			return ret;
+		if (rtipc_put_arg(fd, sopt.optval, &rcfg, sizeof(rcfg)))
+			return -EFAULT;
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -853,6 +1698,158 @@ static int __iddp_getsockopt(struct iddp_socket *sk,
 	return ret;
 }
 
+static int __iddp_ring_reserve_request(struct iddp_socket *sk,
+				       struct rtdm_fd *fd, void *arg)
+{
+	struct iddp_ring_desc desc;
+	struct iddp_socket *rsk;
+	struct rtdm_fd *rfd;
+	int ret;
+
+	if (rtipc_get_arg(fd, &desc, arg, sizeof(desc)))
+		return -EFAULT;
+
+	if (desc.flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	ret = __iddp_lock_ring_peer(sk, &rfd);
+	if (ret)
+		return ret;
+
+	rsk = rtipc_fd_to_state(rfd);
+	ret = __iddp_ring_reserve(sk, rsk, desc.flags, &desc.slot);
+	if (ret == 0) {
+		desc.offset = 0;
+		desc.len = rsk->ring->slot_size;
+		desc.from = sk->name.sipc_port;
+		if (rtipc_put_arg(fd, arg, &desc, sizeof(desc))) {
+			__iddp_release_slot(rsk, desc.slot);
+			ret = -EFAULT;
+		}
+	}
+
+	rtdm_fd_unlock(rfd);
+
+	return ret;
+}
+
+static int __iddp_ring_commit_request(struct iddp_socket *sk,
+				      struct rtdm_fd *fd, void *arg)
+{
+	struct iddp_ring_desc desc;
+	struct iddp_socket *rsk;
+	struct iddp_ring *ring;
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+	int ret;
+
+	if (rtipc_get_arg(fd, &desc, arg, sizeof(desc)))
+		return -EFAULT;
+
+	if (desc.flags & ~MSG_OOB)
+		return -EINVAL;
+
+	ret = __iddp_lock_ring_peer(sk, &rfd);
+	if (ret)
+		return ret;
+
+	rsk = rtipc_fd_to_state(rfd);
+	ring = rsk->ring;
+	if (desc.slot >= ring->nr_slots ||
+	    desc.len == 0 || desc.len > ring->slot_size) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	cobalt_atomic_enter(s);
+
+	/* Only the sender which reserved the slot may commit it. */
+	if (ring->slots[desc.slot].state != IDDP_SLOT_RESERVED ||
+	    ring->slots[desc.slot].owner != sk)
+		ret = -EINVAL;
+	else
+		__iddp_ring_commit(rsk, desc.slot, desc.len,
+				   sk->name.sipc_port, desc.flags);
+
+	cobalt_atomic_leave(s);
+out:
+	rtdm_fd_unlock(rfd);
+
+	return ret;
+}
+
+static int __iddp_ring_receive_request(struct iddp_socket *sk,
+				       struct rtdm_fd *fd, void *arg)
+{
+	struct iddp_ring *ring = sk->ring;
+	struct iddp_ring_desc desc;
+	struct iddp_slot *sl;
+	rtdm_lockctx_t s;
+	int ret;
+
+	if (!test_bit(_IDDP_BOUND, &sk->status) || ring == NULL)
+		return -ENXIO;
+
+	if (rtipc_get_arg(fd, &desc, arg, sizeof(desc)))
+		return -EFAULT;
+
+	if (desc.flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	ret = __iddp_wait_input(sk, desc.flags, &s);
+	if (ret)
+		return ret;
+
+	desc.slot = __iddp_ring_dequeue(ring, IDDP_SLOT_HELD);
+	sl = ring->slots + desc.slot;
+	desc.offset = sl->rdoff;
+	desc.len = sl->len - sl->rdoff;
+	desc.from = sl->from;
+	if (!__iddp_readable(sk)) /* -> non-readable */
+		xnselect_signal(&sk->priv->recv_block, 0);
+
+	cobalt_atomic_leave(s);
+
+	if (rtipc_put_arg(fd, arg, &desc, sizeof(desc))) {
+		__iddp_release_slot(sk, desc.slot);
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+static int __iddp_ring_release_request(struct iddp_socket *sk,
+				       struct rtdm_fd *fd, void *arg)
+{
+	struct iddp_ring *ring = sk->ring;
+	struct iddp_ring_desc desc;
+	rtdm_lockctx_t s;
+	int ret = 0;
+
+	if (!test_bit(_IDDP_BOUND, &sk->status) || ring == NULL)
+		return -ENXIO;
+
+	if (rtipc_get_arg(fd, &desc, arg, sizeof(desc)))
+		return -EFAULT;
+
+	if (desc.slot >= ring->nr_slots)
+		return -EINVAL;
+
+	cobalt_atomic_enter(s);
+
+	if (ring->slots[desc.slot].state != IDDP_SLOT_HELD)
+		ret = -EINVAL;
+	else
+		__iddp_ring_release(ring, desc.slot);
+
+	cobalt_atomic_leave(s);
+
+	if (ret == 0)
+		rtdm_waitqueue_broadcast(sk->poolwaitq);
+
+	return ret;
+}
+
 static int __iddp_ioctl(struct rtdm_fd *fd,
 			unsigned int request, void *arg)
 {
@@ -904,6 +1901,22 @@ static int __iddp_ioctl(struct rtdm_fd *fd,
 		ret = -ENOTCONN;
 		break;
 
+	case IDDP_RTIOC_RESERVE:
+		ret = __iddp_ring_reserve_request(sk, fd, arg);
+		break;
+
+	case IDDP_RTIOC_COMMIT:
+		ret = __iddp_ring_commit_request(sk, fd, arg);
+		break;
+
+	case IDDP_RTIOC_RECEIVE:
+		ret = __iddp_ring_receive_request(sk, fd, arg);
+		break;
+
+	case IDDP_RTIOC_RELEASE:
+		ret = __iddp_ring_release_request(sk, fd, arg);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -917,6 +1930,12 @@ static int iddp_ioctl(struct rtdm_fd *fd,
 	int ret;
 
 	switch (request) {
+	case IDDP_RTIOC_RESERVE:
+	case IDDP_RTIOC_RECEIVE:
+		if (!rtdm_in_rt_context())
+			return -ENOSYS;	/* May block, try upgrading to RT */
+		ret = __iddp_ioctl(fd, request, arg);
+		break;
 	COMPAT_CASE(_RTIOC_BIND):
 		if (rtdm_in_rt_context())
 			return -ENOSYS;	/* Try downgrading to NRT */
@@ -952,7 +1971,7 @@ static unsigned int iddp_pollstate(struct rtdm_fd *fd) /* atomic */
 	unsigned int mask = 0;
 	struct rtdm_fd *rfd;
 
-	if (test_bit(_IDDP_BOUND, &sk->status) && !list_empty(&sk->inq))
+	if (test_bit(_IDDP_BOUND, &sk->status) && __iddp_readable(sk))
 		mask |= POLLIN;
 
 	/*
@@ -976,6 +1995,78 @@ static unsigned int iddp_pollstate(struct rtdm_fd *fd) /* atomic */
 	return mask;
 }
 
+static void iddp_ring_vmopen(struct vm_area_struct *vma)
+{
+	iddp_get_ring(vma->vm_private_data);
+}
+
+static void iddp_ring_vmclose(struct vm_area_struct *vma)
+{
+	iddp_put_ring(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct iddp_ring_vmops = {
+	.open = iddp_ring_vmopen,
+	.close = iddp_ring_vmclose,
+};
+
+static int iddp_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	struct iddp_socket *sk = rtipc_fd_to_state(fd), *rsk;
+	struct iddp_ring *ring = NULL, *oldring;
+	struct rtdm_fd *rfd;
+	int ret;
+
+	/* Map our own receive ring, or the ring of our peer. */
+	if (test_bit(_IDDP_BOUND, &sk->status) && sk->ring) {
+		ring = sk->ring;
+		iddp_get_ring(ring);
+	} else if (test_bit(_IDDP_CONNECTED, &sk->status)) {
+		rfd = __iddp_lock_port(sk->peer.sipc_port);
+		if (rfd) {
+			rsk = rtipc_fd_to_state(rfd);
+			if (test_bit(_IDDP_BOUND, &rsk->status) && rsk->ring) {
+				ring = rsk->ring;
+				iddp_get_ring(ring);
+			}
+			rtdm_fd_unlock(rfd);
+		}
+	}
+
+	if (ring == NULL)
+		return -ENXIO;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > ring->memsz) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	ret = rtdm_mmap_vmem(vma, ring->hdr);
+	if (ret)
+		goto fail;
+
+	/* The mapping holds a reference on the ring. */
+	vma->vm_ops = &iddp_ring_vmops;
+	vma->vm_private_data = ring;
+
+	/* Senders reserve slots from the peer ring mapped last. */
+	if (ring != sk->ring && ring != sk->txring) {
+		oldring = sk->txring;
+		iddp_get_ring(ring);
+		sk->txring = ring;
+		if (oldring) {
+			iddp_cancel_reservations(sk, oldring);
+			iddp_put_ring(oldring);
+		}
+	}
+
+	return 0;
+fail:
+	iddp_put_ring(ring);
+
+	return ret;
+}
+
 struct rtipc_protocol iddp_proto_driver = {
 	.proto_name = "iddp",
 	.proto_statesz = sizeof(struct iddp_socket),
@@ -986,9 +2077,12 @@ struct rtipc_protocol iddp_proto_driver = {
 		.close = iddp_close,
 		.recvmsg = iddp_recvmsg,
 		.sendmsg = iddp_sendmsg,
+		.recvmmsg = iddp_recvmmsg,
+		.sendmmsg = iddp_sendmmsg,
 		.read = iddp_read,
 		.write = iddp_write,
 		.ioctl = iddp_ioctl,
 		.pollstate = iddp_pollstate,
+		.mmap = iddp_mmap,
 	}
 };
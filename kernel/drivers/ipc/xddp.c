@@ -266,44 +266,15 @@ static void xddp_close(struct rtdm_fd *fd)
 	xnpipe_disconnect(sk->minor);
 }
 
-static ssize_t __xddp_recvmsg(struct rtdm_fd *fd,
-			      struct iovec *iov, int iovlen, int flags,
-			      struct sockaddr_ipc *saddr)
+/* Write "len" bytes from mbuf->data to the vector cells. */
+static int __xddp_copy_out(struct rtdm_fd *fd, struct iovec *iov,
+			   int iovlen, struct xddp_message *mbuf, size_t len)
 {
-	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct xddp_message *mbuf = NULL; /* Fake GCC */
-	struct xddp_socket *sk = priv->state;
-	ssize_t maxlen, len, wrlen, vlen;
-	nanosecs_rel_t timeout;
-	struct xnpipe_mh *mh;
-	int nvec, rdoff, ret;
+	ssize_t wrlen, vlen, ret;
 	struct xnbufd bufd;
-	spl_t s;
-
-	if (!test_bit(_XDDP_BOUND, &sk->status))
-		return -EAGAIN;
+	int nvec, rdoff;
 
-	maxlen = rtdm_get_iov_flatlen(iov, iovlen);
-	if (maxlen == 0)
-		return 0;
-
-	timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sk->timeout;
-	/* Pull heading message from the input queue. */
-	len = xnpipe_recv(sk->minor, &mh, timeout);
-	if (len < 0)
-		return len == -EIDRM ? 0 : len;
-	if (len > maxlen) {
-		ret = -ENOBUFS;
-		goto out;
-	}
-
-	mbuf = container_of(mh, struct xddp_message, mh);
-
-	if (saddr)
-		*saddr = sk->name;
-
-	/* Write "len" bytes from mbuf->data to the vector cells */
-	for (ret = 0, nvec = 0, rdoff = 0, wrlen = len;
+	for (nvec = 0, rdoff = 0, wrlen = len;
 	     nvec < iovlen && wrlen > 0; nvec++) {
 		if (iov[nvec].iov_len == 0)
 			continue;
@@ -318,23 +289,83 @@ static ssize_t __xddp_recvmsg(struct rtdm_fd *fd,
 			xnbufd_unmap_kread(&bufd);
 		}
 		if (ret < 0)
-			goto out;
+			return ret;
 		iov[nvec].iov_base += vlen;
 		iov[nvec].iov_len -= vlen;
 		wrlen -= vlen;
 		rdoff += vlen;
 	}
-out:
-	xnheap_free(sk->bufpool, mbuf);
+
+	return 0;
+}
+
+static void __xddp_update_input(struct rtipc_private *priv,
+				struct xddp_socket *sk)
+{
+	spl_t s;
+
 	cobalt_atomic_enter(s);
 	if ((__xnpipe_pollstate(sk->minor) & POLLIN) == 0 &&
 	    xnselect_signal(&priv->recv_block, 0))
 		xnsched_run();
 	cobalt_atomic_leave(s);
+}
+
+static ssize_t __xddp_recvmsg(struct rtdm_fd *fd,
+			      struct iovec *iov, int iovlen, int flags,
+			      struct sockaddr_ipc *saddr)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct xddp_socket *sk = priv->state;
+	struct xddp_message *mbuf;
+	nanosecs_rel_t timeout;
+	struct xnpipe_mh *mh;
+	ssize_t maxlen, len;
+	int ret;
+
+	if (!test_bit(_XDDP_BOUND, &sk->status))
+		return -EAGAIN;
+
+	maxlen = rtdm_get_iov_flatlen(iov, iovlen);
+	if (maxlen == 0)
+		return 0;
+
+	timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sk->timeout;
+	/* Pull heading message from the input queue. */
+	len = xnpipe_recv(sk->minor, &mh, timeout);
+	if (len < 0)
+		return len == -EIDRM ? 0 : len;
+
+	mbuf = container_of(mh, struct xddp_message, mh);
+
+	if (len > maxlen)
+		ret = -ENOBUFS;
+	else {
+		if (saddr)
+			*saddr = sk->name;
+		ret = __xddp_copy_out(fd, iov, iovlen, mbuf, len);
+	}
+
+	xnheap_free(sk->bufpool, mbuf);
+	__xddp_update_input(priv, sk);
 
 	return ret ?: len;
 }
 
+static int __xddp_check_recvmsg(const struct user_msghdr *msg)
+{
+	if (msg->msg_name) {
+		if (msg->msg_namelen < sizeof(struct sockaddr_ipc))
+			return -EINVAL;
+	} else if (msg->msg_namelen != 0)
+		return -EINVAL;
+
+	if (msg->msg_iovlen >= UIO_MAXIOV)
+		return -EINVAL;
+
+	return 0;
+}
+
 static ssize_t xddp_recvmsg(struct rtdm_fd *fd,
 			    struct user_msghdr *msg, int flags)
 {
@@ -345,14 +376,9 @@ static ssize_t xddp_recvmsg(struct rtdm_fd *fd,
 	if (flags & ~MSG_DONTWAIT)
 		return -EINVAL;
 
-	if (msg->msg_name) {
-		if (msg->msg_namelen < sizeof(struct sockaddr_ipc))
-			return -EINVAL;
-	} else if (msg->msg_namelen != 0)
-		return -EINVAL;
-
-	if (msg->msg_iovlen >= UIO_MAXIOV)
-		return -EINVAL;
+	ret = __xddp_check_recvmsg(msg);
+	if (ret)
+		return ret;
 
 	/* Copy I/O vector in */
 	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
@@ -379,6 +405,122 @@ static ssize_t xddp_recvmsg(struct rtdm_fd *fd,
 	return ret;
 }
 
+static int __xddp_put_mmsg(struct rtdm_fd *fd, struct xddp_socket *sk,
+			   struct mmsghdr *mmsg, struct xddp_message *mbuf,
+			   size_t maxlen)
+{
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct user_msghdr *msg = &mmsg->msg_hdr;
+	size_t len = xnpipe_m_size(&mbuf->mh);
+	int ret;
+
+	if (len > maxlen)
+		return -ENOBUFS;
+
+	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+	if (ret)
+		return ret;
+
+	ret = __xddp_copy_out(fd, iov, msg->msg_iovlen, mbuf, len);
+	if (ret) {
+		rtdm_drop_iovec(iov, iov_fast);
+		return ret;
+	}
+
+	ret = rtdm_put_iovec(fd, iov, msg, iov_fast);
+	if (ret)
+		return ret;
+
+	if (msg->msg_name) {
+		if (rtipc_put_arg(fd, msg->msg_name,
+				  &sk->name, sizeof(sk->name)))
+			return -EFAULT;
+		msg->msg_namelen = sizeof(struct sockaddr_ipc);
+	}
+
+	mmsg->msg_len = len;
+
+	return 0;
+}
+
+static int xddp_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct xnpipe_mh *mhv[RTDM_MMSG_BATCH];
+	struct xddp_socket *sk = priv->state;
+	size_t maxlen[RTDM_MMSG_BATCH];
+	struct xddp_message *mbuf;
+	nanosecs_rel_t timeout;
+	struct user_msghdr *msg;
+	int n, nr, count, ret = 0;
+	ssize_t len;
+
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+
+	if (!test_bit(_XDDP_BOUND, &sk->status))
+		return -EAGAIN;
+
+	vlen = min_t(unsigned int, vlen, RTDM_MMSG_BATCH);
+
+	/*
+	 * Figure out the room available from each message first, so
+	 * that the pipe only hands us the messages we can accept.
+	 */
+	for (nr = 0; nr < vlen; nr++) {
+		msg = &msgvec[nr].msg_hdr;
+		ret = __xddp_check_recvmsg(msg);
+		if (ret)
+			break;
+		ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+		if (ret)
+			break;
+		len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+		rtdm_drop_iovec(iov, iov_fast);
+		if (len < 0) {
+			ret = len;
+			break;
+		}
+		if (len == 0 && nr > 0)
+			break;
+		maxlen[nr] = len;
+	}
+
+	if (nr == 0)
+		return ret;
+
+	if (maxlen[0] == 0) {
+		msgvec[0].msg_len = 0;
+		return 1;
+	}
+
+	timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sk->timeout;
+	nr = xnpipe_recvv(sk->minor, mhv, maxlen, nr, timeout);
+	if (nr < 0) {
+		if (nr != -EIDRM)
+			return nr;
+		msgvec[0].msg_len = 0;
+		return 1;
+	}
+
+	/* Like recvmsg(), we drop the input we failed to copy out. */
+	for (n = 0, count = 0; n < nr; n++) {
+		mbuf = container_of(mhv[n], struct xddp_message, mh);
+		if (count == n) {
+			ret = __xddp_put_mmsg(fd, sk, &msgvec[n], mbuf, maxlen[n]);
+			if (ret == 0)
+				count++;
+		}
+		xnheap_free(sk->bufpool, mbuf);
+	}
+
+	__xddp_update_input(priv, sk);
+
+	return count ?: ret;
+}
+
 static ssize_t xddp_read(struct rtdm_fd *fd, void *buf, size_t len)
 {
 	struct iovec iov = { .iov_base = buf, .iov_len = len };
@@ -451,6 +593,15 @@ static ssize_t __xddp_stream(struct xddp_socket *sk,
 					       XNPIPE_NORMAL);
 			if (outbytes > 0)
 				outbytes -= sizeof(*mbuf);
+			else {
+				/*
+				 * Not queued (e.g. shared ring full),
+				 * drop the stream contents.
+				 */
+				sk->fillsz = 0;
+				sk->buffer_port = -1;
+				__clear_bit(_XDDP_SYNCWAIT, &sk->status);
+			}
 		}
 	}
 
@@ -460,6 +611,78 @@ out:
 	return outbytes;
 }
 
+/*
+ * Allocate a message from the receiver's pool, then move "len"
+ * bytes to mbuf->data from the vector cells.
+ */
+static struct xddp_message *__xddp_fill(struct rtdm_fd *fd,
+					struct xddp_socket *rsk,
+					struct iovec *iov, int iovlen,
+					size_t len)
+{
+	struct xddp_message *mbuf;
+	ssize_t rdlen, wrlen, vlen;
+	struct xnbufd bufd;
+	int nvec, ret;
+
+	mbuf = xnheap_alloc(rsk->bufpool, len + sizeof(*mbuf));
+	if (unlikely(mbuf == NULL))
+		return ERR_PTR(-ENOMEM);
+
+	for (nvec = 0, rdlen = len, wrlen = 0;
+	     nvec < iovlen && rdlen > 0; nvec++) {
+		if (iov[nvec].iov_len == 0)
+			continue;
+		vlen = rdlen >= iov[nvec].iov_len ? iov[nvec].iov_len : rdlen;
+		if (rtdm_fd_is_user(fd)) {
+			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem(mbuf->data + wrlen, &bufd, vlen);
+			xnbufd_unmap_uread(&bufd);
+		} else {
+			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem(mbuf->data + wrlen, &bufd, vlen);
+			xnbufd_unmap_kread(&bufd);
+		}
+		if (ret < 0) {
+			xnheap_free(rsk->bufpool, mbuf);
+			return ERR_PTR(ret);
+		}
+		iov[nvec].iov_base += vlen;
+		iov[nvec].iov_len -= vlen;
+		rdlen -= vlen;
+		wrlen += vlen;
+	}
+
+	return mbuf;
+}
+
+static struct xddp_socket *__xddp_lock_dest(int port,
+					    struct rtdm_fd **rfdp)
+{
+	struct xddp_socket *rsk;
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+
+	cobalt_atomic_enter(s);
+	rfd = portmap[port];
+	if (rfd && rtdm_fd_lock(rfd) < 0)
+		rfd = NULL;
+	cobalt_atomic_leave(s);
+
+	if (rfd == NULL)
+		return ERR_PTR(-ECONNRESET);
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_XDDP_BOUND, &rsk->status)) {
+		rtdm_fd_unlock(rfd);
+		return ERR_PTR(-ECONNREFUSED);
+	}
+
+	*rfdp = rfd;
+
+	return rsk;
+}
+
 static ssize_t __xddp_sendmsg(struct rtdm_fd *fd,
 			      struct iovec *iov, int iovlen, int flags,
 			      const struct sockaddr_ipc *daddr)
@@ -470,31 +693,18 @@ static ssize_t __xddp_sendmsg(struct rtdm_fd *fd,
 	struct xddp_message *mbuf;
 	struct xddp_socket *rsk;
 	struct rtdm_fd *rfd;
-	int nvec, to, from;
 	struct xnbufd bufd;
-	rtdm_lockctx_t s;
+	int nvec, from;
 
 	len = rtdm_get_iov_flatlen(iov, iovlen);
 	if (len == 0)
 		return 0;
 
 	from = sk->name.sipc_port;
-	to = daddr->sipc_port;
 
-	cobalt_atomic_enter(s);
-	rfd = portmap[to];
-	if (rfd && rtdm_fd_lock(rfd) < 0)
-		rfd = NULL;
-	cobalt_atomic_leave(s);
-
-	if (rfd == NULL)
-		return -ECONNRESET;
-
-	rsk = rtipc_fd_to_state(rfd);
-	if (!test_bit(_XDDP_BOUND, &rsk->status)) {
-		rtdm_fd_unlock(rfd);
-		return -ECONNREFUSED;
-	}
+	rsk = __xddp_lock_dest(daddr->sipc_port, &rfd);
+	if (IS_ERR(rsk))
+		return PTR_ERR(rsk);
 
 	sublen = len;
 	nvec = 0;
@@ -542,43 +752,18 @@ static ssize_t __xddp_sendmsg(struct rtdm_fd *fd,
 	}
 
 nostream:
-	mbuf = xnheap_alloc(rsk->bufpool, sublen + sizeof(*mbuf));
-	if (unlikely(mbuf == NULL)) {
-		ret = -ENOMEM;
+	mbuf = __xddp_fill(fd, rsk, iov + nvec, iovlen - nvec, sublen);
+	if (IS_ERR(mbuf)) {
+		ret = PTR_ERR(mbuf);
 		goto fail_unlock;
 	}
 
-	/*
-	 * Move "sublen" bytes to mbuf->data from the vector cells
-	 */
-	for (rdlen = sublen, wrlen = 0; nvec < iovlen && rdlen > 0; nvec++) {
-		if (iov[nvec].iov_len == 0)
-			continue;
-		vlen = rdlen >= iov[nvec].iov_len ? iov[nvec].iov_len : rdlen;
-		if (rtdm_fd_is_user(fd)) {
-			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_to_kmem(mbuf->data + wrlen, &bufd, vlen);
-			xnbufd_unmap_uread(&bufd);
-		} else {
-			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_to_kmem(mbuf->data + wrlen, &bufd, vlen);
-			xnbufd_unmap_kread(&bufd);
-		}
-		if (ret < 0)
-			goto fail_freebuf;
-		iov[nvec].iov_base += vlen;
-		iov[nvec].iov_len -= vlen;
-		rdlen -= vlen;
-		wrlen += vlen;
-	}
-
 	ret = xnpipe_send(rsk->minor, &mbuf->mh,
 			  sublen + sizeof(*mbuf),
 			  (flags & MSG_OOB) ?
 			  XNPIPE_URGENT : XNPIPE_NORMAL);
 
 	if (unlikely(ret < 0)) {
-	fail_freebuf:
 		xnheap_free(rsk->bufpool, mbuf);
 	fail_unlock:
 		rtdm_fd_unlock(rfd);
@@ -590,15 +775,37 @@ done:
 	return len;
 }
 
-static ssize_t xddp_sendmsg(struct rtdm_fd *fd,
-			    const struct user_msghdr *msg, int flags)
+static int __xddp_get_daddr(struct rtdm_fd *fd, struct xddp_socket *sk,
+			    const struct user_msghdr *msg,
+			    struct sockaddr_ipc *daddr)
 {
-	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
-	struct xddp_socket *sk = priv->state;
-	struct sockaddr_ipc daddr;
-	ssize_t ret;
+	if (msg->msg_name) {
+		if (msg->msg_namelen != sizeof(struct sockaddr_ipc))
+			return -EINVAL;
 
+		/* Fetch the destination address to send to. */
+		if (rtipc_get_arg(fd, daddr, msg->msg_name, sizeof(*daddr)))
+			return -EFAULT;
+
+		if (daddr->sipc_port < 0 ||
+		    daddr->sipc_port >= CONFIG_XENO_OPT_PIPE_NRDEV)
+			return -EINVAL;
+	} else {
+		if (msg->msg_namelen != 0)
+			return -EINVAL;
+		*daddr = sk->peer;
+		if (daddr->sipc_port < 0)
+			return -EDESTADDRREQ;
+	}
+
+	if (msg->msg_iovlen >= UIO_MAXIOV)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int __xddp_check_sendflags(int flags)
+{
 	/*
 	 * We accept MSG_DONTWAIT, but do not care about it, since
 	 * writing to the real-time endpoint of a message pipe must be
@@ -614,27 +821,25 @@ static ssize_t xddp_sendmsg(struct rtdm_fd *fd,
 	if ((flags & (MSG_MORE | MSG_OOB)) == (MSG_MORE | MSG_OOB))
 		return -EINVAL;
 
-	if (msg->msg_name) {
-		if (msg->msg_namelen != sizeof(struct sockaddr_ipc))
-			return -EINVAL;
+	return 0;
+}
 
-		/* Fetch the destination address to send to. */
-		if (rtipc_get_arg(fd, &daddr, msg->msg_name, sizeof(daddr)))
-			return -EFAULT;
+static ssize_t xddp_sendmsg(struct rtdm_fd *fd,
+			    const struct user_msghdr *msg, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct xddp_socket *sk = priv->state;
+	struct sockaddr_ipc daddr;
+	ssize_t ret;
 
-		if (daddr.sipc_port < 0 ||
-		    daddr.sipc_port >= CONFIG_XENO_OPT_PIPE_NRDEV)
-			return -EINVAL;
-	} else {
-		if (msg->msg_namelen != 0)
-			return -EINVAL;
-		daddr = sk->peer;
-		if (daddr.sipc_port < 0)
-			return -EDESTADDRREQ;
-	}
+	ret = __xddp_check_sendflags(flags);
+	if (ret)
+		return ret;
 
-	if (msg->msg_iovlen >= UIO_MAXIOV)
-		return -EINVAL;
+	ret = __xddp_get_daddr(fd, sk, msg, &daddr);
+	if (ret)
+		return ret;
 
 	/* Copy I/O vector in */
 	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
@@ -651,6 +856,108 @@ static ssize_t xddp_sendmsg(struct rtdm_fd *fd,
 	return rtdm_put_iovec(fd, iov, msg, iov_fast) ?: ret;
 }
 
+static int xddp_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct xddp_socket *sk = priv->state, *rsk = NULL;
+	struct xddp_message *mbufv[RTDM_MMSG_BATCH];
+	int n, i, port = -1, ret;
+	struct sockaddr_ipc daddr;
+	struct rtdm_fd *rfd = NULL;
+	struct user_msghdr *msg;
+	rtdm_lockctx_t s;
+	ssize_t len;
+
+	ret = __xddp_check_sendflags(flags);
+	if (ret)
+		return ret;
+
+	/* Streaming goes through the regular path. */
+	if (flags & MSG_MORE) {
+		len = xddp_sendmsg(fd, &msgvec->msg_hdr, flags);
+		if (len < 0)
+			return len;
+		msgvec->msg_len = len;
+		return 1;
+	}
+
+	vlen = min_t(unsigned int, vlen, RTDM_MMSG_BATCH);
+
+	/* Fill buffers for a series of messages to the same port. */
+	for (n = 0; n < vlen; n++) {
+		msg = &msgvec[n].msg_hdr;
+		ret = __xddp_get_daddr(fd, sk, msg, &daddr);
+		if (ret)
+			break;
+		if (rfd == NULL) {
+			rsk = __xddp_lock_dest(daddr.sipc_port, &rfd);
+			if (IS_ERR(rsk))
+				return PTR_ERR(rsk);
+			port = daddr.sipc_port;
+		} else if (daddr.sipc_port != port)
+			break;
+		ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+		if (ret)
+			break;
+		len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+		if (len < 0) {
+			rtdm_drop_iovec(iov, iov_fast);
+			ret = len;
+			break;
+		}
+		mbufv[n] = NULL;
+		if (len > 0) {
+			mbufv[n] = __xddp_fill(fd, rsk, iov,
+					       msg->msg_iovlen, len);
+			if (IS_ERR(mbufv[n])) {
+				rtdm_drop_iovec(iov, iov_fast);
+				ret = PTR_ERR(mbufv[n]);
+				break;
+			}
+		}
+		ret = rtdm_put_iovec(fd, iov, msg, iov_fast);
+		if (ret) {
+			if (mbufv[n])
+				xnheap_free(rsk->bufpool, mbufv[n]);
+			break;
+		}
+		msgvec[n].msg_len = len;
+	}
+
+	/*
+	 * Post them under a single lock section, which also coalesces
+	 * the wakeup requests to the regular side.
+	 */
+	cobalt_atomic_enter(s);
+
+	for (i = 0; i < n; i++) {
+		if (mbufv[i] == NULL)
+			continue;
+		ret = xnpipe_send(rsk->minor, &mbufv[i]->mh,
+				  msgvec[i].msg_len + sizeof(*mbufv[i]),
+				  (flags & MSG_OOB) ?
+				  XNPIPE_URGENT : XNPIPE_NORMAL);
+		if (unlikely(ret < 0))
+			break;
+	}
+
+	cobalt_atomic_leave(s);
+
+	if (unlikely(i < n)) {
+		while (n > i) {
+			if (mbufv[--n])
+				xnheap_free(rsk->bufpool, mbufv[n]);
+		}
+	}
+
+	if (rfd)
+		rtdm_fd_unlock(rfd);
+
+	return n ?: ret;
+}
+
 static ssize_t xddp_write(struct rtdm_fd *fd,
 			  const void *buf, size_t len)
 {
@@ -1128,6 +1435,8 @@ struct rtipc_protocol xddp_proto_driver = {
 		.close = xddp_close,
 		.recvmsg = xddp_recvmsg,
 		.sendmsg = xddp_sendmsg,
+		.recvmmsg = xddp_recvmmsg,
+		.sendmmsg = xddp_sendmmsg,
 		.read = xddp_read,
 		.write = xddp_write,
 		.ioctl = xddp_ioctl,
@@ -57,7 +57,9 @@ struct rtpacket_type {
 int __rtdev_add_pack(struct rtpacket_type *pt, struct module *module);
 #define rtdev_add_pack(pt) __rtdev_add_pack(pt, THIS_MODULE)
 
+void __rtdev_remove_pack(struct rtpacket_type *pt);
 void rtdev_remove_pack(struct rtpacket_type *pt);
+void rtdev_sync_packs(void);
 
 static inline bool rtdev_lock_pack(struct rtpacket_type *pt)
 {
@@ -69,9 +71,30 @@ static inline void rtdev_unlock_pack(struct rtpacket_type *pt)
 	module_put(pt->owner);
 }
 
+/***
+ * stack manager counters, see rt_stack_mgr_get_stats()
+ */
+struct rt_stack_mgr_stats {
+	int cpu; /* -1: any CPU */
+	unsigned int prio;
+	unsigned long frames; /* frames delivered */
+	unsigned long drops; /* frames dropped on queue overflow */
+	unsigned long wakeups;
+	unsigned int depth; /* frames currently queued */
+	unsigned int max_depth;
+	/* first queued frame to manager wakeup */
+	nanosecs_rel_t avg_lat;
+	nanosecs_rel_t max_lat;
+};
+
 void rt_stack_connect(struct rtnet_device *rtdev, struct rtnet_mgr *mgr);
 void rt_stack_disconnect(struct rtnet_device *rtdev);
 
+int rt_stack_mgr_attach(struct rtnet_device *rtdev);
+void rt_stack_mgr_detach(struct rtnet_device *rtdev);
+int rt_stack_mgr_get_stats(struct rtnet_device *rtdev,
+			   struct rt_stack_mgr_stats *stats);
+
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK)
 void rt_stack_deliver(struct rtskb *rtskb);
 #endif /* CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK */
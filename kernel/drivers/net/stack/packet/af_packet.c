@@ -123,9 +123,9 @@ static int rt_packet_bind(struct rtdm_fd *fd, struct rtsocket *sock,
 
 	rtdm_lock_get_irqsave(&sock->param_lock, context);
 
-	/* release existing binding */
+	/* release existing binding, pt is not released */
 	if (pt->type != 0)
-		rtdev_remove_pack(pt);
+		__rtdev_remove_pack(pt);
 
 	pt->type = new_type;
 	sock->prot.packet.ifindex = sll->sll_ifindex;
@@ -241,12 +241,15 @@ static void rt_packet_close(struct rtdm_fd *fd)
 	rtdm_lock_get_irqsave(&sock->param_lock, context);
 
 	if (pt->type != 0) {
-		rtdev_remove_pack(pt);
+		__rtdev_remove_pack(pt);
 		pt->type = 0;
 	}
 
 	rtdm_lock_put_irqrestore(&sock->param_lock, context);
 
+	/* the socket may still be looked up by receivers */
+	rtdev_sync_packs();
+
 	/* free packets in incoming queue */
 	while ((del = rtskb_dequeue(&sock->incoming)) != NULL) {
 		kfree_rtskb(del);
@@ -646,6 +646,8 @@ int rt_unregister_rtnetdev(struct rtnet_device *rtdev)
 
 	mutex_unlock(&rtnet_devices_nrt_lock);
 
+	rt_stack_mgr_detach(rtdev);
+
 	clear_bit(__RTNET_LINK_STATE_PRESENT, &rtdev->link_state);
 
 	RTNET_ASSERT(atomic_read(&rtdev->refcount) == 0,
@@ -792,6 +794,12 @@ int rtdev_open(struct rtnet_device *rtdev)
 	if (!rtdev_reference(rtdev))
 		return -EIDRM;
 
+	ret = rt_stack_mgr_attach(rtdev);
+	if (ret) {
+		rtdev_dereference(rtdev);
+		return ret;
+	}
+
 	if (rtdev->open) /* Call device private open method  */
 		ret = rtdev->open(rtdev);
 
@@ -254,6 +254,58 @@ static struct xnvfile_regular rtnet_stats_vfile = {
 	.ops = &rtnet_stats_vfile_ops,
 };
 
+static void rtnet_stack_mgr_print(struct xnvfile_regular_iterator *it,
+				  const char *name,
+				  struct rt_stack_mgr_stats *stats)
+{
+	char cpu[8] = "any";
+
+	if (stats->cpu >= 0)
+		ksformat(cpu, sizeof(cpu), "%d", stats->cpu);
+
+	xnvfile_printf(it,
+		       "%-15s %-4s %4u %10lu %7lu %8lu %5u %5u %9lld %9lld\n",
+		       name, cpu, stats->prio, stats->frames, stats->drops,
+		       stats->wakeups, stats->depth, stats->max_depth,
+		       (long long)stats->avg_lat, (long long)stats->max_lat);
+}
+
+static int rtnet_stack_mgr_show(struct xnvfile_regular_iterator *it,
+				void *data)
+{
+	struct rt_stack_mgr_stats stats;
+	struct rtnet_device *rtdev;
+
+	if (it->pos == 0) {
+		xnvfile_printf(it, "%-15s %-4s %4s %10s %7s %8s %5s %5s "
+			       "%9s %9s\n", "Manager", "CPU", "Prio", "Frames",
+			       "Drops", "Wakeups", "Depth", "Max", "Lat(avg)",
+			       "Lat(max)");
+		rt_stack_mgr_get_stats(NULL, &stats);
+		rtnet_stack_mgr_print(it, "shared", &stats);
+		return 0;
+	}
+
+	rtdev = __rtdev_get_by_index(it->pos);
+	if (rtdev == NULL || rt_stack_mgr_get_stats(rtdev, &stats))
+		return VFILE_SEQ_SKIP;
+
+	rtnet_stack_mgr_print(it, rtdev->name, &stats);
+
+	return 0;
+}
+
+static struct xnvfile_regular_ops rtnet_stack_mgr_vfile_ops = {
+	.begin = rtnet_stats_begin,
+	.next = rtnet_stats_next,
+	.show = rtnet_stack_mgr_show,
+};
+
+static struct xnvfile_regular rtnet_stack_mgr_vfile = {
+	.entry = { .lockops = &rtnet_devices_nrt_lock_ops, },
+	.ops = &rtnet_stack_mgr_vfile_ops,
+};
+
 static int rtnet_proc_register(void)
 {
 	int err;
@@ -282,8 +334,16 @@ static int rtnet_proc_register(void)
 	if (err < 0)
 		goto error5;
 
+	err = xnvfile_init_regular("stack_mgr", &rtnet_stack_mgr_vfile,
+				   &rtnet_proc_root);
+	if (err < 0)
+		goto error6;
+
 	return 0;
 
+error6:
+	xnvfile_destroy_regular(&rtnet_stats_vfile);
+
 error5:
 	xnvfile_destroy_regular(&rtnet_version_vfile);
 
@@ -303,6 +363,7 @@ error1:
 
 static void rtnet_proc_unregister(void)
 {
+	xnvfile_destroy_regular(&rtnet_stack_mgr_vfile);
 	xnvfile_destroy_regular(&rtnet_stats_vfile);
 	xnvfile_destroy_regular(&rtnet_version_vfile);
 	xnvfile_destroy_regular(&rtnet_rtskb_vfile);
@@ -23,6 +23,11 @@
  */
 
 #include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/rculist.h>
+#include <linux/delay.h>
 
 #include <rtdev.h>
 #include <rtnet_internal.h>
@@ -33,18 +38,161 @@ static unsigned int stack_mgr_prio = RTNET_DEF_STACK_PRIORITY;
 module_param(stack_mgr_prio, uint, 0444);
 MODULE_PARM_DESC(stack_mgr_prio, "Priority of the stack manager task");
 
+static bool stack_mgr_per_device;
+module_param(stack_mgr_per_device, bool, 0444);
+MODULE_PARM_DESC(stack_mgr_per_device,
+		 "Give each network device its own stack manager task");
+
+static int stack_mgr_cpu[MAX_RT_DEVICES] = {
+	[0 ... MAX_RT_DEVICES - 1] = -1
+};
+module_param_array(stack_mgr_cpu, int, NULL, 0444);
+MODULE_PARM_DESC(stack_mgr_cpu,
+		 "CPU of the per-device stack managers, by interface index "
+		 "(-1: any CPU). Setting a CPU implies a per-device manager");
+
+static unsigned int stack_mgr_dev_prio[MAX_RT_DEVICES];
+module_param_array(stack_mgr_dev_prio, uint, NULL, 0444);
+MODULE_PARM_DESC(stack_mgr_dev_prio,
+		 "Priority of the per-device stack managers, by interface "
+		 "index (0: stack_mgr_prio)");
+
 #if (CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE &                                    \
      (CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE - 1)) != 0
 #error CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE must be power of 2!
 #endif
 static DECLARE_RTSKB_FIFO(rx, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
 
+struct rt_stack_mgr {
+	struct rtnet_mgr *mgr;
+	struct rtskb_fifo *rx;
+	int cpu;
+	unsigned int prio;
+	nanosecs_abs_t pending_since; /* first frame queued since last wakeup */
+	unsigned long frames;
+	unsigned long drops;
+	unsigned long wakeups;
+	unsigned int max_depth;
+	unsigned long nr_lat;
+	u64 sum_lat;
+	nanosecs_rel_t max_lat;
+};
+
+/* Private stack manager of a device, see stack_mgr_per_device. */
+struct rt_stack_mgr_dev {
+	struct rt_stack_mgr base;
+	struct rtnet_mgr mgr;
+	char name[32];
+	DECLARE_RTSKB_FIFO(rx, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+};
+
+static struct rt_stack_mgr shared_stack_mgr = {
+	.rx = &rx.fifo,
+	.cpu = -1,
+};
+
+/*
+ * Protocol handlers are looked up without locking: updaters
+ * serialize on rt_packets_lock and publish list changes RCU-style,
+ * receivers only account for their presence in the per-CPU reader
+ * counters of the current epoch while walking the lists. A removed
+ * entry may not be reused before rtdev_sync_packs() has waited for
+ * all readers which might still see it, with one exception: an entry
+ * may be moved to another list right away, since walking the lists
+ * stops on any list head.
+ */
 struct list_head rt_packets[RTPACKET_HASH_TBL_SIZE];
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
 struct list_head rt_packets_all;
 #endif /* CONFIG_XENO_DRIVERS_NET_ETH_P_ALL */
 DEFINE_RTDM_LOCK(rt_packets_lock);
 
+struct rt_packets_readers {
+	atomic_t count[2];
+};
+
+static DEFINE_PER_CPU(struct rt_packets_readers, rt_packets_readers);
+static unsigned int rt_packets_epoch;
+static DEFINE_MUTEX(rt_packets_sync_lock);
+
+static inline atomic_t *rt_packets_read_lock(void)
+{
+	struct rt_packets_readers *readers = raw_cpu_ptr(&rt_packets_readers);
+	atomic_t *count;
+
+	count = &readers->count[READ_ONCE(rt_packets_epoch) & 1];
+	atomic_inc(count);
+	smp_mb__after_atomic();
+
+	return count;
+}
+
+static inline void rt_packets_read_unlock(atomic_t *count)
+{
+	smp_mb__before_atomic();
+	atomic_dec(count);
+}
+
+static inline struct rtpacket_type *rt_packets_entry(struct list_head *p)
+{
+	if (p >= rt_packets && p < rt_packets + RTPACKET_HASH_TBL_SIZE)
+		return NULL;
+#ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
+	if (p == &rt_packets_all)
+		return NULL;
+#endif /* CONFIG_XENO_DRIVERS_NET_ETH_P_ALL */
+
+	return list_entry(p, struct rtpacket_type, list_entry);
+}
+
+#define rt_packets_for_each(pos, head)                                         \
+	for (pos = rt_packets_entry(READ_ONCE((head)->next)); pos;             \
+	     pos = rt_packets_entry(READ_ONCE(pos->list_entry.next)))
+
+static int rt_packets_readers_active(int idx)
+{
+	int cpu, sum = 0;
+
+	for_each_possible_cpu (cpu)
+		sum += atomic_read(
+			&per_cpu_ptr(&rt_packets_readers, cpu)->count[idx]);
+
+	return sum;
+}
+
+/***
+ *  rtdev_sync_packs:   wait for protocol lookups in progress to complete
+ *
+ *  Entries removed by __rtdev_remove_pack() may be released once this
+ *  call returns. Secondary mode only, may sleep.
+ */
+void rtdev_sync_packs(void)
+{
+	int n, idx;
+
+	mutex_lock(&rt_packets_sync_lock);
+
+	/*
+	 * Flip the epoch twice like classic SRCU does, so that a
+	 * reader which sampled the epoch right before a flip is
+	 * waited for as well.
+	 */
+	for (n = 0; n < 2; n++) {
+		idx = rt_packets_epoch & 1;
+		smp_mb();
+		WRITE_ONCE(rt_packets_epoch, rt_packets_epoch + 1);
+		smp_mb();
+		while (rt_packets_readers_active(idx))
+			msleep(1);
+	}
+
+	smp_mb();
+
+	mutex_unlock(&rt_packets_sync_lock);
+}
+
+EXPORT_SYMBOL_GPL(rtdev_sync_packs);
+
 /***
  *  rtdev_add_pack:         add protocol (Layer 3)
  *  @pt:                    the new protocol
@@ -54,7 +202,10 @@ int __rtdev_add_pack(struct rtpacket_type *pt, struct module *module)
 	int ret = 0;
 	rtdm_lockctx_t context;
 
-	INIT_LIST_HEAD(&pt->list_entry);
+	/*
+	 * Do not reinit the list entry, a reader might still be
+	 * walking from it if it was just removed from another list.
+	 */
 	pt->refcount = 0;
 	if (pt->trylock == NULL)
 		pt->trylock = rtdev_lock_pack;
@@ -66,12 +217,12 @@ int __rtdev_add_pack(struct rtpacket_type *pt, struct module *module)
 
 	if (pt->type == htons(ETH_P_ALL))
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
-		list_add_tail(&pt->list_entry, &rt_packets_all);
+		list_add_tail_rcu(&pt->list_entry, &rt_packets_all);
 #else /* !CONFIG_XENO_DRIVERS_NET_ETH_P_ALL */
 		ret = -EINVAL;
 #endif /* CONFIG_XENO_DRIVERS_NET_ETH_P_ALL */
 	else
-		list_add_tail(
+		list_add_tail_rcu(
 			&pt->list_entry,
 			&rt_packets[ntohs(pt->type) & RTPACKET_HASH_KEY_MASK]);
 
@@ -83,20 +234,37 @@ int __rtdev_add_pack(struct rtpacket_type *pt, struct module *module)
 EXPORT_SYMBOL_GPL(__rtdev_add_pack);
 
 /***
- *  rtdev_remove_pack:  remove protocol (Layer 3)
- *  @pt:                protocol
+ *  __rtdev_remove_pack:  remove protocol (Layer 3), without waiting
+ *  @pt:                  protocol
+ *
+ *  Callable from any context. @pt may be added back right away, but
+ *  must not be released before rtdev_sync_packs() returns.
  */
-void rtdev_remove_pack(struct rtpacket_type *pt)
+void __rtdev_remove_pack(struct rtpacket_type *pt)
 {
 	rtdm_lockctx_t context;
 
 	RTNET_ASSERT(pt != NULL, return;);
 
 	rtdm_lock_get_irqsave(&rt_packets_lock, context);
-	list_del(&pt->list_entry);
+	list_del_rcu(&pt->list_entry);
 	rtdm_lock_put_irqrestore(&rt_packets_lock, context);
 }
 
+EXPORT_SYMBOL_GPL(__rtdev_remove_pack);
+
+/***
+ *  rtdev_remove_pack:  remove protocol (Layer 3)
+ *  @pt:                protocol
+ *
+ *  Secondary mode only, may sleep.
+ */
+void rtdev_remove_pack(struct rtpacket_type *pt)
+{
+	__rtdev_remove_pack(pt);
+	rtdev_sync_packs();
+}
+
 EXPORT_SYMBOL_GPL(rtdev_remove_pack);
 
 /***
@@ -107,10 +275,26 @@ EXPORT_SYMBOL_GPL(rtdev_remove_pack);
  */
 void rtnetif_rx(struct rtskb *skb)
 {
+	struct rt_stack_mgr *mgr;
+	struct rtskb_fifo *fifo;
+	int ret;
+
 	RTNET_ASSERT(skb != NULL, return;);
 	RTNET_ASSERT(skb->rtdev != NULL, return;);
 
-	if (unlikely(rtskb_fifo_insert_inirq(&rx.fifo, skb) < 0)) {
+	mgr = skb->rtdev->stack_mgr ?: &shared_stack_mgr;
+	fifo = mgr->rx;
+
+	rtdm_lock_get(&fifo->write_lock);
+	ret = __rtskb_fifo_insert(fifo, skb);
+	if (likely(ret == 0)) {
+		if (mgr->pending_since == 0)
+			mgr->pending_since = rtdm_clock_read_monotonic();
+	} else
+		mgr->drops++;
+	rtdm_lock_put(&fifo->write_lock);
+
+	if (unlikely(ret < 0)) {
 		rtdm_printk("RTnet: dropping packet in %s()\n", __FUNCTION__);
 		kfree_rtskb(skb);
 	}
@@ -128,8 +312,8 @@ __DELIVER_PREFIX void rt_stack_deliver(struct rtskb *rtskb)
 {
 	unsigned short hash;
 	struct rtpacket_type *pt_entry;
-	rtdm_lockctx_t context;
 	struct rtnet_device *rtdev = rtskb->rtdev;
+	atomic_t *readers;
 	int err;
 	int eth_p_all_hit = 0;
 
@@ -137,18 +321,18 @@ __DELIVER_PREFIX void rt_stack_deliver(struct rtskb *rtskb)
 
 	rtskb->nh.raw = rtskb->data;
 
-	rtdm_lock_get_irqsave(&rt_packets_lock, context);
+	readers = rt_packets_read_lock();
 
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
-	eth_p_all_hit = 0;
-	list_for_each_entry (pt_entry, &rt_packets_all, list_entry) {
-		if (!pt_entry->trylock(pt_entry))
+	rt_packets_for_each(pt_entry, &rt_packets_all)
+	{
+		/* The entry may have just moved to a hash list. */
+		if (pt_entry->type != htons(ETH_P_ALL) ||
+		    !pt_entry->trylock(pt_entry))
 			continue;
-		rtdm_lock_put_irqrestore(&rt_packets_lock, context);
 
 		pt_entry->handler(rtskb, pt_entry);
 
-		rtdm_lock_get_irqsave(&rt_packets_lock, context);
 		pt_entry->unlock(pt_entry);
 		eth_p_all_hit = 1;
 	}
@@ -156,25 +340,22 @@ __DELIVER_PREFIX void rt_stack_deliver(struct rtskb *rtskb)
 
 	hash = ntohs(rtskb->protocol) & RTPACKET_HASH_KEY_MASK;
 
-	list_for_each_entry (pt_entry, &rt_packets[hash], list_entry)
+	rt_packets_for_each(pt_entry, &rt_packets[hash])
 		if (pt_entry->type == rtskb->protocol) {
 			if (!pt_entry->trylock(pt_entry))
 				continue;
-			rtdm_lock_put_irqrestore(&rt_packets_lock, context);
 
 			err = pt_entry->handler(rtskb, pt_entry);
 
-			rtdm_lock_get_irqsave(&rt_packets_lock, context);
 			pt_entry->unlock(pt_entry);
 
 			if (likely(!err)) {
-				rtdm_lock_put_irqrestore(&rt_packets_lock,
-							 context);
+				rt_packets_read_unlock(readers);
 				return;
 			}
 		}
 
-	rtdm_lock_put_irqrestore(&rt_packets_lock, context);
+	rt_packets_read_unlock(readers);
 
 	/* Don't warn if ETH_P_ALL listener were present or when running in
        promiscuous mode (RTcap). */
@@ -190,19 +371,203 @@ __DELIVER_PREFIX void rt_stack_deliver(struct rtskb *rtskb)
 EXPORT_SYMBOL_GPL(rt_stack_deliver);
 #endif /* CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK */
 
+static void rt_stack_mgr_account(struct rt_stack_mgr *mgr)
+{
+	struct rtskb_fifo *fifo = mgr->rx;
+	rtdm_lockctx_t context;
+	nanosecs_abs_t since;
+	nanosecs_rel_t lat;
+	unsigned int depth;
+
+	rtdm_lock_get_irqsave(&fifo->write_lock, context);
+	since = mgr->pending_since;
+	mgr->pending_since = 0;
+	depth = (fifo->write_pos - fifo->read_pos) & fifo->size_mask;
+	rtdm_lock_put_irqrestore(&fifo->write_lock, context);
+
+	mgr->wakeups++;
+	if (depth > mgr->max_depth)
+		mgr->max_depth = depth;
+
+	if (since == 0)
+		return;
+
+	lat = rtdm_clock_read_monotonic() - since;
+	mgr->sum_lat += lat;
+	mgr->nr_lat++;
+	if (lat > mgr->max_lat)
+		mgr->max_lat = lat;
+}
+
 static void rt_stack_mgr_task(void *arg)
 {
-	rtdm_event_t *mgr_event = &((struct rtnet_mgr *)arg)->event;
+	struct rt_stack_mgr *mgr = arg;
+	rtdm_event_t *mgr_event = &mgr->mgr->event;
 	struct rtskb *rtskb;
 
 	while (!rtdm_task_should_stop()) {
 		if (rtdm_event_wait(mgr_event) < 0)
 			break;
 
+		rt_stack_mgr_account(mgr);
+
 		/* we are the only reader => no locking required */
-		while ((rtskb = __rtskb_fifo_remove(&rx.fifo)))
+		while ((rtskb = __rtskb_fifo_remove(mgr->rx))) {
 			rt_stack_deliver(rtskb);
+			mgr->frames++;
+		}
+	}
+}
+
+static int rt_stack_mgr_start(struct rt_stack_mgr *mgr, const char *name)
+{
+	union xnsched_policy_param param;
+	struct xnthread_start_attr sattr;
+	struct xnthread_init_attr iattr;
+	rtdm_task_t *task = &mgr->mgr->task;
+	int ret;
+
+	if (mgr->cpu < 0)
+		return rtdm_task_init(task, name, rt_stack_mgr_task, mgr,
+				      mgr->prio, 0);
+
+	/*
+	 * Same as rtdm_task_init(), with the manager pinned to the
+	 * requested CPU.
+	 */
+	iattr.name = name;
+	iattr.flags = 0;
+	iattr.personality = &xenomai_personality;
+	iattr.affinity = *cpumask_of(mgr->cpu);
+	param.rt.prio = mgr->prio;
+
+	ret = xnthread_init(task, &iattr, &xnsched_class_rt, &param);
+	if (ret)
+		return ret;
+
+	ret = xnthread_register(task, "");
+	if (ret)
+		goto fail;
+
+	sattr.mode = 0;
+	sattr.entry = rt_stack_mgr_task;
+	sattr.cookie = mgr;
+	ret = xnthread_start(task, &sattr);
+	if (ret)
+		goto fail;
+
+	return 0;
+fail:
+	xnthread_cancel(task);
+	return ret;
+}
+
+/***
+ *  rt_stack_mgr_attach - set up the private stack manager of a device
+ *
+ *  Called before the device is opened. Frames received from a device
+ *  which has its own manager are queued and delivered by the latter,
+ *  so the frames of any given flow are still processed in order. The
+ *  manager lives until the device is unregistered.
+ */
+int rt_stack_mgr_attach(struct rtnet_device *rtdev)
+{
+	int cpu = stack_mgr_cpu[rtdev->ifindex - 1], ret;
+	struct rt_stack_mgr_dev *dmgr;
+
+	if (rtdev->stack_mgr || (!stack_mgr_per_device && cpu < 0))
+		return 0;
+
+	if (cpu >= (int)nr_cpu_ids ||
+	    (cpu >= 0 && !xnsched_threading_cpu(cpu)))
+		return -EINVAL;
+
+	dmgr = kzalloc(sizeof(*dmgr), GFP_KERNEL);
+	if (dmgr == NULL)
+		return -ENOMEM;
+
+	rtskb_fifo_init(&dmgr->rx.fifo, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+	dmgr->base.mgr = &dmgr->mgr;
+	dmgr->base.rx = &dmgr->rx.fifo;
+	dmgr->base.cpu = cpu;
+	dmgr->base.prio = stack_mgr_dev_prio[rtdev->ifindex - 1] ?:
+		stack_mgr_prio;
+	ksformat(dmgr->name, sizeof(dmgr->name), "rtnet-stack/%s",
+		 rtdev->name);
+	rtdm_event_init(&dmgr->mgr.event, 0);
+
+	ret = rt_stack_mgr_start(&dmgr->base, dmgr->name);
+	if (ret) {
+		rtdm_event_destroy(&dmgr->mgr.event);
+		kfree(dmgr);
+		return ret;
+	}
+
+	rtdev->stack_mgr = &dmgr->base;
+	if (rtdev->stack_event)
+		rtdev->stack_event = &dmgr->mgr.event;
+
+	return 0;
+}
+
+/***
+ *  rt_stack_mgr_detach - release the private stack manager of a device
+ *
+ *  Called once the device is unregistered.
+ */
+void rt_stack_mgr_detach(struct rtnet_device *rtdev)
+{
+	struct rt_stack_mgr *mgr = rtdev->stack_mgr;
+	struct rt_stack_mgr_dev *dmgr;
+	struct rtskb *rtskb;
+
+	if (mgr == NULL)
+		return;
+
+	dmgr = container_of(mgr, struct rt_stack_mgr_dev, base);
+	rtdev->stack_mgr = NULL;
+	rtdev->stack_event = NULL;
+
+	rtdm_event_destroy(&dmgr->mgr.event);
+	rtdm_task_destroy(&dmgr->mgr.task);
+
+	while ((rtskb = __rtskb_fifo_remove(mgr->rx)))
+		kfree_rtskb(rtskb);
+
+	kfree(dmgr);
+}
+
+/***
+ *  rt_stack_mgr_get_stats - read the counters of a stack manager
+ *  @rtdev: device owning the manager, NULL for the shared one
+ *
+ *  Returns -ENOENT if @rtdev has no private manager.
+ */
+int rt_stack_mgr_get_stats(struct rtnet_device *rtdev,
+			   struct rt_stack_mgr_stats *stats)
+{
+	struct rt_stack_mgr *mgr = &shared_stack_mgr;
+	struct rtskb_fifo *fifo;
+
+	if (rtdev) {
+		mgr = rtdev->stack_mgr;
+		if (mgr == NULL)
+			return -ENOENT;
 	}
+
+	fifo = mgr->rx;
+	stats->cpu = mgr->cpu;
+	stats->prio = mgr->prio;
+	stats->frames = mgr->frames;
+	stats->drops = mgr->drops;
+	stats->wakeups = mgr->wakeups;
+	stats->depth = (READ_ONCE(fifo->write_pos) -
+			READ_ONCE(fifo->read_pos)) & fifo->size_mask;
+	stats->max_depth = mgr->max_depth;
+	stats->max_lat = mgr->max_lat;
+	stats->avg_lat = mgr->nr_lat ? div64_u64(mgr->sum_lat, mgr->nr_lat) : 0;
+
+	return 0;
 }
 
 /***
@@ -210,6 +575,9 @@ static void rt_stack_mgr_task(void *arg)
  */
 void rt_stack_connect(struct rtnet_device *rtdev, struct rtnet_mgr *mgr)
 {
+	if (rtdev->stack_mgr)
+		mgr = rtdev->stack_mgr->mgr;
+
 	rtdev->stack_event = &mgr->event;
 }
 
@@ -242,8 +610,10 @@ int rt_stack_mgr_init(struct rtnet_mgr *mgr)
 
 	rtdm_event_init(&mgr->event, 0);
 
-	return rtdm_task_init(&mgr->task, "rtnet-stack", rt_stack_mgr_task, mgr,
-			      stack_mgr_prio, 0);
+	shared_stack_mgr.mgr = mgr;
+	shared_stack_mgr.prio = stack_mgr_prio;
+
+	return rt_stack_mgr_start(&shared_stack_mgr, "rtnet-stack");
 }
 
 /***
@@ -18,6 +18,8 @@
 
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/math64.h>
 #include <linux/semaphore.h>
 #include <cobalt/kernel/trace.h>
 #include <cobalt/kernel/arith.h>
@@ -436,6 +438,287 @@ static int rt_tmbench_stop(struct rt_tmbench_context *ctx, void *u_res)
 	return ret;
 }
 
+#define TMQ_MAX_TIMERS	65536
+
+struct tmq_timer {
+	union {
+		struct xntlholder l;
+		struct xntrbholder rb;
+		struct xntwholder w;
+	} u;
+	unsigned long long date;
+};
+
+union tmq_queue {
+	struct list_head l;
+	struct xntrbtree rb;
+	struct xntwheel w;
+};
+
+struct tmq_ops {
+	void (*init)(union tmq_queue *q);
+	void (*insert)(union tmq_queue *q, struct tmq_timer *t);
+	void (*remove)(union tmq_queue *q, struct tmq_timer *t);
+	struct tmq_timer *(*head)(union tmq_queue *q);
+};
+
+static void tmq_list_init(union tmq_queue *q)
+{
+	xntlist_init(&q->l);
+}
+
+static void tmq_list_insert(union tmq_queue *q, struct tmq_timer *t)
+{
+	t->u.l.key = t->date;
+	t->u.l.prio = XNTIMER_STDPRIO;
+	xntlist_insert(&q->l, &t->u.l);
+}
+
+static void tmq_list_remove(union tmq_queue *q, struct tmq_timer *t)
+{
+	xntlist_remove(&q->l, &t->u.l);
+}
+
+static struct tmq_timer *tmq_list_head(union tmq_queue *q)
+{
+	struct xntlholder *h = xntlist_head(&q->l);
+
+	return h ? container_of(h, struct tmq_timer, u.l) : NULL;
+}
+
+static void tmq_rbtree_init(union tmq_queue *q)
+{
+	xntrbtree_init(&q->rb);
+}
+
+static void tmq_rbtree_insert(union tmq_queue *q, struct tmq_timer *t)
+{
+	t->u.rb.date = t->date;
+	t->u.rb.prio = XNTIMER_STDPRIO;
+	xntrbtree_insert(&q->rb, &t->u.rb);
+}
+
+static void tmq_rbtree_remove(union tmq_queue *q, struct tmq_timer *t)
+{
+	xntrbtree_remove(&q->rb, &t->u.rb);
+}
+
+static struct tmq_timer *tmq_rbtree_head(union tmq_queue *q)
+{
+	struct xntrbholder *h = xntrbtree_head(&q->rb);
+
+	return h ? container_of(h, struct tmq_timer, u.rb) : NULL;
+}
+
+static void tmq_wheel_init(union tmq_queue *q)
+{
+	xntwheel_init(&q->w);
+}
+
+static void tmq_wheel_insert(union tmq_queue *q, struct tmq_timer *t)
+{
+	t->u.w.date = t->date;
+	t->u.w.prio = XNTIMER_STDPRIO;
+	xntwheel_insert(&q->w, &t->u.w);
+}
+
+static void tmq_wheel_remove(union tmq_queue *q, struct tmq_timer *t)
+{
+	xntwheel_remove(&q->w, &t->u.w);
+}
+
+static struct tmq_timer *tmq_wheel_head(union tmq_queue *q)
+{
+	struct xntwholder *h = xntwheel_head(&q->w);
+
+	return h ? container_of(h, struct tmq_timer, u.w) : NULL;
+}
+
+static const struct tmq_ops tmq_ops[RTTST_TMQUEUE_NR] = {
+	[RTTST_TMQUEUE_LIST] = {
+		.init = tmq_list_init,
+		.insert = tmq_list_insert,
+		.remove = tmq_list_remove,
+		.head = tmq_list_head,
+	},
+	[RTTST_TMQUEUE_RBTREE] = {
+		.init = tmq_rbtree_init,
+		.insert = tmq_rbtree_insert,
+		.remove = tmq_rbtree_remove,
+		.head = tmq_rbtree_head,
+	},
+	[RTTST_TMQUEUE_WHEEL] = {
+		.init = tmq_wheel_init,
+		.insert = tmq_wheel_insert,
+		.remove = tmq_wheel_remove,
+		.head = tmq_wheel_head,
+	},
+};
+
+static inline unsigned int tmq_random(unsigned int *seed)
+{
+	unsigned int x = *seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed = x;
+
+	return x;
+}
+
+static inline u64 tmq_delay(unsigned int *seed, u64 span)
+{
+	u64 r, rem;
+
+	r = ((u64)tmq_random(seed) << 32) | tmq_random(seed);
+	div64_u64_rem(r, span, &rem);
+
+	return rem;
+}
+
+static inline void tmq_account(nanosecs_abs_t start,
+			       __s64 *sum, __s64 *max)
+{
+	__s64 d = rtdm_clock_read_monotonic() - start;
+
+	*sum += d;
+	if (d > *max)
+		*max = d;
+}
+
+/*
+ * Load a private queue with bench->nrtimers timers, then run
+ * bench->nrops operations on it, either expiring the head timer or
+ * cancelling a random one, rearming the timer in both cases. Every
+ * queue kind is fed the very same sequence of dates.
+ */
+static int tmq_run(const struct tmq_ops *ops, union tmq_queue *q,
+		   struct tmq_timer *timers,
+		   struct rttst_tmqueue_bench *bench,
+		   struct rttst_tmqueue_stats *st)
+{
+	__s64 insert_sum = 0, remove_sum = 0, expire_sum = 0;
+	unsigned int n, seed = 0x2545f491, inserts = 0, removals = 0,
+		expiries = 0;
+	unsigned long long now = 0;
+	nanosecs_abs_t start;
+	struct tmq_timer *t;
+	int ret = 0;
+	spl_t s;
+
+	memset(st, 0, sizeof(*st));
+	ops->init(q);
+
+	for (n = 0; n < bench->nrtimers; n++) {
+		t = timers + n;
+		t->date = tmq_delay(&seed, bench->span);
+		cobalt_atomic_enter(s);
+		start = rtdm_clock_read_monotonic();
+		ops->insert(q, t);
+		tmq_account(start, &insert_sum, &st->insert_max_ns);
+		cobalt_atomic_leave(s);
+		inserts++;
+		if ((n % 256) == 0)
+			cond_resched();
+	}
+
+	for (n = 0; n < bench->nrops; n++) {
+		cobalt_atomic_enter(s);
+		if (tmq_random(&seed) % 100 < bench->cancel_ratio) {
+			t = timers + tmq_random(&seed) % bench->nrtimers;
+			start = rtdm_clock_read_monotonic();
+			ops->remove(q, t);
+			tmq_account(start, &remove_sum, &st->remove_max_ns);
+			removals++;
+		} else {
+			start = rtdm_clock_read_monotonic();
+			t = ops->head(q);
+			ops->remove(q, t);
+			tmq_account(start, &expire_sum, &st->expire_max_ns);
+			expiries++;
+			if (t->date < now) {
+				cobalt_atomic_leave(s);
+				printk(XENO_ERR "timerbench: queue %td out of order"
+				       " (%llu < %llu)\n", ops - tmq_ops,
+				       t->date, now);
+				ret = -EPROTO;
+				break;
+			}
+			now = t->date;
+		}
+		t->date = now + tmq_delay(&seed, bench->span);
+		start = rtdm_clock_read_monotonic();
+		ops->insert(q, t);
+		tmq_account(start, &insert_sum, &st->insert_max_ns);
+		cobalt_atomic_leave(s);
+		inserts++;
+		if ((n % 256) == 0)
+			cond_resched();
+	}
+
+	for (;;) {
+		cobalt_atomic_enter(s);
+		t = ops->head(q);
+		if (t)
+			ops->remove(q, t);
+		cobalt_atomic_leave(s);
+		if (t == NULL)
+			break;
+	}
+
+	st->insert_avg_ns = div_s64(insert_sum, inserts);
+	if (removals)
+		st->remove_avg_ns = div_s64(remove_sum, removals);
+	if (expiries)
+		st->expire_avg_ns = div_s64(expire_sum, expiries);
+
+	return ret;
+}
+
+static int rt_tmbench_queues(struct rtdm_fd *fd, void __user *u_bench)
+{
+	struct rttst_tmqueue_bench bench;
+	struct tmq_timer *timers;
+	union tmq_queue *q;
+	int ret, kind;
+
+	ret = rtdm_copy_from_user(fd, &bench, u_bench, sizeof(bench));
+	if (ret)
+		return ret;
+
+	if (bench.nrtimers == 0 || bench.nrtimers > TMQ_MAX_TIMERS ||
+	    bench.span == 0 ||
+	    bench.cancel_ratio < 0 || bench.cancel_ratio > 100)
+		return -EINVAL;
+
+	timers = vmalloc(sizeof(*timers) * bench.nrtimers);
+	if (timers == NULL)
+		return -ENOMEM;
+
+	q = kmalloc(sizeof(*q), GFP_KERNEL);
+	if (q == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (kind = 0; kind < RTTST_TMQUEUE_NR; kind++) {
+		ret = tmq_run(tmq_ops + kind, q, timers, &bench,
+			      bench.stats + kind);
+		if (ret)
+			break;
+	}
+
+	kfree(q);
+
+	if (ret == 0)
+		ret = rtdm_copy_to_user(fd, u_bench, &bench, sizeof(bench));
+out:
+	vfree(timers);
+
+	return ret;
+}
+
 static int rt_tmbench_ioctl_nrt(struct rtdm_fd *fd,
 				unsigned int request, void __user *arg)
 {
@@ -452,6 +735,10 @@ static int rt_tmbench_ioctl_nrt(struct rtdm_fd *fd,
 	COMPAT_CASE(RTTST_RTIOC_TMBENCH_STOP):
 		err = rt_tmbench_stop(ctx, arg);
 		break;
+
+	case RTTST_RTIOC_TMBENCH_QUEUES:
+		err = rt_tmbench_queues(fd, arg);
+		break;
 	default:
 		err = -ENOSYS;
 	}
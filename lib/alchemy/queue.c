@@ -46,6 +46,8 @@ static DEFINE_NAME_GENERATOR(queue_namegen, "queue",
 
 DEFINE_SYNC_LOOKUP(queue, RT_QUEUE);
 
+#define QUEUE_FLUSH_BATCH  32
+
 #ifdef CONFIG_XENO_REGISTRY
 
 static int prepare_waiter_cache(struct fsobstack *o,
@@ -1043,10 +1045,11 @@ out:
 int rt_queue_flush(RT_QUEUE *queue)
 {
 	struct alchemy_queue_msg *msg, *tmp;
+	void *msgs[QUEUE_FLUSH_BATCH];
 	struct alchemy_queue *qcb;
 	struct syncstate syns;
 	struct service svc;
-	int ret = 0;
+	int ret = 0, nr = 0;
 
 	CANCEL_DEFER(svc);
 
@@ -1061,13 +1064,20 @@ int rt_queue_flush(RT_QUEUE *queue)
 	 * Flushing a message queue is not an operation we should see
 	 * in any fast path within an application, so locking out
 	 * other threads from using that queue while we flush it is
-	 * acceptable.
+	 * acceptable. Release the message buffers in batches, so
+	 * that we lock the queue heap once per batch.
 	 */
 	if (!list_empty(&qcb->mq)) {
 		list_for_each_entry_safe(msg, tmp, &qcb->mq, next) {
 			list_remove(&msg->next);
-			heapobj_free(&qcb->hobj, msg);
+			msgs[nr++] = msg;
+			if (nr == QUEUE_FLUSH_BATCH) {
+				heapobj_free_bulk(&qcb->hobj, msgs, nr);
+				nr = 0;
+			}
 		}
+		if (nr > 0)
+			heapobj_free_bulk(&qcb->hobj, msgs, nr);
 	}
 
 	put_alchemy_queue(qcb, &syns);
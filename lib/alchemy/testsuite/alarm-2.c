@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <boilerplate/tunables.h>
+#include <copperplate/traceobj.h>
+#include <copperplate/timerobj.h>
+#include <alchemy/task.h>
+#include <alchemy/alarm.h>
+#include <alchemy/timer.h>
+
+/*
+ * Arm a large set of periodic alarms with staggered dates, then
+ * report the dispatch jitter observed by each of them. This
+ * exercises the timer indexing method of Copperplate
+ * (--with-timer-index), and the timer server(s) dispatching the
+ * handlers (--per-cpu-timers).
+ */
+
+#define MAX_ALARMS	2000
+#define ALARM_PERIOD	100000000ULL	/* 100 ms */
+#define RUN_TIME	2000000000ULL	/* 2 s */
+
+static struct traceobj trobj;
+
+static RT_TASK t_main;
+
+static int nr_alarms;
+
+static struct alarm_stat {
+	RT_ALARM alrm;
+	RTIME next;
+	RTIME min_lat;
+	RTIME max_lat;
+	RTIME sum_lat;
+	unsigned long hits;
+} stats[MAX_ALARMS];
+
+static void alarm_handler(void *arg)
+{
+	struct alarm_stat *st = arg;
+	RTIME now, lat;
+
+	now = rt_timer_read();
+	lat = now > st->next ? now - st->next : 0;
+	st->next += ALARM_PERIOD;
+
+	if (st->hits++ == 0 || lat < st->min_lat)
+		st->min_lat = lat;
+	if (lat > st->max_lat)
+		st->max_lat = lat;
+	st->sum_lat += lat;
+}
+
+static void print_server_stats(void)
+{
+	struct timerobj_stats st;
+	int n;
+
+	for (n = 0; timerobj_get_stats(n, &st) == 0; n++) {
+		if (st.dispatches == 0)
+			continue;
+		printf("  server #%d (cpu %d): %llu calls, "
+		       "latency avg=%.3f max=%.3f us, "
+		       "runtime avg=%.3f max=%.3f us\n",
+		       n, st.cpu, st.dispatches,
+		       st.latency_sum / (double)st.dispatches / 1000.0,
+		       st.latency_max / 1000.0,
+		       st.runtime_sum / (double)st.dispatches / 1000.0,
+		       st.runtime_max / 1000.0);
+	}
+}
+
+static void main_task(void *arg)
+{
+	RTIME delay, worst = 0, sum = 0, best = ~0ULL;
+	unsigned long hits = 0;
+	struct alarm_stat *st;
+	int ret, n;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < nr_alarms; n++) {
+		st = stats + n;
+		/* Spread the initial shots over a full period. */
+		delay = ALARM_PERIOD + ALARM_PERIOD * n / nr_alarms;
+		st->next = rt_timer_read() + delay;
+		ret = rt_alarm_start(&st->alrm, delay, ALARM_PERIOD);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	ret = rt_task_sleep(RUN_TIME);
+	traceobj_check(&trobj, ret, 0);
+
+	for (n = 0; n < nr_alarms; n++) {
+		st = stats + n;
+		ret = rt_alarm_stop(&st->alrm);
+		traceobj_check(&trobj, ret, 0);
+		traceobj_assert(&trobj, st->hits > 0);
+		hits += st->hits;
+		sum += st->sum_lat;
+		if (st->min_lat < best)
+			best = st->min_lat;
+		if (st->max_lat > worst)
+			worst = st->max_lat;
+	}
+
+	if (get_runtime_tunable(verbosity_level) > 0) {
+		printf("%d alarms, %lu shots, latency min=%.3f avg=%.3f max=%.3f us\n",
+		       nr_alarms, hits, best / 1000.0,
+		       sum / (double)hits / 1000.0, worst / 1000.0);
+		print_server_stats();
+		for (n = 0; n < nr_alarms; n++) {
+			st = stats + n;
+			if (get_runtime_tunable(verbosity_level) < 2 &&
+			    st->max_lat < worst)
+				continue;
+			printf("  alarm #%d: %lu shots, jitter=%.3f us\n",
+			       n, st->hits,
+			       (st->max_lat - st->min_lat) / 1000.0);
+		}
+	}
+
+	for (n = 0; n < nr_alarms; n++) {
+		ret = rt_alarm_delete(&stats[n].alrm);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	int ret, n;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	/*
+	 * Create as many alarms as the private memory pool allows,
+	 * up to MAX_ALARMS.
+	 */
+	for (n = 0; n < MAX_ALARMS; n++) {
+		ret = rt_alarm_create(&stats[n].alrm, NULL,
+				      alarm_handler, stats + n);
+		if (ret == -ENOMEM && n > 0)
+			break;
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	nr_alarms = n;
+
+	ret = rt_task_spawn(&t_main, "main_task", 0,  50, 0, main_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_join(&trobj);
+
+	exit(0);
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/queue.h>
+
+/*
+ * Flush a queue holding more messages than rt_queue_flush() releases
+ * in a single batch, then make sure all buffers went back to the
+ * queue pool.
+ */
+
+#define NMESSAGES  100
+
+static struct traceobj trobj;
+
+static RT_TASK t_main;
+
+static void main_task(void *arg)
+{
+	RT_QUEUE_INFO info;
+	int ret, n, msg;
+	size_t usedmem;
+	RT_QUEUE q;
+
+	traceobj_enter(&trobj);
+
+	ret = rt_queue_create(&q, "QUEUE", NMESSAGES * 64, NMESSAGES, Q_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	usedmem = info.usedmem;
+
+	for (n = 0; n < NMESSAGES; n++) {
+		/* Vary the message sizes a bit. */
+		ret = rt_queue_write(&q, &n, sizeof(n) + (n % 5) * 8, Q_NORMAL);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.nmessages == NMESSAGES);
+	traceobj_assert(&trobj, info.usedmem > usedmem);
+
+	ret = rt_queue_flush(&q);
+	traceobj_check(&trobj, ret, NMESSAGES);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.nmessages == 0);
+	traceobj_assert(&trobj, info.usedmem == usedmem);
+
+	ret = rt_queue_read(&q, &msg, sizeof(msg), TM_NONBLOCK);
+	traceobj_check(&trobj, ret, -EWOULDBLOCK);
+
+	ret = rt_queue_flush(&q);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_delete(&q);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	int ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_task_spawn(&t_main, "main_task", 0,  50, 0, main_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_join(&trobj);
+
+	exit(0);
+}
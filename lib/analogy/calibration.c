@@ -29,6 +29,7 @@
 #include "iniparser/iniparser.h"
 #include "boilerplate/list.h"
 #include "calibration.h"
+#include "convert.h"
 
 #define CHK(func, ...)								\
 do {										\
@@ -39,20 +40,9 @@ do {										\
 
 #define ARRAY_LEN(a)  (sizeof(a) / sizeof((a)[0]))
 
-static lsampl_t data32_get(void *src)
-{
-	return (lsampl_t) * ((lsampl_t *) (src));
-}
-
-static lsampl_t data16_get(void *src)
-{
-	return (lsampl_t) * ((sampl_t *) (src));
-}
-
-static lsampl_t data8_get(void *src)
-{
-	return (lsampl_t) * ((unsigned char *)(src));
-}
+A4L_DEFINE_RAWTOPOLY(rawtodcal_32, uint32_t)
+A4L_DEFINE_RAWTOPOLY(rawtodcal_16, uint16_t)
+A4L_DEFINE_RAWTOPOLY(rawtodcal_8, uint8_t)
 
 static void data32_set(void *dst, lsampl_t val)
 {
@@ -348,54 +338,55 @@ int a4l_get_softcal_converter(struct a4l_polynomial *converter,
 int a4l_rawtodcal(a4l_chinfo_t *chan, double *dst, void *src,
 		  int cnt, struct a4l_polynomial *converter)
 {
-	int i = 0, j = 0, k = 0;
-	double term = 1.0;
-	lsampl_t tmp;
-	int size;
-
-	/* Temporary data accessor */
-	lsampl_t(*datax_get) (void *);
-
 	/* Basic checking */
 	if (chan == NULL)
 		return -EINVAL;
 
-	/* Find out the size in memory */
-	size = a4l_sizeof_chan(chan);
-
-	/* Get the suitable accessor */
+	/* Convert with the kernel suited to the sample width */
 	switch (a4l_sizeof_chan(chan)) {
 	case 4:
-		datax_get = data32_get;
+		A4L_CONVERT(rawtodcal_32, dst, src, cnt, converter);
 		break;
 	case 2:
-		datax_get = data16_get;
+		A4L_CONVERT(rawtodcal_16, dst, src, cnt, converter);
 		break;
 	case 1:
-		datax_get = data8_get;
+		A4L_CONVERT(rawtodcal_8, dst, src, cnt, converter);
 		break;
 	default:
 		return -EINVAL;
 	};
 
-	while (j < cnt) {
-		/* Properly retrieve the data */
-		tmp = datax_get(src + i);
-
-		/* Perform the conversion */
-		dst[j] = 0.0;
-		term = 1.0;
-		for (k = 0; k < converter->nb_coeff; k++) {
-			dst[j] += converter->coeff[k] * term;
-			term *= tmp - converter->expansion;
-		}
-
-		/* Update the counters */
-		i += size;
-		j++;
-	}
+	return cnt > 0 ? cnt : 0;
+}
 
-	return j;
+/**
+ * @brief Convert raw data (from the driver) to calibrated double units
+ * in place
+ *
+ * This function behaves like a4l_rawtodcal() with the same buffer as
+ * input and output: the raw samples at the start of @a buf are
+ * replaced by the calibrated ones. The buffer must be large enough to
+ * hold @a cnt double-typed samples.
+ *
+ * @param[in] chan Channel descriptor
+ * @param[in,out] buf Input / output buffer
+ * @param[in] cnt Count of conversion to perform
+ * @param[in] converter Conversion polynomial
+ *
+ * @return the count of conversion performed, otherwise a negative
+ * error code:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong;
+ *    chan and the pointers should be checked; check also the
+ *    kernel log ("dmesg"); WARNING: a4l_fill_desc() should be called
+ *    before using a4l_rawtodcal_inplace()
+ *
+ */
+int a4l_rawtodcal_inplace(a4l_chinfo_t *chan, void *buf, int cnt,
+			  struct a4l_polynomial *converter)
+{
+	return a4l_rawtodcal(chan, buf, buf, cnt, converter);
 }
 
 /**
@@ -0,0 +1,209 @@
+/**
+ * @file
+ * Analogy for Linux, sample conversion kernels
+ *
+ * @note Copyright (C) 1997-2000 David A. Schleef <ds@schleef.org>
+ * @note Copyright (C) 2008 Alexis Berlemont <alexis.berlemont@free.fr>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef __ANALOGY_LIB_CONVERT__
+#define __ANALOGY_LIB_CONVERT__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef DOXYGEN_CPP
+
+/*
+ * Samples are converted by blocks of fixed size, so that the inner
+ * loops have a constant trip count and no aliasing between input and
+ * output: this is what allows the compiler to vectorize them at the
+ * usual optimization level (SSE on x86, NEON on ARM), the remaining
+ * samples are converted one at a time.
+ *
+ * In-place conversions bounce each input block through the stack
+ * before storing the output over it. Blocks are processed from the end
+ * of the buffer when the output samples are wider than the input ones,
+ * from the start otherwise, so that no input sample is overwritten
+ * before it was read.
+ */
+#define A4L_CONV_BLOCK 64
+
+/* Factors of the linear conversions */
+struct a4l_conv_float {
+	float a, b;
+};
+
+struct a4l_conv_double {
+	double a, b;
+};
+
+/*
+ * Define the direct and in-place conversion routines from
+ * __name##_block(), which converts A4L_CONV_BLOCK samples, and
+ * __name##_one(), which converts a single sample.
+ */
+#define __A4L_DEFINE_CONV_DRIVERS(__name, __dtype, __stype, __ptype)	\
+static void __name(void *dst, const void *src, int cnt, __ptype p)	\
+{									\
+	__dtype *d = dst;						\
+	const __stype *s = src;						\
+	int n = 0;							\
+									\
+	for (; n + A4L_CONV_BLOCK <= cnt; n += A4L_CONV_BLOCK)		\
+		__name##_block(d + n, s + n, p);			\
+									\
+	for (; n < cnt; n++)						\
+		__name##_one(d + n, s + n, p);				\
+}									\
+									\
+static void __name##_inplace(void *buf, int cnt, __ptype p)		\
+{									\
+	__stype tmp[A4L_CONV_BLOCK];					\
+	__dtype *d = buf;						\
+	__stype *s = buf;						\
+	int n;								\
+									\
+	if (cnt <= 0)							\
+		return;							\
+									\
+	if (sizeof(__dtype) > sizeof(__stype)) {			\
+		for (n = cnt; n >= A4L_CONV_BLOCK; n -= A4L_CONV_BLOCK) { \
+			memcpy(tmp, s + n - A4L_CONV_BLOCK, sizeof(tmp)); \
+			__name##_block(d + n - A4L_CONV_BLOCK, tmp, p);	\
+		}							\
+		while (n-- > 0) {					\
+			tmp[0] = s[n];					\
+			__name##_one(d + n, tmp, p);			\
+		}							\
+	} else {							\
+		for (n = 0; n + A4L_CONV_BLOCK <= cnt; n += A4L_CONV_BLOCK) { \
+			memcpy(tmp, s + n, sizeof(tmp));		\
+			__name##_block(d + n, tmp, p);			\
+		}							\
+		for (; n < cnt; n++) {					\
+			tmp[0] = s[n];					\
+			__name##_one(d + n, tmp, p);			\
+		}							\
+	}								\
+}
+
+#define __A4L_DEFINE_CONV(__name, __dtype, __stype, __ptype, __expr)	\
+static inline void __name##_block(__dtype *__restrict__ dst,		\
+				  const __stype *__restrict__ src,	\
+				  __ptype p)				\
+{									\
+	__stype x;							\
+	int n;								\
+									\
+	for (n = 0; n < A4L_CONV_BLOCK; n++) {				\
+		x = src[n];						\
+		dst[n] = (__expr);					\
+	}								\
+}									\
+									\
+static inline void __name##_one(__dtype *dst, const __stype *src,	\
+				__ptype p)				\
+{									\
+	__stype x = *src;						\
+									\
+	*dst = (__expr);						\
+}									\
+									\
+__A4L_DEFINE_CONV_DRIVERS(__name, __dtype, __stype, __ptype)
+
+/* Raw to physical: phys = a * raw + b. */
+#define A4L_DEFINE_RAWTO(__name, __dtype, __stype)			\
+	__A4L_DEFINE_CONV(__name, __dtype, __stype,			\
+			  struct a4l_conv_##__dtype, p.a * x + p.b)
+
+/*
+ * Physical to raw: raw = a * phys - b, truncated to the sample
+ * width. Narrow samples go through a signed 32-bit conversion, which
+ * is vectorizable, unlike the conversion to an unsigned value.
+ */
+#define A4L_DEFINE_TORAW(__name, __dtype, __stype)			\
+	__A4L_DEFINE_CONV(__name, __dtype, __stype,			\
+			  struct a4l_conv_##__stype,			\
+			  sizeof(__dtype) < 4 ?				\
+			  (__dtype)(int32_t)(p.a * x - p.b) :		\
+			  (__dtype)(p.a * x - p.b))
+
+/*
+ * Raw to calibrated: the polynomial is evaluated for a block of
+ * samples at once, one coefficient after the other, which keeps the
+ * order of the operations of the per sample evaluation. The offset
+ * from the expansion origin is computed in double precision, so that
+ * raw values below the origin do not wrap around.
+ */
+#define A4L_DEFINE_RAWTOPOLY(__name, __stype)				\
+static inline void __name##_block(double *__restrict__ dst,		\
+				  const __stype *__restrict__ src,	\
+				  const struct a4l_polynomial *p)	\
+{									\
+	double x[A4L_CONV_BLOCK], term[A4L_CONV_BLOCK];		\
+	double acc[A4L_CONV_BLOCK], e = p->expansion, c;	\
+	int n, k;							\
+									\
+	for (n = 0; n < A4L_CONV_BLOCK; n++) {				\
+		x[n] = src[n] - e;					\
+		term[n] = 1.0;						\
+		acc[n] = 0.0;						\
+	}								\
+									\
+	for (k = 0; k < p->nb_coeff; k++) {				\
+		c = p->coeff[k];					\
+		for (n = 0; n < A4L_CONV_BLOCK; n++) {			\
+			acc[n] += c * term[n];				\
+			term[n] *= x[n];				\
+		}							\
+	}								\
+									\
+	memcpy(dst, acc, sizeof(acc));					\
+}									\
+									\
+static inline void __name##_one(double *dst, const __stype *src,	\
+				const struct a4l_polynomial *p)		\
+{									\
+	double term = 1.0, acc = 0.0;					\
+	int k;								\
+									\
+	for (k = 0; k < p->nb_coeff; k++) {				\
+		acc += p->coeff[k] * term;				\
+		term *= (double)*src - p->expansion;		\
+	}								\
+									\
+	*dst = acc;							\
+}									\
+									\
+__A4L_DEFINE_CONV_DRIVERS(__name, double, __stype,			\
+			  const struct a4l_polynomial *)
+
+/*
+ * Convert with a kernel defined by the macros above, switching to its
+ * in-place variant if the output buffer is the input one.
+ */
+#define A4L_CONVERT(__kernel, __dst, __src, __cnt, __p)		\
+	do {								\
+		if ((void *)(__dst) == (void *)(__src))		\
+			__kernel##_inplace(__dst, __cnt, __p);		\
+		else							\
+			__kernel(__dst, __src, __cnt, __p);		\
+	} while (0)
+
+#endif /* !DOXYGEN_CPP */
+
+#endif /* __ANALOGY_LIB_CONVERT__ */
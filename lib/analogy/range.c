@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <math.h>
 #include "internal.h"
+#include "convert.h"
 #include <rtdm/analogy.h>
 
 #ifndef DOXYGEN_CPP
@@ -57,6 +58,19 @@ static void data8_set(void *dst, lsampl_t val)
 	*((unsigned char *)(dst)) = (unsigned char)(0xff & val);
 }
 
+A4L_DEFINE_RAWTO(rawtof_32, float, uint32_t)
+A4L_DEFINE_RAWTO(rawtof_16, float, uint16_t)
+A4L_DEFINE_RAWTO(rawtof_8, float, uint8_t)
+A4L_DEFINE_RAWTO(rawtod_32, double, uint32_t)
+A4L_DEFINE_RAWTO(rawtod_16, double, uint16_t)
+A4L_DEFINE_RAWTO(rawtod_8, double, uint8_t)
+A4L_DEFINE_TORAW(ftoraw_32, uint32_t, float)
+A4L_DEFINE_TORAW(ftoraw_16, uint16_t, float)
+A4L_DEFINE_TORAW(ftoraw_8, uint8_t, float)
+A4L_DEFINE_TORAW(dtoraw_32, uint32_t, double)
+A4L_DEFINE_TORAW(dtoraw_16, uint16_t, double)
+A4L_DEFINE_TORAW(dtoraw_8, uint8_t, double)
+
 #endif /* !DOXYGEN_CPP */
 
 /*!
@@ -308,56 +322,35 @@ int a4l_rawtoul(a4l_chinfo_t * chan, unsigned long *dst, void *src, int cnt)
 int a4l_rawtof(a4l_chinfo_t * chan,
 	       a4l_rnginfo_t * rng, float *dst, void *src, int cnt)
 {
-	int size, i = 0, j = 0;
-	lsampl_t tmp;
-
 	/* Temporary values used for conversion
 	   (phys = a * src + b) */
-	float a, b;
-	/* Temporary data accessor */
-	lsampl_t(*datax_get) (void *);
+	struct a4l_conv_float p;
 
 	/* Basic checking */
 	if (rng == NULL || chan == NULL)
 		return -EINVAL;
 
-	/* Find out the size in memory */
-	size = a4l_sizeof_chan(chan);
+	/* Compute the translation factor and the constant only once */
+	p.a = ((float)(rng->max - rng->min)) /
+		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
+	p.b = ((float)rng->min) / A4L_RNG_FACTOR;
 
-	/* Get the suitable accessor */
+	/* Convert with the kernel suited to the sample width */
 	switch (a4l_sizeof_chan(chan)) {
 	case 4:
-		datax_get = data32_get;
+		A4L_CONVERT(rawtof_32, dst, src, cnt, p);
 		break;
 	case 2:
-		datax_get = data16_get;
+		A4L_CONVERT(rawtof_16, dst, src, cnt, p);
 		break;
 	case 1:
-		datax_get = data8_get;
+		A4L_CONVERT(rawtof_8, dst, src, cnt, p);
 		break;
 	default:
 		return -EINVAL;
 	};
 
-	/* Compute the translation factor and the constant only once */
-	a = ((float)(rng->max - rng->min)) /
-		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
-	b = ((float)rng->min) / A4L_RNG_FACTOR;
-
-	while (j < cnt) {
-
-		/* Properly retrieve the data */
-		tmp = datax_get(src + i);
-
-		/* Perform the conversion */
-		dst[j] = a * tmp + b;
-
-		/* Update the counters */
-		i += size;
-		j++;
-	}
-
-	return j;
+	return cnt > 0 ? cnt : 0;
 }
 
 /**
@@ -381,56 +374,35 @@ int a4l_rawtof(a4l_chinfo_t * chan,
 int a4l_rawtod(a4l_chinfo_t * chan,
 	       a4l_rnginfo_t * rng, double *dst, void *src, int cnt)
 {
-	int size, i = 0, j = 0;
-	lsampl_t tmp;
-
 	/* Temporary values used for conversion
 	   (phys = a * src + b) */
-	double a, b;
-	/* Temporary data accessor */
-	lsampl_t(*datax_get) (void *);
+	struct a4l_conv_double p;
 
 	/* Basic checking */
 	if (rng == NULL || chan == NULL)
 		return -EINVAL;
 
-	/* Find out the size in memory */
-	size = a4l_sizeof_chan(chan);
+	/* Compute the translation factor and the constant only once */
+	p.a = ((double)(rng->max - rng->min)) /
+		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
+	p.b = ((double)rng->min) / A4L_RNG_FACTOR;
 
-	/* Get the suitable accessor */
+	/* Convert with the kernel suited to the sample width */
 	switch (a4l_sizeof_chan(chan)) {
 	case 4:
-		datax_get = data32_get;
+		A4L_CONVERT(rawtod_32, dst, src, cnt, p);
 		break;
 	case 2:
-		datax_get = data16_get;
+		A4L_CONVERT(rawtod_16, dst, src, cnt, p);
 		break;
 	case 1:
-		datax_get = data8_get;
+		A4L_CONVERT(rawtod_8, dst, src, cnt, p);
 		break;
 	default:
 		return -EINVAL;
 	};
 
-	/* Computes the translation factor and the constant only once */
-	a = ((double)(rng->max - rng->min)) /
-		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
-	b = ((double)rng->min) / A4L_RNG_FACTOR;
-
-	while (j < cnt) {
-
-		/* Properly retrieve the data */
-		tmp = datax_get(src + i);
-
-		/* Perform the conversion */
-		dst[j] = a * tmp + b;
-
-		/* Update the counters */
-		i += size;
-		j++;
-	}
-
-	return j;
+	return cnt > 0 ? cnt : 0;
 }
 
 /**
@@ -517,53 +489,36 @@ int a4l_ultoraw(a4l_chinfo_t * chan, void *dst, unsigned long *src, int cnt)
 int a4l_ftoraw(a4l_chinfo_t * chan,
 	       a4l_rnginfo_t * rng, void *dst, float *src, int cnt)
 {
-	int size, i = 0, j = 0;
-
 	/* Temporary values used for conversion
 	   (dst = a * phys - b) */
-	float a, b;
-	/* Temporary data accessor */
-	void (*datax_set) (void *, lsampl_t);
+	struct a4l_conv_float p;
 
 	/* Basic checking */
 	if (rng == NULL || chan == NULL)
 		return -EINVAL;
 
-	/* Find out the size in memory */
-	size = a4l_sizeof_chan(chan);
+	/* Computes the translation factor and the constant only once */
+	p.a = (((float)A4L_RNG_FACTOR) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
+	p.b = ((float)(rng->min) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
 
-	/* Select the suitable accessor */
-	switch (size) {
+	/* Convert with the kernel suited to the sample width */
+	switch (a4l_sizeof_chan(chan)) {
 	case 4:
-		datax_set = data32_set;
+		A4L_CONVERT(ftoraw_32, dst, src, cnt, p);
 		break;
 	case 2:
-		datax_set = data16_set;
+		A4L_CONVERT(ftoraw_16, dst, src, cnt, p);
 		break;
 	case 1:
-		datax_set = data8_set;
+		A4L_CONVERT(ftoraw_8, dst, src, cnt, p);
 		break;
 	default:
 		return -EINVAL;
 	};
 
-	/* Computes the translation factor and the constant only once */
-	a = (((float)A4L_RNG_FACTOR) / (rng->max - rng->min)) *
-		((1ULL << chan->nb_bits) - 1);
-	b = ((float)(rng->min) / (rng->max - rng->min)) *
-		((1ULL << chan->nb_bits) - 1);
-
-	while (j < cnt) {
-
-		/* Performs the conversion */
-		datax_set(dst + i, (lsampl_t) (a * src[j] - b));
-
-		/* Updates the counters */
-		i += size;
-		j++;
-	}
-
-	return j;
+	return cnt > 0 ? cnt : 0;
 }
 
 /**
@@ -587,52 +542,145 @@ int a4l_ftoraw(a4l_chinfo_t * chan,
 int a4l_dtoraw(a4l_chinfo_t * chan,
 	       a4l_rnginfo_t * rng, void *dst, double *src, int cnt)
 {
-	int size, i = 0, j = 0;
-
 	/* Temporary values used for conversion
 	   (dst = a * phys - b) */
-	double a, b;
-	/* Temporary data accessor */
-	void (*datax_set) (void *, lsampl_t);
+	struct a4l_conv_double p;
 
 	/* Basic checking */
 	if (rng == NULL || chan == NULL)
 		return -EINVAL;
 
-	/* Find out the size in memory */
-	size = a4l_sizeof_chan(chan);
+	/* Computes the translation factor and the constant only once */
+	p.a = (((double)A4L_RNG_FACTOR) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
+	p.b = ((double)(rng->min) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
 
-	/* Select the suitable accessor */
-	switch (size) {
+	/* Convert with the kernel suited to the sample width */
+	switch (a4l_sizeof_chan(chan)) {
 	case 4:
-		datax_set = data32_set;
+		A4L_CONVERT(dtoraw_32, dst, src, cnt, p);
 		break;
 	case 2:
-		datax_set = data16_set;
+		A4L_CONVERT(dtoraw_16, dst, src, cnt, p);
 		break;
 	case 1:
-		datax_set = data8_set;
+		A4L_CONVERT(dtoraw_8, dst, src, cnt, p);
 		break;
 	default:
 		return -EINVAL;
 	};
 
-	/* Computes the translation factor and the constant only once */
-	a = (((double)A4L_RNG_FACTOR) / (rng->max - rng->min)) *
-		((1ULL << chan->nb_bits) - 1);
-	b = ((double)(rng->min) / (rng->max - rng->min)) *
-		((1ULL << chan->nb_bits) - 1);
+	return cnt > 0 ? cnt : 0;
+}
 
-	while (j < cnt) {
+/**
+ * @brief Convert raw data (from the driver) to float-typed samples in place
+ *
+ * This function behaves like a4l_rawtof() with the same buffer
+ * as input and output: the raw samples at the start of @a buf are
+ * replaced by the converted ones. The buffer must be large enough to
+ * hold @a cnt float-typed samples.
+ *
+ * @param[in] chan Channel descriptor
+ * @param[in] rng Range descriptor
+ * @param[in,out] buf Input / output buffer
+ * @param[in] cnt Count of conversion to perform
+ *
+ * @return the count of conversion performed, otherwise a negative
+ * error code:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong;
+ *    chan, rng and the pointers should be checked; check also the
+ *    kernel log ("dmesg"); WARNING: a4l_fill_desc() should be called
+ *    before using a4l_rawtof_inplace()
+ *
+ */
+int a4l_rawtof_inplace(a4l_chinfo_t * chan,
+		       a4l_rnginfo_t * rng, void *buf, int cnt)
+{
+	return a4l_rawtof(chan, rng, buf, buf, cnt);
+}
 
-		/* Performs the conversion */
-		datax_set(dst + i, (lsampl_t) (a * src[j] - b));
+/**
+ * @brief Convert raw data (from the driver) to double-typed samples in place
+ *
+ * This function behaves like a4l_rawtod() with the same buffer
+ * as input and output: the raw samples at the start of @a buf are
+ * replaced by the converted ones. The buffer must be large enough to
+ * hold @a cnt double-typed samples.
+ *
+ * @param[in] chan Channel descriptor
+ * @param[in] rng Range descriptor
+ * @param[in,out] buf Input / output buffer
+ * @param[in] cnt Count of conversion to perform
+ *
+ * @return the count of conversion performed, otherwise a negative
+ * error code:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong;
+ *    chan, rng and the pointers should be checked; check also the
+ *    kernel log ("dmesg"); WARNING: a4l_fill_desc() should be called
+ *    before using a4l_rawtod_inplace()
+ *
+ */
+int a4l_rawtod_inplace(a4l_chinfo_t * chan,
+		       a4l_rnginfo_t * rng, void *buf, int cnt)
+{
+	return a4l_rawtod(chan, rng, buf, buf, cnt);
+}
 
-		/* Updates the counters */
-		i += size;
-		j++;
-	}
+/**
+ * @brief Convert float-typed samples to raw data (for the driver) in place
+ *
+ * This function behaves like a4l_ftoraw() with the same buffer
+ * as input and output: the float-typed samples of @a buf are
+ * replaced by the raw ones, packed from the start of the buffer.
+ *
+ * @param[in] chan Channel descriptor
+ * @param[in] rng Range descriptor
+ * @param[in,out] buf Input / output buffer
+ * @param[in] cnt Count of conversion to perform
+ *
+ * @return the count of conversion performed, otherwise a negative
+ * error code:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong;
+ *    chan, rng and the pointers should be checked; check also the
+ *    kernel log ("dmesg"); WARNING: a4l_fill_desc() should be called
+ *    before using a4l_ftoraw_inplace()
+ *
+ */
+int a4l_ftoraw_inplace(a4l_chinfo_t * chan,
+		       a4l_rnginfo_t * rng, void *buf, int cnt)
+{
+	return a4l_ftoraw(chan, rng, buf, buf, cnt);
+}
 
-	return j;
+/**
+ * @brief Convert double-typed samples to raw data (for the driver) in place
+ *
+ * This function behaves like a4l_dtoraw() with the same buffer
+ * as input and output: the double-typed samples of @a buf are
+ * replaced by the raw ones, packed from the start of the buffer.
+ *
+ * @param[in] chan Channel descriptor
+ * @param[in] rng Range descriptor
+ * @param[in,out] buf Input / output buffer
+ * @param[in] cnt Count of conversion to perform
+ *
+ * @return the count of conversion performed, otherwise a negative
+ * error code:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong;
+ *    chan, rng and the pointers should be checked; check also the
+ *    kernel log ("dmesg"); WARNING: a4l_fill_desc() should be called
+ *    before using a4l_dtoraw_inplace()
+ *
+ */
+int a4l_dtoraw_inplace(a4l_chinfo_t * chan,
+		       a4l_rnginfo_t * rng, void *buf, int cnt)
+{
+	return a4l_dtoraw(chan, rng, buf, buf, cnt);
 }
 /** @} Range / conversion  API */
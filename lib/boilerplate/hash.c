@@ -18,6 +18,7 @@
 
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include "boilerplate/lock.h"
 #include "boilerplate/hash.h"
 #include "boilerplate/debug.h"
@@ -91,6 +92,146 @@ unsigned int __hash_key(const void *key, size_t length, unsigned int c)
 	return c;
 }
 
+/*
+ * Lockless readers vs updaters, see hash.h. The compiler must not
+ * move accesses to the chains across the sequence checks, full
+ * barriers are required on SMP in addition.
+ */
+#define sync_barrier()			\
+	do {				\
+		smp_mb();		\
+		compiler_barrier();	\
+	} while (0)
+
+#define HASH_READ_RETRIES  4
+
+static void init_sync(struct hash_sync *sync)
+{
+	sync->seq = 0;
+	sync->epoch = 0;
+	atomic_set(&sync->readers[0], 0);
+	atomic_set(&sync->readers[1], 0);
+}
+
+static inline void write_seq_begin(struct hash_sync *sync)
+{
+	ACCESS_ONCE(sync->seq) = sync->seq + 1;
+	sync_barrier();
+}
+
+static inline void write_seq_end(struct hash_sync *sync)
+{
+	sync_barrier();
+	ACCESS_ONCE(sync->seq) = sync->seq + 1;
+}
+
+static inline int read_enter(struct hash_sync *sync)
+{
+	int epoch = ACCESS_ONCE(sync->epoch) & 1;
+
+	atomic_add_fetch(&sync->readers[epoch], 1);
+	sync_barrier();
+
+	return epoch;
+}
+
+static inline void read_exit(struct hash_sync *sync, int epoch)
+{
+	sync_barrier();
+	atomic_sub_fetch(&sync->readers[epoch], 1);
+}
+
+static inline unsigned int read_seq_begin(struct hash_sync *sync)
+{
+	unsigned int seq = ACCESS_ONCE(sync->seq);
+
+	sync_barrier();
+
+	return seq;
+}
+
+static inline int read_seq_retry(struct hash_sync *sync, unsigned int seq)
+{
+	sync_barrier();
+
+	return (seq & 1) || ACCESS_ONCE(sync->seq) != seq;
+}
+
+/*
+ * Cheap check for chain walkers, only meant to bail out early from
+ * a chain which is being changed under our feet. read_seq_retry()
+ * still has the final say.
+ */
+static inline int read_seq_moved(struct hash_sync *sync, unsigned int seq)
+{
+	smp_rmb();	/* Pairs with write_seq_begin(). */
+
+	return ACCESS_ONCE(sync->seq) != seq;
+}
+
+static void drain_readers(struct hash_sync *sync, int epoch)
+{
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = 1000 };
+	int spins = 0, state;
+
+	while (ACCESS_ONCE(sync->readers[epoch].v) > 0) {
+		if (++spins < 100) {
+			cpu_relax();
+			continue;
+		}
+		/*
+		 * The reader may have been preempted by the caller,
+		 * sleep so that it can complete. We may be running a
+		 * _nocancel section, so this must not be a
+		 * cancellation point.
+		 */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+		__RT(clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, NULL));
+		pthread_setcancelstate(state, NULL);
+	}
+}
+
+/*
+ * Wait until no lockless reader may still refer to the memory
+ * unlinked by the caller, which must have dropped t->lock, so that
+ * readers falling back to a locked search and other updaters are not
+ * held back meanwhile.
+ *
+ * Any reader registering past our first barrier walks the chains
+ * after the update, so it is enough to see both reader counts drop
+ * to zero at some point: the common case with no reader in flight
+ * costs two loads. The epoch flip in between only keeps newcomers
+ * from delaying us indefinitely, grace periods may therefore run
+ * concurrently without any further serialization.
+ */
+static void wait_for_readers(struct hash_sync *sync)
+{
+	int epoch;
+
+	sync_barrier();
+
+	if (ACCESS_ONCE(sync->readers[0].v) == 0 &&
+	    ACCESS_ONCE(sync->readers[1].v) == 0)
+		return;
+
+	epoch = ACCESS_ONCE(sync->epoch) & 1;
+	drain_readers(sync, !epoch);
+	ACCESS_ONCE(sync->epoch) = sync->epoch + 1;
+	sync_barrier();
+	drain_readers(sync, epoch);
+}
+
+#ifdef CONFIG_XENO_PSHARED
+/*
+ * A process dying in a read section of a shared table would wedge
+ * the updaters of every other process forever, so shared tables are
+ * only searched under lock, and need no grace period.
+ */
+static inline void wait_for_shared_readers(struct hash_sync *sync) { }
+#else
+#define wait_for_shared_readers(__sync)  wait_for_readers(__sync)
+#endif
+
 void __hash_init(void *heap, struct hash_table *t)
 {
 	pthread_mutexattr_t mattr;
@@ -99,6 +240,15 @@ void __hash_init(void *heap, struct hash_table *t)
 	for (n = 0; n < HASHSLOTS; n++)
 		__list_init(heap, &t->table[n].obj_list);
 
+	for (n = 0; n < HASH_MAXLEVELS; n++)
+		t->segments[n] = 0;
+
+	t->level = 0;
+	t->split = 0;
+	t->nr_objs = 0;
+	t->walkers = 0;
+	init_sync(&t->sync);
+
 	pthread_mutexattr_init(&mattr);
 	pthread_mutexattr_settype(&mattr, mutex_type_attribute);
 	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
@@ -112,11 +262,143 @@ void hash_destroy(struct hash_table *t)
 	__RT(pthread_mutex_destroy(&t->lock));
 }
 
-static struct hash_bucket *do_hash(struct hash_table *t,
-				   const void *key, size_t len)
+/*
+ * Linear hashing: at level L, hash values are folded over the first
+ * HASHSLOTS << L buckets, except for those hitting a bucket below
+ * the split index, which have already been split to a second bucket
+ * over the next level.
+ */
+static inline unsigned int get_slot(unsigned int level,
+				    unsigned int split, unsigned int hash)
+{
+	unsigned int mask = (HASHSLOTS << level) - 1, n = hash & mask;
+
+	if (n < split)
+		n = hash & ((mask << 1) | 1);
+
+	return n;
+}
+
+static inline unsigned int get_segment(unsigned int n)
+{
+	/* Segment #s holds buckets [HASHSLOTS << s, HASHSLOTS << (s+1)). */
+	return 31 - __builtin_clz(n / HASHSLOTS);
+}
+
+static inline int should_grow(unsigned int nr_objs, unsigned int level,
+			      unsigned int split)
+{
+	return level < HASH_MAXLEVELS &&
+		nr_objs > ((HASHSLOTS << level) + split) * HASH_GROW_LOAD;
+}
+
+static inline int should_shrink(unsigned int nr_objs, unsigned int level,
+				unsigned int split)
+{
+	return (level > 0 || split > 0) &&
+		nr_objs * HASH_GROW_LOAD < (HASHSLOTS << level) + split;
+}
+
+static struct hash_bucket *get_bucket(struct hash_table *t, unsigned int n)
+{
+	struct hash_bucket *segment;
+	unsigned int s;
+
+	if (n < HASHSLOTS)
+		return &t->table[n];
+
+	s = get_segment(n);
+	segment = __mptr(t->segments[s]);
+
+	return &segment[n - (HASHSLOTS << s)];
+}
+
+static inline struct hash_bucket *do_hash(struct hash_table *t,
+					  unsigned int hash)
+{
+	return get_bucket(t, get_slot(t->level, t->split, hash));
+}
+
+static void grow_table(struct hash_table *t, /* t->lock held */
+		       const struct hash_operations *hops)
+{
+	unsigned int size = HASHSLOTS << t->level, mask, n;
+	struct hash_bucket *segment, *from, *to;
+	struct hashobj *obj, *tmp;
+
+	if (t->walkers || hops->alloc == NULL ||
+	    !should_grow(t->nr_objs, t->level, t->split))
+		return;
+
+	if (t->split == 0) {
+		segment = hops->alloc(size * sizeof(*segment));
+		if (segment == NULL)
+			return;	/* Keep going with longer chains. */
+		for (n = 0; n < size; n++)
+			list_init(&segment[n].obj_list);
+		t->segments[t->level] = __moff(segment);
+	}
+
+	from = get_bucket(t, t->split);
+	to = get_bucket(t, size + t->split);
+	mask = (size << 1) - 1;
+
+	if (!list_empty(&from->obj_list)) {
+		list_for_each_entry_safe(obj, tmp, &from->obj_list, link) {
+			if ((obj->hash & mask) != t->split) {
+				list_remove(&obj->link);
+				list_append(&obj->link, &to->obj_list);
+			}
+		}
+	}
+
+	if (++t->split == size) {
+		t->level++;
+		t->split = 0;
+	}
+}
+
+/*
+ * Returns the segment which was emptied by merging buckets if any,
+ * the caller should release it once lockless readers are gone.
+ */
+static void *shrink_table(struct hash_table *t, /* t->lock held */
+			  const struct hash_operations *hops)
 {
-	unsigned int hash = __hash_key(key, len, 0);
-	return &t->table[hash & (HASHSLOTS-1)];
+	struct hash_bucket *from, *to, *segment = NULL;
+	struct hashobj *obj, *tmp;
+	int steps;
+
+	if (t->walkers || hops->free == NULL)
+		return NULL;
+
+	for (steps = 0; steps < 2; steps++) {
+		if (!should_shrink(t->nr_objs, t->level, t->split))
+			break;
+
+		if (t->split == 0) {
+			t->level--;
+			t->split = HASHSLOTS << t->level;
+		}
+
+		t->split--;
+		to = get_bucket(t, t->split);
+		from = get_bucket(t, (HASHSLOTS << t->level) + t->split);
+
+		if (!list_empty(&from->obj_list)) {
+			list_for_each_entry_safe(obj, tmp, &from->obj_list, link) {
+				list_remove(&obj->link);
+				list_append(&obj->link, &to->obj_list);
+			}
+		}
+
+		if (t->split == 0) {
+			segment = __mptr(t->segments[t->level]);
+			t->segments[t->level] = 0;
+		}
+	}
+
+	return segment;
 }
 
 int __hash_enter(struct hash_table *t,
@@ -134,9 +416,10 @@ int __hash_enter(struct hash_table *t,
 	if (ret)
 		return ret;
 
-	bucket = do_hash(t, key, len);
+	newobj->hash = __hash_key(key, len, 0);
 	write_lock_nocancel(&t->lock);
 
+	bucket = do_hash(t, newobj->hash);
 	if (nodup && !list_empty(&bucket->obj_list)) {
 		list_for_each_entry(obj, &bucket->obj_list, link) {
 			if (obj->len != newobj->len)
@@ -150,7 +433,11 @@ int __hash_enter(struct hash_table *t,
 		}
 	}
 
+	write_seq_begin(&t->sync);
 	list_append(&newobj->link, &bucket->obj_list);
+	t->nr_objs++;
+	grow_table(t, hops);
+	write_seq_end(&t->sync);
 out:
 	write_unlock(&t->lock);
 
@@ -161,26 +448,37 @@ int hash_remove(struct hash_table *t, struct hashobj *delobj,
 		const struct hash_operations *hops)
 {
 	struct hash_bucket *bucket;
+	void *segment = NULL;
 	struct hashobj *obj;
 	int ret = -ESRCH;
 
-	bucket = do_hash(t, __mptr(delobj->key), delobj->len);
-
 	write_lock_nocancel(&t->lock);
 
+	bucket = do_hash(t, delobj->hash);
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry(obj, &bucket->obj_list, link) {
 			if (obj == delobj) {
+				write_seq_begin(&t->sync);
 				list_remove_init(&obj->link);
-				drop_key(obj, hops);
+				t->nr_objs--;
+				segment = shrink_table(t, hops);
+				write_seq_end(&t->sync);
 				ret = 0;
-				goto out;
+				break;
 			}
 		}
 	}
-out:
+
 	write_unlock(&t->lock);
 
+	if (ret == 0) {
+		/* The caller may free delobj on return. */
+		wait_for_shared_readers(&t->sync);
+		drop_key(delobj, hops);
+		if (segment)
+			hops->free(segment);
+	}
+
 	return __bt(ret);
 }
 
@@ -188,15 +486,17 @@ struct hashobj *hash_search(struct hash_table *t, const void *key,
 			    size_t len, const struct hash_operations *hops)
 {
 	struct hash_bucket *bucket;
+	unsigned int hash;
 	struct hashobj *obj;
 
-	bucket = do_hash(t, key, len);
+	hash = __hash_key(key, len, 0);
 
 	read_lock_nocancel(&t->lock);
 
+	bucket = do_hash(t, hash);
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry(obj, &bucket->obj_list, link) {
-			if (obj->len != len)
+			if (obj->hash != hash || obj->len != len)
 				continue;
 			if (hops->compare(__mptr(obj->key), key, len) == 0)
 				goto out;
@@ -209,30 +509,122 @@ out:
 	return obj;
 }
 
+#ifdef CONFIG_XENO_PSHARED
+
+/* See wait_for_shared_readers(). */
+struct hashobj *hash_search_lockless(struct hash_table *t, const void *key,
+				     size_t len,
+				     const struct hash_operations *hops)
+{
+	return hash_search(t, key, len, hops);
+}
+
+#else /* !CONFIG_XENO_PSHARED */
+
+static struct hash_bucket *get_bucket_lockless(struct hash_table *t,
+					       unsigned int hash)
+{
+	struct hash_bucket *segment;
+	unsigned int n, s;
+
+	n = get_slot(ACCESS_ONCE(t->level), ACCESS_ONCE(t->split), hash);
+	if (n < HASHSLOTS)
+		return &t->table[n];
+
+	/*
+	 * We may have read the level and split index of different
+	 * table geometries, make sure not to follow a wild pointer
+	 * before the sequence check tells us to retry.
+	 */
+	s = get_segment(n);
+	if (s >= HASH_MAXLEVELS || ACCESS_ONCE(t->segments[s]) == 0)
+		return NULL;
+
+	segment = __mptr(ACCESS_ONCE(t->segments[s]));
+
+	return &segment[n - (HASHSLOTS << s)];
+}
+
+struct hashobj *hash_search_lockless(struct hash_table *t, const void *key,
+				     size_t len,
+				     const struct hash_operations *hops)
+{
+	struct hash_bucket *bucket;
+	unsigned int hash, seq;
+	struct hashobj *obj;
+	int epoch, retries;
+
+	hash = __hash_key(key, len, 0);
+
+	for (retries = 0; retries < HASH_READ_RETRIES; retries++) {
+		epoch = read_enter(&t->sync);
+		seq = read_seq_begin(&t->sync);
+		if (seq & 1)
+			goto retry;
+		bucket = get_bucket_lockless(t, hash);
+		if (bucket == NULL)
+			goto retry;
+		list_for_each_entry(obj, &bucket->obj_list, link) {
+			/*
+			 * Objects may be moved to another chain while
+			 * we walk this one, so check for updates at
+			 * each step, or we might never get back to
+			 * the list head.
+			 */
+			if (read_seq_moved(&t->sync, seq))
+				goto retry;
+			if (obj->hash != hash || obj->len != len)
+				continue;
+			if (hops->compare(__mptr(obj->key), key, len) == 0)
+				goto found;
+		}
+		obj = NULL;
+	found:
+		if (!read_seq_retry(&t->sync, seq)) {
+			read_exit(&t->sync, epoch);
+			return obj;
+		}
+	retry:
+		read_exit(&t->sync, epoch);
+	}
+
+	/* Too many updates in flight, wait for our turn. */
+	return hash_search(t, key, len, hops);
+}
+
+#endif /* !CONFIG_XENO_PSHARED */
+
 int hash_walk(struct hash_table *t, hash_walk_op walk, void *arg)
 {
 	struct hash_bucket *bucket;
 	struct hashobj *obj, *tmp;
-	int ret, n;
+	int ret = 0, n;
 
 	read_lock_nocancel(&t->lock);
 
-	for (n = 0; n < HASHSLOTS; n++) {
-		bucket = &t->table[n];
+	/*
+	 * Buckets may not be split or merged while walking the
+	 * table, so that each object is visited once.
+	 */
+	t->walkers++;
+
+	for (n = 0; n < (int)hash_get_buckets(t); n++) {
+		bucket = get_bucket(t, n);
 		if (list_empty(&bucket->obj_list))
 			continue;
 		list_for_each_entry_safe(obj, tmp, &bucket->obj_list, link) {
 			read_unlock(&t->lock);
 			ret = walk(t, obj, arg);
-			if (ret)
-				return __bt(ret);
 			read_lock_nocancel(&t->lock);
+			if (ret)
+				goto out;
 		}
 	}
-
+out:
+	t->walkers--;
 	read_unlock(&t->lock);
 
-	return 0;
+	return __bt(ret);
 }
 
 #ifdef CONFIG_XENO_PSHARED
@@ -285,10 +677,11 @@ int __hash_enter_probe(struct hash_table *t,
 	if (ret)
 		return ret;
 
-	bucket = do_hash(t, key, len);
+	newobj->hash = __hash_key(key, len, 0);
 	CANCEL_DEFER(svc);
 	write_lock(&t->lock);
 
+	bucket = do_hash(t, newobj->hash);
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry_safe(obj, tmp, &bucket->obj_list, link) {
 			if (obj->len != newobj->len)
@@ -303,13 +696,20 @@ int __hash_enter_probe(struct hash_table *t,
 					}
 					continue;
 				}
+				write_seq_begin(&t->sync);
 				list_remove_init(&obj->link);
+				t->nr_objs--;
+				write_seq_end(&t->sync);
 				drop_key(obj, hops);
 			}
 		}
 	}
 
+	write_seq_begin(&t->sync);
 	list_append(&newobj->link, &bucket->obj_list);
+	t->nr_objs++;
+	grow_table(t, hops);
+	write_seq_end(&t->sync);
 out:
 	write_unlock(&t->lock);
 	CANCEL_RESTORE(svc);
@@ -324,19 +724,25 @@ struct hashobj *hash_search_probe(struct hash_table *t,
 	struct hash_bucket *bucket;
 	struct hashobj *obj, *tmp;
 	struct service svc;
+	unsigned int hash;
+	void *segment;
 
-	bucket = do_hash(t, key, len);
+	hash = __hash_key(key, len, 0);
 
 	CANCEL_DEFER(svc);
 	write_lock(&t->lock);
 
+	bucket = do_hash(t, hash);
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry_safe(obj, tmp, &bucket->obj_list, link) {
-			if (obj->len != len)
+			if (obj->hash != hash || obj->len != len)
 				continue;
 			if (hops->compare(__mptr(obj->key), key, len) == 0) {
 				if (!hops->probe(obj)) {
+					write_seq_begin(&t->sync);
 					list_remove_init(&obj->link);
+					t->nr_objs--;
+					write_seq_end(&t->sync);
 					drop_key(obj, hops);
 					continue;
 				}
@@ -346,6 +752,13 @@ struct hashobj *hash_search_probe(struct hash_table *t,
 	}
 	obj = NULL;
 out:
+	if (should_shrink(t->nr_objs, t->level, t->split)) {
+		write_seq_begin(&t->sync);
+		segment = shrink_table(t, hops);
+		write_seq_end(&t->sync);
+		if (segment)
+			hops->free(segment);
+	}
 	write_unlock(&t->lock);
 	CANCEL_RESTORE(svc);
 
@@ -360,6 +773,15 @@ void pvhash_init(struct pvhash_table *t)
 	for (n = 0; n < HASHSLOTS; n++)
 		pvlist_init(&t->table[n].obj_list);
 
+	for (n = 0; n < HASH_MAXLEVELS; n++)
+		t->segments[n] = NULL;
+
+	t->level = 0;
+	t->split = 0;
+	t->nr_objs = 0;
+	t->walkers = 0;
+	init_sync(&t->sync);
+
 	pthread_mutexattr_init(&mattr);
 	pthread_mutexattr_settype(&mattr, mutex_type_attribute);
 	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
@@ -368,11 +790,101 @@ void pvhash_init(struct pvhash_table *t)
 	pthread_mutexattr_destroy(&mattr);
 }
 
-static struct pvhash_bucket *do_pvhash(struct pvhash_table *t,
-				       const void *key, size_t len)
+static struct pvhash_bucket *get_pvbucket(struct pvhash_table *t,
+					  unsigned int n)
+{
+	unsigned int s;
+
+	if (n < HASHSLOTS)
+		return &t->table[n];
+
+	s = get_segment(n);
+
+	return &t->segments[s][n - (HASHSLOTS << s)];
+}
+
+static inline struct pvhash_bucket *do_pvhash(struct pvhash_table *t,
+					      unsigned int hash)
+{
+	return get_pvbucket(t, get_slot(t->level, t->split, hash));
+}
+
+static void grow_pvtable(struct pvhash_table *t, /* t->lock held */
+			 const struct pvhash_operations *hops)
+{
+	unsigned int size = HASHSLOTS << t->level, mask, n;
+	struct pvhash_bucket *segment, *from, *to;
+	struct pvhashobj *obj, *tmp;
+
+	if (t->walkers || hops->alloc == NULL ||
+	    !should_grow(t->nr_objs, t->level, t->split))
+		return;
+
+	if (t->split == 0) {
+		segment = hops->alloc(size * sizeof(*segment));
+		if (segment == NULL)
+			return;
+		for (n = 0; n < size; n++)
+			pvlist_init(&segment[n].obj_list);
+		t->segments[t->level] = segment;
+	}
+
+	from = get_pvbucket(t, t->split);
+	to = get_pvbucket(t, size + t->split);
+	mask = (size << 1) - 1;
+
+	if (!pvlist_empty(&from->obj_list)) {
+		pvlist_for_each_entry_safe(obj, tmp, &from->obj_list, link) {
+			if ((obj->hash & mask) != t->split) {
+				pvlist_remove(&obj->link);
+				pvlist_append(&obj->link, &to->obj_list);
+			}
+		}
+	}
+
+	if (++t->split == size) {
+		t->level++;
+		t->split = 0;
+	}
+}
+
+static void *shrink_pvtable(struct pvhash_table *t, /* t->lock held */
+			    const struct pvhash_operations *hops)
 {
-	unsigned int hash = __hash_key(key, len, 0);
-	return &t->table[hash & (HASHSLOTS-1)];
+	struct pvhash_bucket *from, *to, *segment = NULL;
+	struct pvhashobj *obj, *tmp;
+	int steps;
+
+	if (t->walkers || hops->free == NULL)
+		return NULL;
+
+	for (steps = 0; steps < 2; steps++) {
+		if (!should_shrink(t->nr_objs, t->level, t->split))
+			break;
+
+		if (t->split == 0) {
+			t->level--;
+			t->split = HASHSLOTS << t->level;
+		}
+
+		t->split--;
+		to = get_pvbucket(t, t->split);
+		from = get_pvbucket(t, (HASHSLOTS << t->level) + t->split);
+
+		if (!pvlist_empty(&from->obj_list)) {
+			pvlist_for_each_entry_safe(obj, tmp, &from->obj_list, link) {
+				pvlist_remove(&obj->link);
+				pvlist_append(&obj->link, &to->obj_list);
+			}
+		}
+
+		if (t->split == 0) {
+			segment = t->segments[t->level];
+			t->segments[t->level] = NULL;
+		}
+	}
+
+	return segment;
 }
 
 int __pvhash_enter(struct pvhash_table *t,
@@ -388,10 +900,11 @@ int __pvhash_enter(struct pvhash_table *t,
 	pvholder_init(&newobj->link);
 	newobj->key = key;
 	newobj->len = len;
-	bucket = do_pvhash(t, key, len);
+	newobj->hash = __hash_key(key, len, 0);
 
 	write_lock_nocancel(&t->lock);
 
+	bucket = do_pvhash(t, newobj->hash);
 	if (nodup && !pvlist_empty(&bucket->obj_list)) {
 		pvlist_for_each_entry(obj, &bucket->obj_list, link) {
 			if (obj->len != newobj->len)
@@ -403,7 +916,11 @@ int __pvhash_enter(struct pvhash_table *t,
 		}
 	}
 
+	write_seq_begin(&t->sync);
 	pvlist_append(&newobj->link, &bucket->obj_list);
+	t->nr_objs++;
+	grow_pvtable(t, hops);
+	write_seq_end(&t->sync);
 out:
 	write_unlock(&t->lock);
 
@@ -415,24 +932,35 @@ int pvhash_remove(struct pvhash_table *t, struct pvhashobj *delobj,
 {
 	struct pvhash_bucket *bucket;
 	struct pvhashobj *obj;
+	void *segment = NULL;
 	int ret = -ESRCH;
 
-	bucket = do_pvhash(t, delobj->key, delobj->len);
-
 	write_lock_nocancel(&t->lock);
 
+	bucket = do_pvhash(t, delobj->hash);
 	if (!pvlist_empty(&bucket->obj_list)) {
 		pvlist_for_each_entry(obj, &bucket->obj_list, link) {
 			if (obj == delobj) {
+				write_seq_begin(&t->sync);
 				pvlist_remove_init(&obj->link);
+				t->nr_objs--;
+				segment = shrink_pvtable(t, hops);
+				write_seq_end(&t->sync);
 				ret = 0;
-				goto out;
+				break;
 			}
 		}
 	}
-out:
+
 	write_unlock(&t->lock);
 
+	if (ret == 0) {
+		/* The caller may free delobj on return. */
+		wait_for_readers(&t->sync);
+		if (segment)
+			hops->free(segment);
+	}
+
 	return __bt(ret);
 }
 
@@ -442,14 +970,16 @@ struct pvhashobj *pvhash_search(struct pvhash_table *t,
 {
 	struct pvhash_bucket *bucket;
 	struct pvhashobj *obj;
+	unsigned int hash;
 
-	bucket = do_pvhash(t, key, len);
+	hash = __hash_key(key, len, 0);
 
 	read_lock_nocancel(&t->lock);
 
+	bucket = do_pvhash(t, hash);
 	if (!pvlist_empty(&bucket->obj_list)) {
 		pvlist_for_each_entry(obj, &bucket->obj_list, link) {
-			if (obj->len != len)
+			if (obj->hash != hash || obj->len != len)
 				continue;
 			if (hops->compare(obj->key, key, len) == 0)
 				goto out;
@@ -462,30 +992,94 @@ out:
 	return obj;
 }
 
+static struct pvhash_bucket *get_pvbucket_lockless(struct pvhash_table *t,
+						   unsigned int hash)
+{
+	struct pvhash_bucket *segment;
+	unsigned int n, s;
+
+	n = get_slot(ACCESS_ONCE(t->level), ACCESS_ONCE(t->split), hash);
+	if (n < HASHSLOTS)
+		return &t->table[n];
+
+	s = get_segment(n);
+	if (s >= HASH_MAXLEVELS)
+		return NULL;
+
+	segment = ACCESS_ONCE(t->segments[s]);
+	if (segment == NULL)
+		return NULL;
+
+	return &segment[n - (HASHSLOTS << s)];
+}
+
+struct pvhashobj *pvhash_search_lockless(struct pvhash_table *t,
+					 const void *key, size_t len,
+					 const struct pvhash_operations *hops)
+{
+	struct pvhash_bucket *bucket;
+	unsigned int hash, seq;
+	struct pvhashobj *obj;
+	int epoch, retries;
+
+	hash = __hash_key(key, len, 0);
+
+	for (retries = 0; retries < HASH_READ_RETRIES; retries++) {
+		epoch = read_enter(&t->sync);
+		seq = read_seq_begin(&t->sync);
+		if (seq & 1)
+			goto retry;
+		bucket = get_pvbucket_lockless(t, hash);
+		if (bucket == NULL)
+			goto retry;
+		pvlist_for_each_entry(obj, &bucket->obj_list, link) {
+			if (read_seq_moved(&t->sync, seq))
+				goto retry;
+			if (obj->hash != hash || obj->len != len)
+				continue;
+			if (hops->compare(obj->key, key, len) == 0)
+				goto found;
+		}
+		obj = NULL;
+	found:
+		if (!read_seq_retry(&t->sync, seq)) {
+			read_exit(&t->sync, epoch);
+			return obj;
+		}
+	retry:
+		read_exit(&t->sync, epoch);
+	}
+
+	return pvhash_search(t, key, len, hops);
+}
+
 int pvhash_walk(struct pvhash_table *t,	pvhash_walk_op walk, void *arg)
 {
 	struct pvhash_bucket *bucket;
 	struct pvhashobj *obj, *tmp;
-	int ret, n;
+	int ret = 0, n;
 
 	read_lock_nocancel(&t->lock);
 
-	for (n = 0; n < HASHSLOTS; n++) {
-		bucket = &t->table[n];
+	t->walkers++;
+
+	for (n = 0; n < (int)pvhash_get_buckets(t); n++) {
+		bucket = get_pvbucket(t, n);
 		if (pvlist_empty(&bucket->obj_list))
 			continue;
 		pvlist_for_each_entry_safe(obj, tmp, &bucket->obj_list, link) {
 			read_unlock(&t->lock);
 			ret = walk(t, obj, arg);
-			if (ret)
-				return __bt(ret);
 			read_lock_nocancel(&t->lock);
+			if (ret)
+				goto out;
 		}
 	}
-
+out:
+	t->walkers--;
 	read_unlock(&t->lock);
 
-	return 0;
+	return __bt(ret);
 }
 
 #else /* !CONFIG_XENO_PSHARED */
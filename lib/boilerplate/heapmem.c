@@ -32,21 +32,88 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <boilerplate/atomic.h>
 #include <boilerplate/heapmem.h>
 
 enum heapmem_pgtype {
 	page_free =0,
 	page_cont =1,
-	page_list =2
+	page_list =2,
+	/* Bucketed memory, type - page_bucket is the size class. */
+	page_bucket =3
 };
 
 static struct avl_searchops size_search_ops;
 static struct avl_searchops addr_search_ops;
 
+static inline int blocks_per_page(int sclass)
+{
+	return HEAPMEM_PAGE_SIZE / __heapmem_class_size(sclass);
+}
+
+/*
+ * Bits from the block map which do not match any block in a page
+ * from bucket @sclass are permanently set, as if busy.
+ */
 static inline uint32_t __attribute__ ((always_inline))
-gen_block_mask(int log2size)
+gen_unused_mask(int sclass, int word)
+{
+	int nrblocks = blocks_per_page(sclass) - word * 32;
+
+	if (nrblocks >= 32)
+		return 0;
+
+	if (nrblocks <= 0)
+		return -1U;
+
+	return -1U << nrblocks;
+}
+
+static inline bool map_is_full(struct heapmem_pgentry *pgent)
+{
+	int n;
+
+	for (n = 0; n < HEAPMEM_MAP_WORDS; n++)
+		if (pgent->map[n] != -1U)
+			return false;
+
+	return true;
+}
+
+static inline bool map_is_idle(struct heapmem_pgentry *pgent, int sclass)
+{
+	int n;
+
+	for (n = 0; n < HEAPMEM_MAP_WORDS; n++)
+		if (pgent->map[n] != gen_unused_mask(sclass, n))
+			return false;
+
+	return true;
+}
+
+/*
+ * Return the position of the block starting at offset @boff in a
+ * page from bucket @sclass, or -1 if no block starts there.
+ */
+static inline int get_block_index(int sclass, size_t boff)
 {
-	return -1U >> (32 - (HEAPMEM_PAGE_SIZE >> log2size));
+#ifdef CONFIG_XENO_HEAPMEM_FINE_CLASSES
+	size_t bsize = __heapmem_class_size(sclass);
+
+	if (boff % bsize)
+		return -1;
+
+	boff /= bsize;
+
+	return boff < blocks_per_page(sclass) ? (int)boff : -1;
+#else
+	int log2size = sclass + HEAPMEM_MIN_LOG2;
+
+	if (boff & ((1 << log2size) - 1))
+		return -1;
+
+	return boff >> log2size;
+#endif
 }
 
 static inline  __attribute__ ((always_inline))
@@ -111,6 +178,7 @@ ssize_t heapmem_check(struct heap_memory *heap, void *block)
 	memoff_t pg, pgoff, boff;
 	ssize_t ret = -EINVAL;
 	size_t bsize;
+	int sclass;
 
 	read_lock_nocancel(&heap->lock);
 
@@ -131,9 +199,10 @@ found:
 		if (ext->pagemap[pg].type == page_list)
 			bsize = ext->pagemap[pg].bsize;
 		else {
-			bsize = (1 << ext->pagemap[pg].type);
+			sclass = ext->pagemap[pg].type - page_bucket;
+			bsize = __heapmem_class_size(sclass);
 			boff = pgoff & ~HEAPMEM_PAGE_MASK;
-			if ((boff & (bsize - 1)) != 0) /* Not at block start? */
+			if (get_block_index(sclass, boff) < 0) /* Not at block start? */
 				goto out;
 		}
 		ret = (ssize_t)bsize;
@@ -278,14 +347,14 @@ static void release_page_range(struct heapmem_extent *ext,
 
 static void add_page_front(struct heap_memory *heap,
 			   struct heapmem_extent *ext,
-			   int pg, int log2size)
+			   int pg, int sclass)
 {
 	struct heapmem_pgentry *new, *head, *next;
 	int ilog;
 
 	/* Insert page at front of the per-bucket page list. */
 	
-	ilog = log2size - HEAPMEM_MIN_LOG2;
+	ilog = sclass;
 	new = &ext->pagemap[pg];
 	if (heap->buckets[ilog] == -1U) {
 		heap->buckets[ilog] = pg;
@@ -303,10 +372,10 @@ static void add_page_front(struct heap_memory *heap,
 
 static void remove_page(struct heap_memory *heap,
 			struct heapmem_extent *ext,
-			int pg, int log2size)
+			int pg, int sclass)
 {
 	struct heapmem_pgentry *old, *prev, *next;
-	int ilog = log2size - HEAPMEM_MIN_LOG2;
+	int ilog = sclass;
 
 	/* Remove page from the per-bucket page list. */
 
@@ -325,22 +394,22 @@ static void remove_page(struct heap_memory *heap,
 
 static void move_page_front(struct heap_memory *heap,
 			    struct heapmem_extent *ext,
-			    int pg, int log2size)
+			    int pg, int sclass)
 {
-	int ilog = log2size - HEAPMEM_MIN_LOG2;
+	int ilog = sclass;
 
 	/* Move page at front of the per-bucket page list. */
 	
 	if (heap->buckets[ilog] == pg)
 		return;	 /* Already at front, no move. */
 		
-	remove_page(heap, ext, pg, log2size);
-	add_page_front(heap, ext, pg, log2size);
+	remove_page(heap, ext, pg, sclass);
+	add_page_front(heap, ext, pg, sclass);
 }
 
 static void move_page_back(struct heap_memory *heap,
 			   struct heapmem_extent *ext,
-			   int pg, int log2size)
+			   int pg, int sclass)
 {
 	struct heapmem_pgentry *old, *last, *head, *next;
 	int ilog;
@@ -351,9 +420,9 @@ static void move_page_back(struct heap_memory *heap,
 	if (pg == old->next) /* Singleton, no move. */
 		return;
 		
-	remove_page(heap, ext, pg, log2size);
+	remove_page(heap, ext, pg, sclass);
 
-	ilog = log2size - HEAPMEM_MIN_LOG2;
+	ilog = sclass;
 	head = &ext->pagemap[heap->buckets[ilog]];
 	last = &ext->pagemap[head->prev];
 	old->prev = head->prev;
@@ -363,11 +432,11 @@ static void move_page_back(struct heap_memory *heap,
 	last->next = pg;
 }
 
-static void *add_free_range(struct heap_memory *heap, size_t bsize, int log2size)
+static void *add_free_range(struct heap_memory *heap, size_t bsize, int sclass)
 {
 	struct heapmem_extent *ext;
 	size_t rsize;
-	int pg;
+	int pg, n;
 
 	/*
 	 * Scanning each extent, search for a range of contiguous
@@ -381,33 +450,38 @@ static void *add_free_range(struct heap_memory *heap, size_t bsize, int log2size
 			goto found;
 	}
 
+	heap->nomem_count++;
+
 	return NULL;
 
 found:	
 	/*
-	 * Update the page entry.  If @log2size is non-zero
-	 * (i.e. bsize < HEAPMEM_PAGE_SIZE), bsize is (1 << log2Size)
-	 * between 2^HEAPMEM_MIN_LOG2 and 2^(HEAPMEM_PAGE_SHIFT - 1).
-	 * Save the log2 power into entry.type, then update the
-	 * per-page allocation bitmap to reserve the first block.
+	 * Update the page entry.  If @sclass is positive or null
+	 * (i.e. bsize < HEAPMEM_PAGE_SIZE), bsize is the size of the
+	 * blocks from this bucket, between 2^HEAPMEM_MIN_LOG2 and
+	 * 2^(HEAPMEM_PAGE_SHIFT - 1).  Save the size class into
+	 * entry.type, then update the per-page allocation bitmap to
+	 * reserve the first block.
 	 *
 	 * Otherwise, we have a larger block which may span multiple
 	 * pages: set entry.type to page_list, indicating the start of
 	 * the page range, and entry.bsize to the overall block size.
 	 */
-	if (log2size) {
-		ext->pagemap[pg].type = log2size;
+	if (sclass >= 0) {
+		ext->pagemap[pg].type = sclass + page_bucket;
 		/*
 		 * Mark the first object slot (#0) as busy, along with
-		 * the leftmost bits we won't use for this log2 size.
+		 * the leftmost bits we won't use for this size class.
 		 */
-		ext->pagemap[pg].map = ~gen_block_mask(log2size) | 1;
+		for (n = 0; n < HEAPMEM_MAP_WORDS; n++)
+			ext->pagemap[pg].map[n] = gen_unused_mask(sclass, n);
+		ext->pagemap[pg].map[0] |= 1;
 		/*
 		 * Insert the new page at front of the per-bucket page
 		 * list, enforcing the assumption that pages with free
 		 * space live close to the head of this list.
 		 */
-		add_page_front(heap, ext, pg, log2size);
+		add_page_front(heap, ext, pg, sclass);
 	} else {
 		ext->pagemap[pg].type = page_list;
 		ext->pagemap[pg].bsize = (uint32_t)bsize;
@@ -420,31 +494,35 @@ found:
 	return pagenr_to_addr(ext, pg);
 }
 
-void *heapmem_alloc(struct heap_memory *heap, size_t size)
+/*
+ * Return the actual size of the block serving @size bytes, and its
+ * size class in *@sclassp, or -1 for a range of pages.
+ */
+static inline size_t get_block_size(size_t size, int *sclassp)
+{
+	if (size <= HEAPMEM_MIN_ALIGN) {
+		*sclassp = 0;
+		return HEAPMEM_MIN_ALIGN;
+	}
+
+	if (size <= HEAPMEM_PAGE_SIZE / 2) {
+		*sclassp = __heapmem_size_class(size);
+		return __heapmem_class_size(*sclassp);
+	}
+
+	*sclassp = -1;
+
+	return __align_to(size, HEAPMEM_PAGE_SIZE);
+}
+
+static void *alloc_block(struct heap_memory *heap, /* heap->lock held */
+			 size_t bsize, int sclass)
 {
+	struct heapmem_pgentry *pgent;
 	struct heapmem_extent *ext;
-	int log2size, ilog, pg, b;
-	uint32_t bmask;
-	size_t bsize;
+	int pg, b, n;
 	void *block;
 
-	if (size == 0)
-		return NULL;
-
-	if (size < HEAPMEM_MIN_ALIGN) {
-		bsize = size = HEAPMEM_MIN_ALIGN;
-		log2size = HEAPMEM_MIN_LOG2;
-	} else {
-		log2size = sizeof(size) * CHAR_BIT - 1 -
-			xenomai_count_leading_zeros(size);
-		if (log2size < HEAPMEM_PAGE_SHIFT) {
-			if (size & (size - 1))
-				log2size++;
-			bsize = 1 << log2size;
-		} else
-			bsize = __align_to(size, HEAPMEM_PAGE_SIZE);
-	}
-	
 	/*
 	 * Allocate entire pages directly from the pool whenever the
 	 * block is larger or equal to HEAPMEM_PAGE_SIZE.  Otherwise,
@@ -457,14 +535,11 @@ void *heapmem_alloc(struct heap_memory *heap, size_t size)
 	 * this list, in which case we should immediately add a fresh
 	 * page.
 	 */
-	if (bsize < HEAPMEM_PAGE_SIZE) {
-		ilog = log2size - HEAPMEM_MIN_LOG2;
-		assert(ilog >= 0 && ilog < HEAPMEM_MAX);
-
-		write_lock_nocancel(&heap->lock);
+	if (sclass >= 0) {
+		assert(sclass < HEAPMEM_MAX);
 
 		pvlist_for_each_entry(ext, &heap->extents, next) {
-			pg = heap->buckets[ilog];
+			pg = heap->buckets[sclass];
 			if (pg < 0) /* Empty page list? */
 				continue;
 
@@ -473,49 +548,46 @@ void *heapmem_alloc(struct heap_memory *heap, size_t size)
 			 * is none, there won't be any down the list:
 			 * add a new page right away.
 			 */
-			bmask = ext->pagemap[pg].map;
-			if (bmask == -1U)
-				break;
-			b = xenomai_count_trailing_zeros(~bmask);
+			pgent = &ext->pagemap[pg];
+			for (n = 0; n < HEAPMEM_MAP_WORDS; n++)
+				if (pgent->map[n] != -1U)
+					goto found;
+			break;
+		found:
+			b = xenomai_count_trailing_zeros(~pgent->map[n]);
 
 			/*
 			 * Got one block from the heading per-bucket
 			 * page, tag it as busy in the per-page
 			 * allocation map.
 			 */
-			ext->pagemap[pg].map |= (1U << b);
+			pgent->map[n] |= (1U << b);
 			heap->used_size += bsize;
 			block = ext->membase +
 				(pg << HEAPMEM_PAGE_SHIFT) +
-				(b << log2size);
-			if (ext->pagemap[pg].map == -1U)
-				move_page_back(heap, ext, pg, log2size);
-			goto out;
+				(n * 32 + b) * bsize;
+			if (map_is_full(pgent))
+				move_page_back(heap, ext, pg, sclass);
+			return block;
 		}
 
 		/* No free block in bucketed memory, add one page. */
-		block = add_free_range(heap, bsize, log2size);
-	} else {
-		write_lock_nocancel(&heap->lock);
-		/* Add a range of contiguous free pages. */
-		block = add_free_range(heap, bsize, 0);
+		return add_free_range(heap, bsize, sclass);
 	}
-out:
-	write_unlock(&heap->lock);
 
-	return block;
+	/* Add a range of contiguous free pages. */
+	return add_free_range(heap, bsize, -1);
 }
 
-int heapmem_free(struct heap_memory *heap, void *block)
+static int free_block(struct heap_memory *heap, /* heap->lock held */
+		      void *block)
 {
-	int log2size, ret = 0, pg, n;
+	int sclass, pg, n, w;
 	struct heapmem_extent *ext;
 	memoff_t pgoff, boff;
-	uint32_t oldmap;
+	bool was_full;
 	size_t bsize;
 
-	write_lock_nocancel(&heap->lock);
-
 	/*
 	 * Find the extent from which the returned block is
 	 * originating from.
@@ -541,16 +613,20 @@ found:
 		break;
 
 	default:
-		log2size = ext->pagemap[pg].type;
-		bsize = (1 << log2size);
+		sclass = ext->pagemap[pg].type - page_bucket;
+		bsize = __heapmem_class_size(sclass);
 		assert(bsize < HEAPMEM_PAGE_SIZE);
 		boff = pgoff & ~HEAPMEM_PAGE_MASK;
-		if ((boff & (bsize - 1)) != 0) /* Not at block start? */
+		n = get_block_index(sclass, boff); /* Block position in page. */
+		if (n < 0) /* Not at block start? */
 			goto bad;
 
-		n = boff >> log2size; /* Block position in page. */
-		oldmap = ext->pagemap[pg].map;
-		ext->pagemap[pg].map &= ~(1U << n);
+		w = n / 32;
+		if ((ext->pagemap[pg].map[w] & (1U << (n % 32))) == 0)
+			goto bad; /* Already free. */
+
+		was_full = map_is_full(&ext->pagemap[pg]);
+		ext->pagemap[pg].map[w] &= ~(1U << (n % 32));
 
 		/*
 		 * If the page the block was sitting on is fully idle,
@@ -559,22 +635,533 @@ found:
 		 * partially busy state, in which case it should move
 		 * toward the front of the per-bucket page list.
 		 */
-		if (ext->pagemap[pg].map == ~gen_block_mask(log2size)) {
-			remove_page(heap, ext, pg, log2size);
+		if (map_is_idle(&ext->pagemap[pg], sclass)) {
+			remove_page(heap, ext, pg, sclass);
 			release_page_range(ext, pagenr_to_addr(ext, pg),
 					   HEAPMEM_PAGE_SIZE);
-		} else if (oldmap == -1U)
-			move_page_front(heap, ext, pg, log2size);
+		} else if (was_full)
+			move_page_front(heap, ext, pg, sclass);
 	}
 
 	heap->used_size -= bsize;
-out:
+
+	return 0;
+bad:
+	heap->badfree_count++;
+
+	return -EINVAL;
+}
+
+/*
+ * Allocate up to @nr blocks of @size bytes, holding the heap lock
+ * once for all. Returns the number of blocks actually allocated,
+ * which is less than @nr if the heap ran out of memory. Per-thread
+ * magazines are bypassed.
+ */
+int heapmem_alloc_bulk(struct heap_memory *heap,
+		       size_t size, void **blocks, int nr)
+{
+	int sclass, n;
+	size_t bsize;
+
+	if (size == 0)
+		return 0;
+
+	bsize = get_block_size(size, &sclass);
+
+	write_lock_nocancel(&heap->lock);
+
+	for (n = 0; n < nr; n++) {
+		blocks[n] = alloc_block(heap, bsize, sclass);
+		if (blocks[n] == NULL)
+			break;
+	}
+
+	write_unlock(&heap->lock);
+
+	return n;
+}
+
+/*
+ * Release @nr blocks, holding the heap lock once for all. Blocks
+ * may be of different sizes. Returns -EINVAL if any of them is
+ * invalid, all others are released nevertheless.
+ */
+int heapmem_free_bulk(struct heap_memory *heap,
+		      void **blocks, int nr)
+{
+	int ret = 0, n;
+
+	write_lock_nocancel(&heap->lock);
+
+	for (n = 0; n < nr; n++) {
+		if (free_block(heap, blocks[n]))
+			ret = -EINVAL;
+	}
+
 	write_unlock(&heap->lock);
 
 	return __bt(ret);
-bad:
-	ret = -EINVAL;
-	goto out;
+}
+
+static int get_blocks(void *heap, int sclass, void **blocks, int nr)
+{
+	return heapmem_alloc_bulk(heap, __heapmem_class_size(sclass),
+				  blocks, nr);
+}
+
+static int put_blocks(void *heap, void **blocks, int nr)
+{
+	return heapmem_free_bulk(heap, blocks, nr);
+}
+
+static void *do_alloc(void *__heap, size_t size)
+{
+	struct heap_memory *heap = __heap;
+	size_t bsize;
+	void *block;
+	int sclass;
+
+	bsize = get_block_size(size, &sclass);
+	write_lock_nocancel(&heap->lock);
+	block = alloc_block(heap, bsize, sclass);
+	write_unlock(&heap->lock);
+
+	return block;
+}
+
+static void do_free(void *__heap, void *block)
+{
+	struct heap_memory *heap = __heap;
+
+	write_lock_nocancel(&heap->lock);
+	free_block(heap, block);
+	write_unlock(&heap->lock);
+}
+
+static const struct heapmem_mag_operations heapmem_mag_ops = {
+	.get = get_blocks,
+	.put = put_blocks,
+	.alloc = do_alloc,
+	.free = do_free,
+};
+
+/*
+ * Find out whether @block may go to a magazine, returning its size
+ * class if so, -1 otherwise. A busy block cannot move to another
+ * page, and extents are never dropped from a live heap, so we do
+ * not need to lock the heap for this. Anything which does not look
+ * like the start of a busy bucketed block is left to free_block()
+ * for sorting out, so that bad pointers and blocks already returned
+ * to the heap are caught there.
+ */
+static int get_cacheable_class(struct heap_memory *heap, void *block)
+{
+	struct heapmem_extent *ext;
+	memoff_t pgoff;
+	int sclass, pg, n;
+
+	pvlist_for_each_entry(ext, &heap->extents, next) {
+		if (block >= ext->membase && block < ext->memlim)
+			goto found;
+	}
+
+	return -1;
+found:
+	pgoff = block - ext->membase;
+	pg = pgoff >> HEAPMEM_PAGE_SHIFT;
+	if (!page_is_valid(ext, pg))
+		return -1;
+
+	sclass = ext->pagemap[pg].type - page_bucket;
+	if (sclass < 0 || sclass >= HEAPMEM_MAG_BUCKETS)
+		return -1;
+
+	n = get_block_index(sclass, pgoff & ~HEAPMEM_PAGE_MASK);
+	if (n < 0)
+		return -1;
+
+	if ((ACCESS_ONCE(ext->pagemap[pg].map[n / 32]) &
+	     (1U << (n % 32))) == 0)
+		return -1;
+
+	return sclass;
+}
+
+void *heapmem_alloc(struct heap_memory *heap, size_t size)
+{
+	size_t bsize;
+	void *block;
+	int sclass;
+
+	if (size == 0)
+		return NULL;
+
+	bsize = get_block_size(size, &sclass);
+
+	if (sclass >= 0 && sclass < HEAPMEM_MAG_BUCKETS &&
+	    heapmem_mag_enabled_p(&heap->depot))
+		return __heapmem_mag_alloc(&heap->depot, heap, sclass,
+					   &heapmem_mag_ops);
+
+	write_lock_nocancel(&heap->lock);
+	block = alloc_block(heap, bsize, sclass);
+	write_unlock(&heap->lock);
+
+	return block;
+}
+
+int heapmem_free(struct heap_memory *heap, void *block)
+{
+	int sclass, ret;
+
+	if (heapmem_mag_enabled_p(&heap->depot)) {
+		sclass = get_cacheable_class(heap, block);
+		if (sclass >= 0)
+			return __bt(__heapmem_mag_free(&heap->depot, heap,
+						       block, sclass,
+						       &heapmem_mag_ops));
+	}
+
+	write_lock_nocancel(&heap->lock);
+	ret = free_block(heap, block);
+	write_unlock(&heap->lock);
+
+	return __bt(ret);
+}
+
+static inline int count_busy_blocks(struct heapmem_pgentry *pgent,
+				    int sclass)
+{
+	int n, count = 0;
+
+	for (n = 0; n < HEAPMEM_MAP_WORDS; n++)
+		count += __builtin_popcount(pgent->map[n] &
+					    ~gen_unused_mask(sclass, n));
+	return count;
+}
+
+/*
+ * Collect occupancy and fragmentation figures. Every free range and
+ * busy page is visited with the heap locked, so this is no call for
+ * time-critical code. Blocks held in per-thread magazines count as
+ * busy.
+ */
+int heapmem_stat(struct heap_memory *heap, struct heapmem_stats *stats)
+{
+	struct heapmem_pgentry *pgent;
+	struct heapmem_extent *ext;
+	struct heapmem_range *r;
+	int pg, nrpages, sclass, bin;
+	struct avlh *node;
+	size_t rpages;
+
+	memset(stats, 0, sizeof(*stats));
+
+	read_lock_nocancel(&heap->lock);
+
+	stats->arena_size = heap->arena_size;
+	stats->usable_size = heap->usable_size;
+	stats->used_size = heap->used_size;
+	stats->nomem_count = heap->nomem_count;
+	stats->badfree_count = heap->badfree_count;
+
+	pvlist_for_each_entry(ext, &heap->extents, next) {
+		/*
+		 * Free ranges are indexed by address, so we may walk
+		 * the page map and the range tree in lockstep.
+		 */
+		nrpages = (ext->memlim - ext->membase) >> HEAPMEM_PAGE_SHIFT;
+		node = avl_head(&ext->addr_tree);
+		pg = 0;
+		while (pg < nrpages) {
+			if (node) {
+				r = container_of(node, struct heapmem_range,
+						 addr_node);
+				if (addr_to_pagenr(ext, r) == pg) {
+					rpages = r->size >> HEAPMEM_PAGE_SHIFT;
+					bin = sizeof(rpages) * CHAR_BIT - 1 -
+						xenomai_count_leading_zeros(rpages);
+					if (bin >= HEAPMEM_HIST_SIZE)
+						bin = HEAPMEM_HIST_SIZE - 1;
+					stats->free_hist[bin]++;
+					stats->free_ranges++;
+					stats->free_size += r->size;
+					if (r->size > stats->largest_free)
+						stats->largest_free = r->size;
+					node = avl_next(&ext->addr_tree, node);
+					pg += rpages;
+					continue;
+				}
+			}
+			pgent = &ext->pagemap[pg];
+			if (pgent->type == page_list) {
+				pg += pgent->bsize >> HEAPMEM_PAGE_SHIFT;
+				continue;
+			}
+			/*
+			 * Pages marked free or continued in debug
+			 * mode are none of our business here.
+			 */
+			sclass = pgent->type - page_bucket;
+			if (sclass >= 0 && sclass < HEAPMEM_MAX) {
+				stats->bucket_pages[sclass]++;
+				stats->bucket_blocks[sclass] +=
+					count_busy_blocks(pgent, sclass);
+			}
+			pg++;
+		}
+	}
+
+	read_unlock(&heap->lock);
+
+	return 0;
+}
+
+#ifdef HAVE_TLS
+
+#define HEAPMEM_MAG_HEAPS  4
+
+struct heapmem_magazine {
+	int nr;
+	void *blocks[HEAPMEM_MAG_SIZE];
+};
+
+/*
+ * Per-thread cache for a given heap, allocated from that heap. All
+ * blocks from a magazine belong to the same size class.
+ */
+struct heapmem_mag_cache {
+	void *heap;
+	const struct heapmem_mag_operations *ops;
+	struct heapmem_magazine mags[HEAPMEM_MAG_BUCKETS];
+};
+
+/*
+ * The depot address and serial identify the heap a cache belongs
+ * to. We keep them in TLS so that we never have to touch the
+ * memory of a heap which may have been destroyed meanwhile.
+ */
+struct heapmem_mag_slot {
+	struct heapmem_depot *depot;
+	unsigned long serial;
+	struct heapmem_mag_cache *cache;
+};
+
+static __thread __attribute__ ((tls_model (CONFIG_XENO_TLS_MODEL)))
+struct heapmem_mag_slot mag_slots[HEAPMEM_MAG_HEAPS];
+
+static pthread_key_t mag_key;
+
+static pthread_once_t mag_once = PTHREAD_ONCE_INIT;
+
+static unsigned long mag_serial;
+
+static void flush_mag_slot(struct heapmem_mag_slot *slot)
+{
+	struct heapmem_mag_cache *cache = slot->cache;
+	struct heapmem_magazine *mag;
+	int n;
+
+	for (n = 0; n < HEAPMEM_MAG_BUCKETS; n++) {
+		mag = cache->mags + n;
+		if (mag->nr > 0)
+			cache->ops->put(cache->heap, mag->blocks, mag->nr);
+	}
+
+	cache->ops->free(cache->heap, cache);
+	slot->depot = NULL;
+	slot->cache = NULL;
+}
+
+static void flush_mag_slots(void *arg)
+{
+	struct heapmem_mag_slot *slot;
+	int n;
+
+	/* Thread is exiting, give our blocks back to live heaps. */
+	for (n = 0; n < HEAPMEM_MAG_HEAPS; n++) {
+		slot = mag_slots + n;
+		if (slot->depot && slot->depot->serial == slot->serial)
+			flush_mag_slot(slot);
+	}
+}
+
+static void init_mag_key(void)
+{
+	pthread_key_create(&mag_key, flush_mag_slots);
+}
+
+static struct heapmem_mag_cache *
+get_mag_cache(struct heapmem_depot *depot, void *heap,
+	      const struct heapmem_mag_operations *ops)
+{
+	struct heapmem_mag_slot *slot, *free_slot = NULL;
+	unsigned long serial = depot->serial;
+	struct heapmem_mag_cache *cache;
+	int n;
+
+	for (n = 0; n < HEAPMEM_MAG_HEAPS; n++) {
+		slot = mag_slots + n;
+		if (slot->depot == depot) {
+			if (slot->serial == serial)
+				return slot->cache;
+			/* Same address, new heap: recycle. */
+			free_slot = slot;
+		} else if (slot->depot == NULL && free_slot == NULL)
+			free_slot = slot;
+	}
+
+	/* Too many heaps in use by this thread, go uncached. */
+	if (free_slot == NULL)
+		return NULL;
+
+	cache = ops->alloc(heap, sizeof(*cache));
+	if (cache == NULL)
+		return NULL;
+
+	memset(cache, 0, sizeof(*cache));
+	cache->heap = heap;
+	cache->ops = ops;
+	free_slot->depot = depot;
+	free_slot->serial = serial;
+	free_slot->cache = cache;
+
+	/* Arm the thread finalizer. */
+	pthread_once(&mag_once, init_mag_key);
+	pthread_setspecific(mag_key, mag_slots);
+
+	return cache;
+}
+
+void __heapmem_depot_init(struct heapmem_depot *depot)
+{
+	depot->serial = __sync_add_and_fetch(&mag_serial, 1);
+}
+
+void *__heapmem_mag_alloc(struct heapmem_depot *depot, void *heap,
+			  int sclass,
+			  const struct heapmem_mag_operations *ops)
+{
+	struct heapmem_mag_cache *cache;
+	struct heapmem_magazine *mag;
+	void *block;
+
+	cache = get_mag_cache(depot, heap, ops);
+	if (cache == NULL)
+		return ops->get(heap, sclass, &block, 1) ? block : NULL;
+
+	mag = cache->mags + sclass;
+	if (mag->nr == 0) {
+		mag->nr = ops->get(heap, sclass, mag->blocks,
+				   HEAPMEM_MAG_BATCH);
+		if (mag->nr == 0)
+			return NULL;
+	}
+
+	return mag->blocks[--mag->nr];
+}
+
+/*
+ * The caller made sure @block is a busy block of class @sclass.
+ * Since cached blocks are still busy for the heap, a block freed
+ * twice by the same thread may only be caught by looking up its
+ * magazine. A block freed twice by distinct threads goes undetected
+ * until both caches are flushed.
+ */
+int __heapmem_mag_free(struct heapmem_depot *depot, void *heap,
+		       void *block, int sclass,
+		       const struct heapmem_mag_operations *ops)
+{
+	struct heapmem_mag_cache *cache;
+	struct heapmem_magazine *mag;
+	int n;
+
+	cache = get_mag_cache(depot, heap, ops);
+	if (cache == NULL)
+		return ops->put(heap, &block, 1);
+
+	mag = cache->mags + sclass;
+	for (n = 0; n < mag->nr; n++) {
+		if (mag->blocks[n] == block)
+			return -EINVAL;
+	}
+
+	if (mag->nr == HEAPMEM_MAG_SIZE) {
+		/* Full magazine, give back the least recently freed. */
+		ops->put(heap, mag->blocks, HEAPMEM_MAG_BATCH);
+		memmove(mag->blocks, mag->blocks + HEAPMEM_MAG_BATCH,
+			(HEAPMEM_MAG_SIZE - HEAPMEM_MAG_BATCH) *
+			sizeof(mag->blocks[0]));
+		mag->nr -= HEAPMEM_MAG_BATCH;
+	}
+
+	mag->blocks[mag->nr++] = block;
+
+	return 0;
+}
+
+void __heapmem_mag_flush(struct heapmem_depot *depot)
+{
+	struct heapmem_mag_slot *slot;
+	int n;
+
+	for (n = 0; n < HEAPMEM_MAG_HEAPS; n++) {
+		slot = mag_slots + n;
+		if (slot->depot == depot && slot->serial == depot->serial) {
+			flush_mag_slot(slot);
+			break;
+		}
+	}
+}
+
+#else /* !HAVE_TLS */
+
+/* Magazines are not available without TLS support. */
+
+void __heapmem_depot_init(struct heapmem_depot *depot)
+{
+	depot->serial = 0;
+}
+
+void *__heapmem_mag_alloc(struct heapmem_depot *depot, void *heap,
+			  int sclass,
+			  const struct heapmem_mag_operations *ops)
+{
+	void *block;
+
+	return ops->get(heap, sclass, &block, 1) ? block : NULL;
+}
+
+int __heapmem_mag_free(struct heapmem_depot *depot, void *heap,
+		       void *block, int sclass,
+		       const struct heapmem_mag_operations *ops)
+{
+	return ops->put(heap, &block, 1);
+}
+
+void __heapmem_mag_flush(struct heapmem_depot *depot)
+{ }
+
+#endif /* !HAVE_TLS */
+
+/*
+ * Blocks released to a heap with magazines enabled may stay cached
+ * by the releasing thread, so that an allocation request may fail
+ * although enough memory would be available from the caches of
+ * other threads. Therefore, magazines should not be enabled on
+ * heaps callers may wait for, such as application-defined memory
+ * pools. Blocks cached by a thread go back to the heap when it
+ * exits, or calls heapmem_flush_magazines().
+ */
+void heapmem_enable_magazines(struct heap_memory *heap)
+{
+	__heapmem_depot_init(&heap->depot);
+}
+
+void heapmem_flush_magazines(struct heap_memory *heap)
+{
+	__heapmem_mag_flush(&heap->depot);
 }
 
 static inline int compare_range_by_size(const struct avlh *l, const struct avlh *r)
@@ -708,6 +1295,10 @@ int heapmem_init(struct heap_memory *heap, void *mem, size_t size)
 	for (n = 0; n < HEAPMEM_MAX; n++)
 		heap->buckets[n] = -1U;
 
+	heap->depot.serial = 0;
+	heap->nomem_count = 0;
+	heap->badfree_count = 0;
+
 	ret = add_extent(heap, mem, size);
 	if (ret) {
 		__RT(pthread_mutex_destroy(&heap->lock));
@@ -724,5 +1315,7 @@ int heapmem_extend(struct heap_memory *heap, void *mem, size_t size)
 
 void heapmem_destroy(struct heap_memory *heap)
 {
+	/* Stale caches will be recycled by their respective threads. */
+	heap->depot.serial = 0;
 	__RT(pthread_mutex_destroy(&heap->lock));
 }
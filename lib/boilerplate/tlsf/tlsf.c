@@ -217,6 +217,8 @@ typedef struct TLSF_struct {
      * do not know the sizes when freeing/reallocing memory. */
     size_t used_size;
     size_t max_size;
+    /* Allocation requests which could not be satisfied. */
+    unsigned long nomem_count;
 #endif
 
     /* A linked list holding all the existing areas */
@@ -584,6 +586,18 @@ size_t get_used_size(void *mem_pool)
 #endif
 }
 
+/******************************************************************/
+unsigned long get_nomem_count(void *mem_pool)
+{
+/******************************************************************/
+#if TLSF_STATISTIC
+    return ((tlsf_t *) mem_pool)->nomem_count;
+#else
+    (void)mem_pool;
+    return 0;
+#endif
+}
+
 /******************************************************************/
 size_t get_max_size(void *mem_pool)
 {
@@ -707,8 +721,12 @@ void *malloc_ex(size_t size, void *mem_pool)
     /* Searching a free block, recall that this function changes the values of fl and sl,
        so they are not longer valid when the function fails */
     b = FIND_SUITABLE_BLOCK(tlsf, &fl, &sl);
-    if (!b)
+    if (!b) {
+#if TLSF_STATISTIC
+	tlsf->nomem_count++;
+#endif
 	return NULL;            /* Not found */
+    }
 
     EXTRACT_BLOCK_HDR(b, tlsf, fl, sl);
 
@@ -878,6 +896,42 @@ void *calloc_ex(size_t nelem, size_t elem_size, void *mem_pool)
 }
 
 
+/******************************************************************/
+int malloc_bulk_ex(size_t size, void **blocks, int nr, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    int n;
+
+    /* Grab the pool lock once for the whole batch. */
+    TLSF_ACQUIRE_LOCK(&tlsf->lock);
+
+    for (n = 0; n < nr; n++) {
+	blocks[n] = malloc_ex(size, mem_pool);
+	if (!blocks[n])
+	    break;
+    }
+
+    TLSF_RELEASE_LOCK(&tlsf->lock);
+
+    return n;
+}
+
+/******************************************************************/
+void free_bulk_ex(void **blocks, int nr, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    int n;
+
+    TLSF_ACQUIRE_LOCK(&tlsf->lock);
+
+    for (n = 0; n < nr; n++)
+	free_ex(blocks[n], mem_pool);
+
+    TLSF_RELEASE_LOCK(&tlsf->lock);
+}
+
 /******************************************************************/
 size_t malloc_usable_size_ex(void *ptr, void *pool)
 {
@@ -893,6 +947,29 @@ size_t malloc_usable_size_ex(void *ptr, void *pool)
     return b->size & BLOCK_SIZE;
 }
 
+/******************************************************************/
+void walk_free_blocks(void *mem_pool,
+		      void (*walker)(size_t size, void *arg), void *arg)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    bhdr_t *b;
+    int i, j;
+
+    /* Keep blocks from being split or merged under our feet. */
+    TLSF_ACQUIRE_LOCK(&tlsf->lock);
+
+    for (i = 0; i < REAL_FLI; i++) {
+	if (!(tlsf->fl_bitmap & (1 << i)))
+	    continue;
+	for (j = 0; j < MAX_SLI; j++) {
+	    for (b = tlsf->matrix[i][j]; b; b = b->ptr.free_ptr.next)
+		walker(b->size & BLOCK_SIZE, arg);
+	}
+    }
+
+    TLSF_RELEASE_LOCK(&tlsf->lock);
+}
 
 #if _DEBUG_TLSF_
 
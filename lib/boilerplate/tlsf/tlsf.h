@@ -27,12 +27,16 @@
 extern size_t init_memory_pool(size_t, void *);
 extern size_t get_used_size(void *);
 extern size_t get_max_size(void *);
+extern unsigned long get_nomem_count(void *);
+extern void walk_free_blocks(void *, void (*)(size_t, void *), void *);
 extern void destroy_memory_pool(void *);
 extern size_t add_new_area(void *, size_t, void *);
 extern void *malloc_ex(size_t, void *);
 extern void free_ex(void *, void *);
 extern void *realloc_ex(void *, size_t, void *);
 extern void *calloc_ex(size_t, size_t, void *);
+extern int malloc_bulk_ex(size_t, void **, int, void *);
+extern void free_bulk_ex(void **, int, void *);
 
 extern void *tlsf_malloc(size_t size);
 extern void tlsf_free(void *ptr);
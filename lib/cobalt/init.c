@@ -123,6 +123,16 @@ static const struct option cobalt_options[] = {
 		.name = "print-sync-delay",
 		.has_arg = required_argument,
 	},
+	{
+#define print_ringsz_opt	4
+		.name = "print-shared-ring",
+		.has_arg = required_argument,
+	},
+	{
+#define print_watermark_opt	5
+		.name = "print-flush-watermark",
+		.has_arg = required_argument,
+	},
 	{ /* Sentinel */ }
 };
 
@@ -343,6 +353,20 @@ static int cobalt_parse_option(int optnum, const char *optarg)
 			return ret;
 		__cobalt_print_syncdelay = value;
 		break;
+	case print_ringsz_opt:
+		ret = get_int_arg("--print-shared-ring", optarg, &value, 0);
+		if (ret)
+			return ret;
+		__cobalt_print_ringsz = value;
+		break;
+	case print_watermark_opt:
+		ret = get_int_arg("--print-flush-watermark", optarg, &value, 0);
+		if (ret)
+			return ret;
+		if (value > 100)
+			return -EINVAL;
+		__cobalt_print_watermark = value;
+		break;
 	default:
 		/* Paranoid, can't happen. */
 		return -EINVAL;
@@ -357,6 +381,8 @@ static void cobalt_help(void)
 	fprintf(stderr, "--print-buffer-size=<bytes>	size of a print relay buffer (16k)\n");
 	fprintf(stderr, "--print-buffer-count=<num>	number of print relay buffers (4)\n");
 	fprintf(stderr, "--print-sync-delay=<ms>	max delay of output synchronization (100 ms)\n");
+	fprintf(stderr, "--print-shared-ring=<bytes>	size of a ring shared by all threads (0, off)\n");
+	fprintf(stderr, "--print-flush-watermark=<pct>	buffer fill level forcing early output (0, off)\n");
 }
 
 static struct setup_descriptor cobalt_interface = {
@@ -70,7 +70,19 @@
  * are used when creating a message queue:
  * - @a mq_maxmsg is the maximum number of messages in the queue (128 by
  *   default);
- * - @a mq_msgsize is the maximum size of each message (128 by default).
+ * - @a mq_msgsize is the maximum size of each message (128 by default);
+ * - @a mq_flags may have the Cobalt-specific @a MQ_SPSC bit set, for
+ *   a queue shared by a single sender and a single receiver. Messages
+ *   are then conveyed through a lockless ring in FIFO order, their
+ *   priority is returned to the receiver but does not reorder the
+ *   queue. At most one descriptor open for sending (O_WRONLY or
+ *   O_RDWR) and one descriptor open for receiving (O_RDONLY or O_RDWR)
+ *   may exist at any time, and each of them must not be used by
+ *   several threads concurrently.
+ *
+ * Regardless of @a MQ_SPSC, sending and receiving only serialize on
+ * the queue being operated, unless a thread has to be woken up, or
+ * select() or mq_notify() are used on the queue.
  *
  * @a name may be any arbitrary string, in which slashes have no particular
  * meaning. However, for portability, using a name which starts with a slash and
@@ -92,6 +104,8 @@
  *   CONFIG_XENO_OPT_SYS_HEAPSZ;
  * - EPERM, attempting to create a message queue from an invalid context;
  * - EINVAL, the @a attr argument is invalid;
+ * - EBUSY, the queue was created with @a MQ_SPSC, and opening it
+ *   would add a second sender or receiver;
  * - EMFILE, too many descriptors are currently open.
  * - EAGAIN, no registry slot available, check/raise CONFIG_XENO_OPT_REGISTRY_NRSLOTS.
  *
@@ -278,7 +292,7 @@ COBALT_IMPL(int, mq_setattr, (mqd_t mqd,
 		flags = err;
 	}
 
-	flags = (flags & ~O_NONBLOCK) | (attr->mq_flags & O_NONBLOCK);
+	flags = (flags & ~(O_NONBLOCK | MQ_SPSC)) | (attr->mq_flags & O_NONBLOCK);
 
 	err = __WRAP(fcntl(mqd, F_SETFL, flags));
 	if (!err)
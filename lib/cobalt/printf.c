@@ -20,10 +20,12 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <syslog.h>
@@ -43,12 +45,14 @@
 
 #define RT_PRINT_MODE_FORMAT		0
 #define RT_PRINT_MODE_FWRITE		1
+#define RT_PRINT_MODE_BINARY		2
 
 struct entry_head {
 	FILE *dest;
 	uint32_t seq_no;
 	int priority;
 	size_t len;
+	unsigned char mode;
 	char data[0];
 } __attribute__((packed));
 
@@ -62,6 +66,11 @@ struct print_buffer {
 
 	char name[32];
 
+	/* Statistics, only updated by the owner. */
+	unsigned long records;
+	unsigned long dropped;
+	unsigned long truncated;
+
 	/*
 	 * Keep read_pos separated from write_pos to optimise write
 	 * caching on SMP.
@@ -75,9 +84,38 @@ int __cobalt_print_bufcount = RT_PRINT_DEFAULT_BUFFERS_COUNT;
 
 int __cobalt_print_syncdelay = RT_PRINT_DEFAULT_SYNCDELAY;
 
+int __cobalt_print_ringsz;
+
+int __cobalt_print_watermark;
+
+/*
+ * The shared ring is an alternative to per-thread buffers, made of
+ * fixed-size slots which any thread may fill concurrently without
+ * locking. Producers claim slots in FIFO order by moving the tail
+ * index, each slot bears a sequence stamp telling whether it is
+ * free for the producer of a given lap, or ready for the printer
+ * (D. Vyukov's bounded queue, with a single consumer). A producer
+ * finding the ring full drops its record.
+ */
+#define RT_PRINT_SLOT_SIZE		RT_PRINT_LINE_BREAK
+
+struct print_slot {
+	atomic_long_t seq;
+	char entry[RT_PRINT_SLOT_SIZE - sizeof(atomic_long_t)];
+};
+
+#define RT_PRINT_SLOT_DATA \
+	(sizeof(((struct print_slot *)0)->entry) - sizeof(struct entry_head))
+
+static struct print_slot *shared_ring;
+static unsigned long shared_mask;
+static atomic_long_t shared_tail;
+static unsigned long shared_head;
+static atomic_long_t shared_records, shared_dropped, shared_truncated;
+
 static struct print_buffer *first_buffer;
 static int buffers;
-static uint32_t seq_no;
+static uint32_t seq_no;	/* Shared by all writers, bumped atomically. */
 static struct timespec syncdelay;
 static pthread_mutex_t buffer_lock;
 static pthread_cond_t printer_wakeup;
@@ -88,67 +126,408 @@ static atomic_long_t *pool_bitmap;
 static unsigned pool_bitmap_len;
 static unsigned pool_buf_size;
 static unsigned long pool_start, pool_len;
+static unsigned long retired_records, retired_dropped, retired_truncated;
+static sem_t printer_sem;
+static atomic_long_t flush_pending;
+static atomic_long_t flush_wakeups;
 
 static void release_buffer(struct print_buffer *buffer);
 static void print_buffers(void);
 
-/* *** rt_print API *** */
+/* *** Binary records *** */
 
-static int 
-vprint_to_buffer(FILE *stream, int fortify_level, int priority, 
-		 unsigned int mode, size_t sz, const char *format, va_list args)
+/*
+ * Binary records carry the format string pointer followed by the
+ * raw argument values, formatting is deferred to the printer
+ * thread. Strings are copied into the record, so callers may reuse
+ * their storage on return, but the format string must stay valid
+ * until the output is flushed.
+ */
+
+enum print_arg_class {
+	PRINT_ARG_NONE,
+	PRINT_ARG_INT,
+	PRINT_ARG_LONG,
+	PRINT_ARG_LLONG,
+	PRINT_ARG_INTMAX,
+	PRINT_ARG_SIZE,
+	PRINT_ARG_PTRDIFF,
+	PRINT_ARG_DOUBLE,
+	PRINT_ARG_LDOUBLE,
+	PRINT_ARG_PTR,
+	PRINT_ARG_STRING,
+	PRINT_ARG_ERRNO,
+	PRINT_ARG_UNSUPPORTED,
+};
+
+union print_arg {
+	int i;
+	long l;
+	long long ll;
+	intmax_t j;
+	size_t z;
+	ptrdiff_t t;
+	double d;
+	long double ld;
+	void *ptr;
+};
+
+struct print_spec {
+	int stars;	/* '*' fields consuming an int argument */
+	int prec;	/* -1 if unspecified, -2 if passed as argument */
+	char size;	/* length modifier, 'H' for hh, 'q' for ll */
+	char conv;
+};
+
+static const char *parse_spec(const char *p, struct print_spec *spec)
 {
-	struct print_buffer *buffer = pthread_getspecific(buffer_key);
-	off_t write_pos, read_pos;
-	struct entry_head *head;
-	int len, str_len;
-	int res = 0;
+	spec->stars = 0;
+	spec->prec = -1;
+	spec->size = 0;
 
-	if (!buffer) {
-		res = rt_print_init(0, NULL);
-		if (res) {
-			errno = res;
-			return -1;
+	while (*p && strchr("#0- +'I", *p))
+		p++;
+
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	} else
+		while (*p >= '0' && *p <= '9')
+			p++;
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->stars++;
+			spec->prec = -2;
+			p++;
+		} else {
+			spec->prec = 0;
+			while (*p >= '0' && *p <= '9')
+				spec->prec = spec->prec * 10 + *p++ - '0';
 		}
-		buffer = pthread_getspecific(buffer_key);
 	}
 
-	/* Take a snapshot of the ring buffer state */
-	write_pos = buffer->write_pos;
-	read_pos = buffer->read_pos;
-	smp_mb();
+	switch (*p) {
+	case 'h':
+		if (*++p == 'h') {
+			spec->size = 'H';
+			p++;
+		} else
+			spec->size = 'h';
+		break;
+	case 'l':
+		if (*++p == 'l') {
+			spec->size = 'q';
+			p++;
+		} else
+			spec->size = 'l';
+		break;
+	case 'L':
+	case 'q':
+		spec->size = 'q';
+		p++;
+		break;
+	case 'Z':
+		spec->size = 'z';
+		p++;
+		break;
+	case 'j':
+	case 'z':
+	case 't':
+		spec->size = *p++;
+		break;
+	}
 
-	/* Is our write limit the end of the ring buffer? */
-	if (write_pos >= read_pos) {
-		/* Keep a safety margin to the end for at least an empty entry */
-		len = buffer->size - write_pos - sizeof(struct entry_head);
+	spec->conv = *p;
 
-		/* Special case: We were stuck at the end of the ring buffer
-		   with space left there only for one empty entry. Now
-		   read_pos was moved forward and we can wrap around. */
-		if (len == 0 && read_pos > sizeof(struct entry_head)) {
-			/* Write out empty entry */
-			head = buffer->ring + write_pos;
-			head->seq_no = seq_no;
-			head->priority = 0;
-			head->len = 0;
+	return *p ? p + 1 : p;
+}
 
-			/* Forward to the ring buffer start */
-			write_pos = 0;
-			len = read_pos - 1;
+static enum print_arg_class get_arg_class(const struct print_spec *spec)
+{
+	switch (spec->conv) {
+	case 'd':
+	case 'i':
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		switch (spec->size) {
+		case 'l':
+			return PRINT_ARG_LONG;
+		case 'q':
+			return PRINT_ARG_LLONG;
+		case 'j':
+			return PRINT_ARG_INTMAX;
+		case 'z':
+			return PRINT_ARG_SIZE;
+		case 't':
+			return PRINT_ARG_PTRDIFF;
 		}
-	} else {
-		/* Our limit is the read_pos ahead of our write_pos. One byte
-		   margin is required to detect a full ring. */
-		len = read_pos - write_pos - 1;
+		return PRINT_ARG_INT;
+	case 'c':
+		return spec->size ? PRINT_ARG_UNSUPPORTED : PRINT_ARG_INT;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		return spec->size == 'q' ? PRINT_ARG_LDOUBLE : PRINT_ARG_DOUBLE;
+	case 'p':
+		return PRINT_ARG_PTR;
+	case 's':
+		return spec->size ? PRINT_ARG_UNSUPPORTED : PRINT_ARG_STRING;
+	case 'm':
+		return PRINT_ARG_ERRNO;
+	case '%':
+		return PRINT_ARG_NONE;
 	}
 
-	/* Account for head length */
-	len -= sizeof(struct entry_head);
-	if (len < 0)
-		len = 0;
+	/* %n, wide characters, positional arguments, garbage. */
+	return PRINT_ARG_UNSUPPORTED;
+}
 
-	head = buffer->ring + write_pos;
+static size_t get_arg_size(enum print_arg_class class)
+{
+	switch (class) {
+	case PRINT_ARG_LONG:
+		return sizeof(long);
+	case PRINT_ARG_LLONG:
+		return sizeof(long long);
+	case PRINT_ARG_INTMAX:
+		return sizeof(intmax_t);
+	case PRINT_ARG_SIZE:
+		return sizeof(size_t);
+	case PRINT_ARG_PTRDIFF:
+		return sizeof(ptrdiff_t);
+	case PRINT_ARG_DOUBLE:
+		return sizeof(double);
+	case PRINT_ARG_LDOUBLE:
+		return sizeof(long double);
+	case PRINT_ARG_PTR:
+		return sizeof(void *);
+	default:
+		return sizeof(int);
+	}
+}
+
+static bool binary_format_p(const char *format)
+{
+	struct print_spec spec;
+	const char *p = format;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		p = parse_spec(p + 1, &spec);
+		if (get_arg_class(&spec) == PRINT_ARG_UNSUPPORTED)
+			return false;
+	}
+
+	return true;
+}
+
+static inline char *put_bytes(char *p, const char *end,
+			      const void *data, size_t len)
+{
+	if (p == NULL || len > end - p)
+		return NULL;
+
+	memcpy(p, data, len);
+
+	return p + len;
+}
+
+/*
+ * Encode a record into at most @len bytes, return its size, or zero
+ * if it does not fit.
+ */
+static int encode_record(char *buf, int len, const char *format, va_list args)
+{
+	const char *f = format, *end = buf + len, *s;
+	enum print_arg_class class;
+	struct print_spec spec;
+	union print_arg arg;
+	char *p = buf;
+	int n, v = -1;
+
+	p = put_bytes(p, end, &format, sizeof(format));
+
+	while (p && (f = strchr(f, '%')) != NULL) {
+		f = parse_spec(f + 1, &spec);
+		for (n = 0; n < spec.stars; n++) {
+			v = va_arg(args, int);
+			p = put_bytes(p, end, &v, sizeof(v));
+		}
+		if (spec.prec == -2)
+			spec.prec = v < 0 ? -1 : v;
+
+		class = get_arg_class(&spec);
+		switch (class) {
+		case PRINT_ARG_NONE:
+			continue;
+		case PRINT_ARG_ERRNO:
+			arg.i = errno;
+			break;
+		case PRINT_ARG_STRING:
+			s = va_arg(args, const char *);
+			if (s == NULL)
+				s = "(null)";
+			n = spec.prec >= 0 ? strnlen(s, spec.prec) : strlen(s);
+			p = put_bytes(p, end, s, n);
+			p = put_bytes(p, end, "", 1);
+			continue;
+		case PRINT_ARG_LONG:
+			arg.l = va_arg(args, long);
+			break;
+		case PRINT_ARG_LLONG:
+			arg.ll = va_arg(args, long long);
+			break;
+		case PRINT_ARG_INTMAX:
+			arg.j = va_arg(args, intmax_t);
+			break;
+		case PRINT_ARG_SIZE:
+			arg.z = va_arg(args, size_t);
+			break;
+		case PRINT_ARG_PTRDIFF:
+			arg.t = va_arg(args, ptrdiff_t);
+			break;
+		case PRINT_ARG_DOUBLE:
+			arg.d = va_arg(args, double);
+			break;
+		case PRINT_ARG_LDOUBLE:
+			arg.ld = va_arg(args, long double);
+			break;
+		case PRINT_ARG_PTR:
+			arg.ptr = va_arg(args, void *);
+			break;
+		default:
+			arg.i = va_arg(args, int);
+		}
+
+		p = put_bytes(p, end, &arg, get_arg_size(class));
+	}
+
+	return p ? p - buf : 0;
+}
+
+static void print_binary(FILE *dest, const char *data)
+{
+	const char *format, *f, *q;
+	enum print_arg_class class;
+	struct print_spec spec;
+	union print_arg arg;
+	char fmt[64], *o;
+	int v, ret;
+
+	memcpy(&format, data, sizeof(format));
+	data += sizeof(format);
+
+	for (f = format; *f; f = q) {
+		if (*f != '%') {
+			q = strchrnul(f, '%');
+			ret = fwrite(f, q - f, 1, dest);
+			continue;
+		}
+
+		q = parse_spec(f + 1, &spec);
+		class = get_arg_class(&spec);
+
+		/* Rebuild the conversion, expanding '*' fields. */
+		for (o = fmt; f < q; f++) {
+			if (*f == '*') {
+				memcpy(&v, data, sizeof(v));
+				data += sizeof(v);
+				if (o < fmt + sizeof(fmt) - 12)
+					o += sprintf(o, "%d", v);
+			} else if (o < fmt + sizeof(fmt) - 1)
+				*o++ = *f;
+		}
+		*o = '\0';
+
+		switch (class) {
+		case PRINT_ARG_NONE:
+			fputc('%', dest);
+			continue;
+		case PRINT_ARG_STRING:
+			ret = fprintf(dest, fmt, data);
+			data += strlen(data) + 1;
+			continue;
+		case PRINT_ARG_ERRNO:
+			memcpy(&v, data, sizeof(v));
+			data += sizeof(v);
+			fputs(strerror(v), dest);
+			continue;
+		default:
+			memcpy(&arg, data, get_arg_size(class));
+			data += get_arg_size(class);
+		}
+
+		switch (class) {
+		case PRINT_ARG_LONG:
+			ret = fprintf(dest, fmt, arg.l);
+			break;
+		case PRINT_ARG_LLONG:
+			ret = fprintf(dest, fmt, arg.ll);
+			break;
+		case PRINT_ARG_INTMAX:
+			ret = fprintf(dest, fmt, arg.j);
+			break;
+		case PRINT_ARG_SIZE:
+			ret = fprintf(dest, fmt, arg.z);
+			break;
+		case PRINT_ARG_PTRDIFF:
+			ret = fprintf(dest, fmt, arg.t);
+			break;
+		case PRINT_ARG_DOUBLE:
+			ret = fprintf(dest, fmt, arg.d);
+			break;
+		case PRINT_ARG_LDOUBLE:
+			ret = fprintf(dest, fmt, arg.ld);
+			break;
+		case PRINT_ARG_PTR:
+			ret = fprintf(dest, fmt, arg.ptr);
+			break;
+		default:
+			ret = fprintf(dest, fmt, arg.i);
+		}
+	}
+
+	(void)ret;
+}
+
+/* *** rt_print API *** */
+
+static void kick_printer(void)
+{
+	if (atomic_cmpxchg(&flush_pending, 0, 1) == 0) {
+		atomic_add_fetch(&flush_wakeups, 1);
+		__RT(sem_post(&printer_sem));
+	}
+}
+
+static inline void check_watermark(size_t used, size_t size)
+{
+	if (__cobalt_print_watermark &&
+	    used * 100 >= size * __cobalt_print_watermark)
+		kick_printer();
+}
+
+/*
+ * Write the payload of an entry into at most @len bytes. Return the
+ * value to be reported to the caller, and the payload size into
+ * @len_r, which is zero if nothing could be written.
+ */
+static int fill_entry(struct entry_head *head, int len, int *len_r,
+		      bool *truncated_r, FILE *stream, int fortify_level,
+		      unsigned int mode, size_t sz, const char *format,
+		      va_list args)
+{
+	int str_len, res = 0;
+
+	*truncated_r = false;
 
 	if (mode == RT_PRINT_MODE_FORMAT) {
 		if (stream != RT_PRINT_SYSLOG_STREAM) {
@@ -171,6 +550,7 @@ vprint_to_buffer(FILE *stream, int fortify_level, int priority,
 				len = res;
 			} else {
 				/* Text was truncated */
+				*truncated_r = true;
 				res = len;
 			}
 		} else {
@@ -191,26 +571,160 @@ vprint_to_buffer(FILE *stream, int fortify_level, int priority,
 				len = res + 1;
 			} else {
 				/* Text was truncated */
+				*truncated_r = true;
 				res = len;
 			}
 		}
+	} else if (mode == RT_PRINT_MODE_BINARY) {
+		len = encode_record(head->data, len, format, args);
+		*truncated_r = len == 0;
+		res = len;
 	} else if (len >= 1) {
 		str_len = sz;
+		*truncated_r = str_len > len;
 		len = (str_len < len) ? str_len : len;
 		memcpy(head->data, format, len);
 	} else
 		len = 0;
 
+	*len_r = len;
+
+	return res;
+}
+
+static int 
+vprint_to_shared(FILE *stream, int fortify_level, int priority, 
+		 unsigned int mode, size_t sz, const char *format, va_list args)
+{
+	unsigned long pos = atomic_long_read(&shared_tail);
+	struct print_slot *slot;
+	struct entry_head *head;
+	bool truncated;
+	long diff;
+	int len, res;
+
+	/* Claim the next free slot, unless the ring is full. */
+	for (;;) {
+		slot = shared_ring + (pos & shared_mask);
+		diff = atomic_long_read(&slot->seq) - (long)pos;
+		if (diff == 0) {
+			if (atomic_cmpxchg(&shared_tail, pos, pos + 1) == pos)
+				break;
+			pos = atomic_long_read(&shared_tail);
+		} else if (diff < 0) {
+			atomic_add_fetch(&shared_dropped, 1);
+			check_watermark(shared_mask + 1, shared_mask + 1);
+			return 0;
+		} else
+			pos = atomic_long_read(&shared_tail);
+	}
+
+	head = (struct entry_head *)slot->entry;
+	res = fill_entry(head, RT_PRINT_SLOT_DATA, &len, &truncated,
+			 stream, fortify_level, mode, sz, format, args);
+	if (len > 0) {
+		atomic_add_fetch(&shared_records, 1);
+		if (truncated)
+			atomic_add_fetch(&shared_truncated, 1);
+	} else if (truncated)
+		atomic_add_fetch(&shared_dropped, 1);
+
+	/* An empty slot is consumed silently. */
+	head->seq_no = __sync_add_and_fetch(&seq_no, 1);
+	head->priority = priority;
+	head->dest = stream;
+	head->len = len;
+	head->mode = mode;
+
+	/* All entry data must be written before the slot is published */
+	smp_wmb();
+
+	atomic_long_set(&slot->seq, pos + 1);
+
+	check_watermark(pos + 1 - shared_head, shared_mask + 1);
+
+	return res;
+}
+
+static int 
+vprint_to_buffer(FILE *stream, int fortify_level, int priority, 
+		 unsigned int mode, size_t sz, const char *format, va_list args)
+{
+	struct print_buffer *buffer;
+	off_t write_pos, read_pos;
+	struct entry_head *head;
+	bool truncated;
+	int len, res;
+
+	if (shared_ring)
+		return vprint_to_shared(stream, fortify_level, priority,
+					mode, sz, format, args);
+
+	buffer = pthread_getspecific(buffer_key);
+	if (!buffer) {
+		res = rt_print_init(0, NULL);
+		if (res) {
+			errno = res;
+			return -1;
+		}
+		buffer = pthread_getspecific(buffer_key);
+	}
+
+	/* Take a snapshot of the ring buffer state */
+	write_pos = buffer->write_pos;
+	read_pos = buffer->read_pos;
+	smp_mb();
+
+	/* Is our write limit the end of the ring buffer? */
+	if (write_pos >= read_pos) {
+		/* Keep a safety margin to the end for at least an empty entry */
+		len = buffer->size - write_pos - sizeof(struct entry_head);
+
+		/* Special case: We were stuck at the end of the ring buffer
+		   with space left there only for one empty entry. Now
+		   read_pos was moved forward and we can wrap around. */
+		if (len == 0 && read_pos > sizeof(struct entry_head)) {
+			/* Write out empty entry */
+			head = buffer->ring + write_pos;
+			head->seq_no = seq_no;
+			head->priority = 0;
+			head->len = 0;
+
+			/* Forward to the ring buffer start */
+			write_pos = 0;
+			len = read_pos - 1;
+		}
+	} else {
+		/* Our limit is the read_pos ahead of our write_pos. One byte
+		   margin is required to detect a full ring. */
+		len = read_pos - write_pos - 1;
+	}
+
+	/* Account for head length */
+	len -= sizeof(struct entry_head);
+	if (len < 0)
+		len = 0;
+
+	head = buffer->ring + write_pos;
+
+	res = fill_entry(head, len, &len, &truncated,
+			 stream, fortify_level, mode, sz, format, args);
+
 	/* If we were able to write some text, finalise the entry */
 	if (len > 0) {
-		head->seq_no = ++seq_no;
+		head->seq_no = __sync_add_and_fetch(&seq_no, 1);
 		head->priority = priority;
 		head->dest = stream;
 		head->len = len;
+		head->mode = mode;
 
 		/* Move forward by text and head length */
 		write_pos += len + sizeof(struct entry_head);
-	}
+		buffer->records++;
+		if (truncated)
+			buffer->truncated++;
+	} else if (truncated)
+		buffer->dropped++;
 
 	/* Wrap around early if there is more space on the other side */
 	if (write_pos >= buffer->size - RT_PRINT_LINE_BREAK &&
@@ -229,6 +743,12 @@ vprint_to_buffer(FILE *stream, int fortify_level, int priority,
 
 	buffer->write_pos = write_pos;
 
+	if (__cobalt_print_watermark)
+		check_watermark(write_pos >= read_pos ?
+				write_pos - read_pos :
+				buffer->size - (read_pos - write_pos),
+				buffer->size);
+
 	return res;
 }
 
@@ -290,6 +810,44 @@ int rt_printf(const char *format, ...)
 	return n;
 }
 
+int rt_vfprintf_bin(FILE *stream, const char *format, va_list args)
+{
+	unsigned int mode = RT_PRINT_MODE_BINARY;
+
+	/*
+	 * Fall back to formatting in place what the printer could not
+	 * reproduce from a record.
+	 */
+	if (stream == RT_PRINT_SYSLOG_STREAM || !binary_format_p(format))
+		mode = RT_PRINT_MODE_FORMAT;
+
+	return vprint_to_buffer(stream, 0, 0, mode, 0, format, args);
+}
+
+int rt_fprintf_bin(FILE *stream, const char *format, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	n = rt_vfprintf_bin(stream, format, args);
+	va_end(args);
+
+	return n;
+}
+
+int rt_printf_bin(const char *format, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	n = rt_vfprintf_bin(stdout, format, args);
+	va_end(args);
+
+	return n;
+}
+
 int rt_fputs(const char *s, FILE *stream)
 {
 	return print_to_buffer(stream, 0, RT_PRINT_MODE_FWRITE, strlen(s), s);
@@ -377,6 +935,10 @@ static void rt_print_init_inner(struct print_buffer *buffer, size_t size)
 	buffer->read_pos  = 0;
 	buffer->write_pos = 0;
 
+	buffer->records = 0;
+	buffer->dropped = 0;
+	buffer->truncated = 0;
+
 	buffer->prev = NULL;
 
 	pthread_mutex_lock(&buffer_lock);
@@ -536,6 +1098,10 @@ dofree:
 
 	buffers--;
 
+	retired_records += buffer->records;
+	retired_dropped += buffer->dropped;
+	retired_truncated += buffer->truncated;
+
 	pthread_mutex_unlock(&buffer_lock);
 
 	free(buffer->ring);
@@ -576,12 +1142,56 @@ static struct print_buffer *get_next_buffer(void)
 	return buffer;
 }
 
+static void print_entry(struct entry_head *head)
+{
+	int ret;
+
+	/* Check if output goes to syslog */
+	if (head->dest == RT_PRINT_SYSLOG_STREAM) {
+		syslog(head->priority,
+		       "%s", head->data);
+	} else if (head->mode == RT_PRINT_MODE_BINARY) {
+		print_binary(head->dest, head->data);
+	} else {
+		ret = fwrite(head->data,
+			     head->len, 1, head->dest);
+		(void)ret;
+	}
+}
+
+static void print_shared_ring(void)
+{
+	struct print_slot *slot;
+	struct entry_head *head;
+
+	for (;;) {
+		slot = shared_ring + (shared_head & shared_mask);
+		if (atomic_long_read(&slot->seq) != shared_head + 1)
+			break;
+
+		/* Make sure we read the entry the producer published */
+		smp_rmb();
+
+		head = (struct entry_head *)slot->entry;
+		if (head->len)
+			print_entry(head);
+
+		/* Make sure we have read the entry before recycling it */
+		smp_mb();
+		atomic_long_set(&slot->seq, shared_head + shared_mask + 1);
+		shared_head++;
+	}
+}
+
 static void print_buffers(void)
 {
 	struct print_buffer *buffer;
 	struct entry_head *head;
 	off_t read_pos;
-	int len, ret;
+	int len;
+
+	if (shared_ring)
+		print_shared_ring();
 
 	while (1) {
 		buffer = get_next_buffer();
@@ -594,15 +1204,7 @@ static void print_buffers(void)
 
 		if (len) {
 			/* Print out non-empty entry and proceed */
-			/* Check if output goes to syslog */
-			if (head->dest == RT_PRINT_SYSLOG_STREAM) {
-				syslog(head->priority,
-				       "%s", head->data);
-			} else {
-				ret = fwrite(head->data,
-					     head->len, 1, head->dest);
-				(void)ret;
-			}
+			print_entry(head);
 
 			read_pos += sizeof(*head) + len;
 		} else {
@@ -620,19 +1222,46 @@ static void print_buffers(void)
 	}
 }
 
+static void wait_next_sync(void)
+{
+	struct timespec timeout;
+
+	if (!__cobalt_print_watermark) {
+		nanosleep(&syncdelay, NULL);
+		return;
+	}
+
+	/*
+	 * Writers crossing the fill watermark post the semaphore from
+	 * primary mode, which we catch as a Cobalt thread. Otherwise,
+	 * we wake up after the regular sync delay.
+	 */
+	__RT(clock_gettime(CLOCK_REALTIME, &timeout));
+	timeout.tv_sec += syncdelay.tv_sec;
+	timeout.tv_nsec += syncdelay.tv_nsec;
+	if (timeout.tv_nsec >= 1000000000) {
+		timeout.tv_nsec -= 1000000000;
+		timeout.tv_sec++;
+	}
+
+	__RT(sem_timedwait(&printer_sem, &timeout));
+	atomic_long_set(&flush_pending, 0);
+	smp_mb();
+}
+
 static void *printer_loop(void *arg)
 {
 	while (1) {
 		pthread_mutex_lock(&buffer_lock);
 
-		while (buffers == 0)
+		while (buffers == 0 && shared_ring == NULL)
 			pthread_cond_wait(&printer_wakeup, &buffer_lock);
 
 		print_buffers();
 
 		pthread_mutex_unlock(&buffer_lock);
 
-		nanosleep(&syncdelay, NULL);
+		wait_next_sync();
 	}
 
 	return NULL;
@@ -640,17 +1269,63 @@ static void *printer_loop(void *arg)
 
 static void spawn_printer_thread(void)
 {
+	struct sched_param param = { .sched_priority = 0 };
 	pthread_attr_t thattr;
 	sigset_t sset, oset;
 
 	pthread_attr_init(&thattr);
 	sigfillset(&sset);
 	pthread_sigmask(SIG_BLOCK, &sset, &oset);
-	pthread_create(&printer_thread, &thattr, printer_loop, NULL);
+	if (__cobalt_print_watermark) {
+		__RT(sem_init(&printer_sem, 0, 0));
+		atomic_long_set(&flush_pending, 0);
+		pthread_attr_setinheritsched(&thattr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&thattr, SCHED_OTHER);
+		pthread_attr_setschedparam(&thattr, &param);
+		__RT(pthread_create(&printer_thread, &thattr,
+				    printer_loop, NULL));
+	} else
+		pthread_create(&printer_thread, &thattr, printer_loop, NULL);
 	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	pthread_attr_destroy(&thattr);
 	pthread_setname_np(printer_thread, "cobalt_printf");
 }
 
+void rt_print_get_stats(struct rt_print_stats *stats)
+{
+	struct print_buffer *buffer;
+
+	pthread_mutex_lock(&buffer_lock);
+
+	stats->records = retired_records;
+	stats->dropped = retired_dropped;
+	stats->truncated = retired_truncated;
+
+	for (buffer = first_buffer; buffer; buffer = buffer->next) {
+		stats->records += buffer->records;
+		stats->dropped += buffer->dropped;
+		stats->truncated += buffer->truncated;
+	}
+
+	pthread_mutex_unlock(&buffer_lock);
+
+	stats->records += atomic_long_read(&shared_records);
+	stats->dropped += atomic_long_read(&shared_dropped);
+	stats->truncated += atomic_long_read(&shared_truncated);
+	stats->wakeups = atomic_long_read(&flush_wakeups);
+}
+
+static void init_shared_ring(void)
+{
+	unsigned long n;
+
+	for (n = 0; n <= shared_mask; n++)
+		atomic_long_set(&shared_ring[n].seq, n);
+
+	atomic_long_set(&shared_tail, 0);
+	shared_head = 0;
+}
+
 void cobalt_print_init_atfork(void)
 {
 	struct print_buffer *my_buffer = pthread_getspecific(buffer_key);
@@ -668,6 +1343,10 @@ void cobalt_print_init_atfork(void)
 	/* re-init to avoid finding it locked by some parent thread */
 	pthread_mutex_init(&buffer_lock, NULL);
 
+	/* Same for the shared ring, which our parent owns the content of. */
+	if (shared_ring)
+		init_shared_ring();
+
 	while (*pbuffer) {
 		if (*pbuffer == my_buffer)
 			pbuffer = &(*pbuffer)->next;
@@ -684,7 +1363,7 @@ void cobalt_print_init_atfork(void)
 
 void cobalt_print_init(void)
 {
-	unsigned int i;
+	unsigned int i, nr;
 
 	first_buffer = NULL;
 	seq_no = 0;
@@ -692,6 +1371,20 @@ void cobalt_print_init(void)
 	syncdelay.tv_sec  = __cobalt_print_syncdelay / 1000;
 	syncdelay.tv_nsec = (__cobalt_print_syncdelay % 1000) * 1000000;
 
+	if (__cobalt_print_ringsz > 0) {
+		/* Round down to a power of two number of slots. */
+		nr = __cobalt_print_ringsz / RT_PRINT_SLOT_SIZE;
+		if (nr < 2)
+			nr = 2;
+		while (nr & (nr - 1))
+			nr &= nr - 1;
+		shared_mask = nr - 1;
+		shared_ring = malloc(nr * sizeof(*shared_ring));
+		if (!shared_ring)
+			early_panic("error allocating shared print ring");
+		init_shared_ring();
+	}
+
 	/* Fill the buffer pool */
 	pool_bitmap_len = (__cobalt_print_bufcount+LONG_BIT-1)/LONG_BIT;
 	if (!pool_bitmap_len)
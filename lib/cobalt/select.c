@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <sys/select.h>
+#include <cobalt/sys/cobalt.h>
 #include <asm/xenomai/syscall.h>
 #include "internal.h"
 
@@ -46,3 +47,98 @@ COBALT_IMPL(int, select, (int __nfds, fd_set *__restrict __readfds,
 	errno = -err;
 	return -1;
 }
+
+/**
+ * Create a selector descriptor.
+ *
+ * A selector keeps a persistent set of real-time file descriptors to
+ * watch, and reports those which turned ready since the last call to
+ * cobalt_selector_wait(). Unlike select(), the cost of waiting does
+ * not depend on the number of descriptors watched.
+ *
+ * @param flags COBALT_SELECT_CLOEXEC, or zero.
+ *
+ * @return the selector descriptor on success, otherwise a negated
+ * error code: -EINVAL if @a flags is invalid, -ENOMEM if memory is
+ * short, -EMFILE if the process ran out of file descriptors.
+ */
+int cobalt_selector_create(int flags)
+{
+	return XENOMAI_SYSCALL1(sc_cobalt_selector_create, flags);
+}
+
+/**
+ * Add or remove file descriptors from the interest set of a selector.
+ *
+ * @param sfd the selector descriptor.
+ *
+ * @param op COBALT_SELECT_ADD for watching @a fd, COBALT_SELECT_DEL
+ * for not watching it anymore.
+ *
+ * @param fd the real-time file descriptor to watch.
+ *
+ * @param events a mask of COBALT_SELECT_READ, COBALT_SELECT_WRITE and
+ * COBALT_SELECT_EXCEPT bits. Zero with COBALT_SELECT_DEL stands for
+ * all events.
+ *
+ * A descriptor closed while watched is removed from the interest set
+ * automatically, no event is reported for it.
+ *
+ * @return 0 on success, otherwise a negated error code: -EEXIST if
+ * @a fd is already watched for one of @a events, -ENOENT if @a fd is
+ * not watched, -EPERM if @a fd is not a real-time descriptor,
+ * -EBADF if @a sfd is not a selector, -EINVAL if an argument is
+ * invalid.
+ */
+int cobalt_selector_ctl(int sfd, int op, int fd, unsigned int events)
+{
+	return XENOMAI_SYSCALL4(sc_cobalt_selector_ctl, sfd, op, fd, events);
+}
+
+/**
+ * Wait for watched file descriptors to turn ready.
+ *
+ * Readiness is edge-triggered: a descriptor is reported once each
+ * time it turns ready for one of the watched events, it is reported
+ * again only after it went through a not ready state, e.g. once all
+ * pending input was consumed.
+ *
+ * @param sfd the selector descriptor.
+ *
+ * @param events the array receiving one entry per descriptor and
+ * event turning ready.
+ *
+ * @param maxevents the number of entries available in @a events.
+ *
+ * @param timeout the relative timeout, NULL for waiting indefinitely,
+ * zero for not waiting at all.
+ *
+ * @return the number of entries filled in @a events, zero on
+ * timeout, otherwise a negated error code: -EINTR if the wait was
+ * interrupted by a signal, -EBADF if @a sfd is not a selector,
+ * -EINVAL if an argument is invalid, -EFAULT if @a events is
+ * not writable. Events collected before a fault on @a events are
+ * still returned.
+ */
+int cobalt_selector_wait(int sfd, struct cobalt_select_event *events,
+			 int maxevents, const struct timespec *timeout)
+{
+	int64_t ns, *nsp = NULL;
+	int ret, oldtype;
+
+	if (timeout) {
+		if ((unsigned long)timeout->tv_nsec >= 1000000000)
+			return -EINVAL;
+		ns = (int64_t)timeout->tv_sec * 1000000000 + timeout->tv_nsec;
+		nsp = &ns;
+	}
+
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	ret = XENOMAI_SYSCALL4(sc_cobalt_selector_wait,
+			       sfd, events, maxevents, nsp);
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	return ret;
+}
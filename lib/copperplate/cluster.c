@@ -215,6 +215,15 @@ struct clusterobj *cluster_findobj(struct cluster *c, const char *name)
 {
 	struct hashobj *hobj;
 
+	/*
+	 * Look up without locking first, which is enough as long as
+	 * the owner of the entry we found is alive.
+	 */
+	hobj = hash_search_lockless(&c->d->table, name, strlen(name),
+				    &hash_operations);
+	if (hobj && cluster_probe(hobj))
+		goto out;
+
 	/*
 	 * Search for object entry and probe for owner node existence,
 	 * discarding dead instances on the fly.
@@ -223,7 +232,7 @@ struct clusterobj *cluster_findobj(struct cluster *c, const char *name)
 				 &hash_operations);
 	if (hobj == NULL)
 		return NULL;
-
+out:
 	return container_of(hobj, struct clusterobj, hobj);
 }
 
@@ -349,6 +358,20 @@ int syncluster_findobj(struct syncluster *sc,
 	struct hashobj *hobj;
 	int ret = 0;
 
+	/*
+	 * Binders should not serialize on the cluster lock when the
+	 * object already exists, so try a lockless lookup
+	 * first. Otherwise, search again under lock, so that we
+	 * cannot miss the wakeup from syncluster_addobj() if we have
+	 * to wait for the object to appear.
+	 */
+	hobj = hash_search_lockless(&sc->d->table, name, strlen(name),
+				    &hash_operations);
+	if (hobj && cluster_probe(hobj)) {
+		*cobjp = container_of(hobj, struct clusterobj, hobj);
+		return 0;
+	}
+
 	ret = syncobj_lock(&sc->d->sobj, &syns);
 	if (ret)
 		return ret;
@@ -400,12 +423,16 @@ const static struct hash_operations hash_operations = {
 
 const static struct pvhash_operations pvhash_operations = {
 	.compare = memcmp,
+	.alloc = pvmalloc,
+	.free = pvfree,
 };
 
 #else /* !CONFIG_XENO_PSHARED */
 
 const static struct hash_operations hash_operations = {
 	.compare = memcmp,
+	.alloc = xnmalloc,
+	.free = xnfree,
 };
 
 #endif /* !CONFIG_XENO_PSHARED */
@@ -444,8 +471,8 @@ struct pvclusterobj *pvcluster_findobj(struct pvcluster *c, const char *name)
 {
 	struct pvhashobj *hobj;
 
-	hobj = pvhash_search(&c->table, name, strlen(name),
-			     &pvhash_operations);
+	hobj = pvhash_search_lockless(&c->table, name, strlen(name),
+				      &pvhash_operations);
 	if (hobj == NULL)
 		return NULL;
 
@@ -561,6 +588,13 @@ int pvsyncluster_findobj(struct pvsyncluster *sc,
 	struct syncstate syns;
 	int ret = 0;
 
+	/* Same as syncluster_findobj(), lockless lookup first. */
+	cobj = pvcluster_findobj(&sc->c, name);
+	if (cobj) {
+		*cobjp = cobj;
+		return 0;
+	}
+
 	ret = syncobj_lock(&sc->sobj, &syns);
 	if (ret)
 		return ret;
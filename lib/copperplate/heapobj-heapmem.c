@@ -68,28 +68,61 @@ int __heapobj_init_private(struct heapobj *hobj, const char *name,
 int heapobj_init_array_private(struct heapobj *hobj, const char *name,
 			       size_t size, int elems)
 {
-	size_t log2;
-
 	if (size == 0 || elems <= 0)
 		return __bt(-EINVAL);
 
-	log2 = sizeof(size) * CHAR_BIT - 1 -
-		xenomai_count_leading_zeros(size);
-
 	/*
-	 * Heapmem aligns individual object sizes on the next ^2
-	 * boundary, do likewise when determining the overall heap
-	 * size, so that we can allocate as many as @elems items.
+	 * Heapmem rounds individual object sizes up to their size
+	 * class, do likewise when determining the overall heap size,
+	 * so that we can allocate as many as @elems items.
 	 */
-	if (size & (size - 1))
-		log2++;
-
-	size = 1 << log2;
+	if (size <= HEAPMEM_MIN_ALIGN)
+		size = HEAPMEM_MIN_ALIGN;
+	else if (size <= HEAPMEM_PAGE_SIZE / 2)
+		size = __heapmem_class_size(__heapmem_size_class(size));
+	else
+		size = __align_to(size, HEAPMEM_PAGE_SIZE);
 
 	return __bt(__heapobj_init_private(hobj, name,
 					   size * elems, NULL));
 }
 
+int pvheapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats)
+{
+	struct heap_memory *heap = hobj->pool;
+	struct heapmem_stats hs;
+	int n, bin;
+
+	heapmem_stat(heap, &hs);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->usable_size = hs.usable_size;
+	stats->used_size = hs.used_size;
+	stats->nomem_count = hs.nomem_count;
+	stats->badfree_count = hs.badfree_count;
+
+	/* heapmem counts free ranges by number of pages. */
+	for (n = 0; n < HEAPMEM_HIST_SIZE; n++) {
+		bin = n + HEAPMEM_PAGE_SHIFT - HEAPOBJ_HIST_MIN_LOG2;
+		if (bin >= HEAPOBJ_HIST_SIZE)
+			bin = HEAPOBJ_HIST_SIZE - 1;
+		stats->free_hist[bin] += hs.free_hist[n];
+	}
+	stats->free_ranges = hs.free_ranges;
+	stats->free_size = hs.free_size;
+	stats->largest_free = hs.largest_free;
+
+	stats->nr_buckets = HEAPMEM_MAX < HEAPOBJ_MAX_BUCKETS ?
+		HEAPMEM_MAX : HEAPOBJ_MAX_BUCKETS;
+	for (n = 0; n < stats->nr_buckets; n++) {
+		stats->buckets[n].bsize = __heapmem_class_size(n);
+		stats->buckets[n].pages = hs.bucket_pages[n];
+		stats->buckets[n].busy = hs.bucket_blocks[n];
+	}
+
+	return 0;
+}
+
 int heapobj_pkg_init_private(void)
 {
 	size_t size;
@@ -114,5 +147,9 @@ int heapobj_pkg_init_private(void)
 		return ret;
 	}
 
+#ifdef CONFIG_XENO_HEAP_MAGAZINES
+	heapmem_enable_magazines(&heapmem_main);
+#endif
+
 	return 0;
 }
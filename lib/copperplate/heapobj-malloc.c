@@ -31,6 +31,7 @@
 struct pool_header {
 	pthread_mutex_t lock;
 	size_t used;
+	unsigned long nomem_count;
 };
 
 struct block_header {
@@ -70,6 +71,7 @@ int __heapobj_init_private(struct heapobj *hobj, const char *name,
 	}
 
 	ph->used = 0;
+	ph->nomem_count = 0;
 
 	hobj->pool = ph;
 	hobj->size = size;
@@ -138,6 +140,7 @@ void *pvheapobj_alloc(struct heapobj *hobj, size_t size)
 	return bh + 1;
 fail:
 	ph->used -= size;
+	ph->nomem_count++;
 	write_unlock(&ph->lock);
 
 	return NULL;
@@ -155,6 +158,75 @@ void pvheapobj_free(struct heapobj *hobj, void *ptr)
 	free(bh);
 }
 
+int pvheapobj_alloc_bulk(struct heapobj *hobj, size_t size,
+			 void **blocks, int nr)
+{
+	struct pool_header *ph = hobj->pool;
+	struct block_header *bh;
+	size_t avail;
+	void *ptr;
+	int n, max;
+
+	if (nr <= 0)
+		return 0;
+
+	/*
+	 * Charge the pool at once for as many blocks as the hard
+	 * limit allows, like the other allocators we may return a
+	 * partial batch.
+	 */
+	write_lock(&ph->lock);
+
+	max = nr;
+	avail = hobj->size - ph->used;
+	if (size > 0 && avail / size < (size_t)nr)
+		max = avail / size;
+
+	ph->used += size * max;
+	if (max < nr)
+		ph->nomem_count++;
+
+	write_unlock(&ph->lock);
+
+	for (n = 0; n < max; n++) {
+		ptr = malloc(size + sizeof(*bh));
+		if (ptr == NULL)
+			break;
+		bh = ptr;
+		bh->magic = MALLOC_MAGIC;
+		bh->size = size;
+		blocks[n] = bh + 1;
+	}
+
+	if (n < max) {
+		write_lock(&ph->lock);
+		ph->used -= size * (max - n);
+		if (max == nr)
+			ph->nomem_count++;
+		write_unlock(&ph->lock);
+	}
+
+	return n;
+}
+
+void pvheapobj_free_bulk(struct heapobj *hobj, void **blocks, int nr)
+{
+	struct pool_header *ph = hobj->pool;
+	struct block_header *bh;
+	size_t size = 0;
+	int n;
+
+	for (n = 0; n < nr; n++) {
+		bh = blocks[n] - sizeof(*bh);
+		size += bh->size;
+		free(bh);
+	}
+
+	write_lock(&ph->lock);
+	ph->used -= size;
+	write_unlock(&ph->lock);
+}
+
 size_t pvheapobj_inquire(struct heapobj *hobj)
 {
 	struct pool_header *ph = hobj->pool;
@@ -162,6 +234,24 @@ size_t pvheapobj_inquire(struct heapobj *hobj)
 	return ph->used;
 }
 
+int pvheapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats)
+{
+	struct pool_header *ph = hobj->pool;
+
+	/*
+	 * The process arena is shared by all heaps, we can only
+	 * tell about the figures we track.
+	 */
+	memset(stats, 0, sizeof(*stats));
+	read_lock_nocancel(&ph->lock);
+	stats->usable_size = hobj->size;
+	stats->used_size = ph->used;
+	stats->nomem_count = ph->nomem_count;
+	read_unlock(&ph->lock);
+
+	return 0;
+}
+
 size_t pvheapobj_validate(struct heapobj *hobj, void *ptr)
 {
 	struct block_header *bh;
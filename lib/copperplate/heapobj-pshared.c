@@ -49,7 +49,9 @@
 enum sheapmem_pgtype {
 	page_free =0,
 	page_cont =1,
-	page_list =2
+	page_list =2,
+	/* Bucketed memory, type - page_bucket is the size class. */
+	page_bucket =3
 };
 
 static struct shavl_searchops size_search_ops;
@@ -96,10 +98,66 @@ static struct heapobj main_pool;
 #define __shref(b, o)		((void *)((void *)(b) + (o)))
 #define __shref_check(b, o)	((o) ? __shref(b, o) : NULL)
 
+static inline int blocks_per_page(int sclass)
+{
+	return SHEAPMEM_PAGE_SIZE / __heapmem_class_size(sclass);
+}
+
 static inline uint32_t __attribute__ ((always_inline))
-gen_block_mask(int log2size)
+gen_unused_mask(int sclass, int word)
 {
-	return -1U >> (32 - (SHEAPMEM_PAGE_SIZE >> log2size));
+	int nrblocks = blocks_per_page(sclass) - word * 32;
+
+	if (nrblocks >= 32)
+		return 0;
+
+	if (nrblocks <= 0)
+		return -1U;
+
+	return -1U << nrblocks;
+}
+
+static inline bool map_is_full(struct sheapmem_pgentry *pgent)
+{
+	int n;
+
+	for (n = 0; n < SHEAPMEM_MAP_WORDS; n++)
+		if (pgent->map[n] != -1U)
+			return false;
+
+	return true;
+}
+
+static inline bool map_is_idle(struct sheapmem_pgentry *pgent, int sclass)
+{
+	int n;
+
+	for (n = 0; n < SHEAPMEM_MAP_WORDS; n++)
+		if (pgent->map[n] != gen_unused_mask(sclass, n))
+			return false;
+
+	return true;
+}
+
+static inline int get_block_index(int sclass, size_t boff)
+{
+#ifdef CONFIG_XENO_HEAPMEM_FINE_CLASSES
+	size_t bsize = __heapmem_class_size(sclass);
+
+	if (boff % bsize)
+		return -1;
+
+	boff /= bsize;
+
+	return boff < blocks_per_page(sclass) ? (int)boff : -1;
+#else
+	int log2size = sclass + SHEAPMEM_MIN_LOG2;
+
+	if (boff & ((1 << log2size) - 1))
+		return -1;
+
+	return boff >> log2size;
+#endif
 }
 
 static inline  __attribute__ ((always_inline))
@@ -164,6 +222,7 @@ ssize_t sheapmem_check(struct shared_heap_memory *heap, void *block)
 	memoff_t pg, pgoff, boff;
 	ssize_t ret = -EINVAL;
 	size_t bsize;
+	int sclass;
 
 	read_lock_nocancel(&heap->lock);
 
@@ -184,9 +243,10 @@ found:
 		if (ext->pagemap[pg].type == page_list)
 			bsize = ext->pagemap[pg].bsize;
 		else {
-			bsize = (1 << ext->pagemap[pg].type);
+			sclass = ext->pagemap[pg].type - page_bucket;
+			bsize = __heapmem_class_size(sclass);
 			boff = pgoff & ~SHEAPMEM_PAGE_MASK;
-			if ((boff & (bsize - 1)) != 0) /* Not at block start? */
+			if (get_block_index(sclass, boff) < 0) /* Not at block start? */
 				goto out;
 		}
 		ret = (ssize_t)bsize;
@@ -331,14 +391,14 @@ static void release_page_range(struct sheapmem_extent *ext,
 
 static void add_page_front(struct shared_heap_memory *heap,
 			   struct sheapmem_extent *ext,
-			   int pg, int log2size)
+			   int pg, int sclass)
 {
 	struct sheapmem_pgentry *new, *head, *next;
 	int ilog;
 
 	/* Insert page at front of the per-bucket page list. */
 	
-	ilog = log2size - SHEAPMEM_MIN_LOG2;
+	ilog = sclass;
 	new = &ext->pagemap[pg];
 	if (heap->buckets[ilog] == -1U) {
 		heap->buckets[ilog] = pg;
@@ -356,10 +416,10 @@ static void add_page_front(struct shared_heap_memory *heap,
 
 static void remove_page(struct shared_heap_memory *heap,
 			struct sheapmem_extent *ext,
-			int pg, int log2size)
+			int pg, int sclass)
 {
 	struct sheapmem_pgentry *old, *prev, *next;
-	int ilog = log2size - SHEAPMEM_MIN_LOG2;
+	int ilog = sclass;
 
 	/* Remove page from the per-bucket page list. */
 
@@ -378,22 +438,22 @@ static void remove_page(struct shared_heap_memory *heap,
 
 static void move_page_front(struct shared_heap_memory *heap,
 			    struct sheapmem_extent *ext,
-			    int pg, int log2size)
+			    int pg, int sclass)
 {
-	int ilog = log2size - SHEAPMEM_MIN_LOG2;
+	int ilog = sclass;
 
 	/* Move page at front of the per-bucket page list. */
 	
 	if (heap->buckets[ilog] == pg)
 		return;	 /* Already at front, no move. */
 		
-	remove_page(heap, ext, pg, log2size);
-	add_page_front(heap, ext, pg, log2size);
+	remove_page(heap, ext, pg, sclass);
+	add_page_front(heap, ext, pg, sclass);
 }
 
 static void move_page_back(struct shared_heap_memory *heap,
 			   struct sheapmem_extent *ext,
-			   int pg, int log2size)
+			   int pg, int sclass)
 {
 	struct sheapmem_pgentry *old, *last, *head, *next;
 	int ilog;
@@ -404,9 +464,9 @@ static void move_page_back(struct shared_heap_memory *heap,
 	if (pg == old->next) /* Singleton, no move. */
 		return;
 		
-	remove_page(heap, ext, pg, log2size);
+	remove_page(heap, ext, pg, sclass);
 
-	ilog = log2size - SHEAPMEM_MIN_LOG2;
+	ilog = sclass;
 	head = &ext->pagemap[heap->buckets[ilog]];
 	last = &ext->pagemap[head->prev];
 	old->prev = head->prev;
@@ -416,11 +476,11 @@ static void move_page_back(struct shared_heap_memory *heap,
 	last->next = pg;
 }
 
-static void *add_free_range(struct shared_heap_memory *heap, size_t bsize, int log2size)
+static void *add_free_range(struct shared_heap_memory *heap, size_t bsize, int sclass)
 {
 	struct sheapmem_extent *ext;
 	size_t rsize;
-	int pg;
+	int pg, n;
 
 	/*
 	 * Scanning each extent, search for a range of contiguous
@@ -434,33 +494,38 @@ static void *add_free_range(struct shared_heap_memory *heap, size_t bsize, int l
 			goto found;
 	}
 
+	heap->nomem_count++;
+
 	return NULL;
 
 found:	
 	/*
-	 * Update the page entry.  If @log2size is non-zero
-	 * (i.e. bsize < SHEAPMEM_PAGE_SIZE), bsize is (1 << log2Size)
-	 * between 2^SHEAPMEM_MIN_LOG2 and 2^(SHEAPMEM_PAGE_SHIFT - 1).
-	 * Save the log2 power into entry.type, then update the
-	 * per-page allocation bitmap to reserve the first block.
+	 * Update the page entry.  If @sclass is positive or null
+	 * (i.e. bsize < SHEAPMEM_PAGE_SIZE), bsize is the size of the
+	 * blocks from this bucket, between 2^SHEAPMEM_MIN_LOG2 and
+	 * 2^(SHEAPMEM_PAGE_SHIFT - 1).  Save the size class into
+	 * entry.type, then update the per-page allocation bitmap to
+	 * reserve the first block.
 	 *
 	 * Otherwise, we have a larger block which may span multiple
 	 * pages: set entry.type to page_list, indicating the start of
 	 * the page range, and entry.bsize to the overall block size.
 	 */
-	if (log2size) {
-		ext->pagemap[pg].type = log2size;
+	if (sclass >= 0) {
+		ext->pagemap[pg].type = sclass + page_bucket;
 		/*
 		 * Mark the first object slot (#0) as busy, along with
-		 * the leftmost bits we won't use for this log2 size.
+		 * the leftmost bits we won't use for this size class.
 		 */
-		ext->pagemap[pg].map = ~gen_block_mask(log2size) | 1;
+		for (n = 0; n < SHEAPMEM_MAP_WORDS; n++)
+			ext->pagemap[pg].map[n] = gen_unused_mask(sclass, n);
+		ext->pagemap[pg].map[0] |= 1;
 		/*
 		 * Insert the new page at front of the per-bucket page
 		 * list, enforcing the assumption that pages with free
 		 * space live close to the head of this list.
 		 */
-		add_page_front(heap, ext, pg, log2size);
+		add_page_front(heap, ext, pg, sclass);
 	} else {
 		ext->pagemap[pg].type = page_list;
 		ext->pagemap[pg].bsize = (uint32_t)bsize;
@@ -473,31 +538,35 @@ found:
 	return pagenr_to_addr(ext, pg);
 }
 
-static void *sheapmem_alloc(struct shared_heap_memory *heap, size_t size)
+/*
+ * Return the actual size of the block serving @size bytes, and its
+ * size class in *@sclassp, or -1 for a range of pages.
+ */
+static inline size_t get_block_size(size_t size, int *sclassp)
 {
+	if (size <= SHEAPMEM_MIN_ALIGN) {
+		*sclassp = 0;
+		return SHEAPMEM_MIN_ALIGN;
+	}
+
+	if (size <= SHEAPMEM_PAGE_SIZE / 2) {
+		*sclassp = __heapmem_size_class(size);
+		return __heapmem_class_size(*sclassp);
+	}
+
+	*sclassp = -1;
+
+	return __align_to(size, SHEAPMEM_PAGE_SIZE);
+}
+
+static void *alloc_block(struct shared_heap_memory *heap, /* heap->lock held */
+			 size_t bsize, int sclass)
+{
+	struct sheapmem_pgentry *pgent;
 	struct sheapmem_extent *ext;
-	int log2size, ilog, pg, b;
-	uint32_t bmask;
-	size_t bsize;
+	int pg, b, n;
 	void *block;
 
-	if (size == 0)
-		return NULL;
-
-	if (size < SHEAPMEM_MIN_ALIGN) {
-		bsize = size = SHEAPMEM_MIN_ALIGN;
-		log2size = SHEAPMEM_MIN_LOG2;
-	} else {
-		log2size = sizeof(size) * CHAR_BIT - 1 -
-			xenomai_count_leading_zeros(size);
-		if (log2size < SHEAPMEM_PAGE_SHIFT) {
-			if (size & (size - 1))
-				log2size++;
-			bsize = 1 << log2size;
-		} else
-			bsize = __align_to(size, SHEAPMEM_PAGE_SIZE);
-	}
-	
 	/*
 	 * Allocate entire pages directly from the pool whenever the
 	 * block is larger or equal to SHEAPMEM_PAGE_SIZE.  Otherwise,
@@ -510,14 +579,11 @@ static void *sheapmem_alloc(struct shared_heap_memory *heap, size_t size)
 	 * this list, in which case we should immediately add a fresh
 	 * page.
 	 */
-	if (bsize < SHEAPMEM_PAGE_SIZE) {
-		ilog = log2size - SHEAPMEM_MIN_LOG2;
-		assert(ilog >= 0 && ilog < SHEAPMEM_MAX);
-
-		write_lock_nocancel(&heap->lock);
+	if (sclass >= 0) {
+		assert(sclass < SHEAPMEM_MAX);
 
 		__list_for_each_entry(main_base, ext, &heap->extents, next) {
-			pg = heap->buckets[ilog];
+			pg = heap->buckets[sclass];
 			if (pg < 0) /* Empty page list? */
 				continue;
 
@@ -526,49 +592,46 @@ static void *sheapmem_alloc(struct shared_heap_memory *heap, size_t size)
 			 * is none, there won't be any down the list:
 			 * add a new page right away.
 			 */
-			bmask = ext->pagemap[pg].map;
-			if (bmask == -1U)
-				break;
-			b = xenomai_count_trailing_zeros(~bmask);
+			pgent = &ext->pagemap[pg];
+			for (n = 0; n < SHEAPMEM_MAP_WORDS; n++)
+				if (pgent->map[n] != -1U)
+					goto found;
+			break;
+		found:
+			b = xenomai_count_trailing_zeros(~pgent->map[n]);
 
 			/*
 			 * Got one block from the heading per-bucket
 			 * page, tag it as busy in the per-page
 			 * allocation map.
 			 */
-			ext->pagemap[pg].map |= (1U << b);
+			pgent->map[n] |= (1U << b);
 			heap->used_size += bsize;
 			block = __shref(main_base, ext->membase) +
 				(pg << SHEAPMEM_PAGE_SHIFT) +
-				(b << log2size);
-			if (ext->pagemap[pg].map == -1U)
-				move_page_back(heap, ext, pg, log2size);
-			goto out;
+				(n * 32 + b) * bsize;
+			if (map_is_full(pgent))
+				move_page_back(heap, ext, pg, sclass);
+			return block;
 		}
 
 		/* No free block in bucketed memory, add one page. */
-		block = add_free_range(heap, bsize, log2size);
-	} else {
-		write_lock_nocancel(&heap->lock);
-		/* Add a range of contiguous free pages. */
-		block = add_free_range(heap, bsize, 0);
+		return add_free_range(heap, bsize, sclass);
 	}
-out:
-	write_unlock(&heap->lock);
 
-	return block;
+	/* Add a range of contiguous free pages. */
+	return add_free_range(heap, bsize, -1);
 }
 
-static int sheapmem_free(struct shared_heap_memory *heap, void *block)
+static int free_block(struct shared_heap_memory *heap, /* heap->lock held */
+		      void *block)
 {
-	int log2size, ret = 0, pg, n;
+	int sclass, pg, n, w;
 	struct sheapmem_extent *ext;
 	memoff_t pgoff, boff;
-	uint32_t oldmap;
+	bool was_full;
 	size_t bsize;
 
-	write_lock_nocancel(&heap->lock);
-
 	/*
 	 * Find the extent from which the returned block is
 	 * originating from.
@@ -595,16 +658,17 @@ found:
 		break;
 
 	default:
-		log2size = ext->pagemap[pg].type;
-		bsize = (1 << log2size);
+		sclass = ext->pagemap[pg].type - page_bucket;
+		bsize = __heapmem_class_size(sclass);
 		assert(bsize < SHEAPMEM_PAGE_SIZE);
 		boff = pgoff & ~SHEAPMEM_PAGE_MASK;
-		if ((boff & (bsize - 1)) != 0) /* Not at block start? */
+		n = get_block_index(sclass, boff); /* Block position in page. */
+		if (n < 0) /* Not at block start? */
 			goto bad;
 
-		n = boff >> log2size; /* Block position in page. */
-		oldmap = ext->pagemap[pg].map;
-		ext->pagemap[pg].map &= ~(1U << n);
+		was_full = map_is_full(&ext->pagemap[pg]);
+		w = n / 32;
+		ext->pagemap[pg].map[w] &= ~(1U << (n % 32));
 
 		/*
 		 * If the page the block was sitting on is fully idle,
@@ -613,22 +677,163 @@ found:
 		 * partially busy state, in which case it should move
 		 * toward the front of the per-bucket page list.
 		 */
-		if (ext->pagemap[pg].map == ~gen_block_mask(log2size)) {
-			remove_page(heap, ext, pg, log2size);
+		if (map_is_idle(&ext->pagemap[pg], sclass)) {
+			remove_page(heap, ext, pg, sclass);
 			release_page_range(ext, pagenr_to_addr(ext, pg),
 					   SHEAPMEM_PAGE_SIZE);
-		} else if (oldmap == -1U)
-			move_page_front(heap, ext, pg, log2size);
+		} else if (was_full)
+			move_page_front(heap, ext, pg, sclass);
 	}
 
 	heap->used_size -= bsize;
-out:
+
+	return 0;
+bad:
+	heap->badfree_count++;
+
+	return -EINVAL;
+}
+
+static int sheapmem_alloc_bulk(struct shared_heap_memory *heap,
+			       size_t size, void **blocks, int nr)
+{
+	int sclass, n;
+	size_t bsize;
+
+	if (size == 0)
+		return 0;
+
+	bsize = get_block_size(size, &sclass);
+
+	write_lock_nocancel(&heap->lock);
+
+	for (n = 0; n < nr; n++) {
+		blocks[n] = alloc_block(heap, bsize, sclass);
+		if (blocks[n] == NULL)
+			break;
+	}
+
+	write_unlock(&heap->lock);
+
+	return n;
+}
+
+static int sheapmem_free_bulk(struct shared_heap_memory *heap,
+			      void **blocks, int nr)
+{
+	int ret = 0, n;
+
+	write_lock_nocancel(&heap->lock);
+
+	for (n = 0; n < nr; n++) {
+		if (free_block(heap, blocks[n]))
+			ret = -EINVAL;
+	}
+
+	write_unlock(&heap->lock);
+
+	return __bt(ret);
+}
+
+static void *sheapmem_alloc(struct shared_heap_memory *heap, size_t size)
+{
+	size_t bsize;
+	void *block;
+	int sclass;
+
+	if (size == 0)
+		return NULL;
+
+	bsize = get_block_size(size, &sclass);
+	write_lock_nocancel(&heap->lock);
+	block = alloc_block(heap, bsize, sclass);
+	write_unlock(&heap->lock);
+
+	return block;
+}
+
+static int sheapmem_free(struct shared_heap_memory *heap, void *block)
+{
+	int ret;
+
+	write_lock_nocancel(&heap->lock);
+	ret = free_block(heap, block);
 	write_unlock(&heap->lock);
 
 	return __bt(ret);
-bad:
-	ret = -EINVAL;
-	goto out;
+}
+
+static inline int count_busy_blocks(struct sheapmem_pgentry *pgent,
+				    int sclass)
+{
+	int n, count = 0;
+
+	for (n = 0; n < SHEAPMEM_MAP_WORDS; n++)
+		count += __builtin_popcount(pgent->map[n] &
+					    ~gen_unused_mask(sclass, n));
+	return count;
+}
+
+/*
+ * Same walk as heapmem_stat(), visiting every free range and busy
+ * page with the heap locked. This may be called for any heap from
+ * the session, including from the registry daemon.
+ */
+int sheapmem_stat(struct shared_heap_memory *heap,
+		  struct heapobj_stats *stats)
+{
+	struct sheapmem_pgentry *pgent;
+	struct sheapmem_extent *ext;
+	struct sheapmem_range *r;
+	int pg, nrpages, sclass;
+	struct shavlh *node;
+
+	memset(stats, 0, sizeof(*stats));
+
+	read_lock_nocancel(&heap->lock);
+
+	stats->usable_size = heap->usable_size;
+	stats->used_size = heap->used_size;
+	stats->nomem_count = heap->nomem_count;
+	stats->badfree_count = heap->badfree_count;
+	stats->nr_buckets = SHEAPMEM_MAX < HEAPOBJ_MAX_BUCKETS ?
+		SHEAPMEM_MAX : HEAPOBJ_MAX_BUCKETS;
+	for (sclass = 0; sclass < stats->nr_buckets; sclass++)
+		stats->buckets[sclass].bsize = __heapmem_class_size(sclass);
+
+	__list_for_each_entry(main_base, ext, &heap->extents, next) {
+		nrpages = (ext->memlim - ext->membase) >> SHEAPMEM_PAGE_SHIFT;
+		node = shavl_head(&ext->addr_tree);
+		pg = 0;
+		while (pg < nrpages) {
+			if (node) {
+				r = container_of(node, struct sheapmem_range,
+						 addr_node);
+				if (addr_to_pagenr(ext, r) == pg) {
+					heapobj_stat_free_range(stats, r->size);
+					node = shavl_next(&ext->addr_tree, node);
+					pg += r->size >> SHEAPMEM_PAGE_SHIFT;
+					continue;
+				}
+			}
+			pgent = &ext->pagemap[pg];
+			if (pgent->type == page_list) {
+				pg += pgent->bsize >> SHEAPMEM_PAGE_SHIFT;
+				continue;
+			}
+			sclass = pgent->type - page_bucket;
+			if (sclass >= 0 && sclass < stats->nr_buckets) {
+				stats->buckets[sclass].pages++;
+				stats->buckets[sclass].busy +=
+					count_busy_blocks(pgent, sclass);
+			}
+			pg++;
+		}
+	}
+
+	read_unlock(&heap->lock);
+
+	return 0;
 }
 
 static inline int compare_range_by_size(const struct shavlh *l, const struct shavlh *r)
@@ -767,6 +972,9 @@ static int sheapmem_init(struct shared_heap_memory *heap, void *base,
 	for (n = 0; n < SHEAPMEM_MAX; n++)
 		heap->buckets[n] = -1U;
 
+	heap->nomem_count = 0;
+	heap->badfree_count = 0;
+
 	ret = add_extent(heap, base, mem, size);
 	if (ret) {
 		__RT(pthread_mutex_destroy(&heap->lock));
@@ -1111,20 +1319,9 @@ int heapobj_init(struct heapobj *hobj, const char *name, size_t size)
 int heapobj_init_array(struct heapobj *hobj, const char *name,
 		       size_t size, int elems)
 {
-	int log2size;
+	int sclass;
 
-	if (size < SHEAPMEM_MIN_ALIGN) {
-		size = SHEAPMEM_MIN_ALIGN;
-	} else {
-		log2size = sizeof(size) * CHAR_BIT - 1 -
-			xenomai_count_leading_zeros(size);
-		if (log2size < SHEAPMEM_PAGE_SHIFT) {
-			if (size & (size - 1))
-				log2size++;
-			size = 1 << log2size;
-		} else
-			size = __align_to(size, SHEAPMEM_PAGE_SIZE);
-	}
+	size = get_block_size(size, &sclass);
 
 	return __bt(heapobj_init(hobj, name, size * elems));
 }
@@ -1189,6 +1386,17 @@ void heapobj_free(struct heapobj *hobj, void *ptr)
 	sheapmem_free(__mptr(hobj->pool_ref), ptr);
 }
 
+int heapobj_alloc_bulk(struct heapobj *hobj, size_t size,
+		       void **blocks, int nr)
+{
+	return sheapmem_alloc_bulk(__mptr(hobj->pool_ref), size, blocks, nr);
+}
+
+void heapobj_free_bulk(struct heapobj *hobj, void **blocks, int nr)
+{
+	sheapmem_free_bulk(__mptr(hobj->pool_ref), blocks, nr);
+}
+
 size_t heapobj_validate(struct heapobj *hobj, void *ptr)
 {
 	ssize_t ret = sheapmem_check(__mptr(hobj->pool_ref), ptr);
@@ -1207,6 +1415,11 @@ size_t heapobj_get_size(struct heapobj *hobj)
 	return heap->usable_size;
 }
 
+int heapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats)
+{
+	return __bt(sheapmem_stat(__mptr(hobj->pool_ref), stats));
+}
+
 void *xnmalloc(size_t size)
 {
 	return sheapmem_alloc(&main_heap.heap, size);
@@ -78,6 +78,27 @@ int heapobj_init_array_private(struct heapobj *hobj, const char *name,
 	return __bt(__heapobj_init_private(hobj, name, poolsz, NULL));
 }
 
+static void stat_free_block(size_t size, void *arg)
+{
+	heapobj_stat_free_range(arg, size);
+}
+
+int pvheapobj_stat(struct heapobj *hobj, struct heapobj_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->usable_size = hobj->size;
+	stats->used_size = get_used_size(hobj->pool);
+	stats->nomem_count = get_nomem_count(hobj->pool);
+	/*
+	 * TLSF does not check released blocks, so there is no
+	 * failure count for them. walk_free_blocks() holds the pool
+	 * lock while scanning the free lists.
+	 */
+	walk_free_blocks(hobj->pool, stat_free_block, stats);
+
+	return 0;
+}
+
 int heapobj_pkg_init_private(void)
 {
 	size_t alloc_size, available_size;
@@ -77,6 +77,13 @@ static const struct option copperplate_options[] = {
 		.flag = &__copperplate_setup_data.shared_registry,
 		.val = 1,
 	},
+	{
+#define per_cpu_timers_opt	5
+		.name = "per-cpu-timers",
+		.has_arg = no_argument,
+		.flag = &__copperplate_setup_data.per_cpu_timers,
+		.val = 1,
+	},
 	{ /* Sentinel */ }
 };
 
@@ -274,6 +281,7 @@ static int copperplate_parse_option(int optnum, const char *optarg)
 		break;
 	case shared_registry_opt:
 	case no_registry_opt:
+	case per_cpu_timers_opt:
 		break;
 	default:
 		/* Paranoid, can't happen. */
@@ -290,6 +298,7 @@ static void copperplate_help(void)
         fprintf(stderr, "--shared-registry		enable public access to registry\n");
         fprintf(stderr, "--registry-root=<path>		root path of registry\n");
         fprintf(stderr, "--session=<label>[/<group>]	enable shared session\n");
+        fprintf(stderr, "--per-cpu-timers		run one timer server per CPU\n");
 }
 
 static struct setup_descriptor copperplate_interface = {
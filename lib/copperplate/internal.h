@@ -35,17 +35,23 @@
 #ifdef CONFIG_XENO_PSHARED
 
 #include <boilerplate/shavl.h>
+#include <boilerplate/heapmem.h>
 
-#define SHEAPMEM_PAGE_SHIFT	9 /* 2^9 => 512 bytes */
+/*
+ * The shared heap follows the page layout and size classes of the
+ * private heapmem allocator, see boilerplate/heapmem.h.
+ */
+#define SHEAPMEM_PAGE_SHIFT	HEAPMEM_PAGE_SHIFT
 #define SHEAPMEM_PAGE_SIZE	(1UL << SHEAPMEM_PAGE_SHIFT)
 #define SHEAPMEM_PAGE_MASK	(~(SHEAPMEM_PAGE_SIZE - 1))
-#define SHEAPMEM_MIN_LOG2	4 /* 16 bytes */
+#define SHEAPMEM_MIN_LOG2	HEAPMEM_MIN_LOG2
 /*
  * Use bucketed memory for sizes between 2^SHEAPMEM_MIN_LOG2 and
  * 2^(SHEAPMEM_PAGE_SHIFT-1).
  */
-#define SHEAPMEM_MAX		(SHEAPMEM_PAGE_SHIFT - SHEAPMEM_MIN_LOG2)
+#define SHEAPMEM_MAX		HEAPMEM_MAX
 #define SHEAPMEM_MIN_ALIGN	(1U << SHEAPMEM_MIN_LOG2)
+#define SHEAPMEM_MAP_WORDS	HEAPMEM_MAP_WORDS
 /* Max size of an extent (4Gb - SHEAPMEM_PAGE_SIZE). */
 #define SHEAPMEM_MAX_EXTSZ	(4294967295U - SHEAPMEM_PAGE_SIZE + 1)
 /* Bits we need for encoding a page # */
@@ -58,16 +64,15 @@ struct sheapmem_pgentry {
 	/* Linkage in bucket list. */
 	unsigned int prev : SHEAPMEM_PGENT_BITS;
 	unsigned int next : SHEAPMEM_PGENT_BITS;
-	/*  page_list or log2. */
+	/*  page_list or bucket size class. */
 	unsigned int type : 6;
 	/*
 	 * We hold either a spatial map of busy blocks within the page
-	 * for bucketed memory (up to 32 blocks per page), or the
-	 * overall size of the multi-page block if entry.type ==
-	 * page_list.
+	 * for bucketed memory, or the overall size of the multi-page
+	 * block if entry.type == page_list.
 	 */
 	union {
-		uint32_t map;
+		uint32_t map[SHEAPMEM_MAP_WORDS];
 		uint32_t bsize;
 	};
 };
@@ -121,13 +126,18 @@ struct shared_heap_memory {
 	size_t arena_size;
 	size_t usable_size;
 	size_t used_size;
-	/* Heads of page lists for log2-sized blocks. */
+	/* Heads of page lists for bucketed blocks, per size class. */
 	uint32_t buckets[SHEAPMEM_MAX];
+	unsigned long nomem_count;
+	unsigned long badfree_count;
 	struct sysgroup_memspec memspec;
 };
 
 ssize_t sheapmem_check(struct shared_heap_memory *heap, void *block);
 
+int sheapmem_stat(struct shared_heap_memory *heap,
+		  struct heapobj_stats *stats);
+
 #endif /* CONFIG_XENO_PSHARED */
 
 #ifdef CONFIG_XENO_REGISTRY
@@ -176,4 +186,23 @@ void copperplate_bootstrap_internal(const char *arg0,
 }
 #endif
 
+static inline void heapobj_stat_free_range(struct heapobj_stats *stats,
+					   size_t size)
+{
+	int bin;
+
+	bin = sizeof(size) * CHAR_BIT - 1 - xenomai_count_leading_zeros(size);
+	bin -= HEAPOBJ_HIST_MIN_LOG2;
+	if (bin < 0)
+		bin = 0;
+	else if (bin >= HEAPOBJ_HIST_SIZE)
+		bin = HEAPOBJ_HIST_SIZE - 1;
+
+	stats->free_hist[bin]++;
+	stats->free_ranges++;
+	stats->free_size += size;
+	if (size > stats->largest_free)
+		stats->largest_free = size;
+}
+
 #endif /* _COPPERPLATE_INTERNAL_H */
@@ -138,6 +138,17 @@ struct sysreg_fsfile sysreg_files[] = {
 			.read = fsobj_obstack_read
 		},
 	},
+#ifdef CONFIG_XENO_PSHARED
+	{
+		.path = "/heapstat",
+		.mode = O_RDONLY,
+		.ops = {
+			.open = open_heapstat,
+			.release = fsobj_obstack_release,
+			.read = fsobj_obstack_read
+		},
+	},
+#endif
 	{
 		.path = "/version",
 		.mode = O_RDONLY,
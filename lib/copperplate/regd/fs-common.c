@@ -276,6 +276,114 @@ out:
 	return len < 0 ? len : 0;
 }
 
+struct heapstat_data {
+	char name[XNOBJECT_NAME_LEN];
+	struct heapobj_stats stats;
+};
+
+static char *format_range_size(int bin, char *buf, size_t bufsz)
+{
+	size_t size = (size_t)1 << (bin + HEAPOBJ_HIST_MIN_LOG2);
+	const char *plus = bin == HEAPOBJ_HIST_SIZE - 1 ? "+" : "";
+
+	if (size >= 1024 * 1024)
+		snprintf(buf, bufsz, "%zuM%s", size >> 20, plus);
+	else if (size >= 1024)
+		snprintf(buf, bufsz, "%zuK%s", size >> 10, plus);
+	else
+		snprintf(buf, bufsz, "%zu%s", size, plus);
+
+	return buf;
+}
+
+int open_heapstat(struct fsobj *fsobj, void *priv)
+{
+	struct heapstat_data *heap_data, *p;
+	struct sysgroup_memspec *obj, *tmp;
+	struct shared_heap_memory *heap;
+	struct heapobj_bucket_stats *b;
+	struct fsobstack *o = priv;
+	int ret, count, len = 0, n;
+	char sbuf[16];
+
+	ret = heapobj_bind_session(__copperplate_setup_data.session_label);
+	if (ret)
+		return ret;
+
+	fsobstack_init(o);
+
+	sysgroup_lock();
+	count = sysgroup_count(heap);
+	sysgroup_unlock();
+
+	if (count == 0)
+		goto out;
+
+	heap_data = p = malloc(sizeof(*p) * count);
+	if (heap_data == NULL) {
+		len = -ENOMEM;
+		goto out;
+	}
+
+	/*
+	 * Unlike open_heaps(), we have to walk each heap with its
+	 * lock held, which briefly delays allocations from it.
+	 */
+	sysgroup_lock();
+
+	for_each_sysgroup(obj, tmp, heap) {
+		if (p - heap_data >= count)
+			break;
+		heap = container_of(obj, struct shared_heap_memory, memspec);
+		namecpy(p->name, heap->name);
+		sheapmem_stat(heap, &p->stats);
+		p++;
+	}
+
+	sysgroup_unlock();
+
+	count = p - heap_data;
+
+	for (p = heap_data; count > 0; count--, p++) {
+		len += fsobstack_grow_format(o, "[%s]\n", p->name);
+		len += fsobstack_grow_format(o,
+			     "  size=%Zu used=%Zu free=%Zu largest=%Zu ranges=%u\n",
+			     p->stats.usable_size, p->stats.used_size,
+			     p->stats.free_size, p->stats.largest_free,
+			     p->stats.free_ranges);
+		len += fsobstack_grow_format(o, "  nomem=%lu badfree=%lu\n",
+					     p->stats.nomem_count,
+					     p->stats.badfree_count);
+		if (p->stats.free_ranges > 0) {
+			len += fsobstack_grow_format(o, "  free ranges:");
+			for (n = 0; n < HEAPOBJ_HIST_SIZE; n++) {
+				if (p->stats.free_hist[n] == 0)
+					continue;
+				len += fsobstack_grow_format(o, " %s:%u",
+					     format_range_size(n, sbuf, sizeof(sbuf)),
+					     p->stats.free_hist[n]);
+			}
+			len += fsobstack_grow_format(o, "\n");
+		}
+		for (n = 0; n < p->stats.nr_buckets; n++) {
+			b = p->stats.buckets + n;
+			if (b->pages == 0)
+				continue;
+			len += fsobstack_grow_format(o,
+				     "  bucket %5Zu: %u pages, %u busy\n",
+				     b->bsize, b->pages, b->busy);
+		}
+	}
+
+	free(heap_data);
+out:
+	heapobj_unbind_session();
+
+	fsobstack_finish(o);
+
+	return len < 0 ? len : 0;
+}
+
 #endif /* CONFIG_XENO_PSHARED */
 
 int open_version(struct fsobj *fsobj, void *priv)
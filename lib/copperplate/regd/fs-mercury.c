@@ -111,6 +111,15 @@ struct sysreg_fsfile sysreg_files[] = {
 			.read = fsobj_obstack_read
 		},
 	},
+	{
+		.path = "/heapstat",
+		.mode = O_RDONLY,
+		.ops = {
+			.open = open_heapstat,
+			.release = fsobj_obstack_release,
+			.read = fsobj_obstack_read
+		},
+	},
 #endif /* CONFIG_XENO_PSHARED */
 	{
 		.path = "/version",
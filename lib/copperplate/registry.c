@@ -89,6 +89,8 @@ struct regfs_dir {
 
 const static struct pvhash_operations pvhash_operations = {
 	.compare = memcmp,
+	.alloc = pvmalloc,
+	.free = pvfree,
 };
 
 int registry_add_dir(const char *fmt, ...)
@@ -18,6 +18,7 @@
  * Timer object abstraction.
  */
 
+#include <stdio.h>
 #include <signal.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -32,16 +33,37 @@
 #include "copperplate/threadobj.h"
 #include "copperplate/timerobj.h"
 #include "copperplate/clockobj.h"
+#include "copperplate/heapobj.h"
 #include "copperplate/debug.h"
 #include "internal.h"
 
-static pthread_mutex_t svlock;
-
-static pthread_t svthread;
-
-static pid_t svpid;
-
-static DEFINE_PRIVATE_LIST(svtimers);
+/*
+ * A timer server is a SCHED_CORE thread running the handlers of the
+ * timers bound to it. By default, a single server runs all handlers
+ * of the process. With --per-cpu-timers, one server is pinned to
+ * each CPU the process may run on, and every timer is bound to the
+ * server of the CPU its creator runs on, so that a slow handler only
+ * delays the timers of that CPU.
+ */
+struct timer_server {
+	pthread_mutex_t lock;
+	pthread_t thread;
+	pid_t pid;
+	int cpu;
+#ifdef CONFIG_XENO_TIMER_HEAP
+	struct timerobj **heap;
+	int heap_count;
+	int heap_size;
+	int nr_timers;
+#else
+	struct pvlistobj timers;
+#endif
+	struct timerobj_stats stats;
+};
+
+static struct timer_server *servers;
+
+static int nr_servers;
 
 #ifdef CONFIG_XENO_COBALT
 
@@ -60,24 +82,178 @@ static inline void timersv_init_corespec(void)
 
 #endif /* CONFIG_XENO_MERCURY */
 
+#ifdef CONFIG_XENO_TIMER_HEAP
+
+/*
+ * Outstanding timers are indexed by a binary min-heap ordered by
+ * expiry date, which keeps insertion and removal in O(log n) for
+ * applications running hundreds of watchdogs. Each timer records
+ * its current slot into the heap array, so that we may pull it from
+ * any position. Slots are reserved at timer creation, so that
+ * arming a timer never has to allocate memory.
+ */
+static inline void timersv_init_index(struct timer_server *sv)
+{
+	sv->heap = NULL;
+	sv->heap_count = 0;
+	sv->heap_size = 0;
+	sv->nr_timers = 0;
+}
+
+static inline void timerobj_init_holder(struct timerobj *tmobj)
+{
+	tmobj->hpos = -1;
+}
+
+static inline int timerobj_queued(struct timerobj *tmobj)
+{
+	return tmobj->hpos >= 0;
+}
+
+static inline int heap_before(struct timer_server *sv, int a, int b)
+{
+	return timespec_before(&sv->heap[a]->itspec.it_value,
+			       &sv->heap[b]->itspec.it_value);
+}
+
+static inline void heap_swap(struct timer_server *sv, int a, int b)
+{
+	struct timerobj *tmobj = sv->heap[a];
+
+	sv->heap[a] = sv->heap[b];
+	sv->heap[a]->hpos = a;
+	sv->heap[b] = tmobj;
+	tmobj->hpos = b;
+}
+
+static void heap_up(struct timer_server *sv, int pos)
+{
+	int parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (!heap_before(sv, pos, parent))
+			break;
+		heap_swap(sv, pos, parent);
+		pos = parent;
+	}
+}
+
+static void heap_down(struct timer_server *sv, int pos)
+{
+	int child;
+
+	for (;;) {
+		child = pos * 2 + 1;
+		if (child >= sv->heap_count)
+			break;
+		if (child + 1 < sv->heap_count &&
+		    heap_before(sv, child + 1, child))
+			child++;
+		if (!heap_before(sv, child, pos))
+			break;
+		heap_swap(sv, pos, child);
+		pos = child;
+	}
+}
+
+static void timerobj_enqueue(struct timerobj *tmobj)
+{
+	struct timer_server *sv = tmobj->server;
+	int pos = sv->heap_count++;
+
+	assert(sv->heap_count <= sv->heap_size);
+	sv->heap[pos] = tmobj;
+	tmobj->hpos = pos;
+	heap_up(sv, pos);
+}
+
+static void timerobj_dequeue(struct timerobj *tmobj)
+{
+	struct timer_server *sv = tmobj->server;
+	int pos = tmobj->hpos, last = --sv->heap_count;
+
+	tmobj->hpos = -1;
+	if (pos == last)
+		return;
+
+	sv->heap[pos] = sv->heap[last];
+	sv->heap[pos]->hpos = pos;
+	heap_down(sv, pos);
+	heap_up(sv, pos);
+}
+
+static inline struct timerobj *timerobj_first(struct timer_server *sv)
+{
+	return sv->heap_count > 0 ? sv->heap[0] : NULL;
+}
+
+static int timerobj_reserve(struct timer_server *sv) /* sv->lock held */
+{
+	struct timerobj **heap;
+	int size;
+
+	if (sv->nr_timers < sv->heap_size) {
+		sv->nr_timers++;
+		return 0;
+	}
+
+	size = sv->heap_size ? sv->heap_size * 2 : 32;
+	heap = pvmalloc(size * sizeof(*heap));
+	if (heap == NULL)
+		return -ENOMEM;
+
+	if (sv->heap) {
+		memcpy(heap, sv->heap, sv->heap_count * sizeof(*heap));
+		pvfree(sv->heap);
+	}
+
+	sv->heap = heap;
+	sv->heap_size = size;
+	sv->nr_timers++;
+
+	return 0;
+}
+
+static inline void timerobj_release(struct timer_server *sv) /* sv->lock held */
+{
+	sv->nr_timers--;
+}
+
+#else /* !CONFIG_XENO_TIMER_HEAP */
+
+static inline void timersv_init_index(struct timer_server *sv)
+{
+	pvlist_init(&sv->timers);
+}
+
+static inline void timerobj_init_holder(struct timerobj *tmobj)
+{
+	pvholder_init(&tmobj->next); /* so we may use pvholder_linked() */
+}
+
+static inline int timerobj_queued(struct timerobj *tmobj)
+{
+	return pvholder_linked(&tmobj->next);
+}
+
 /*
- * XXX: at some point, we may consider using a timer wheel instead of
- * a simple linked list to index timers. The latter method is
- * efficient for up to ten outstanding timers or so, which should be
- * enough for most applications. However, there exist poorly designed
- * apps involving dozens of active timers, particularly in the legacy
- * embedded world.
+ * A simple linked list is efficient for up to ten outstanding
+ * timers or so, which should be enough for most applications.
+ * Configure with --with-timer-index=heap for apps involving dozens
+ * of active timers, particularly in the legacy embedded world.
  */
 static void timerobj_enqueue(struct timerobj *tmobj)
 {
+	struct pvlistobj *timers = &tmobj->server->timers;
 	struct timerobj *__tmobj;
 
-	if (pvlist_empty(&svtimers)) {
-		pvlist_append(&tmobj->next, &svtimers);
+	if (pvlist_empty(timers)) {
+		pvlist_append(&tmobj->next, timers);
 		return;
 	}
 
-	pvlist_for_each_entry_reverse(__tmobj, &svtimers, next) {
+	pvlist_for_each_entry_reverse(__tmobj, timers, next) {
 		if (timespec_before_or_same(&__tmobj->itspec.it_value,
 					    &tmobj->itspec.it_value))
 			break;
@@ -86,20 +262,81 @@ static void timerobj_enqueue(struct timerobj *tmobj)
 	atpvh(&__tmobj->next, &tmobj->next);
 }
 
+static inline void timerobj_dequeue(struct timerobj *tmobj)
+{
+	pvlist_remove_init(&tmobj->next);
+}
+
+static inline struct timerobj *timerobj_first(struct timer_server *sv)
+{
+	if (pvlist_empty(&sv->timers))
+		return NULL;
+
+	return pvlist_first_entry(&sv->timers, struct timerobj, next);
+}
+
+static inline int timerobj_reserve(struct timer_server *sv)
+{
+	return 0;
+}
+
+static inline void timerobj_release(struct timer_server *sv) { }
+
+#endif /* !CONFIG_XENO_TIMER_HEAP */
+
 static int server_prologue(void *arg)
 {
-	svpid = get_thread_pid();
-	copperplate_set_current_name("timer-internal");
+	struct timer_server *sv = arg;
+	char name[16];
+	cpu_set_t cpuset;
+
+	sv->pid = get_thread_pid();
+
+	if (sv->cpu >= 0) {
+		CPU_ZERO(&cpuset);
+		CPU_SET(sv->cpu, &cpuset);
+		if (sched_setaffinity(0, sizeof(cpuset), &cpuset))
+			return __bt(-errno);
+		snprintf(name, sizeof(name), "timer-cpu%d", sv->cpu);
+		copperplate_set_current_name(name);
+	} else
+		copperplate_set_current_name("timer-internal");
+
 	timersv_init_corespec();
 	threadobj_set_current(THREADOBJ_IRQCONTEXT);
 
 	return 0;
 }
 
+static void update_stats(struct timer_server *sv, /* sv->lock held */
+			 const struct timespec *value,
+			 const struct timespec *start,
+			 const struct timespec *end)
+{
+	struct timerobj_stats *stats = &sv->stats;
+	struct timespec delta;
+	ticks_t ns;
+
+	stats->dispatches++;
+
+	timespec_sub(&delta, start, value);
+	ns = timespec_scalar(&delta);
+	stats->latency_sum += ns;
+	if (ns > stats->latency_max)
+		stats->latency_max = ns;
+
+	timespec_sub(&delta, end, start);
+	ns = timespec_scalar(&delta);
+	stats->runtime_sum += ns;
+	if (ns > stats->runtime_max)
+		stats->runtime_max = ns;
+}
+
 static void *timerobj_server(void *arg)
 {
 	void (*handler)(struct timerobj *tmobj);
-	struct timespec now, value, interval;
+	struct timespec now, value, interval, start, end;
+	struct timer_server *sv = arg;
 	struct timerobj *tmobj;
 	sigset_t set;
 	int sig, ret;
@@ -112,58 +349,79 @@ static void *timerobj_server(void *arg)
 		if (ret && ret != -EINTR)
 			break;
 		/*
-		 * We have a single server thread for now, so handlers
-		 * are fully serialized.
+		 * Handlers of timers bound to the same server are
+		 * fully serialized.
 		 */
-		write_lock_nocancel(&svlock);
+		write_lock_nocancel(&sv->lock);
 
 		__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
 
-		while (!pvlist_empty(&svtimers)) {
-			tmobj = pvlist_first_entry(&svtimers, typeof(*tmobj),
-						   next);
-
+		while ((tmobj = timerobj_first(sv)) != NULL) {
 			value = tmobj->itspec.it_value;
 			interval = tmobj->itspec.it_interval;
 			handler = tmobj->handler;
 			if (timespec_after(&value, &now))
 				break;
-			pvlist_remove_init(&tmobj->next);
+			timerobj_dequeue(tmobj);
 			if (interval.tv_sec > 0 || interval.tv_nsec > 0) {
 				timespec_add(&tmobj->itspec.it_value,
 					     &value, &interval);
 				timerobj_enqueue(tmobj);
 			}
-			write_unlock(&svlock);
+			write_unlock(&sv->lock);
+			__RT(clock_gettime(CLOCK_COPPERPLATE, &start));
 			handler(tmobj);
-			write_lock_nocancel(&svlock);
+			__RT(clock_gettime(CLOCK_COPPERPLATE, &end));
+			write_lock_nocancel(&sv->lock);
+			update_stats(sv, &value, &start, &end);
 		}
 
-		write_unlock(&svlock);
+		write_unlock(&sv->lock);
 	}
 
 	return NULL;
 }
 
-static void timerobj_spawn_server(void)
+static void timerobj_spawn_servers(void)
 {
 	struct corethread_attributes cta;
+	struct timer_server *sv;
+	int n;
 
 	cta.policy = SCHED_CORE;
 	cta.param_ex.sched_priority = threadobj_irq_prio;
 	cta.prologue = server_prologue;
 	cta.run = timerobj_server;
-	cta.arg = NULL;
 	cta.stacksize = PTHREAD_STACK_DEFAULT;
 	cta.detachstate = PTHREAD_CREATE_DETACHED;
 
-	__bt(copperplate_create_thread(&cta, &svthread));
+	for (n = 0; n < nr_servers; n++) {
+		sv = servers + n;
+		cta.arg = sv;
+		__bt(copperplate_create_thread(&cta, &sv->thread));
+	}
+}
+
+static struct timer_server *get_server(void)
+{
+	int cpu, n;
+
+	if (nr_servers > 1) {
+		cpu = sched_getcpu();
+		for (n = 0; n < nr_servers; n++) {
+			if (servers[n].cpu == cpu)
+				return servers + n;
+		}
+	}
+
+	return servers;
 }
 
 int timerobj_init(struct timerobj *tmobj)
 {
 	static pthread_once_t spawn_once;
 	pthread_mutexattr_t mattr;
+	struct timer_server *sv;
 	struct sigevent sev;
 	int ret;
 
@@ -178,21 +436,31 @@ int timerobj_init(struct timerobj *tmobj)
 	 * very least), and spawning a short-lived thread at each
 	 * timeout expiration to run the handler is just overkill.
 	 */
-	pthread_once(&spawn_once, timerobj_spawn_server);
-	if (!svthread)
+	pthread_once(&spawn_once, timerobj_spawn_servers);
+	sv = get_server();
+	if (!sv->thread)
 		return __bt(-EAGAIN);
 
 	tmobj->handler = NULL;
-	pvholder_init(&tmobj->next); /* so we may use pvholder_linked() */
+	tmobj->server = sv;
+	timerobj_init_holder(tmobj);
 
 	memset(&sev, 0, sizeof(sev));
 	sev.sigev_notify = SIGEV_THREAD_ID;
 	sev.sigev_signo = SIGALRM;
-	sev.sigev_notify_thread_id = svpid;
+	sev.sigev_notify_thread_id = sv->pid;
 
-	ret = __RT(timer_create(CLOCK_COPPERPLATE, &sev, &tmobj->timer));
+	write_lock_nocancel(&sv->lock);
+	ret = timerobj_reserve(sv);
+	write_unlock(&sv->lock);
 	if (ret)
-		return __bt(-errno);
+		return __bt(ret);
+
+	ret = __RT(timer_create(CLOCK_COPPERPLATE, &sev, &tmobj->timer));
+	if (ret) {
+		ret = __bt(-errno);
+		goto fail_timer;
+	}
 
 	pthread_mutexattr_init(&mattr);
 	pthread_mutexattr_settype(&mattr, mutex_type_attribute);
@@ -201,18 +469,29 @@ int timerobj_init(struct timerobj *tmobj)
 	assert(ret == 0);
 	ret = __bt(-__RT(pthread_mutex_init(&tmobj->lock, &mattr)));
 	pthread_mutexattr_destroy(&mattr);
+	if (ret == 0)
+		return 0;
+
+	__RT(timer_delete(tmobj->timer));
+fail_timer:
+	write_lock_nocancel(&sv->lock);
+	timerobj_release(sv);
+	write_unlock(&sv->lock);
 
 	return ret;
 }
 
 void timerobj_destroy(struct timerobj *tmobj) /* lock held, dropped */
 {
-	write_lock_nocancel(&svlock);
+	struct timer_server *sv = tmobj->server;
+
+	write_lock_nocancel(&sv->lock);
 
-	if (pvholder_linked(&tmobj->next))
-		pvlist_remove_init(&tmobj->next);
+	if (timerobj_queued(tmobj))
+		timerobj_dequeue(tmobj);
 
-	write_unlock(&svlock);
+	timerobj_release(sv);
+	write_unlock(&sv->lock);
 
 	__RT(timer_delete(tmobj->timer));
 	__RT(pthread_mutex_unlock(&tmobj->lock));
@@ -223,6 +502,7 @@ int timerobj_start(struct timerobj *tmobj,
 		   void (*handler)(struct timerobj *tmobj),
 		   struct itimerspec *it) /* lock held, dropped */
 {
+	struct timer_server *sv = tmobj->server;
 	int ret = 0;
 
 	/*
@@ -234,10 +514,10 @@ int timerobj_start(struct timerobj *tmobj,
 	 * happens to check the return code then drop the timer
 	 * (again).
 	 */
-	write_lock_nocancel(&svlock);
+	write_lock_nocancel(&sv->lock);
 
-       if (pvholder_linked(&tmobj->next))
-               pvlist_remove_init(&tmobj->next);
+	if (timerobj_queued(tmobj))
+		timerobj_dequeue(tmobj);
 
 	tmobj->handler = handler;
 	tmobj->itspec = *it;
@@ -249,7 +529,7 @@ int timerobj_start(struct timerobj *tmobj,
 
 	timerobj_enqueue(tmobj);
 fail:
-	write_unlock(&svlock);
+	write_unlock(&sv->lock);
 	timerobj_unlock(tmobj);
 
 	return ret;
@@ -258,30 +538,81 @@ fail:
 int timerobj_stop(struct timerobj *tmobj) /* lock held, dropped */
 {
 	static const struct itimerspec itimer_stop;
+	struct timer_server *sv = tmobj->server;
 
-	write_lock_nocancel(&svlock);
+	write_lock_nocancel(&sv->lock);
 
-	if (pvholder_linked(&tmobj->next))
-		pvlist_remove_init(&tmobj->next);
+	if (timerobj_queued(tmobj))
+		timerobj_dequeue(tmobj);
 
 	__RT(timer_settime(tmobj->timer, 0, &itimer_stop, NULL));
 	tmobj->handler = NULL;
-	write_unlock(&svlock);
+	write_unlock(&sv->lock);
 	timerobj_unlock(tmobj);
 
 	return 0;
 }
 
+int timerobj_get_stats(int server, struct timerobj_stats *stats)
+{
+	struct timer_server *sv;
+
+	if (server < 0 || server >= nr_servers)
+		return -ENOENT;
+
+	sv = servers + server;
+	write_lock_nocancel(&sv->lock);
+	*stats = sv->stats;
+	write_unlock(&sv->lock);
+
+	return 0;
+}
+
 int timerobj_pkg_init(void)
 {
 	pthread_mutexattr_t mattr;
-	int ret;
+	struct timer_server *sv;
+	cpu_set_t cpuset;
+	int ret, cpu, n;
+
+	nr_servers = 1;
+	if (__copperplate_setup_data.per_cpu_timers) {
+		/*
+		 * Serve the CPUs the process may run on, as
+		 * restricted by --cpu-affinity if given.
+		 */
+		if (CPU_COUNT(&__base_setup_data.cpu_affinity))
+			cpuset = __base_setup_data.cpu_affinity;
+		else if (sched_getaffinity(0, sizeof(cpuset), &cpuset))
+			return __bt(-errno);
+		nr_servers = CPU_COUNT(&cpuset);
+	}
+
+	servers = pvmalloc(nr_servers * sizeof(*servers));
+	if (servers == NULL)
+		return -ENOMEM;
 
 	pthread_mutexattr_init(&mattr);
 	pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
 	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_PRIVATE);
-	ret = __bt(-__RT(pthread_mutex_init(&svlock, &mattr)));
+
+	for (n = 0, cpu = 0; n < nr_servers; n++, cpu++) {
+		sv = servers + n;
+		memset(sv, 0, sizeof(*sv));
+		sv->cpu = -1;
+		if (nr_servers > 1) {
+			while (!CPU_ISSET(cpu, &cpuset))
+				cpu++;
+			sv->cpu = cpu;
+		}
+		sv->stats.cpu = sv->cpu;
+		timersv_init_index(sv);
+		ret = __bt(-__RT(pthread_mutex_init(&sv->lock, &mattr)));
+		if (ret)
+			break;
+	}
+
 	pthread_mutexattr_destroy(&mattr);
 
 	return ret;
@@ -17,6 +17,8 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
+#include <boilerplate/atomic.h>
 #include <boilerplate/lock.h>
 #include <copperplate/heapobj.h>
 #include <vxworks/errnoLib.h>
@@ -91,48 +93,98 @@ void rngFlush(RING_ID rid)
 	}
 }
 
+/*
+ * A ring may be used by a single reader and a single writer
+ * concurrently, without locking: the reader only updates readPos,
+ * the writer only updates writePos, and each side publishes its
+ * index after the data it guards.
+ */
 int rngBufGet(RING_ID rid, char *buffer, int maxbytes)
 {
 	struct wind_ring *ring = find_ring_from_id(rid);
-	unsigned int savedWritePos;
-	int j, bytesRead = 0;
+	unsigned int readPos, writePos, size, nbytes, chunk;
 
 	if (ring == NULL)
 		return ERROR;
 
-	savedWritePos = ring->writePos;
+	if (maxbytes <= 0)
+		return 0;
 
-	for (j = 0; j < maxbytes; j++) {
-		if ((ring->readPos) % (ring->bufSize + 1) == savedWritePos)
-			break;
-		buffer[j] = ring->buffer[ring->readPos];
-		++bytesRead;
-		ring->readPos = (ring->readPos + 1) % (ring->bufSize + 1);
-	}
+	size = ring->bufSize + 1;
+	readPos = ring->readPos;
+	writePos = ACCESS_ONCE(ring->writePos);
+	/* Read data only once the writer has published it. */
+	smp_rmb();
+
+	if (writePos >= readPos)
+		nbytes = writePos - readPos;
+	else
+		nbytes = size - readPos + writePos;
+
+	if (nbytes > (unsigned int)maxbytes)
+		nbytes = maxbytes;
+
+	/* At most two segments: up to the end, then from the start. */
+	chunk = size - readPos;
+	if (chunk > nbytes)
+		chunk = nbytes;
+
+	memcpy(buffer, ring->buffer + readPos, chunk);
+	memcpy(buffer + chunk, ring->buffer, nbytes - chunk);
+
+	readPos += nbytes;
+	if (readPos >= size)
+		readPos -= size;
+
+	/* Data must be consumed before the writer may overwrite it. */
+	smp_mb();
+	ACCESS_ONCE(ring->readPos) = readPos;
 
-	return bytesRead;
+	return nbytes;
 }
 
 int rngBufPut(RING_ID rid, char *buffer, int nbytes)
 {
 	struct wind_ring *ring = find_ring_from_id(rid);
-	unsigned int savedReadPos;
-	int j, bytesWritten = 0;
+	unsigned int readPos, writePos, size, room, chunk;
 
 	if (ring == NULL)
 		return ERROR;
 
-	savedReadPos = ring->readPos;
+	if (nbytes <= 0)
+		return 0;
 
-	for (j = 0; j < nbytes; j++) {
-		if ((ring->writePos + 1) % (ring->bufSize + 1) == savedReadPos)
-			break;
-		ring->buffer[ring->writePos] = buffer[j];
-		++bytesWritten;
-		ring->writePos = (ring->writePos + 1) % (ring->bufSize + 1);
-	}
+	size = ring->bufSize + 1;
+	writePos = ring->writePos;
+	readPos = ACCESS_ONCE(ring->readPos);
+	/* Do not overwrite data the reader may still be fetching. */
+	smp_mb();
+
+	/* One byte is always left unused, to tell full from empty. */
+	if (readPos > writePos)
+		room = readPos - writePos - 1;
+	else
+		room = size - writePos + readPos - 1;
+
+	if (room > (unsigned int)nbytes)
+		room = nbytes;
+
+	chunk = size - writePos;
+	if (chunk > room)
+		chunk = room;
+
+	memcpy(ring->buffer + writePos, buffer, chunk);
+	memcpy(ring->buffer, buffer + chunk, room - chunk);
+
+	writePos += room;
+	if (writePos >= size)
+		writePos -= size;
+
+	/* Data must be visible before the reader may fetch it. */
+	smp_wmb();
+	ACCESS_ONCE(ring->writePos) = writePos;
 
-	return bytesWritten;
+	return room;
 }
 
 BOOL rngIsEmpty(RING_ID rid)
@@ -163,7 +215,8 @@ int rngFreeBytes(RING_ID rid)
 		return ERROR;
 
 	return ((ring->bufSize -
-		 (ring->writePos - ring->readPos)) % (ring->bufSize + 1));
+		 (ACCESS_ONCE(ring->writePos) - ACCESS_ONCE(ring->readPos))) %
+		(ring->bufSize + 1));
 }
 
 int rngNBytes(RING_ID rid)
@@ -192,7 +245,9 @@ void rngMoveAhead(RING_ID rid, int n)
 	struct wind_ring *ring = find_ring_from_id(rid);
 
 	if (ring) {
-		ring->writePos += n;
-		ring->writePos %= (ring->bufSize + 1);
+		/* Publish the bytes stored by rngPutAhead() first. */
+		smp_wmb();
+		ACCESS_ONCE(ring->writePos) =
+			(ring->writePos + n) % (ring->bufSize + 1);
 	}
 }
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <boilerplate/tunables.h>
+#include <copperplate/traceobj.h>
+#include <vxworks/errnoLib.h>
+#include <vxworks/taskLib.h>
+#include <vxworks/rngLib.h>
+
+/*
+ * Stream data from a writer task to a reader task through a ring
+ * they both access without locking, checking the byte sequence
+ * received. With --verbose, report the throughput obtained for a
+ * few transfer sizes.
+ */
+
+#define RING_BYTES	8191
+#define TOTAL_BYTES	(16 * 1024 * 1024)
+#define MAX_XFER	4096
+
+static struct traceobj trobj;
+
+static const int xfer_sizes[] = { 16, 256, MAX_XFER };
+
+static RING_ID rng;
+
+static int xfer;
+
+static void writerTask(long arg, ...)
+{
+	char buffer[MAX_XFER];
+	int done, n, k;
+
+	traceobj_enter(&trobj);
+
+	for (done = 0; done < TOTAL_BYTES; done += n) {
+		n = TOTAL_BYTES - done;
+		if (n > xfer)
+			n = xfer;
+		for (k = 0; k < n; k++)
+			buffer[k] = (char)(done + k);
+		n = rngBufPut(rng, buffer, n);
+		traceobj_assert(&trobj, n >= 0);
+		if (n == 0)
+			taskDelay(0);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static void rootTask(long arg, ...)
+{
+	struct timespec start, end;
+	char buffer[MAX_XFER];
+	int done, n, k, i;
+	TASK_ID tid;
+	double ns;
+
+	traceobj_enter(&trobj);
+
+	for (i = 0; i < sizeof(xfer_sizes) / sizeof(xfer_sizes[0]); i++) {
+		xfer = xfer_sizes[i];
+		rng = rngCreate(RING_BYTES);
+		traceobj_assert(&trobj, rng != 0);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		tid = taskSpawn("writerTask", 50, 0, 0, writerTask,
+				0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		traceobj_assert(&trobj, tid != ERROR);
+
+		for (done = 0; done < TOTAL_BYTES; done += n) {
+			n = rngBufGet(rng, buffer, xfer);
+			traceobj_assert(&trobj, n >= 0);
+			if (n == 0) {
+				taskDelay(0);
+				continue;
+			}
+			for (k = 0; k < n; k++)
+				traceobj_assert(&trobj,
+						buffer[k] == (char)(done + k));
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		traceobj_assert(&trobj, rngIsEmpty(rng));
+		rngDelete(rng);
+
+		if (get_runtime_tunable(verbosity_level) > 0) {
+			ns = (end.tv_sec - start.tv_sec) * 1e9 +
+				(end.tv_nsec - start.tv_nsec);
+			printf("%5d bytes per call: %8.1f MB/s\n",
+			       xfer, TOTAL_BYTES * 1e3 / ns);
+		}
+	}
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	TASK_ID tid;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	tid = taskSpawn("rootTask", 50, 0, 0, rootTask,
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	traceobj_assert(&trobj, tid != ERROR);
+
+	traceobj_join(&trobj);
+
+	exit(0);
+}
@@ -22,6 +22,9 @@ smokey_test_plugin(bufp,
 );
 
 #define BUFP_SVPORT 12
+#define BUFP_BCPORT 13
+#define BUFP_BCREADERS 3
+#define BUFP_BCBUFSZ (64 * sizeof(long))
 
 static pthread_t svtid, cltid;
 
@@ -132,6 +135,114 @@ static void *client(void *arg)
 	return NULL;
 }
 
+static int check_broadcast(void)
+{
+	int ret, n, i, owner, rd[BUFP_BCREADERS];
+	struct sockaddr_ipc saddr;
+	unsigned int overruns;
+	size_t bufsz = BUFP_BCBUFSZ;
+	long data, control;
+	socklen_t optlen;
+	int on = 1;
+
+	owner = smokey_check_errno(socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP));
+	if (owner < 0)
+		return owner;
+
+	if (!__Terrno(ret, setsockopt(owner, SOL_BUFP, BUFP_BUFSZ,
+				 &bufsz, sizeof(bufsz))) ||
+	    !__Terrno(ret, setsockopt(owner, SOL_BUFP, BUFP_BROADCAST,
+				 &on, sizeof(on))))
+		goto out_owner;
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = BUFP_BCPORT;
+	if (!__Terrno(ret, bind(owner, (struct sockaddr *)&saddr, sizeof(saddr))))
+		goto out_owner;
+
+	for (n = 0; n < BUFP_BCREADERS; n++) {
+		rd[n] = smokey_check_errno(socket(AF_RTIPC, SOCK_DGRAM,
+						  IPCPROTO_BUFP));
+		if (rd[n] < 0) {
+			ret = rd[n];
+			goto out_readers;
+		}
+		if (!__Terrno(ret, connect(rd[n], (struct sockaddr *)&saddr,
+				      sizeof(saddr)))) {
+			n++;
+			goto out_readers;
+		}
+	}
+
+	/* Every reader gets a copy of each message. */
+	for (data = 1; data <= 16; data++) {
+		ret = smokey_check_errno(send(owner, &data, sizeof(data), 0));
+		if (ret < 0)
+			goto out_readers;
+	}
+
+	for (i = 0; i < BUFP_BCREADERS; i++) {
+		for (control = 1; control <= 16; control++) {
+			ret = smokey_check_errno(recv(rd[i], &data, sizeof(data),
+						      MSG_DONTWAIT));
+			if (ret < 0)
+				goto out_readers;
+			if (!__Tassert(data == control)) {
+				ret = -EINVAL;
+				goto out_readers;
+			}
+		}
+		ret = recv(rd[i], &data, sizeof(data), MSG_DONTWAIT);
+		if (!__Tassert(ret < 0 && errno == EWOULDBLOCK)) {
+			ret = -EINVAL;
+			goto out_readers;
+		}
+	}
+
+	/*
+	 * The writer never blocks: overflowing the buffer makes the
+	 * lagging readers lose data, which they are told about.
+	 */
+	for (data = 0; data < (long)(2 * BUFP_BCBUFSZ / sizeof(long)); data++) {
+		ret = smokey_check_errno(send(owner, &data, sizeof(data), 0));
+		if (ret < 0)
+			goto out_readers;
+	}
+
+	ret = recv(rd[0], &data, sizeof(data), MSG_DONTWAIT);
+	if (!__Tassert(ret < 0 && errno == EPIPE)) {
+		ret = -EINVAL;
+		goto out_readers;
+	}
+
+	optlen = sizeof(overruns);
+	if (!__Terrno(ret, getsockopt(rd[0], SOL_BUFP, BUFP_OVERRUNS,
+				 &overruns, &optlen)))
+		goto out_readers;
+	if (!__Tassert(overruns == 1)) {
+		ret = -EINVAL;
+		goto out_readers;
+	}
+
+	/* The reader resumed from the most recent write position. */
+	control = 12345;
+	ret = smokey_check_errno(send(owner, &control, sizeof(control), 0));
+	if (ret < 0)
+		goto out_readers;
+	ret = smokey_check_errno(recv(rd[0], &data, sizeof(data), MSG_DONTWAIT));
+	if (ret < 0)
+		goto out_readers;
+	ret = __Tassert(data == control) ? 0 : -EINVAL;
+out_readers:
+	while (--n >= 0)
+		close(rd[n]);
+out_owner:
+	close(owner);
+
+	return ret < 0 ? ret : 0;
+}
+
 static int run_bufp(struct smokey_test *t, int argc, char *const argv[])
 {
 	struct sched_param svparam = {.sched_priority = 71 };
@@ -170,5 +281,5 @@ static int run_bufp(struct smokey_test *t, int argc, char *const argv[])
 	pthread_cancel(svtid);
 	pthread_join(svtid, NULL);
 
-	return 0;
+	return check_broadcast();
 }
@@ -0,0 +1,261 @@
+/*
+ * RT Socket CAN receive filter scaling benchmark
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <rtdm/can.h>
+#include <sys/cobalt.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <smokey/smokey.h>
+
+#define CAN_MOD			"xeno_can"
+#define CAN_VIRT_MOD		"xeno_can_virt"
+#define RECV_IFNAME		"rtcan0"
+#define SEND_IFNAME		"rtcan1"
+
+/* Beyond any identifier the filters are set for */
+#define MISS_ID			0x7ff
+
+smokey_test_plugin(can_filters,
+	SMOKEY_ARGLIST(
+		SMOKEY_INT(max_filters),
+		SMOKEY_INT(frames),
+	),
+	"Measure the RT Socket CAN reception time on the virtual CAN bus\n"
+	"\tdepending on the number of exact-match receive filters,\n"
+	"\tmax_filters sets the largest filter count tried (default: 256,\n"
+	"\tlimited by CONFIG_XENO_DRIVERS_CAN_MAX_RECEIVERS), frames the\n"
+	"\tnumber of frames sent per measurement (default: 10000)."
+);
+
+static int can_config(int s, const char *ifname, int mode, int *ifindex)
+{
+	struct can_ifreq ifr;
+	int ret;
+
+	namecpy(ifr.ifr_name, ifname);
+	ret = smokey_check_errno(__RT(ioctl(s, SIOCGIFINDEX, &ifr)));
+	if (ret < 0)
+		return ret;
+
+	if (ifindex)
+		*ifindex = ifr.ifr_ifindex;
+
+	if (mode == CAN_MODE_START) {
+		ifr.ifr_ifru.baudrate = 1000000;
+		ret = smokey_check_errno(__RT(ioctl(s, SIOCSCANBAUDRATE,
+						    &ifr)));
+		if (ret < 0)
+			return ret;
+	}
+
+	ifr.ifr_ifru.mode = mode;
+
+	return smokey_check_errno(__RT(ioctl(s, SIOCSCANMODE, &ifr)));
+}
+
+/* Spread identifiers over the 11 bit range, the miss ID excepted. */
+static inline canid_t filter_id(int n)
+{
+	return (n * 97) % MISS_ID;
+}
+
+static int open_receiver(int ifindex, int nrfilters)
+{
+	struct sockaddr_can addr;
+	struct can_filter *flist;
+	int s, n, ret;
+
+	s = smokey_check_errno(__RT(socket(PF_CAN, SOCK_RAW, CAN_RAW)));
+	if (s < 0)
+		return s;
+
+	flist = malloc(nrfilters * sizeof(*flist));
+	if (flist == NULL) {
+		__RT(close(s));
+		return -ENOMEM;
+	}
+
+	for (n = 0; n < nrfilters; n++) {
+		flist[n].can_id = filter_id(n);
+		flist[n].can_mask = CAN_SFF_MASK;
+	}
+
+	ret = __RT(setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER,
+			      flist, nrfilters * sizeof(*flist)));
+	free(flist);
+	if (ret < 0) {
+		ret = -errno;
+		goto fail;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifindex;
+	ret = __RT(bind(s, (struct sockaddr *)&addr, sizeof(addr)));
+	if (ret < 0) {
+		ret = -errno;
+		goto fail;
+	}
+
+	return s;
+fail:
+	__RT(close(s));
+
+	return ret;
+}
+
+static int send_frames(int tx, int rx, int ifindex,
+		       int nrfilters, int frames, bool hit,
+		       long long *ns_per_frame)
+{
+	struct timespec start, end;
+	struct sockaddr_can to;
+	struct can_frame frame;
+	int n, ret;
+
+	memset(&to, 0, sizeof(to));
+	to.can_family = AF_CAN;
+	to.can_ifindex = ifindex;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.can_id = MISS_ID;
+	frame.can_dlc = 8;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < frames; n++) {
+		if (hit)
+			frame.can_id = filter_id(n % nrfilters);
+		ret = smokey_check_errno(
+			__RT(sendto(tx, &frame, sizeof(frame), 0,
+				    (struct sockaddr *)&to, sizeof(to))));
+		if (ret < 0)
+			return ret;
+		if (hit) {
+			ret = smokey_check_errno(
+				__RT(recv(rx, &frame, sizeof(frame),
+					  MSG_DONTWAIT)));
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	*ns_per_frame = ((end.tv_sec - start.tv_sec) * 1000000000LL +
+			 end.tv_nsec - start.tv_nsec) / frames;
+
+	return 0;
+}
+
+static int run_filters(int s, int recv_ifindex, int send_ifindex,
+		       int max_filters, int frames)
+{
+	long long hit_ns, miss_ns;
+	int nrfilters, rx, ret = 0;
+
+	smokey_trace("filters   hit ns/frame   miss ns/frame");
+
+	for (nrfilters = 1; nrfilters <= max_filters; nrfilters *= 4) {
+		rx = open_receiver(recv_ifindex, nrfilters);
+		if (rx == -EINVAL || rx == -ENOSPC) {
+			smokey_note("can_filters: no room for %d filters "
+				    "(CONFIG_XENO_DRIVERS_CAN_MAX_RECEIVERS)",
+				    nrfilters);
+			break;
+		}
+		if (rx < 0) {
+			ret = rx;
+			break;
+		}
+
+		ret = send_frames(s, rx, send_ifindex, nrfilters,
+				  frames, true, &hit_ns);
+		if (ret == 0)
+			ret = send_frames(s, rx, send_ifindex, nrfilters,
+					  frames, false, &miss_ns);
+		__RT(close(rx));
+		if (ret)
+			break;
+
+		smokey_trace("%7d %14lld %15lld", nrfilters, hit_ns, miss_ns);
+	}
+
+	return ret;
+}
+
+static int run_can_filters(struct smokey_test *t,
+			   int argc, char *const argv[])
+{
+	int max_filters = 256, frames = 10000;
+	int recv_ifindex, send_ifindex;
+	struct sched_param param;
+	int s, cfg, ret, r;
+
+	if (SMOKEY_ARG_ISSET(can_filters, max_filters))
+		max_filters = SMOKEY_ARG_INT(can_filters, max_filters);
+
+	if (SMOKEY_ARG_ISSET(can_filters, frames))
+		frames = SMOKEY_ARG_INT(can_filters, frames);
+	if (frames <= 0)
+		frames = 1;
+
+	smokey_modprobe(CAN_MOD, true);
+
+	ret = cobalt_corectl(_CC_COBALT_GET_CAN_CONFIG, &cfg, sizeof(cfg));
+	if (ret == -EINVAL || (ret == 0 && (cfg & _CC_COBALT_CAN) == 0))
+		ret = -ENOSYS;
+	if (ret < 0)
+		goto out_mod;
+
+	smokey_modprobe(CAN_VIRT_MOD, true);
+
+	s = smokey_check_errno(__RT(socket(PF_CAN, SOCK_RAW, CAN_RAW)));
+	if (s < 0) {
+		ret = s;
+		goto out_virt;
+	}
+
+	ret = can_config(s, RECV_IFNAME, CAN_MODE_START, &recv_ifindex);
+	if (ret)
+		goto out_sock;
+
+	ret = can_config(s, SEND_IFNAME, CAN_MODE_START, &send_ifindex);
+	if (ret)
+		goto out_recv;
+
+	param.sched_priority = 1;
+	ret = smokey_check_status(
+		pthread_setschedparam(pthread_self(), SCHED_FIFO, &param));
+	if (ret == 0) {
+		ret = run_filters(s, recv_ifindex, send_ifindex,
+				  max_filters, frames);
+		param.sched_priority = 0;
+		pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+	}
+
+	r = can_config(s, SEND_IFNAME, CAN_MODE_STOP, NULL);
+	if (ret == 0)
+		ret = r;
+out_recv:
+	r = can_config(s, RECV_IFNAME, CAN_MODE_STOP, NULL);
+	if (ret == 0)
+		ret = r;
+out_sock:
+	__RT(close(s));
+out_virt:
+	smokey_rmmod(CAN_VIRT_MOD);
+out_mod:
+	smokey_rmmod(CAN_MOD);
+
+	return ret;
+}
@@ -11,9 +11,11 @@
 #include <rtdm/can.h>
 #include <sys/cobalt.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <smokey/smokey.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #define CAN_MOD                        "xeno_can"
 #define CAN_VIRT_MOD                   "xeno_can_virt"
@@ -217,6 +219,150 @@ finally:
 	pthread_exit((void *)(long)ret);
 }
 
+static int can_virt_ring_check(struct smokey_can_virt_ctx *ctx,
+			       struct can_ring_header *hdr,
+			       int ifindex, unsigned int nr)
+{
+	struct can_ring_frame *frames, *f;
+	unsigned int n, cnt;
+	uint32_t tail;
+
+	frames = (void *)hdr + hdr->data_offset;
+	tail = hdr->tail;
+
+	if (!smokey_assert(hdr->head - tail == nr))
+		return -EINVAL;
+
+	for (n = 0; n < nr; n++, tail++) {
+		f = &frames[tail & (hdr->nr_frames - 1)];
+		if (!smokey_assert(f->frame.can_id == ctx->id) ||
+		    !smokey_assert(f->frame.can_dlc == sizeof(cnt)) ||
+		    !smokey_assert(f->ifindex == ifindex) ||
+		    !smokey_assert(f->timestamp != 0))
+			return -EINVAL;
+		memcpy(&cnt, &f->frame.data[0], sizeof(cnt));
+		if (!smokey_assert(cnt == ctx->cnt_rcv))
+			return -EINVAL;
+		ctx->cnt_rcv++;
+	}
+
+	hdr->tail = tail;
+	__sync_synchronize();
+
+	return 0;
+}
+
+static int can_virt_ring(struct smokey_can_virt_ctx *ctx)
+{
+	unsigned int nr_frames = 64, n;
+	struct can_ring_header *hdr;
+	struct sockaddr_can addr;
+	struct can_ifreq ifr;
+	size_t map_size;
+	char dummy;
+	int s, ret;
+
+	s = smokey_check_errno(__RT(socket(PF_CAN, SOCK_RAW, CAN_RAW)));
+	if (s < 0)
+		return s;
+
+	ret = smokey_check_errno(__RT(setsockopt(s, SOL_CAN_RAW,
+						 CAN_RAW_RX_RING, &nr_frames,
+						 sizeof(nr_frames))));
+	if (ret < 0)
+		goto out;
+
+	namecpy(ifr.ifr_name, ctx->recv_ifname);
+	ret = smokey_check_errno(__RT(ioctl(s, SIOCGIFINDEX, &ifr)));
+	if (ret < 0)
+		goto out;
+
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+	ret = smokey_check_errno(__RT(bind(s, (struct sockaddr *)&addr,
+					   sizeof(addr))));
+	if (ret < 0)
+		goto out;
+
+	ret = smokey_check_errno(__RT(ioctl(s, RTCAN_RTIOC_RCV_TIMEOUT,
+					    &ctx->recv_timeout)));
+	if (ret < 0)
+		goto out;
+
+	map_size = getpagesize() + nr_frames * sizeof(struct can_ring_frame);
+	hdr = mmap(NULL, map_size, PROT_READ|PROT_WRITE,
+		   MAP_SHARED, s, 0);
+	if (hdr == MAP_FAILED) {
+		ret = smokey_check_errno(-1);
+		goto out;
+	}
+
+	if (!smokey_assert(hdr->nr_frames == nr_frames)) {
+		ret = -EINVAL;
+		goto unmap;
+	}
+
+	/* Nothing received yet. */
+	ret = __RT(recv(s, &dummy, sizeof(dummy), MSG_DONTWAIT));
+	if (!smokey_assert(ret < 0 && errno == EAGAIN)) {
+		ret = -EINVAL;
+		goto unmap;
+	}
+
+	ctx->cnt_snd = ctx->cnt_rcv = 1;
+
+	/* Fill half of the ring, then consume it in place. */
+	for (n = 0; n < nr_frames / 2; n++, ctx->cnt_snd++) {
+		ret = can_virt_send(ctx);
+		if (ret)
+			goto unmap;
+	}
+
+	ret = smokey_check_errno(__RT(recv(s, &dummy, sizeof(dummy), 0)));
+	if (ret < 0)
+		goto unmap;
+	if (!smokey_assert(ret == nr_frames / 2)) {
+		ret = -EINVAL;
+		goto unmap;
+	}
+
+	ret = can_virt_ring_check(ctx, hdr, ifr.ifr_ifindex, nr_frames / 2);
+	if (ret)
+		goto unmap;
+
+	/* Overflow the ring, the excess frames must be dropped. */
+	for (n = 0; n < nr_frames + 8; n++, ctx->cnt_snd++) {
+		ret = can_virt_send(ctx);
+		if (ret)
+			goto unmap;
+	}
+
+	if (!smokey_assert(hdr->drops == 8)) {
+		ret = -EINVAL;
+		goto unmap;
+	}
+
+	ret = can_virt_ring_check(ctx, hdr, ifr.ifr_ifindex, nr_frames);
+	if (ret)
+		goto unmap;
+
+	ret = __RT(recv(s, &dummy, sizeof(dummy), MSG_DONTWAIT));
+	if (!smokey_assert(ret < 0 && errno == EAGAIN)) {
+		ret = -EINVAL;
+		goto unmap;
+	}
+
+	smokey_trace("receive ring: %u frames consumed in place",
+		     ctx->cnt_rcv - 1);
+	ret = 0;
+unmap:
+	munmap(hdr, map_size);
+out:
+	__RT(close(s));
+
+	return ret;
+}
+
 static int can_virt_config(int s, const char *ifname, int baudrate, int mode)
 {
 	struct can_ifreq ifr;
@@ -368,6 +514,9 @@ static int run_can(struct smokey_test *t, int argc, char *const argv[])
 		ret = (int)(long)status;
 	}
 
+	if (ret == 0)
+		ret = can_virt_ring(&ctx);
+
 	r = can_virt_teardown(&ctx);
 	if (ret == 0)
 		ret = r;
@@ -0,0 +1,374 @@
+/*
+ * Lookup throughput of the copperplate hash tables, which index all
+ * named objects. Tables are filled with an increasing number of
+ * objects, searched for each of them with and without locking, then
+ * drained. The shared table is laid into the main heap when shared
+ * multi-processing is enabled, the private table always lives in
+ * process memory. Last, lockless readers race with threads updating
+ * the same table.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <boilerplate/hash.h>
+#include <copperplate/heapobj.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(hash_lookup,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(max_objects),
+			   SMOKEY_INT(rounds),
+			   SMOKEY_INT(stress),
+			   ),
+		   "Measure lookup throughput of hash tables.\n"
+		   "\tmax_objects=<N>, fill tables with up to N objects (65536)\n"
+		   "\trounds=<N>, number of lookup rounds (10)\n"
+		   "\tstress=<ms>, duration of the concurrency test (500)"
+);
+
+struct test_obj {
+	struct hashobj hobj;
+};
+
+struct test_pvobj {
+	struct pvhashobj hobj;
+};
+
+static const struct hash_operations shared_ops = {
+	.compare = memcmp,
+	.alloc = xnmalloc,
+	.free = xnfree,
+};
+
+static void *pvalloc_segment(size_t size)
+{
+	return malloc(size);
+}
+
+static const struct pvhash_operations private_ops = {
+	.compare = memcmp,
+	.alloc = pvalloc_segment,
+	.free = free,
+};
+
+static char (*names)[16];
+
+static int rounds = 10;
+
+static inline unsigned long long get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *kind, const char *mode, int nr,
+		   unsigned int buckets, unsigned long long ns)
+{
+	smokey_trace("%-7s %-8s %7d objects, %7u buckets, %8.3f Mlookups/s",
+		     kind, mode, nr, buckets,
+		     (double)nr * rounds * 1000.0 / ns);
+}
+
+static int run_shared(int nr)
+{
+	struct hash_table *t;
+	struct test_obj *objs;
+	struct hashobj *hobj;
+	unsigned long long start;
+	int ret = 0, n, r;
+
+	t = xnmalloc(sizeof(*t));
+	objs = xnmalloc(nr * sizeof(*objs));
+	if (t == NULL || objs == NULL) {
+		smokey_note("hash_lookup: no memory for %d shared objects, "
+			    "skipping (see --mem-pool-size)", nr);
+		if (t)
+			xnfree(t);
+		return 0;
+	}
+
+	hash_init(t);
+
+	for (n = 0; n < nr; n++) {
+		ret = hash_enter(t, names[n], strlen(names[n]),
+				 &objs[n].hobj, &shared_ops);
+		if (!__Tassert(ret == 0))
+			goto out;
+	}
+
+	start = get_ns();
+	for (r = 0; r < rounds; r++) {
+		for (n = 0; n < nr; n++) {
+			hobj = hash_search(t, names[n], strlen(names[n]),
+					   &shared_ops);
+			if (!__Tassert(hobj == &objs[n].hobj)) {
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+	report("shared", "locked", nr, hash_get_buckets(t), get_ns() - start);
+
+	start = get_ns();
+	for (r = 0; r < rounds; r++) {
+		for (n = 0; n < nr; n++) {
+			hobj = hash_search_lockless(t, names[n], strlen(names[n]),
+						    &shared_ops);
+			if (!__Tassert(hobj == &objs[n].hobj)) {
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+	report("shared", "lockless", nr, hash_get_buckets(t), get_ns() - start);
+
+	for (n = 0; n < nr; n++) {
+		ret = hash_remove(t, &objs[n].hobj, &shared_ops);
+		if (!__Tassert(ret == 0))
+			goto out;
+	}
+
+	/* Draining the table must bring it back to its initial size. */
+	if (!__Tassert(hash_get_buckets(t) == HASHSLOTS))
+		ret = -EINVAL;
+out:
+	hash_destroy(t);
+	xnfree(objs);
+	xnfree(t);
+
+	return ret;
+}
+
+static int run_private(int nr)
+{
+	struct pvhash_table t;
+	struct test_pvobj *objs;
+	struct pvhashobj *hobj;
+	unsigned long long start;
+	int ret = 0, n, r;
+
+	objs = malloc(nr * sizeof(*objs));
+	if (objs == NULL)
+		return -ENOMEM;
+
+	pvhash_init(&t);
+
+	for (n = 0; n < nr; n++) {
+		ret = pvhash_enter(&t, names[n], strlen(names[n]),
+				   &objs[n].hobj, &private_ops);
+		if (!__Tassert(ret == 0))
+			goto out;
+	}
+
+	start = get_ns();
+	for (r = 0; r < rounds; r++) {
+		for (n = 0; n < nr; n++) {
+			hobj = pvhash_search(&t, names[n], strlen(names[n]),
+					     &private_ops);
+			if (!__Tassert(hobj == &objs[n].hobj)) {
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+	report("private", "locked", nr, pvhash_get_buckets(&t),
+	       get_ns() - start);
+
+	start = get_ns();
+	for (r = 0; r < rounds; r++) {
+		for (n = 0; n < nr; n++) {
+			hobj = pvhash_search_lockless(&t, names[n],
+						      strlen(names[n]),
+						      &private_ops);
+			if (!__Tassert(hobj == &objs[n].hobj)) {
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+	report("private", "lockless", nr, pvhash_get_buckets(&t),
+	       get_ns() - start);
+
+	for (n = 0; n < nr; n++) {
+		ret = pvhash_remove(&t, &objs[n].hobj, &private_ops);
+		if (!__Tassert(ret == 0))
+			goto out;
+	}
+
+	if (!__Tassert(pvhash_get_buckets(&t) == HASHSLOTS))
+		ret = -EINVAL;
+out:
+	free(objs);
+
+	return ret;
+}
+
+#define STRESS_READERS   3
+#define STRESS_WRITERS   2
+#define STRESS_STABLE    512
+#define STRESS_CHURN     4096
+
+/*
+ * Writers keep adding and removing batches of objects, forcing the
+ * table to grow and shrink all along, while readers look for a
+ * stable set of objects which must never go missing, and for the
+ * others which must be either found intact or not at all.
+ */
+static struct pvhash_table stress_table;
+
+static struct test_pvobj *stress_objs;
+
+static volatile int stress_done;
+
+static unsigned long long stress_lookups[STRESS_READERS];
+
+static int stress_errors;
+
+static void *stress_reader(void *arg)
+{
+	unsigned long long count = 0;
+	struct pvhashobj *hobj;
+	long id = (long)arg;
+	int n;
+
+	while (!stress_done) {
+		for (n = 0; n < STRESS_STABLE + STRESS_CHURN; n++) {
+			hobj = pvhash_search_lockless(&stress_table, names[n],
+						      strlen(names[n]),
+						      &private_ops);
+			if (hobj != &stress_objs[n].hobj &&
+			    (n < STRESS_STABLE || hobj != NULL))
+				__sync_fetch_and_add(&stress_errors, 1);
+			count++;
+		}
+	}
+
+	stress_lookups[id] = count;
+
+	return NULL;
+}
+
+static void *stress_writer(void *arg)
+{
+	long id = (long)arg;
+	int n, base;
+
+	/* Each writer owns half of the churning objects. */
+	base = STRESS_STABLE + id * (STRESS_CHURN / STRESS_WRITERS);
+
+	while (!stress_done) {
+		for (n = base; n < base + STRESS_CHURN / STRESS_WRITERS; n++)
+			pvhash_enter(&stress_table, names[n], strlen(names[n]),
+				     &stress_objs[n].hobj, &private_ops);
+		for (n = base; n < base + STRESS_CHURN / STRESS_WRITERS; n++)
+			pvhash_remove(&stress_table, &stress_objs[n].hobj,
+				      &private_ops);
+	}
+
+	return NULL;
+}
+
+static int run_stress(int duration_ms)
+{
+	pthread_t readers[STRESS_READERS], writers[STRESS_WRITERS];
+	struct timespec delay;
+	unsigned long long sum = 0;
+	long n;
+	int ret;
+
+	stress_objs = malloc((STRESS_STABLE + STRESS_CHURN) *
+			     sizeof(*stress_objs));
+	if (stress_objs == NULL)
+		return -ENOMEM;
+
+	pvhash_init(&stress_table);
+
+	for (n = 0; n < STRESS_STABLE; n++) {
+		ret = pvhash_enter(&stress_table, names[n], strlen(names[n]),
+				   &stress_objs[n].hobj, &private_ops);
+		if (!__Tassert(ret == 0))
+			goto out;
+	}
+
+	stress_done = 0;
+	for (n = 0; n < STRESS_READERS; n++)
+		pthread_create(&readers[n], NULL, stress_reader, (void *)n);
+	for (n = 0; n < STRESS_WRITERS; n++)
+		pthread_create(&writers[n], NULL, stress_writer, (void *)n);
+
+	delay.tv_sec = duration_ms / 1000;
+	delay.tv_nsec = (duration_ms % 1000) * 1000000;
+	nanosleep(&delay, NULL);
+	stress_done = 1;
+
+	for (n = 0; n < STRESS_WRITERS; n++)
+		pthread_join(writers[n], NULL);
+	for (n = 0; n < STRESS_READERS; n++) {
+		pthread_join(readers[n], NULL);
+		sum += stress_lookups[n];
+	}
+
+	smokey_trace("stress   %d readers, %d writers, %llu lookups, %d errors",
+		     STRESS_READERS, STRESS_WRITERS, sum, stress_errors);
+
+	ret = __Tassert(stress_errors == 0) ? 0 : -EINVAL;
+out:
+	free(stress_objs);
+
+	return ret;
+}
+
+static int run_hash_lookup(struct smokey_test *t, int argc, char *const argv[])
+{
+	int max_objects = 65536, stress = 500, ret = 0, nr, n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(hash_lookup, max_objects))
+		max_objects = SMOKEY_ARG_INT(hash_lookup, max_objects);
+
+	if (SMOKEY_ARG_ISSET(hash_lookup, rounds))
+		rounds = SMOKEY_ARG_INT(hash_lookup, rounds);
+
+	if (SMOKEY_ARG_ISSET(hash_lookup, stress))
+		stress = SMOKEY_ARG_INT(hash_lookup, stress);
+
+	if (max_objects <= 0 || rounds <= 0)
+		return -EINVAL;
+
+	/* The concurrency test needs its own set of names. */
+	n = max_objects;
+	if (n < STRESS_STABLE + STRESS_CHURN)
+		n = STRESS_STABLE + STRESS_CHURN;
+
+	names = malloc(n * sizeof(*names));
+	if (names == NULL)
+		return -ENOMEM;
+
+	while (--n >= 0)
+		snprintf(names[n], sizeof(names[n]), "obj-%d", n);
+
+	for (nr = 16; nr <= max_objects; nr *= 4) {
+		ret = run_private(nr);
+		if (ret)
+			break;
+		ret = run_shared(nr);
+		if (ret)
+			break;
+	}
+
+	if (ret == 0 && stress > 0)
+		ret = run_stress(stress);
+
+	free(names);
+
+	return ret;
+}
@@ -13,6 +13,9 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
 #include <smokey/smokey.h>
 #include <rtdm/ipc.h>
 
@@ -23,6 +26,11 @@ smokey_test_plugin(iddp,
 
 #define IDDP_SVPORT 12
 #define IDDP_CLPORT 13
+#define IDDP_RGPORT 14
+#define IDDP_BTPORT 15
+
+#define BATCH_MAX   64
+#define BATCH_MSGS  16384
 
 static pthread_t svtid, cltid;
 
@@ -136,12 +144,221 @@ static void *client(void *arg)
 	return NULL;
 }
 
+static void *slot_data(void *mem, unsigned int slot)
+{
+	struct iddp_ring_header *hdr = mem;
+
+	return mem + hdr->data_offset + slot * hdr->slot_size;
+}
+
+static int check_ring(void)
+{
+	struct iddp_ring_config rcfg = { .nr_slots = 8, .slot_size = 100 };
+	struct sockaddr_ipc saddr;
+	struct iddp_ring_desc desc;
+	struct iddp_ring_header *hdr;
+	void *svmem, *clmem;
+	int ret, sv, cl, n;
+	socklen_t len;
+	long data;
+
+	sv = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (sv < 0)
+		fail("socket");
+
+	ret = setsockopt(sv, SOL_IDDP, IDDP_RING, &rcfg, sizeof(rcfg));
+	if (ret)
+		fail("setsockopt");
+
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = IDDP_RGPORT;
+	ret = bind(sv, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("bind");
+
+	len = sizeof(rcfg);
+	ret = getsockopt(sv, SOL_IDDP, IDDP_RING, &rcfg, &len);
+	if (ret)
+		fail("getsockopt");
+
+	svmem = mmap(NULL, rcfg.map_size, PROT_READ|PROT_WRITE,
+		     MAP_SHARED, sv, 0);
+	if (svmem == MAP_FAILED)
+		fail("mmap");
+
+	hdr = svmem;
+	if (hdr->nr_slots != 8 || hdr->slot_size < 100) {
+		smokey_warning("bad ring geometry");
+		return -EINVAL;
+	}
+
+	cl = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (cl < 0)
+		fail("socket");
+
+	ret = connect(cl, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("connect");
+
+	/* The sender maps the ring of the receiver. */
+	clmem = mmap(NULL, rcfg.map_size, PROT_READ|PROT_WRITE,
+		     MAP_SHARED, cl, 0);
+	if (clmem == MAP_FAILED)
+		fail("mmap");
+
+	/* Fill up the ring in place. */
+	for (n = 0; n < 8; n++) {
+		desc.flags = MSG_DONTWAIT;
+		ret = ioctl(cl, IDDP_RTIOC_RESERVE, &desc);
+		if (ret)
+			fail("reserve");
+		data = n;
+		memcpy(slot_data(clmem, desc.slot), &data, sizeof(data));
+		desc.len = sizeof(data);
+		desc.flags = 0;
+		ret = ioctl(cl, IDDP_RTIOC_COMMIT, &desc);
+		if (ret)
+			fail("commit");
+	}
+
+	desc.flags = MSG_DONTWAIT;
+	ret = ioctl(cl, IDDP_RTIOC_RESERVE, &desc);
+	if (ret == 0 || errno != EAGAIN) {
+		smokey_warning("ring overflow not detected");
+		return -EINVAL;
+	}
+
+	/* Consume datagrams in place, in FIFO order. */
+	for (n = 0; n < 8; n++) {
+		desc.flags = MSG_DONTWAIT;
+		ret = ioctl(sv, IDDP_RTIOC_RECEIVE, &desc);
+		if (ret)
+			fail("receive");
+		memcpy(&data, slot_data(svmem, desc.slot) + desc.offset,
+		       sizeof(data));
+		if (desc.len != sizeof(data) || data != n) {
+			smokey_warning("data does not match control value");
+			return -EINVAL;
+		}
+		ret = ioctl(sv, IDDP_RTIOC_RELEASE, &desc);
+		if (ret)
+			fail("release");
+	}
+
+	/* Regular calls still work, copying data through the ring. */
+	data = 42;
+	ret = send(cl, &data, sizeof(data), 0);
+	if (ret != sizeof(data))
+		fail("send");
+
+	data = 0;
+	ret = recv(sv, &data, sizeof(data), MSG_DONTWAIT);
+	if (ret != sizeof(data) || data != 42) {
+		smokey_warning("data does not match control value");
+		return -EINVAL;
+	}
+
+	smokey_trace("%s: %d datagrams conveyed in place", __func__, n);
+
+	munmap(clmem, rcfg.map_size);
+	munmap(svmem, rcfg.map_size);
+	close(cl);
+	close(sv);
+
+	return 0;
+}
+
+static void setup_batch(struct mmsghdr *msgv, struct iovec *iov,
+			long *data, int nr)
+{
+	int n;
+
+	/* The I/O vectors are updated by each transfer. */
+	memset(msgv, 0, nr * sizeof(*msgv));
+	for (n = 0; n < nr; n++) {
+		iov[n].iov_base = &data[n];
+		iov[n].iov_len = sizeof(data[n]);
+		msgv[n].msg_hdr.msg_iov = &iov[n];
+		msgv[n].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+static int check_batching(void)
+{
+	static const int batch_sizes[] = { 1, 8, 64 };
+	struct mmsghdr svmsg[BATCH_MAX], clmsg[BATCH_MAX];
+	struct iovec sviov[BATCH_MAX], cliov[BATCH_MAX];
+	long svdata[BATCH_MAX], cldata[BATCH_MAX];
+	int ret, sv, cl, n, b, batch, count;
+	struct sockaddr_ipc saddr;
+	struct timespec start, end;
+	unsigned long long ns;
+	size_t poolsz;
+
+	sv = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (sv < 0)
+		fail("socket");
+
+	poolsz = 32768; /* bytes */
+	ret = setsockopt(sv, SOL_IDDP, IDDP_POOLSZ, &poolsz, sizeof(poolsz));
+	if (ret)
+		fail("setsockopt");
+
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = IDDP_BTPORT;
+	ret = bind(sv, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("bind");
+
+	cl = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (cl < 0)
+		fail("socket");
+
+	ret = connect(cl, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("connect");
+
+	for (b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+		batch = batch_sizes[b];
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (count = 0; count < BATCH_MSGS; count += batch) {
+			setup_batch(clmsg, cliov, cldata, batch);
+			for (n = 0; n < batch; n++)
+				cldata[n] = count + n;
+			ret = sendmmsg(cl, clmsg, batch, 0);
+			if (ret != batch)
+				fail("sendmmsg");
+			setup_batch(svmsg, sviov, svdata, batch);
+			ret = recvmmsg(sv, svmsg, batch, MSG_DONTWAIT, NULL);
+			if (ret != batch)
+				fail("recvmmsg");
+			for (n = 0; n < batch; n++) {
+				if (svmsg[n].msg_len != sizeof(long) ||
+				    svdata[n] != count + n) {
+					smokey_warning("data does not match control value");
+					return -EINVAL;
+				}
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+			end.tv_nsec - start.tv_nsec;
+		smokey_trace("%s: batch size %2d, %10.0f msgs/s",
+			     __func__, batch, (double)count * 1e9 / ns);
+	}
+
+	close(cl);
+	close(sv);
+
+	return 0;
+}
+
 static int run_iddp(struct smokey_test *t, int argc, char *const argv[])
 {
 	struct sched_param svparam = {.sched_priority = 71 };
 	struct sched_param clparam = {.sched_priority = 70 };
 	pthread_attr_t svattr, clattr;
-	int s;
+	int s, ret;
 
 	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
 	if (s < 0) {
@@ -174,5 +391,9 @@ static int run_iddp(struct smokey_test *t, int argc, char *const argv[])
 	pthread_cancel(svtid);
 	pthread_join(svtid, NULL);
 
-	return 0;
+	ret = check_ring();
+	if (ret)
+		return ret;
+
+	return check_batching();
 }
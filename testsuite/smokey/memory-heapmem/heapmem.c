@@ -3,6 +3,12 @@
  *
  * SPDX-License-Identifier: MIT
  */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
 #include <boilerplate/heapmem.h>
 #include "memcheck/memcheck.h"
 
@@ -19,6 +25,17 @@ smokey_test_plugin(memory_heapmem,
 #define PATTERN_HEAP_SIZE  (128*1024)
 #define PATTERN_ROUNDS     128
 
+#define MT_HEAP_SIZE     (1024 * 1024)
+#define MT_MAX_THREADS   4
+#define MT_BATCH         16
+#define MT_LOOPS         20000
+
+#define BULK_HEAP_SIZE   (64 * 1024)
+#define BULK_BLOCKS      256
+
+#define STAT_HEAP_SIZE   (64 * 1024)
+#define STAT_BLOCKS      8
+
 static struct heap_memory heap;
 
 static size_t get_arena_size(size_t heap_size)
@@ -44,8 +61,283 @@ static struct memcheck_descriptor heapmem_descriptor = {
 	.valid_flags = MEMCHECK_ALL_FLAGS,
 };
 
+static struct heap_memory mt_heap;
+
+static void *mt_worker(void *arg)
+{
+	void *blocks[MT_BATCH];
+	int loop, n;
+
+	/*
+	 * Allocate then release small blocks of mixed sizes in
+	 * batches, which is what most xnmalloc() callers do.
+	 */
+	for (loop = 0; loop < MT_LOOPS; loop++) {
+		for (n = 0; n < MT_BATCH; n++) {
+			blocks[n] = heapmem_alloc(&mt_heap, 16 << (n % 5));
+			if (blocks[n] == NULL)
+				return (void *)-1L;
+		}
+		for (n = 0; n < MT_BATCH; n++)
+			heapmem_free(&mt_heap, blocks[n]);
+	}
+
+	return NULL;
+}
+
+static int run_mt_round(int nrthreads, bool cached)
+{
+	pthread_t threads[MT_MAX_THREADS];
+	struct timespec start, end;
+	int ret = 0, n, failed = 0;
+	void *mem, *status;
+	double ns;
+
+	mem = malloc(HEAPMEM_ARENA_SIZE(MT_HEAP_SIZE));
+	if (mem == NULL)
+		return -ENOMEM;
+
+	ret = heapmem_init(&mt_heap, mem, HEAPMEM_ARENA_SIZE(MT_HEAP_SIZE));
+	if (ret)
+		goto out;
+
+	if (cached)
+		heapmem_enable_magazines(&mt_heap);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < nrthreads; n++) {
+		ret = -pthread_create(threads + n, NULL, mt_worker, NULL);
+		if (ret)
+			break;
+	}
+
+	while (--n >= 0) {
+		pthread_join(threads[n], &status);
+		if (status)
+			failed++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (ret)
+		goto destroy;
+
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	smokey_trace("%-8s %d thread(s): %7.3f Mops/s",
+		     cached ? "cached" : "uncached", nrthreads,
+		     2.0 * nrthreads * MT_LOOPS * MT_BATCH * 1000.0 / ns);
+
+	/* Exiting threads must have returned their magazines. */
+	if (!__Tassert(failed == 0) ||
+	    !__Tassert(heapmem_used_size(&mt_heap) == 0))
+		ret = -EINVAL;
+destroy:
+	heapmem_destroy(&mt_heap);
+out:
+	free(mem);
+
+	return ret;
+}
+
+static int run_bulk_check(void)
+{
+	void *blocks[BULK_BLOCKS], *mem;
+	int ret, n, nr;
+
+	mem = malloc(HEAPMEM_ARENA_SIZE(BULK_HEAP_SIZE));
+	if (mem == NULL)
+		return -ENOMEM;
+
+	ret = heapmem_init(&mt_heap, mem, HEAPMEM_ARENA_SIZE(BULK_HEAP_SIZE));
+	if (ret)
+		goto out;
+
+	/* Ask for more than available, we should get a partial batch. */
+	nr = heapmem_alloc_bulk(&mt_heap, 512, blocks, BULK_BLOCKS);
+	if (!__Tassert(nr > 0 && nr < BULK_BLOCKS) ||
+	    !__Tassert(heapmem_used_size(&mt_heap) == nr * 512)) {
+		ret = -EINVAL;
+		goto destroy;
+	}
+
+	for (n = 0; n < nr; n++)
+		memset(blocks[n], n, 512);
+
+	for (n = 0; n < nr; n++) {
+		if (!__Tassert(*(unsigned char *)blocks[n] == (unsigned char)n &&
+			       heapmem_check(&mt_heap, blocks[n]) == 512)) {
+			ret = -EINVAL;
+			goto destroy;
+		}
+	}
+
+	ret = heapmem_free_bulk(&mt_heap, blocks, nr);
+	if (!__Tassert(ret == 0) ||
+	    !__Tassert(heapmem_used_size(&mt_heap) == 0))
+		ret = -EINVAL;
+destroy:
+	heapmem_destroy(&mt_heap);
+out:
+	free(mem);
+
+	return ret;
+}
+
+static int run_badfree_check(void)
+{
+	void *block, *pin, *mem;
+	int ret;
+
+	mem = malloc(HEAPMEM_ARENA_SIZE(BULK_HEAP_SIZE));
+	if (mem == NULL)
+		return -ENOMEM;
+
+	ret = heapmem_init(&mt_heap, mem, HEAPMEM_ARENA_SIZE(BULK_HEAP_SIZE));
+	if (ret)
+		goto out;
+
+	heapmem_enable_magazines(&mt_heap);
+
+	/* Keep the bucket page busy once the block is released. */
+	pin = heapmem_alloc(&mt_heap, 64);
+	block = heapmem_alloc(&mt_heap, 64);
+	if (!__Tassert(pin != NULL && block != NULL)) {
+		ret = -ENOMEM;
+		goto destroy;
+	}
+
+	/*
+	 * Double frees must be caught whether the block is still
+	 * parked in our magazine, or went back to the heap already.
+	 */
+	if (!__Tassert(heapmem_free(&mt_heap, block) == 0) ||
+	    !__Tassert(heapmem_free(&mt_heap, block) == -EINVAL) ||
+	    !__Tassert(heapmem_free(&mt_heap, (char *)pin + 1) == -EINVAL)) {
+		ret = -EINVAL;
+		goto destroy;
+	}
+
+	heapmem_flush_magazines(&mt_heap);
+
+	if (!__Tassert(heapmem_free(&mt_heap, block) == -EINVAL) ||
+	    !__Tassert(heapmem_free(&mt_heap, pin) == 0))
+		ret = -EINVAL;
+destroy:
+	heapmem_destroy(&mt_heap);
+out:
+	free(mem);
+
+	return ret;
+}
+
+static int run_stat_check(void)
+{
+	void *blocks[STAT_BLOCKS], *large, *mem;
+	struct heapmem_stats stats;
+	int ret, n;
+
+	mem = malloc(HEAPMEM_ARENA_SIZE(STAT_HEAP_SIZE));
+	if (mem == NULL)
+		return -ENOMEM;
+
+	ret = heapmem_init(&mt_heap, mem, HEAPMEM_ARENA_SIZE(STAT_HEAP_SIZE));
+	if (ret)
+		goto out;
+
+	/* A fresh heap is a single range of free pages. */
+	heapmem_stat(&mt_heap, &stats);
+	if (!__Tassert(stats.free_ranges == 1 &&
+		       stats.free_size == stats.usable_size &&
+		       stats.largest_free == stats.usable_size)) {
+		ret = -EINVAL;
+		goto destroy;
+	}
+
+	for (n = 0; n < STAT_BLOCKS; n++)
+		blocks[n] = heapmem_alloc(&mt_heap, HEAPMEM_MIN_ALIGN);
+
+	large = heapmem_alloc(&mt_heap, HEAPMEM_PAGE_SIZE * 2);
+
+	/* Trigger one failure of each kind. */
+	if (!__Tassert(heapmem_alloc(&mt_heap, STAT_HEAP_SIZE * 2) == NULL) ||
+	    !__Tassert(heapmem_free(&mt_heap, &stats) == -EINVAL)) {
+		ret = -EINVAL;
+		goto destroy;
+	}
+
+	heapmem_stat(&mt_heap, &stats);
+	smokey_trace("heapmem stats: used=%zu free=%zu largest=%zu ranges=%u",
+		     stats.used_size, stats.free_size, stats.largest_free,
+		     stats.free_ranges);
+	if (!__Tassert(stats.used_size == STAT_BLOCKS * HEAPMEM_MIN_ALIGN +
+		       HEAPMEM_PAGE_SIZE * 2) ||
+	    !__Tassert(stats.free_size == stats.usable_size -
+		       HEAPMEM_PAGE_SIZE * 3) ||
+	    !__Tassert(stats.bucket_pages[0] == 1 &&
+		       stats.bucket_blocks[0] == STAT_BLOCKS) ||
+	    !__Tassert(stats.nomem_count == 1 && stats.badfree_count == 1)) {
+		ret = -EINVAL;
+		goto destroy;
+	}
+
+	heapmem_free(&mt_heap, large);
+	for (n = 0; n < STAT_BLOCKS; n++)
+		heapmem_free(&mt_heap, blocks[n]);
+
+	/* Released pages must have been merged back. */
+	heapmem_stat(&mt_heap, &stats);
+	if (!__Tassert(stats.used_size == 0 && stats.free_ranges == 1 &&
+		       stats.bucket_pages[0] == 0))
+		ret = -EINVAL;
+destroy:
+	heapmem_destroy(&mt_heap);
+out:
+	free(mem);
+
+	return ret;
+}
+
 static int run_memory_heapmem(struct smokey_test *t,
 			      int argc, char *const argv[])
 {
-	return memcheck_run(&heapmem_descriptor, t, argc, argv);
+	cpu_set_t affinity;
+	int ret, nrthreads;
+
+	sched_getaffinity(0, sizeof(affinity), &affinity);
+
+	ret = memcheck_run(&heapmem_descriptor, t, argc, argv);
+	if (ret)
+		return ret;
+
+	ret = run_bulk_check();
+	if (ret)
+		return ret;
+
+	ret = run_badfree_check();
+	if (ret)
+		return ret;
+
+	ret = run_stat_check();
+	if (ret)
+		return ret;
+
+	/*
+	 * memcheck_run() pinned us to CPU0, let the contention test
+	 * threads spread over the CPUs we had initially.
+	 */
+	sched_setaffinity(0, sizeof(affinity), &affinity);
+
+	smokey_trace("== heapmem multi-threaded alloc/free throughput");
+
+	for (nrthreads = 1; nrthreads <= MT_MAX_THREADS; nrthreads *= 2) {
+		ret = run_mt_round(nrthreads, false);
+		if (ret)
+			break;
+		ret = run_mt_round(nrthreads, true);
+		if (ret)
+			break;
+	}
+
+	return ret;
 }
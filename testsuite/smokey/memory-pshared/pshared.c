@@ -21,6 +21,9 @@ smokey_test_plugin(memory_pshared,
 #define PATTERN_HEAP_SIZE  (128*1024)
 #define PATTERN_ROUNDS     128
 
+#define STAT_HEAP_SIZE     (64 * 1024)
+#define STAT_BLOCKS        8
+
 static struct heapobj heap;
 
 static int do_pshared_init(void *heap, void *mem, size_t arena_size)
@@ -96,10 +99,72 @@ static struct memcheck_descriptor pshared_descriptor = {
 	.heap = &heap,
 };
 
+static int run_stat_check(void)
+{
+	void *blocks[STAT_BLOCKS], *large;
+	struct heapobj_stats stats;
+	struct heapobj h;
+	int ret, n;
+
+	ret = heapobj_init(&h, "memstat", STAT_HEAP_SIZE);
+	if (ret)
+		return ret;
+
+	heapobj_stat(&h, &stats);
+	if (!__Tassert(stats.free_ranges == 1 &&
+		       stats.largest_free == stats.usable_size)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (n = 0; n < STAT_BLOCKS; n++)
+		blocks[n] = heapobj_alloc(&h, 16);
+
+	large = heapobj_alloc(&h, STAT_HEAP_SIZE / 4);
+
+	/* Trigger one failure of each kind. */
+	heapobj_free(&h, &stats);
+	if (!__Tassert(heapobj_alloc(&h, STAT_HEAP_SIZE * 2) == NULL)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	heapobj_stat(&h, &stats);
+	smokey_trace("pshared stats: used=%zu free=%zu largest=%zu ranges=%u",
+		     stats.used_size, stats.free_size, stats.largest_free,
+		     stats.free_ranges);
+	if (!__Tassert(stats.used_size == STAT_BLOCKS * 16 + STAT_HEAP_SIZE / 4) ||
+	    !__Tassert(stats.nr_buckets > 0 && stats.buckets[0].bsize == 16 &&
+		       stats.buckets[0].pages == 1 &&
+		       stats.buckets[0].busy == STAT_BLOCKS) ||
+	    !__Tassert(stats.nomem_count == 1 && stats.badfree_count == 1)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	heapobj_free(&h, large);
+	for (n = 0; n < STAT_BLOCKS; n++)
+		heapobj_free(&h, blocks[n]);
+
+	heapobj_stat(&h, &stats);
+	if (!__Tassert(stats.used_size == 0 && stats.free_ranges == 1))
+		ret = -EINVAL;
+out:
+	heapobj_destroy(&h);
+
+	return ret;
+}
+
 static int run_memory_pshared(struct smokey_test *t,
 			      int argc, char *const argv[])
 {
-	return memcheck_run(&pshared_descriptor, t, argc, argv);
+	int ret;
+
+	ret = memcheck_run(&pshared_descriptor, t, argc, argv);
+	if (ret)
+		return ret;
+
+	return run_stat_check();
 }
 
 static int memcheck_pshared_tune(void)
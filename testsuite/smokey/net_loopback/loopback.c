@@ -0,0 +1,229 @@
+/*
+ * RTnet loopback receive path throughput
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+
+#include <sys/cobalt.h>
+#include <rtdm/net.h>
+#include <smokey/smokey.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_loopback,
+	SMOKEY_ARGLIST(
+		SMOKEY_INT(rtnet_taps),
+		SMOKEY_INT(rtnet_duration),
+	),
+	"Measure the RTnet receive path throughput in frames per second,\n"
+	"\tsending raw packets to a packet socket over the loopback device,\n"
+	"\tthe rtnet_taps parameter allows choosing the number of ETH_P_ALL\n"
+	"\tpacket sockets receiving a copy of each frame (default: 0, then 4),\n"
+	"\tthe rtnet_duration parameter allows choosing the duration of each\n"
+	"\trun in seconds (default: 1)."
+);
+
+#define LOOPBACK_PROTO	(ETH_P_802_EX1 + 2)
+#define MAX_TAPS	16
+#define BATCH		64
+#define RX_TIMEOUT	1000000000LL /* ns */
+
+struct loopback_frame {
+	struct ethhdr header;
+	char payload[ETH_ZLEN - ETH_HLEN];
+};
+
+static int open_socket(int ifindex, int proto)
+{
+	int64_t timeout = RX_TIMEOUT;
+	struct sockaddr_ll sll;
+	int sock, err;
+
+	sock = __RT(socket(PF_PACKET, SOCK_RAW, htons(proto)));
+	if (sock < 0)
+		return -errno;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(proto);
+	sll.sll_ifindex = ifindex;
+
+	err = smokey_check_errno(
+		__RT(bind(sock, (struct sockaddr *)&sll, sizeof(sll))));
+	if (err < 0)
+		goto fail;
+
+	/*
+	 * Loopback frames are received asynchronously by the stack
+	 * manager, wait for them instead of polling, but do not hang
+	 * if one gets lost.
+	 */
+	err = smokey_check_errno(
+		__RT(ioctl(sock, RTNET_RTIOC_TIMEOUT, &timeout)));
+	if (err < 0)
+		goto fail;
+
+	return sock;
+fail:
+	__RT(close(sock));
+
+	return err;
+}
+
+static int get_ifindex(const char *intf)
+{
+	struct ifreq ifr;
+	int sock, err;
+
+	sock = smokey_check_errno(
+		__RT(socket(PF_PACKET, SOCK_DGRAM, 0)));
+	if (sock < 0)
+		return sock;
+
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", intf);
+	err = smokey_check_errno(__RT(ioctl(sock, SIOCGIFINDEX, &ifr)));
+	__RT(close(sock));
+
+	return err < 0 ? err : ifr.ifr_ifindex;
+}
+
+static int run_rate(int ifindex, int nrtaps, int duration)
+{
+	struct loopback_frame frame, buf;
+	unsigned long long frames = 0;
+	struct timespec start, now;
+	int sock, taps[MAX_TAPS];
+	int n, k, i, ret, err = 0;
+	long long elapsed;
+
+	sock = open_socket(ifindex, LOOPBACK_PROTO);
+	if (sock < 0)
+		return sock;
+
+	for (n = 0; n < nrtaps; n++) {
+		taps[n] = open_socket(ifindex, ETH_P_ALL);
+		if (taps[n] == -EINVAL) {
+			smokey_note("net_loopback: ETH_P_ALL not supported "
+				    "(CONFIG_XENO_DRIVERS_NET_ETH_P_ALL)");
+			err = -ENOSYS;
+			goto out;
+		}
+		if (taps[n] < 0) {
+			err = taps[n];
+			goto out;
+		}
+	}
+
+	memset(&frame, 0, sizeof(frame));
+	frame.header.h_proto = htons(LOOPBACK_PROTO);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	do {
+		for (k = 0; k < BATCH; k++) {
+			ret = smokey_check_errno(
+				__RT(send(sock, &frame, sizeof(frame), 0)));
+			if (ret < 0) {
+				err = ret;
+				goto out;
+			}
+			ret = smokey_check_errno(
+				__RT(recv(sock, &buf, sizeof(buf), 0)));
+			if (ret < 0) {
+				err = ret;
+				goto out;
+			}
+			for (i = 0; i < nrtaps; i++) {
+				ret = smokey_check_errno(
+					__RT(recv(taps[i], &buf,
+						  sizeof(buf), 0)));
+				if (ret < 0) {
+					err = ret;
+					goto out;
+				}
+			}
+		}
+		frames += BATCH;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - start.tv_sec) * 1000000000LL +
+			now.tv_nsec - start.tv_nsec;
+	} while (elapsed < duration * 1000000000LL);
+
+	smokey_trace("%2d ETH_P_ALL tap(s): %llu frames/s",
+		     nrtaps, frames * 1000000000ULL / elapsed);
+out:
+	while (--n >= 0)
+		__RT(close(taps[n]));
+
+	__RT(close(sock));
+
+	return err;
+}
+
+static int run_net_loopback(struct smokey_test *t,
+			    int argc, char *const argv[])
+{
+	static const int default_taps[] = { 0, 4 };
+	const char *driver = "rt_loopback", *intf = "rtlo";
+	int ifindex, duration = 1, taps = -1, n, err, tmp;
+	struct sockaddr peer = { .sa_family = AF_UNSPEC };
+	struct sched_param param;
+
+	if (SMOKEY_ARG_ISSET(net_loopback, rtnet_taps))
+		taps = SMOKEY_ARG_INT(net_loopback, rtnet_taps);
+	if (taps > MAX_TAPS)
+		taps = MAX_TAPS;
+
+	if (SMOKEY_ARG_ISSET(net_loopback, rtnet_duration))
+		duration = SMOKEY_ARG_INT(net_loopback, rtnet_duration);
+	if (duration <= 0)
+		duration = 1;
+
+	err = smokey_net_setup(driver, intf, _CC_COBALT_NET_AF_PACKET, &peer);
+	if (err < 0)
+		return err;
+
+	ifindex = get_ifindex(intf);
+	if (ifindex < 0) {
+		err = ifindex;
+		goto out;
+	}
+
+	param.sched_priority = 1;
+	err = smokey_check_status(
+		pthread_setschedparam(pthread_self(), SCHED_FIFO, &param));
+	if (err < 0)
+		goto out;
+
+	if (taps >= 0)
+		err = run_rate(ifindex, taps, duration);
+	else {
+		for (n = 0; n < sizeof(default_taps) / sizeof(default_taps[0]);
+		     n++) {
+			err = run_rate(ifindex, default_taps[n], duration);
+			if (err)
+				break;
+		}
+	}
+
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+out:
+	tmp = smokey_net_teardown(driver, intf, _CC_COBALT_NET_AF_PACKET);
+	if (err == 0)
+		err = tmp;
+
+	return err;
+}
@@ -0,0 +1,374 @@
+/*
+ * Cobalt message queue test. The lockless single-producer,
+ * single-consumer mode is checked first, then the throughput of
+ * independent queue pairs running in parallel on distinct CPUs is
+ * measured for the regular and SPSC modes, so that contention on
+ * shared core locks shows up as a drop of the aggregate rate.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <pthread.h>
+#include <sched.h>
+#include <boilerplate/ancillaries.h>
+#include <boilerplate/time.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(posix_mqueue,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(cpus),
+			   SMOKEY_INT(loops),
+			   ),
+		   "Check POSIX message queues, measure their scalability.\n"
+		   "\tcpus=<N>, run one queue pair on each of N CPUs (all)\n"
+		   "\tloops=<N>, messages sent through each pair (100000)"
+);
+
+#define MQ_SPSC_NAME	"/smokey-mq-spsc"
+#define MQ_MAXMSG	64
+
+struct mq_pair {
+	char name[32];
+	int cpu;
+	long loops;
+	mqd_t txq, rxq;
+	pthread_t sender, receiver;
+	struct timespec start, end;
+	int status;
+};
+
+static struct smokey_barrier start_barrier;
+
+static int check_spsc(void)
+{
+	struct mq_attr attr = {
+		.mq_flags = MQ_SPSC,
+		.mq_maxmsg = 4,
+		.mq_msgsize = sizeof(long),
+	};
+	mqd_t txq, rxq, q;
+	unsigned int prio;
+	long data;
+	int ret, n;
+
+	mq_unlink(MQ_SPSC_NAME);
+
+	txq = mq_open(MQ_SPSC_NAME, O_CREAT | O_EXCL | O_WRONLY, 0600, &attr);
+	if (txq == (mqd_t)-1)
+		return smokey_check_errno(-1);
+
+	ret = -EINVAL;
+
+	/* There may be only one sender and one receiver. */
+	q = mq_open(MQ_SPSC_NAME, O_WRONLY);
+	if (!__Tassert(q == (mqd_t)-1 && errno == EBUSY))
+		goto close_tx;
+
+	rxq = mq_open(MQ_SPSC_NAME, O_RDONLY | O_NONBLOCK);
+	if (rxq == (mqd_t)-1) {
+		ret = smokey_check_errno(-1);
+		goto close_tx;
+	}
+
+	q = mq_open(MQ_SPSC_NAME, O_RDWR);
+	if (!__Tassert(q == (mqd_t)-1 && errno == EBUSY))
+		goto close_rx;
+
+	if (!__Terrno(ret, mq_getattr(rxq, &attr)))
+		goto close_rx;
+	ret = -EINVAL;
+	if (!__Tassert(attr.mq_flags & MQ_SPSC))
+		goto close_rx;
+
+	/* FIFO order, regardless of priority. */
+	for (data = 0; data < 4; data++) {
+		if (!__Terrno(ret, mq_send(txq, (char *)&data,
+					   sizeof(data), data)))
+			goto close_rx;
+	}
+
+	if (!__Terrno(ret, mq_getattr(txq, &attr)))
+		goto close_rx;
+	ret = -EINVAL;
+	if (!__Tassert(attr.mq_curmsgs == 4))
+		goto close_rx;
+
+	for (n = 0; n < 4; n++) {
+		ret = smokey_check_errno(mq_receive(rxq, (char *)&data,
+						    sizeof(data), &prio));
+		if (ret < 0)
+			goto close_rx;
+		ret = -EINVAL;
+		if (!__Tassert(data == n && prio == n))
+			goto close_rx;
+	}
+
+	ret = mq_receive(rxq, (char *)&data, sizeof(data), NULL);
+	if (!__Tassert(ret == -1 && errno == EAGAIN)) {
+		ret = -EINVAL;
+		goto close_rx;
+	}
+
+	ret = 0;
+close_rx:
+	mq_close(rxq);
+close_tx:
+	mq_close(txq);
+	mq_unlink(MQ_SPSC_NAME);
+
+	return ret;
+}
+
+static int pin_thread(int cpu)
+{
+	cpu_set_t affinity;
+
+	CPU_ZERO(&affinity);
+	CPU_SET(cpu, &affinity);
+
+	return -pthread_setaffinity_np(pthread_self(),
+				       sizeof(affinity), &affinity);
+}
+
+static void *sender(void *arg)
+{
+	struct mq_pair *p = arg;
+	long n;
+	int ret;
+
+	ret = pin_thread(p->cpu);
+	if (ret) {
+		p->status = ret;
+		return NULL;
+	}
+
+	smokey_barrier_wait(&start_barrier);
+
+	clock_gettime(CLOCK_MONOTONIC, &p->start);
+
+	for (n = 0; n < p->loops; n++) {
+		ret = mq_send(p->txq, (char *)&n, sizeof(n), 0);
+		if (ret) {
+			p->status = -errno;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *receiver(void *arg)
+{
+	struct mq_pair *p = arg;
+	long n, data;
+	ssize_t ret;
+
+	ret = pin_thread(p->cpu);
+	if (ret) {
+		p->status = ret;
+		return NULL;
+	}
+
+	smokey_barrier_wait(&start_barrier);
+
+	for (n = 0; n < p->loops; n++) {
+		ret = mq_receive(p->rxq, (char *)&data, sizeof(data), NULL);
+		if (ret < 0) {
+			p->status = -errno;
+			break;
+		}
+		if (data != n) {
+			p->status = -EPROTO;
+			break;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &p->end);
+
+	return NULL;
+}
+
+static int open_pair(struct mq_pair *p, long flags)
+{
+	struct mq_attr attr = {
+		.mq_flags = flags,
+		.mq_maxmsg = MQ_MAXMSG,
+		.mq_msgsize = sizeof(long),
+	};
+
+	snprintf(p->name, sizeof(p->name), "/smokey-mq-%d", p->cpu);
+	mq_unlink(p->name);
+
+	p->txq = mq_open(p->name, O_CREAT | O_EXCL | O_WRONLY, 0600, &attr);
+	if (p->txq == (mqd_t)-1)
+		return -errno;
+
+	p->rxq = mq_open(p->name, O_RDONLY);
+	if (p->rxq == (mqd_t)-1) {
+		mq_close(p->txq);
+		mq_unlink(p->name);
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void close_pair(struct mq_pair *p)
+{
+	mq_close(p->rxq);
+	mq_close(p->txq);
+	mq_unlink(p->name);
+}
+
+static int run_pairs(struct mq_pair *pairs, int nr_pairs, long flags)
+{
+	struct sched_param param = { .sched_priority = 10 };
+	double rate, total = 0.0, lowest = 0.0;
+	pthread_attr_t tattr;
+	int ret = 0, n, started;
+
+	for (n = 0; n < nr_pairs; n++) {
+		ret = open_pair(&pairs[n], flags);
+		if (ret) {
+			while (--n >= 0)
+				close_pair(&pairs[n]);
+			return ret;
+		}
+		pairs[n].status = 0;
+	}
+
+	smokey_barrier_init(&start_barrier);
+
+	pthread_attr_init(&tattr);
+	pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&tattr, SCHED_FIFO);
+	pthread_attr_setschedparam(&tattr, &param);
+
+	for (started = 0; started < nr_pairs; started++) {
+		ret = -pthread_create(&pairs[started].receiver, &tattr,
+				      receiver, &pairs[started]);
+		if (ret)
+			break;
+		ret = -pthread_create(&pairs[started].sender, &tattr,
+				      sender, &pairs[started]);
+		if (ret) {
+			pthread_cancel(pairs[started].receiver);
+			pthread_join(pairs[started].receiver, NULL);
+			break;
+		}
+	}
+
+	pthread_attr_destroy(&tattr);
+
+	if (ret) {
+		for (n = 0; n < started; n++) {
+			pthread_cancel(pairs[n].sender);
+			pthread_cancel(pairs[n].receiver);
+		}
+	} else
+		smokey_barrier_release(&start_barrier);
+
+	for (n = 0; n < started; n++) {
+		pthread_join(pairs[n].sender, NULL);
+		pthread_join(pairs[n].receiver, NULL);
+	}
+
+	smokey_barrier_destroy(&start_barrier);
+
+	for (n = 0; n < nr_pairs; n++) {
+		close_pair(&pairs[n]);
+		if (ret == 0 && pairs[n].status) {
+			smokey_warning("queue pair on CPU%d failed (%s)",
+				       pairs[n].cpu, symerror(pairs[n].status));
+			ret = pairs[n].status;
+		}
+	}
+
+	if (ret)
+		return ret;
+
+	for (n = 0; n < nr_pairs; n++) {
+		rate = pairs[n].loops * 1e9 /
+			(timespec_scalar(&pairs[n].end) -
+			 timespec_scalar(&pairs[n].start));
+		total += rate;
+		if (n == 0 || rate < lowest)
+			lowest = rate;
+	}
+
+	smokey_trace("%s mode, %2d pair(s): %10.0f msgs/s total, "
+		     "%10.0f msgs/s slowest pair",
+		     flags & MQ_SPSC ? "SPSC   " : "regular", nr_pairs,
+		     total, lowest);
+
+	return 0;
+}
+
+static int run_posix_mqueue(struct smokey_test *t, int argc, char *const argv[])
+{
+	int ret, cpu, nr_cpus = 0, max_cpus = 0, nr;
+	long loops = 100000;
+	struct mq_pair *pairs;
+	cpu_set_t cpuset;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(posix_mqueue, cpus))
+		max_cpus = SMOKEY_ARG_INT(posix_mqueue, cpus);
+
+	if (SMOKEY_ARG_ISSET(posix_mqueue, loops))
+		loops = SMOKEY_ARG_INT(posix_mqueue, loops);
+
+	if (max_cpus < 0 || loops <= 0)
+		return -EINVAL;
+
+	ret = check_spsc();
+	if (ret)
+		return ret;
+
+	if (get_realtime_cpu_set(&cpuset))
+		return -ENOSYS;
+
+	pairs = calloc(CPU_SETSIZE, sizeof(*pairs));
+	if (pairs == NULL)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &cpuset))
+			continue;
+		if (max_cpus > 0 && nr_cpus >= max_cpus)
+			break;
+		pairs[nr_cpus].cpu = cpu;
+		pairs[nr_cpus].loops = loops;
+		nr_cpus++;
+	}
+
+	if (nr_cpus == 0) {
+		smokey_note("posix_mqueue: no real-time CPU available");
+		ret = -ENOSYS;
+		goto out;
+	}
+
+	/* Double the count of busy CPUs at each step. */
+	for (nr = 1; ; nr *= 2) {
+		if (nr > nr_cpus)
+			nr = nr_cpus;
+		ret = run_pairs(pairs, nr, 0);
+		if (ret)
+			break;
+		ret = run_pairs(pairs, nr, MQ_SPSC);
+		if (ret || nr == nr_cpus)
+			break;
+	}
+out:
+	free(pairs);
+
+	return ret;
+}
@@ -0,0 +1,436 @@
+/*
+ * Cobalt selector test. The edge-triggered semantics of the
+ * selector descriptors are checked first, then the latency from
+ * waking up a message queue to the return of the waiter is measured
+ * with select() and with a selector, as the number of watched queues
+ * grows.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <mqueue.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <sys/select.h>
+#include <cobalt/sys/cobalt.h>
+#include <boilerplate/ancillaries.h>
+#include <boilerplate/time.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(posix_selector,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(fds),
+			   SMOKEY_INT(loops),
+			   ),
+		   "Check Cobalt selectors, compare their wake-up latency with select().\n"
+		   "\tfds=<N>, largest count of watched descriptors (256)\n"
+		   "\tloops=<N>, wake-ups measured for each count (1000)"
+);
+
+#define MQ_NAME_FMT	"/smokey-sel-%d"
+
+static struct smokey_barrier start_barrier;
+
+struct bench {
+	int nfds;
+	mqd_t *q;
+	int maxfd;
+	int sfd;
+	bool use_selector;
+	long loops;
+	sem_t ready;
+	int cpu;
+	pthread_t receiver, sender;
+	long long sum, max;
+	int status;
+};
+
+static mqd_t open_queue(int n)
+{
+	struct mq_attr attr = {
+		.mq_maxmsg = 4,
+		.mq_msgsize = sizeof(long long),
+	};
+	char name[32];
+	mqd_t q;
+
+	snprintf(name, sizeof(name), MQ_NAME_FMT, n);
+	mq_unlink(name);
+	q = mq_open(name, O_CREAT | O_EXCL | O_RDWR | O_NONBLOCK, 0600, &attr);
+
+	return q == (mqd_t)-1 ? -errno : q;
+}
+
+static void close_queue(int n, mqd_t q)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), MQ_NAME_FMT, n);
+	mq_close(q);
+	mq_unlink(name);
+}
+
+static int expect_events(int sfd, int nr, int fd)
+{
+	struct cobalt_select_event events[4];
+	struct timespec zero = { 0, 0 };
+	int ret;
+
+	ret = cobalt_selector_wait(sfd, events, 4, &zero);
+	if (!__Tassert(ret == nr))
+		return ret < 0 ? ret : -EINVAL;
+
+	if (nr && !__Tassert(events[0].fd == fd &&
+			     events[0].events == COBALT_SELECT_READ))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int check_selector(void)
+{
+	long long data = 0;
+	int sfd, ret;
+	mqd_t q[2];
+
+	ret = q[0] = open_queue(0);
+	if (ret < 0)
+		return ret;
+
+	ret = q[1] = open_queue(1);
+	if (ret < 0)
+		goto close_q0;
+
+	ret = sfd = cobalt_selector_create(0);
+	if (!__Tassert(sfd >= 0))
+		goto close_q1;
+
+	if (!__T(ret, cobalt_selector_ctl(sfd, COBALT_SELECT_ADD,
+					  q[0], COBALT_SELECT_READ)))
+		goto close_sfd;
+	if (!__T(ret, cobalt_selector_ctl(sfd, COBALT_SELECT_ADD,
+					  q[1], COBALT_SELECT_READ)))
+		goto close_sfd;
+
+	ret = cobalt_selector_ctl(sfd, COBALT_SELECT_ADD,
+				  q[0], COBALT_SELECT_READ);
+	if (!__Tassert(ret == -EEXIST))
+		goto fail;
+
+	/* Nothing ready yet. */
+	if (!__T(ret, expect_events(sfd, 0, -1)))
+		goto close_sfd;
+
+	if (!__Terrno(ret, mq_send(q[1], (char *)&data, sizeof(data), 0)))
+		goto close_sfd;
+
+	if (!__T(ret, expect_events(sfd, 1, q[1])))
+		goto close_sfd;
+
+	/* Still readable, but no new edge. */
+	if (!__Terrno(ret, mq_send(q[1], (char *)&data, sizeof(data), 0)))
+		goto close_sfd;
+	if (!__T(ret, expect_events(sfd, 0, -1)))
+		goto close_sfd;
+
+	/* Drained, then readable again: new edge. */
+	while (mq_receive(q[1], (char *)&data, sizeof(data), NULL) > 0)
+		;
+	if (!__Terrno(ret, mq_send(q[1], (char *)&data, sizeof(data), 0)))
+		goto close_sfd;
+	if (!__T(ret, expect_events(sfd, 1, q[1])))
+		goto close_sfd;
+
+	/* Unwatched descriptors are not reported. */
+	if (!__T(ret, cobalt_selector_ctl(sfd, COBALT_SELECT_DEL, q[0], 0)))
+		goto close_sfd;
+	if (!__Terrno(ret, mq_send(q[0], (char *)&data, sizeof(data), 0)))
+		goto close_sfd;
+	if (!__T(ret, expect_events(sfd, 0, -1)))
+		goto close_sfd;
+
+	ret = cobalt_selector_ctl(sfd, COBALT_SELECT_DEL, q[0], 0);
+	if (!__Tassert(ret == -ENOENT))
+		goto fail;
+
+	ret = 0;
+	goto close_sfd;
+fail:
+	ret = -EINVAL;
+close_sfd:
+	close(sfd);
+close_q1:
+	close_queue(1, q[1]);
+close_q0:
+	close_queue(0, q[0]);
+
+	return ret;
+}
+
+static int pin_thread(int cpu)
+{
+	cpu_set_t affinity;
+
+	CPU_ZERO(&affinity);
+	CPU_SET(cpu, &affinity);
+
+	return -pthread_setaffinity_np(pthread_self(),
+				       sizeof(affinity), &affinity);
+}
+
+static long long now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_scalar(&now);
+}
+
+static int wait_select(struct bench *b, fd_set *watched)
+{
+	fd_set readable = *watched;
+	int ret, fd;
+
+	ret = select(b->maxfd + 1, &readable, NULL, NULL, NULL);
+	if (ret < 0)
+		return -errno;
+
+	for (fd = 0; fd <= b->maxfd; fd++)
+		if (FD_ISSET(fd, &readable))
+			return fd;
+
+	return -EPROTO;
+}
+
+static int wait_selector(struct bench *b)
+{
+	struct cobalt_select_event event;
+	int ret;
+
+	ret = cobalt_selector_wait(b->sfd, &event, 1, NULL);
+	if (ret < 0)
+		return ret;
+
+	return ret == 1 ? (int)event.fd : -EPROTO;
+}
+
+/* Unblock the peer thread on error. */
+static void *bench_abort(struct bench *b, int status, pthread_t peer)
+{
+	b->status = status;
+	pthread_cancel(peer);
+
+	return NULL;
+}
+
+static void *receiver(void *arg)
+{
+	struct bench *b = arg;
+	long long sent, lat;
+	fd_set watched;
+	int ret, fd, n;
+
+	smokey_barrier_wait(&start_barrier);
+
+	ret = pin_thread(b->cpu);
+	if (ret)
+		return bench_abort(b, ret, b->sender);
+
+	FD_ZERO(&watched);
+	for (n = 0; n < b->nfds; n++)
+		FD_SET(b->q[n], &watched);
+
+	for (n = 0; n < b->loops; n++) {
+		sem_post(&b->ready);
+
+		fd = b->use_selector ? wait_selector(b) :
+			wait_select(b, &watched);
+		lat = now_ns();
+		if (fd < 0)
+			return bench_abort(b, fd, b->sender);
+
+		ret = mq_receive(fd, (char *)&sent, sizeof(sent), NULL);
+		if (ret < 0)
+			return bench_abort(b, -errno, b->sender);
+
+		lat -= sent;
+		b->sum += lat;
+		if (lat > b->max)
+			b->max = lat;
+	}
+
+	return NULL;
+}
+
+static void *sender(void *arg)
+{
+	struct bench *b = arg;
+	long long stamp;
+	int ret, n;
+
+	smokey_barrier_wait(&start_barrier);
+
+	ret = pin_thread(b->cpu);
+	if (ret)
+		return bench_abort(b, ret, b->receiver);
+
+	for (n = 0; n < b->loops; n++) {
+		sem_wait(&b->ready);
+		/* Spread the wake-ups over the watched queues. */
+		stamp = now_ns();
+		ret = mq_send(b->q[(n * 7) % b->nfds],
+			      (char *)&stamp, sizeof(stamp), 0);
+		if (ret)
+			return bench_abort(b, -errno, b->receiver);
+	}
+
+	return NULL;
+}
+
+static int run_bench(struct bench *b, bool use_selector)
+{
+	struct sched_param param;
+	pthread_attr_t tattr;
+	int ret;
+
+	b->use_selector = use_selector;
+	b->sum = b->max = 0;
+	b->status = 0;
+	sem_init(&b->ready, 0, 0);
+	smokey_barrier_init(&start_barrier);
+
+	pthread_attr_init(&tattr);
+	pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&tattr, SCHED_FIFO);
+
+	/* The receiver preempts the sender as soon as it is woken up. */
+	param.sched_priority = 20;
+	pthread_attr_setschedparam(&tattr, &param);
+	ret = -pthread_create(&b->receiver, &tattr, receiver, b);
+	if (ret)
+		goto out;
+
+	param.sched_priority = 10;
+	pthread_attr_setschedparam(&tattr, &param);
+	ret = -pthread_create(&b->sender, &tattr, sender, b);
+	if (ret) {
+		pthread_cancel(b->receiver);
+		pthread_join(b->receiver, NULL);
+		goto out;
+	}
+
+	/* Both thread ids are known from now on. */
+	smokey_barrier_release(&start_barrier);
+
+	pthread_join(b->sender, NULL);
+	pthread_join(b->receiver, NULL);
+	ret = b->status;
+	if (ret == 0)
+		smokey_trace("%4d fds, %-8s: %8.3f us avg, %8.3f us max",
+			     b->nfds, use_selector ? "selector" : "select",
+			     b->sum / 1000.0 / b->loops, b->max / 1000.0);
+out:
+	pthread_attr_destroy(&tattr);
+	smokey_barrier_destroy(&start_barrier);
+	sem_destroy(&b->ready);
+
+	return ret;
+}
+
+static int run_posix_selector(struct smokey_test *t,
+			      int argc, char *const argv[])
+{
+	int ret, n, nr, max_fds = 256;
+	struct bench b = { .loops = 1000, .sfd = -1 };
+	cpu_set_t cpuset;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(posix_selector, fds))
+		max_fds = SMOKEY_ARG_INT(posix_selector, fds);
+
+	if (SMOKEY_ARG_ISSET(posix_selector, loops))
+		b.loops = SMOKEY_ARG_INT(posix_selector, loops);
+
+	if (max_fds <= 0 || b.loops <= 0)
+		return -EINVAL;
+
+	ret = check_selector();
+	if (ret)
+		return ret;
+
+	if (get_realtime_cpu_set(&cpuset))
+		return -ENOSYS;
+
+	for (b.cpu = 0; b.cpu < CPU_SETSIZE; b.cpu++)
+		if (CPU_ISSET(b.cpu, &cpuset))
+			break;
+
+	if (b.cpu == CPU_SETSIZE) {
+		smokey_note("posix_selector: no real-time CPU available");
+		return -ENOSYS;
+	}
+
+	b.q = calloc(max_fds, sizeof(*b.q));
+	if (b.q == NULL)
+		return -ENOMEM;
+
+	b.sfd = cobalt_selector_create(0);
+	if (b.sfd < 0) {
+		ret = b.sfd;
+		goto out;
+	}
+
+	/* Multiply the count of watched queues by four at each step. */
+	for (nr = 1, b.nfds = 0, b.maxfd = 0; ; nr *= 4) {
+		if (nr > max_fds)
+			nr = max_fds;
+		for (; b.nfds < nr; b.nfds++) {
+			ret = b.q[b.nfds] = open_queue(b.nfds);
+			if (ret < 0)
+				goto out;
+			if (b.q[b.nfds] >= FD_SETSIZE) {
+				close_queue(b.nfds, b.q[b.nfds]);
+				smokey_note("posix_selector: out of fd_set "
+					    "range at %d queues", b.nfds);
+				ret = 0;
+				goto out;
+			}
+			if (b.q[b.nfds] > b.maxfd)
+				b.maxfd = b.q[b.nfds];
+			ret = cobalt_selector_ctl(b.sfd, COBALT_SELECT_ADD,
+						  b.q[b.nfds],
+						  COBALT_SELECT_READ);
+			if (ret) {
+				close_queue(b.nfds, b.q[b.nfds]);
+				goto out;
+			}
+		}
+		ret = run_bench(&b, false);
+		if (ret)
+			break;
+		ret = run_bench(&b, true);
+		if (ret || nr == max_fds)
+			break;
+	}
+out:
+	if (b.sfd >= 0)
+		close(b.sfd);
+
+	for (n = 0; n < b.nfds; n++)
+		close_queue(n, b.q[n]);
+
+	free(b.q);
+
+	return ret;
+}
@@ -0,0 +1,178 @@
+/*
+ * Deferred printf test. Binary records are checked for being
+ * replayed as the equivalent formatted output, with string arguments
+ * copied at call time, then the statistics are checked for counting
+ * records and drops.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(print_records,
+		   SMOKEY_NOARGS,
+		   "Check binary records and statistics of the deferred printf services."
+);
+
+#define OVERFLOW_BUFSZ	1024
+#define OVERFLOW_LOOPS	100000
+
+struct overflow_run {
+	FILE *fp;
+	int loops;
+	int ret;
+};
+
+static int read_back(FILE *fp, char *buf, size_t size)
+{
+	size_t len;
+
+	rt_print_flush_buffers();
+	fflush(fp);
+	rewind(fp);
+	len = fread(buf, 1, size - 1, fp);
+	buf[len] = '\0';
+
+	return len;
+}
+
+static int check_records(void)
+{
+	struct rt_print_stats before, after;
+	char expected[256], buf[256], str[16];
+	FILE *fp;
+	int ret;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return -errno;
+
+	rt_print_flush_buffers();
+	rt_print_get_stats(&before);
+
+	strcpy(str, "string");
+	rt_fprintf_bin(fp, "%d %u %ld %c %s %5.2f %#x %p|", -42, 42U,
+		       -4242L, 'c', str, 3.14159, 0xbeef, (void *)0x1000);
+	/* Strings must have been copied into the record. */
+	strcpy(str, "clobbered");
+	/* Not replayable, formatted in place instead. */
+	rt_fprintf_bin(fp, "%2$s %1$d|", 7, "positional");
+	rt_fprintf_bin(fp, "%*d %-*s|\n", 4, 1, 3, "ab");
+
+	snprintf(expected, sizeof(expected),
+		 "%d %u %ld %c %s %5.2f %#x %p|%s %d|%*d %-*s|\n",
+		 -42, 42U, -4242L, 'c', "string", 3.14159, 0xbeef,
+		 (void *)0x1000, "positional", 7, 4, 1, 3, "ab");
+
+	read_back(fp, buf, sizeof(buf));
+	rt_print_get_stats(&after);
+	fclose(fp);
+
+	/* Our own traces are counted as well, so snapshot first. */
+	smokey_trace("replayed: %s", buf);
+
+	if (!__Tassert(strcmp(buf, expected) == 0))
+		return -EINVAL;
+
+	ret = after.records - before.records;
+	if (!__Tassert(ret == 3) ||
+	    !__Tassert(after.dropped == before.dropped) ||
+	    !__Tassert(after.truncated == before.truncated))
+		return -EINVAL;
+
+	return 0;
+}
+
+static void *overflow_thread(void *arg)
+{
+	struct overflow_run *run = arg;
+	struct rt_print_stats stats;
+	unsigned long dropped;
+	int n;
+
+	run->ret = rt_print_init(OVERFLOW_BUFSZ, "smokey");
+	if (run->ret)
+		return NULL;
+
+	rt_print_get_stats(&stats);
+	dropped = stats.dropped;
+
+	/*
+	 * Outpace the printer until a record is dropped, since it
+	 * may drain our buffer meanwhile.
+	 */
+	for (n = 0; n < OVERFLOW_LOOPS; n++) {
+		rt_fprintf_bin(run->fp, "%d %s\n", n,
+			       "some padding to fill the relay buffer fast");
+		if ((n % 16) == 15) {
+			rt_print_get_stats(&stats);
+			if (stats.dropped != dropped)
+				break;
+		}
+	}
+
+	run->loops = n < OVERFLOW_LOOPS ? n + 1 : n;
+
+	return NULL;
+}
+
+static int check_overflow(void)
+{
+	struct rt_print_stats before, after;
+	struct overflow_run run;
+	pthread_t tid;
+	char buf[64];
+	int ret;
+
+	run.fp = tmpfile();
+	if (run.fp == NULL)
+		return -errno;
+
+	rt_print_flush_buffers();
+	rt_print_get_stats(&before);
+
+	ret = -pthread_create(&tid, NULL, overflow_thread, &run);
+	if (ret)
+		goto out;
+
+	pthread_join(tid, NULL);
+	ret = -run.ret;
+	if (ret)
+		goto out;
+
+	read_back(run.fp, buf, sizeof(buf));
+	rt_print_get_stats(&after);
+
+	smokey_trace("%d records sent, %lu queued, %lu dropped, "
+		     "%lu truncated, %lu early wakeups", run.loops,
+		     after.records - before.records,
+		     after.dropped - before.dropped,
+		     after.truncated - before.truncated,
+		     after.wakeups);
+
+	/* Retired buffers must still be accounted for. */
+	if (!__Tassert(after.dropped > before.dropped) ||
+	    !__Tassert(after.records - before.records +
+		       after.dropped - before.dropped == run.loops))
+		ret = -EINVAL;
+out:
+	fclose(run.fp);
+
+	return ret;
+}
+
+static int run_print_records(struct smokey_test *t,
+			     int argc, char *const argv[])
+{
+	int ret;
+
+	ret = check_records();
+	if (ret)
+		return ret;
+
+	return check_overflow();
+}
@@ -0,0 +1,221 @@
+/*
+ * Round-trip cost of ioctl() requests on RTDM file descriptors, as
+ * the number of descriptors open in the process and the number of
+ * CPUs issuing requests concurrently grow. Each thread is pinned to
+ * a CPU and hammers its own timerfd, which rejects every request
+ * from primary mode once the descriptor was looked up.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <boilerplate/ancillaries.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(rtdm_ioctl,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(max_fds),
+			   SMOKEY_INT(loops),
+			   ),
+		   "Measure ioctl() round-trip on RTDM descriptors.\n"
+		   "\tmax_fds=<N>, open up to N descriptors (4096)\n"
+		   "\tloops=<N>, requests per thread and run (100000)"
+);
+
+#define BENCH_REQUEST	0x5800	/* unsupported by timerfds */
+
+static int loops = 100000;
+
+static pthread_barrier_t barrier;
+
+struct bench_thread {
+	pthread_t tid;
+	int cpu;
+	int fd;
+	int errors;
+	unsigned long long ns;
+};
+
+static inline unsigned long long get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *bench_thread(void *arg)
+{
+	struct bench_thread *t = arg;
+	unsigned long long start;
+	int n;
+
+	pthread_barrier_wait(&barrier);
+
+	start = get_ns();
+	for (n = 0; n < loops; n++) {
+		if (ioctl(t->fd, BENCH_REQUEST, NULL) != -1 || errno != ENOTTY)
+			t->errors++;
+	}
+	t->ns = get_ns() - start;
+
+	return NULL;
+}
+
+static int run_bench(int nr_fds, int nr_threads, const int *cpus)
+{
+	struct bench_thread threads[nr_threads];
+	unsigned long long sum = 0, worst = 0;
+	struct sched_param param;
+	pthread_attr_t attr;
+	cpu_set_t cpuset;
+	int ret = 0, n;
+
+	pthread_barrier_init(&barrier, NULL, nr_threads);
+
+	for (n = 0; n < nr_threads; n++) {
+		threads[n].cpu = cpus[n];
+		threads[n].errors = 0;
+		threads[n].fd = timerfd_create(CLOCK_MONOTONIC, 0);
+		if (threads[n].fd < 0) {
+			ret = -errno;
+			while (--n >= 0)
+				close(threads[n].fd);
+			goto out;
+		}
+	}
+
+	for (n = 0; n < nr_threads; n++) {
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = 10;
+		pthread_attr_setschedparam(&attr, &param);
+		CPU_ZERO(&cpuset);
+		CPU_SET(threads[n].cpu, &cpuset);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+		ret = __T(ret, pthread_create(&threads[n].tid, &attr,
+					     bench_thread, threads + n));
+		pthread_attr_destroy(&attr);
+		if (ret) {
+			smokey_warning("cannot start thread on cpu%d",
+				       threads[n].cpu);
+			exit(1);
+		}
+	}
+
+	for (n = 0; n < nr_threads; n++) {
+		pthread_join(threads[n].tid, NULL);
+		close(threads[n].fd);
+		if (!__Tassert(threads[n].errors == 0))
+			ret = -EINVAL;
+		sum += threads[n].ns;
+		if (threads[n].ns > worst)
+			worst = threads[n].ns;
+	}
+
+	smokey_trace("%5d fds, %2d cpus: %7.1f ns/ioctl avg, "
+		     "%7.1f ns worst thread, %8.3f Mioctl/s total",
+		     nr_fds, nr_threads,
+		     (double)sum / nr_threads / loops,
+		     (double)worst / loops,
+		     (double)loops * nr_threads * 1000.0 / worst);
+out:
+	pthread_barrier_destroy(&barrier);
+
+	return ret;
+}
+
+static int run_rtdm_ioctl(struct smokey_test *t, int argc, char *const argv[])
+{
+	int max_fds = 4096, nr_fds = 0, nr_cpus = 0, ret = 0, *fds, *cpus,
+		nr, n, cpu;
+	struct rlimit rlim;
+	cpu_set_t cpuset;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(rtdm_ioctl, max_fds))
+		max_fds = SMOKEY_ARG_INT(rtdm_ioctl, max_fds);
+
+	if (SMOKEY_ARG_ISSET(rtdm_ioctl, loops))
+		loops = SMOKEY_ARG_INT(rtdm_ioctl, loops);
+
+	if (max_fds <= 0 || loops <= 0)
+		return -EINVAL;
+
+	/* Leave room for the regular descriptors and our targets. */
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+	    rlim.rlim_cur < max_fds + CPU_SETSIZE + 64) {
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+		if (rlim.rlim_cur < max_fds + CPU_SETSIZE + 64) {
+			max_fds = rlim.rlim_cur - CPU_SETSIZE - 64;
+			smokey_note("rtdm_ioctl: limiting to %d descriptors "
+				    "(see ulimit -n)", max_fds);
+		}
+	}
+
+	fds = malloc(max_fds * sizeof(*fds));
+	cpus = malloc(CPU_SETSIZE * sizeof(*cpus));
+	if (fds == NULL || cpus == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (get_realtime_cpu_set(&cpuset)) {
+		ret = -ENOSYS;
+		goto out;
+	}
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &cpuset))
+			cpus[nr_cpus++] = cpu;
+
+	if (nr_cpus == 0) {
+		smokey_note("rtdm_ioctl: no real-time CPU available");
+		ret = -ENOSYS;
+		goto out;
+	}
+
+	for (nr = 16; nr <= max_fds; nr *= 4) {
+		/* Fill the descriptor table up to the next step. */
+		while (nr_fds < nr) {
+			fds[nr_fds] = timerfd_create(CLOCK_MONOTONIC, 0);
+			if (fds[nr_fds] < 0) {
+				ret = -errno;
+				smokey_warning("timerfd_create failed after "
+					       "%d descriptors", nr_fds);
+				goto close;
+			}
+			nr_fds++;
+		}
+
+		for (n = 1; ; n *= 2) {
+			if (n > nr_cpus)
+				n = nr_cpus;
+			ret = run_bench(nr_fds, n, cpus);
+			if (ret || n == nr_cpus)
+				break;
+		}
+		if (ret)
+			break;
+	}
+close:
+	while (--nr_fds >= 0)
+		close(fds[nr_fds]);
+out:
+	free(cpus);
+	free(fds);
+
+	return ret;
+}
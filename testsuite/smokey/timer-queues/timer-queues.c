@@ -0,0 +1,102 @@
+/*
+ * Timer queue comparison test.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <rtdm/testing.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(timer_queues,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(timers),
+			   SMOKEY_INT(ops),
+			   SMOKEY_INT(cancel),
+		   ),
+   "Compare the timer indexing methods available to the Cobalt core\n"
+   "\t(linear list, red-black tree, timer wheel) on private queues\n"
+   "\tloaded with a number of outstanding timers (timers=<count>).\n"
+   "\tOperations (ops=<count>) either expire the earliest timer or\n"
+   "\tcancel a random one (cancel=<percent>), rearming it in both\n"
+   "\tcases. Requires the timerbench driver."
+);
+
+static const char *queue_names[RTTST_TMQUEUE_NR] = {
+	[RTTST_TMQUEUE_LIST] = "list",
+	[RTTST_TMQUEUE_RBTREE] = "rbtree",
+	[RTTST_TMQUEUE_WHEEL] = "wheel",
+};
+
+static int run_bench(int fd, unsigned int nrtimers, unsigned int nrops,
+		     int cancel_ratio)
+{
+	struct rttst_tmqueue_bench bench;
+	struct rttst_tmqueue_stats *st;
+	int kind, ret;
+
+	bench.nrtimers = nrtimers;
+	bench.nrops = nrops;
+	bench.span = 1000000000ULL;
+	bench.cancel_ratio = cancel_ratio;
+
+	if (!__Terrno(ret, ioctl(fd, RTTST_RTIOC_TMBENCH_QUEUES, &bench)))
+		return ret;
+
+	smokey_trace("%u timers, %u ops, %d%% cancelled:",
+		     nrtimers, nrops, cancel_ratio);
+	smokey_trace("%8s %14s %14s %14s", "queue",
+		     "insert avg/max", "cancel avg/max", "expire avg/max");
+
+	for (kind = 0; kind < RTTST_TMQUEUE_NR; kind++) {
+		st = bench.stats + kind;
+		smokey_trace("%8s %6lld/%-7lld %6lld/%-7lld %6lld/%-7lld",
+			     queue_names[kind],
+			     (long long)st->insert_avg_ns,
+			     (long long)st->insert_max_ns,
+			     (long long)st->remove_avg_ns,
+			     (long long)st->remove_max_ns,
+			     (long long)st->expire_avg_ns,
+			     (long long)st->expire_max_ns);
+	}
+
+	return 0;
+}
+
+static int run_timer_queues(struct smokey_test *t, int argc, char *const argv[])
+{
+	static const unsigned int loads[] = { 16, 256, 4096 };
+	unsigned int nrtimers = 0, nrops = 100000, n;
+	int fd, ret = 0, cancel_ratio = 50;
+
+	if (SMOKEY_ARG_ISSET(timer_queues, timers))
+		nrtimers = SMOKEY_ARG_INT(timer_queues, timers);
+
+	if (SMOKEY_ARG_ISSET(timer_queues, ops))
+		nrops = SMOKEY_ARG_INT(timer_queues, ops);
+
+	if (SMOKEY_ARG_ISSET(timer_queues, cancel))
+		cancel_ratio = SMOKEY_ARG_INT(timer_queues, cancel);
+
+	fd = open("/dev/rtdm/timerbench", O_RDWR);
+	if (fd < 0) {
+		smokey_note("timer_queues: timerbench driver not present");
+		return -ENOSYS;
+	}
+
+	if (nrtimers > 0)
+		ret = run_bench(fd, nrtimers, nrops, cancel_ratio);
+	else {
+		for (n = 0; n < sizeof(loads) / sizeof(loads[0]); n++) {
+			ret = run_bench(fd, loads[n], nrops, cancel_ratio);
+			if (ret)
+				break;
+		}
+	}
+
+	close(fd);
+
+	return ret;
+}
@@ -14,6 +14,10 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <smokey/smokey.h>
 #include <rtdm/ipc.h>
 
@@ -27,6 +31,21 @@ static pthread_t rt1, rt2, nrt;
 static sem_t semsync;
 
 #define XDDP_PORT_LABEL  "xddp-smokey"
+#define XDDP_BATCH_LABEL "xddp-smokey-batch"
+
+#define BATCH_MAX   64
+#define BATCH_MSGS  4096
+
+#define XDDP_STREAM_LABEL "xddp-smokey-stream"
+
+#define RING_SIZE   65536
+#define RING_MSGS   100000
+
+static sem_t semready;
+
+static struct timespec stream_end;
+
+static struct xnpipe_stats stream_stats;
 
 static void fail(const char *reason)
 {
@@ -193,7 +212,7 @@ static void *regular_thread(void *arg)
 
 	if (asprintf(&devname,
 		     "/proc/xenomai/registry/rtipc/xddp/%s",
-		     XDDP_PORT_LABEL) < 0)
+		     (const char *)arg) < 0)
 		fail("asprintf");
 
 	do
@@ -216,11 +235,366 @@ static void *regular_thread(void *arg)
 	return NULL;
 }
 
+static void setup_batch(struct mmsghdr *msgv, struct iovec *iov,
+			long *data, int nr)
+{
+	int n;
+
+	/* The I/O vectors are updated by each transfer. */
+	memset(msgv, 0, nr * sizeof(*msgv));
+	for (n = 0; n < nr; n++) {
+		iov[n].iov_base = &data[n];
+		iov[n].iov_len = sizeof(data[n]);
+		msgv[n].msg_hdr.msg_iov = &iov[n];
+		msgv[n].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+/*
+ * Have the regular thread echo batches of datagrams sent to the
+ * XDDP port, measuring the message rate of the round trip.
+ */
+static int check_batching(pthread_attr_t *regattr)
+{
+	static const int batch_sizes[] = { 1, 8, 64 };
+	int ret, s, n, b, batch, count, rcvd;
+	struct rtipc_port_label plabel;
+	struct mmsghdr msgv[BATCH_MAX];
+	struct timespec start, end;
+	struct iovec iov[BATCH_MAX];
+	struct sockaddr_ipc saddr;
+	unsigned long long ns;
+	long data[BATCH_MAX];
+	socklen_t addrlen;
+	struct timeval tv;
+	size_t poolsz;
+
+	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_XDDP);
+	if (s < 0)
+		fail("socket");
+
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	ret = setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (ret)
+		fail("setsockopt");
+
+	poolsz = 65536; /* bytes */
+	ret = setsockopt(s, SOL_XDDP, XDDP_POOLSZ, &poolsz, sizeof(poolsz));
+	if (ret)
+		fail("setsockopt");
+
+	strcpy(plabel.label, XDDP_BATCH_LABEL);
+	ret = setsockopt(s, SOL_XDDP, XDDP_LABEL, &plabel, sizeof(plabel));
+	if (ret)
+		fail("setsockopt");
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = -1;
+	ret = bind(s, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("bind");
+
+	/* Send to our own port, i.e. to the regular thread. */
+	addrlen = sizeof(saddr);
+	ret = getsockname(s, (struct sockaddr *)&saddr, &addrlen);
+	if (ret || addrlen != sizeof(saddr))
+		fail("getsockname");
+
+	ret = connect(s, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("connect");
+
+	errno = pthread_create(&nrt, regattr, &regular_thread,
+			       XDDP_BATCH_LABEL);
+	if (errno)
+		fail("pthread_create");
+
+	for (b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+		batch = batch_sizes[b];
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (count = 0; count < BATCH_MSGS; count += batch) {
+			setup_batch(msgv, iov, data, batch);
+			for (n = 0; n < batch; n++)
+				data[n] = count + n;
+			ret = sendmmsg(s, msgv, batch, 0);
+			if (ret != batch)
+				fail("sendmmsg");
+			setup_batch(msgv, iov, data, batch);
+			for (rcvd = 0; rcvd < batch; rcvd += ret) {
+				ret = recvmmsg(s, msgv + rcvd, batch - rcvd,
+					       0, NULL);
+				if (ret <= 0)
+					fail("recvmmsg");
+			}
+			for (n = 0; n < batch; n++) {
+				if (msgv[n].msg_len != sizeof(long) ||
+				    data[n] != count + n) {
+					smokey_warning("data does not match control value");
+					return -EINVAL;
+				}
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+			end.tv_nsec - start.tv_nsec;
+		smokey_trace("%s: batch size %2d, %10.0f msgs/s",
+			     __func__, batch, (double)count * 1e9 / ns);
+	}
+
+	pthread_cancel(nrt);
+	pthread_join(nrt, NULL);
+	close(s);
+
+	return 0;
+}
+
+static int open_port(const char *label)
+{
+	char *devname;
+	int fd;
+
+	if (asprintf(&devname,
+		     "/proc/xenomai/registry/rtipc/xddp/%s", label) < 0)
+		fail("asprintf");
+
+	do
+		fd = open(devname, O_RDWR);
+	while (fd < 0 && errno == ENOENT);
+	free(devname);
+	if (fd < 0)
+		fail("open");
+
+	return fd;
+}
+
+static void check_data(long data, long expected)
+{
+	if (data != expected) {
+		smokey_note("data does not match control value");
+		errno = EINVAL;
+		fail("read");
+	}
+}
+
+static int open_stream(const struct xnpipe_coalesce *cf)
+{
+	int fd;
+
+	fd = open_port(XDDP_STREAM_LABEL);
+
+	if (cf->interval && ioctl(fd, XNPIPEIOC_SETCOALESCE, cf))
+		fail("ioctl(XNPIPEIOC_SETCOALESCE)");
+
+	return fd;
+}
+
+static void close_stream(int fd)
+{
+	clock_gettime(CLOCK_MONOTONIC, &stream_end);
+
+	if (ioctl(fd, XNPIPEIOC_GETSTATS, &stream_stats))
+		fail("ioctl(XNPIPEIOC_GETSTATS)");
+
+	close(fd);
+}
+
+/* Pull the stream with read(), one message per call. */
+static void *read_stream(void *arg)
+{
+	long data, count;
+	int fd, ret;
+
+	fd = open_stream(arg);
+	sem_post(&semready);
+
+	for (count = 0; count < RING_MSGS; count++) {
+		ret = read(fd, &data, sizeof(data));
+		if (ret != sizeof(data))
+			fail("read");
+		check_data(data, count);
+	}
+
+	close_stream(fd);
+
+	return NULL;
+}
+
+/* Consume the stream in place from the shared ring. */
+static void *map_stream(void *arg)
+{
+	struct xnpipe_ring_hdr *hdr;
+	struct xnpipe_ring_rec *rec;
+	__u32 head, tail = 0, off;
+	struct pollfd pfd;
+	size_t mapsz;
+	long count = 0;
+	char *data;
+	int fd;
+
+	fd = open_stream(arg);
+
+	if (ioctl(fd, XNPIPEIOC_SETRING, RING_SIZE))
+		fail("ioctl(XNPIPEIOC_SETRING)");
+
+	mapsz = sysconf(_SC_PAGESIZE) + RING_SIZE;
+	hdr = mmap(NULL, mapsz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		fail("mmap");
+
+	data = (char *)hdr + hdr->dataoff;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	sem_post(&semready);
+
+	while (count < RING_MSGS) {
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				fail("poll");
+			continue;
+		}
+		while (tail != head) {
+			off = tail & (hdr->size - 1);
+			rec = (struct xnpipe_ring_rec *)(data + off);
+			if (rec->len == XNPIPE_RING_PAD) {
+				tail += hdr->size - off;
+				continue;
+			}
+			if (rec->len != sizeof(long)) {
+				errno = EPROTO;
+				fail("ring");
+			}
+			check_data(*(long *)(rec + 1), count++);
+			tail += (sizeof(*rec) + rec->len + XNPIPE_RING_ALIGN - 1) &
+				~(XNPIPE_RING_ALIGN - 1);
+		}
+		__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	if (hdr->drops)
+		smokey_trace("%s: %u messages dropped on overflow",
+			     __func__, hdr->drops);
+
+	munmap(hdr, mapsz);
+	close_stream(fd);
+
+	return NULL;
+}
+
+static const struct stream_mode {
+	const char *name;
+	void *(*reader)(void *arg);
+	struct xnpipe_coalesce coalesce;
+} stream_modes[] = {
+	{ "read()", read_stream },
+	{ "read(), coalesced", read_stream,
+	  { .interval = 1000000, .msgs = 64 } },
+	{ "mmap ring", map_stream },
+	{ "mmap ring, coalesced", map_stream,
+	  { .interval = 1000000, .msgs = 64 } },
+};
+
+/*
+ * Stream messages from the real-time side to a regular thread,
+ * reading them through read() or from the shared ring mapped from
+ * the pipe, with and without wakeup coalescing. The sender backs off
+ * briefly whenever the reader lags behind.
+ */
+static int check_stream(pthread_attr_t *regattr)
+{
+	const struct stream_mode *mode;
+	struct rtipc_port_label plabel;
+	struct timespec start, pause;
+	struct sockaddr_ipc saddr;
+	unsigned long long ns;
+	int ret, s, n, retries;
+	socklen_t addrlen;
+	size_t poolsz;
+	long data;
+
+	pause.tv_sec = 0;
+	pause.tv_nsec = 50000;
+
+	for (n = 0; n < sizeof(stream_modes) / sizeof(stream_modes[0]); n++) {
+		mode = stream_modes + n;
+		s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_XDDP);
+		if (s < 0)
+			fail("socket");
+
+		poolsz = 65536; /* bytes */
+		ret = setsockopt(s, SOL_XDDP, XDDP_POOLSZ,
+				 &poolsz, sizeof(poolsz));
+		if (ret)
+			fail("setsockopt");
+
+		strcpy(plabel.label, XDDP_STREAM_LABEL);
+		ret = setsockopt(s, SOL_XDDP, XDDP_LABEL,
+				 &plabel, sizeof(plabel));
+		if (ret)
+			fail("setsockopt");
+
+		memset(&saddr, 0, sizeof(saddr));
+		saddr.sipc_family = AF_RTIPC;
+		saddr.sipc_port = -1;
+		ret = bind(s, (struct sockaddr *)&saddr, sizeof(saddr));
+		if (ret)
+			fail("bind");
+
+		addrlen = sizeof(saddr);
+		ret = getsockname(s, (struct sockaddr *)&saddr, &addrlen);
+		if (ret || addrlen != sizeof(saddr))
+			fail("getsockname");
+
+		ret = connect(s, (struct sockaddr *)&saddr, sizeof(saddr));
+		if (ret)
+			fail("connect");
+
+		errno = pthread_create(&nrt, regattr, mode->reader,
+				       (void *)&mode->coalesce);
+		if (errno)
+			fail("pthread_create");
+
+		sem_sync(&semready);
+
+		retries = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (data = 0; data < RING_MSGS; data++) {
+			for (;;) {
+				ret = sendto(s, &data, sizeof(data),
+					     MSG_DONTWAIT, NULL, 0);
+				if (ret == sizeof(data))
+					break;
+				if (errno != ENOMEM && errno != ENOBUFS &&
+				    errno != EWOULDBLOCK)
+					fail("sendto");
+				retries++;
+				clock_nanosleep(CLOCK_MONOTONIC, 0, &pause, NULL);
+			}
+		}
+
+		pthread_join(nrt, NULL);
+		close(s);
+
+		ns = (stream_end.tv_sec - start.tv_sec) * 1000000000ULL +
+			stream_end.tv_nsec - start.tv_nsec;
+		smokey_trace("%s: %-20s %10.0f msgs/s, %llu wakeups, "
+			     "%llu coalesced, sender backed off %d times",
+			     __func__, mode->name, (double)RING_MSGS * 1e9 / ns,
+			     (unsigned long long)stream_stats.wakeups,
+			     (unsigned long long)stream_stats.coalesced,
+			     retries);
+	}
+
+	return 0;
+}
+
 static int run_xddp(struct smokey_test *t, int argc, char *const argv[])
 {
 	struct sched_param param = { .sched_priority = 42 };
 	pthread_attr_t rtattr, regattr;
-	int s;
+	int ret, s;
 
 	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_XDDP);
 	if (s < 0) {
@@ -230,6 +604,7 @@ static int run_xddp(struct smokey_test *t, int argc, char *const argv[])
 		close(s);
 
 	sem_init(&semsync, 0, 0);
+	sem_init(&semready, 0, 0);
 
 	pthread_attr_init(&rtattr);
 	pthread_attr_setdetachstate(&rtattr, PTHREAD_CREATE_JOINABLE);
@@ -250,7 +625,8 @@ static int run_xddp(struct smokey_test *t, int argc, char *const argv[])
 	pthread_attr_setinheritsched(&regattr, PTHREAD_EXPLICIT_SCHED);
 	pthread_attr_setschedpolicy(&regattr, SCHED_OTHER);
 
-	errno = pthread_create(&nrt, &regattr, &regular_thread, NULL);
+	errno = pthread_create(&nrt, &regattr, &regular_thread,
+			       XDDP_PORT_LABEL);
 	if (errno)
 		fail("pthread_create");
 
@@ -260,5 +636,9 @@ static int run_xddp(struct smokey_test *t, int argc, char *const argv[])
 	pthread_join(rt1, NULL);
 	pthread_join(nrt, NULL);
 
-	return 0;
+	ret = check_batching(&regattr);
+	if (ret)
+		return ret;
+
+	return check_stream(&regattr);
 }
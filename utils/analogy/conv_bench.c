@@ -0,0 +1,457 @@
+/**
+ * Analogy for Linux, sample conversion benchmark
+ *
+ * Copyright (C) 2008 Alexis Berlemont <alexis.berlemont@free.fr>
+ *
+ * Xenomai is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <rtdm/analogy.h>
+
+#define NB_SAMPLES 4096
+#define NB_LOOPS 2000
+
+static int nb_samples = NB_SAMPLES;
+static int nb_loops = NB_LOOPS;
+static int verbose;
+
+struct option conv_bench_opts[] = {
+	{"verbose", no_argument, NULL, 'v'},
+	{"samples", required_argument, NULL, 'n'},
+	{"loops", required_argument, NULL, 'l'},
+	{"help", no_argument, NULL, 'h'},
+	{0},
+};
+
+static void do_print_usage(void)
+{
+	fprintf(stdout, "usage:\tconv_bench [OPTS]\n");
+	fprintf(stdout, "\tOPTS:\t -v, --verbose: verbose output\n");
+	fprintf(stdout,
+		"\t\t -n, --samples: count of samples per conversion "
+		"(default: %d)\n", NB_SAMPLES);
+	fprintf(stdout,
+		"\t\t -l, --loops: count of conversions per measure "
+		"(default: %d)\n", NB_LOOPS);
+	fprintf(stdout, "\t\t -h, --help: print this help\n");
+}
+
+/*
+ * Reference conversions, one sample at a time through an accessor
+ * selected at run time, as libanalogy used to do.
+ */
+
+static lsampl_t data32_get(void *src)
+{
+	return *(uint32_t *)src;
+}
+
+static lsampl_t data16_get(void *src)
+{
+	return *(uint16_t *)src;
+}
+
+static lsampl_t data8_get(void *src)
+{
+	return *(uint8_t *)src;
+}
+
+static void data32_set(void *dst, lsampl_t val)
+{
+	*(uint32_t *)dst = val;
+}
+
+static void data16_set(void *dst, lsampl_t val)
+{
+	*(uint16_t *)dst = (uint16_t)(0xffff & val);
+}
+
+static void data8_set(void *dst, lsampl_t val)
+{
+	*(uint8_t *)dst = (uint8_t)(0xff & val);
+}
+
+static lsampl_t (*const datax_get[])(void *) = {
+	[1] = data8_get, [2] = data16_get, [4] = data32_get,
+};
+
+static void (*const datax_set[])(void *, lsampl_t) = {
+	[1] = data8_set, [2] = data16_set, [4] = data32_set,
+};
+
+static int ref_rawtof(a4l_chinfo_t *chan, a4l_rnginfo_t *rng,
+		      float *dst, void *src, int cnt)
+{
+	int size = a4l_sizeof_chan(chan), i;
+	float a, b;
+
+	a = ((float)(rng->max - rng->min)) /
+		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
+	b = ((float)rng->min) / A4L_RNG_FACTOR;
+
+	for (i = 0; i < cnt; i++)
+		dst[i] = a * datax_get[size](src + i * size) + b;
+
+	return cnt;
+}
+
+static int ref_rawtod(a4l_chinfo_t *chan, a4l_rnginfo_t *rng,
+		      double *dst, void *src, int cnt)
+{
+	int size = a4l_sizeof_chan(chan), i;
+	double a, b;
+
+	a = ((double)(rng->max - rng->min)) /
+		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
+	b = ((double)rng->min) / A4L_RNG_FACTOR;
+
+	for (i = 0; i < cnt; i++)
+		dst[i] = a * datax_get[size](src + i * size) + b;
+
+	return cnt;
+}
+
+static int ref_ftoraw(a4l_chinfo_t *chan, a4l_rnginfo_t *rng,
+		      void *dst, float *src, int cnt)
+{
+	int size = a4l_sizeof_chan(chan), i;
+	float a, b;
+
+	a = (((float)A4L_RNG_FACTOR) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
+	b = ((float)(rng->min) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
+
+	for (i = 0; i < cnt; i++)
+		datax_set[size](dst + i * size, (lsampl_t)(a * src[i] - b));
+
+	return cnt;
+}
+
+static int ref_dtoraw(a4l_chinfo_t *chan, a4l_rnginfo_t *rng,
+		      void *dst, double *src, int cnt)
+{
+	int size = a4l_sizeof_chan(chan), i;
+	double a, b;
+
+	a = (((double)A4L_RNG_FACTOR) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
+	b = ((double)(rng->min) / (rng->max - rng->min)) *
+		((1ULL << chan->nb_bits) - 1);
+
+	for (i = 0; i < cnt; i++)
+		datax_set[size](dst + i * size, (lsampl_t)(a * src[i] - b));
+
+	return cnt;
+}
+
+static int ref_rawtodcal(a4l_chinfo_t *chan, double *dst, void *src,
+			 int cnt, struct a4l_polynomial *converter)
+{
+	int size = a4l_sizeof_chan(chan), i, k;
+	double term;
+
+	for (i = 0; i < cnt; i++) {
+		dst[i] = 0.0;
+		term = 1.0;
+		for (k = 0; k < converter->nb_coeff; k++) {
+			dst[i] += converter->coeff[k] * term;
+			term *= (double)datax_get[size](src + i * size) -
+				converter->expansion;
+		}
+	}
+
+	return cnt;
+}
+
+/* Conversion under test */
+
+enum conv_mode {
+	CONV_REF,
+	CONV_LIB,
+	CONV_INPLACE,
+};
+
+struct conv_test {
+	const char *name;
+	/* Sizes of the input and output samples, 0 for the raw ones */
+	int in_size;
+	int out_size;
+	int (*run)(enum conv_mode mode, a4l_chinfo_t *chan,
+		   a4l_rnginfo_t *rng, struct a4l_polynomial *poly,
+		   void *dst, void *src, int cnt);
+};
+
+static int run_rawtof(enum conv_mode mode, a4l_chinfo_t *chan,
+		      a4l_rnginfo_t *rng, struct a4l_polynomial *poly,
+		      void *dst, void *src, int cnt)
+{
+	switch (mode) {
+	case CONV_REF:
+		return ref_rawtof(chan, rng, dst, src, cnt);
+	case CONV_LIB:
+		return a4l_rawtof(chan, rng, dst, src, cnt);
+	default:
+		return a4l_rawtof_inplace(chan, rng, dst, cnt);
+	}
+}
+
+static int run_rawtod(enum conv_mode mode, a4l_chinfo_t *chan,
+		      a4l_rnginfo_t *rng, struct a4l_polynomial *poly,
+		      void *dst, void *src, int cnt)
+{
+	switch (mode) {
+	case CONV_REF:
+		return ref_rawtod(chan, rng, dst, src, cnt);
+	case CONV_LIB:
+		return a4l_rawtod(chan, rng, dst, src, cnt);
+	default:
+		return a4l_rawtod_inplace(chan, rng, dst, cnt);
+	}
+}
+
+static int run_ftoraw(enum conv_mode mode, a4l_chinfo_t *chan,
+		      a4l_rnginfo_t *rng, struct a4l_polynomial *poly,
+		      void *dst, void *src, int cnt)
+{
+	switch (mode) {
+	case CONV_REF:
+		return ref_ftoraw(chan, rng, dst, src, cnt);
+	case CONV_LIB:
+		return a4l_ftoraw(chan, rng, dst, src, cnt);
+	default:
+		return a4l_ftoraw_inplace(chan, rng, dst, cnt);
+	}
+}
+
+static int run_dtoraw(enum conv_mode mode, a4l_chinfo_t *chan,
+		      a4l_rnginfo_t *rng, struct a4l_polynomial *poly,
+		      void *dst, void *src, int cnt)
+{
+	switch (mode) {
+	case CONV_REF:
+		return ref_dtoraw(chan, rng, dst, src, cnt);
+	case CONV_LIB:
+		return a4l_dtoraw(chan, rng, dst, src, cnt);
+	default:
+		return a4l_dtoraw_inplace(chan, rng, dst, cnt);
+	}
+}
+
+static int run_rawtodcal(enum conv_mode mode, a4l_chinfo_t *chan,
+			 a4l_rnginfo_t *rng, struct a4l_polynomial *poly,
+			 void *dst, void *src, int cnt)
+{
+	switch (mode) {
+	case CONV_REF:
+		return ref_rawtodcal(chan, dst, src, cnt, poly);
+	case CONV_LIB:
+		return a4l_rawtodcal(chan, dst, src, cnt, poly);
+	default:
+		return a4l_rawtodcal_inplace(chan, dst, cnt, poly);
+	}
+}
+
+static struct conv_test conv_tests[] = {
+	{ "rawtof", 0, sizeof(float), run_rawtof },
+	{ "rawtod", 0, sizeof(double), run_rawtod },
+	{ "ftoraw", sizeof(float), 0, run_ftoraw },
+	{ "dtoraw", sizeof(double), 0, run_dtoraw },
+	{ "rawtodcal", 0, sizeof(double), run_rawtodcal },
+};
+
+static double poly_coeff[] = { 1.5e-3, 3.05e-4, -1.2e-12, 4.0e-19 };
+
+static struct a4l_polynomial poly = {
+	.expansion = 0,
+	.order = 3,
+	.nb_coeff = 4,
+	.coeff = poly_coeff,
+};
+
+static a4l_rnginfo_t rng = {
+	.min = -10 * A4L_RNG_FACTOR,
+	.max = 10 * A4L_RNG_FACTOR,
+	.flags = A4L_RNG_VOLT_UNIT,
+};
+
+static inline unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Fill the input buffer with samples spread over the range, leaving
+ * out its bounds which may not be converted back to raw values.
+ */
+static void fill_input(struct conv_test *test, a4l_chinfo_t *chan,
+		       void *buf, int cnt)
+{
+	unsigned long long span = (1ULL << chan->nb_bits) - 1;
+	int size = a4l_sizeof_chan(chan), i;
+	double ratio;
+
+	for (i = 0; i < cnt; i++) {
+		ratio = (double)(i % 1021 + 1) / 1023;
+
+		switch (test->in_size) {
+		case sizeof(float):
+			((float *)buf)[i] = (float)((rng.min +
+				ratio * (rng.max - rng.min)) / A4L_RNG_FACTOR);
+			break;
+		case sizeof(double):
+			((double *)buf)[i] = (rng.min +
+				ratio * (rng.max - rng.min)) / A4L_RNG_FACTOR;
+			break;
+		default:
+			datax_set[size](buf + i * size,
+					(lsampl_t)(ratio * span));
+		}
+	}
+}
+
+static int run_test(struct conv_test *test, a4l_chinfo_t *chan)
+{
+	int size = a4l_sizeof_chan(chan), in_size, out_size, bufsz, i, ret;
+	unsigned long long start, delta[3];
+	void *in, *ref, *out;
+	enum conv_mode mode;
+	double rate[3];
+
+	in_size = test->in_size ?: size;
+	out_size = test->out_size ?: size;
+	bufsz = nb_samples * (in_size > out_size ? in_size : out_size);
+
+	in = malloc(bufsz);
+	ref = malloc(bufsz);
+	out = malloc(bufsz);
+	if (in == NULL || ref == NULL || out == NULL) {
+		fprintf(stderr, "conv_bench: out of memory\n");
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	fill_input(test, chan, in, nb_samples);
+
+	for (mode = CONV_REF; mode <= CONV_INPLACE; mode++) {
+		start = now_ns();
+		for (i = 0; i < nb_loops; i++) {
+			/* The in-place conversion overwrites its input */
+			if (mode == CONV_INPLACE)
+				memcpy(out, in, nb_samples * in_size);
+			ret = test->run(mode, chan, &rng, &poly,
+					mode == CONV_REF ? ref : out,
+					in, nb_samples);
+			if (ret < 0) {
+				fprintf(stderr,
+					"conv_bench: %s failed (ret=%d)\n",
+					test->name, ret);
+				goto out;
+			}
+		}
+		delta[mode] = now_ns() - start;
+		rate[mode] = delta[mode] ?
+			(double)nb_samples * nb_loops * 1000.0 / delta[mode] :
+			0.0;
+
+		if (mode != CONV_REF &&
+		    memcmp(ref, out, nb_samples * out_size)) {
+			fprintf(stderr,
+				"conv_bench: %s (%d bits) %s results differ\n",
+				test->name, chan->nb_bits,
+				mode == CONV_LIB ? "batch" : "in-place");
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	fprintf(stdout, "%-10s %2d bits  %9.1f %9.1f %9.1f  x%.1f\n",
+		test->name, chan->nb_bits,
+		rate[CONV_REF], rate[CONV_LIB], rate[CONV_INPLACE],
+		rate[CONV_REF] ? rate[CONV_LIB] / rate[CONV_REF] : 0.0);
+
+	if (verbose)
+		fprintf(stdout, "\t\t (%llu / %llu / %llu ns)\n",
+			delta[CONV_REF], delta[CONV_LIB], delta[CONV_INPLACE]);
+
+	ret = 0;
+out:
+	free(out);
+	free(ref);
+	free(in);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned char widths[] = { 8, 12, 16, 24, 32 };
+	a4l_chinfo_t chan = { .nb_rng = 1 };
+	int err = 0, i, j;
+
+	/* Compute arguments */
+	while ((err = getopt_long(argc,
+				  argv,
+				  "vn:l:h", conv_bench_opts,
+				  NULL)) >= 0) {
+		switch (err) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'n':
+			nb_samples = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			nb_loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			do_print_usage();
+			return 0;
+		}
+	}
+
+	if (nb_samples <= 0 || nb_loops <= 0) {
+		fprintf(stderr, "conv_bench: wrong count of samples or loops\n");
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stdout, "conv_bench: %d samples, %d loops\n",
+		nb_samples, nb_loops);
+	fprintf(stdout, "%-10s %7s  %9s %9s %9s\n",
+		"", "", "ref MS/s", "batch", "in-place");
+
+	for (i = 0; i < sizeof(widths); i++) {
+		chan.nb_bits = widths[i];
+		for (j = 0; j < sizeof(conv_tests) / sizeof(conv_tests[0]); j++) {
+			err = run_test(&conv_tests[j], &chan);
+			if (err < 0)
+				return EXIT_FAILURE;
+		}
+	}
+
+	return 0;
+}